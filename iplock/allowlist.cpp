@@ -0,0 +1,478 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "iplock/allowlist.h"
+
+
+// advgetopt
+//
+#include    <advgetopt/conf_file.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// C
+//
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+
+/** \file
+ * \brief This file implements the allowlist.
+ *
+ * The allowlist is a compiled trie of IPv4 and IPv6 prefixes. Checking
+ * an address walks at most 22 nodes, whatever the number of prefixes.
+ */
+
+
+
+namespace iplock
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The number of bits handled by one node of the trie.
+ *
+ * With 6 bits, each node has 64 entries which fit in one 64 bit bitmap.
+ */
+constexpr int const         g_stride = 6;
+
+
+/** \brief Get the bits of an address handled by one node.
+ *
+ * The bits past the end of the address (the last node only covers
+ * 2 bits of the address) are zero.
+ *
+ * \param[in] address  The address.
+ * \param[in] offset  The position of the first bit, from the most
+ * significant bit.
+ *
+ * \return The index of the entry in the node, from 0 to 63.
+ */
+int get_index(allowlist::address_t const & address, int offset)
+{
+    int const byte(offset / 8);
+    int const hi(byte < 16 ? address[byte] : 0);
+    int const lo(byte + 1 < 16 ? address[byte + 1] : 0);
+    return (((hi << 8) | lo) >> (16 - g_stride - offset % 8)) & ((1 << g_stride) - 1);
+}
+
+
+/** \brief Get the bits of \p idx entries starting at \p first.
+ *
+ * \param[in] first  The first entry.
+ * \param[in] count  The number of entries, a power of two.
+ *
+ * \return The bitmap with the \p count bits starting at \p first set.
+ */
+std::uint64_t get_range(int first, int count)
+{
+    if(count >= 64)
+    {
+        return ~static_cast<std::uint64_t>(0);
+    }
+    return ((static_cast<std::uint64_t>(1) << count) - 1) << first;
+}
+
+
+/** \brief A node of the trie while building it.
+ *
+ * The compile() function builds the trie with these nodes first and
+ * then flattens them in the compact vector of node_t.
+ */
+struct build_node_t
+{
+    std::uint64_t                                   f_leaves = 0;
+    std::array<std::unique_ptr<build_node_t>, 64>   f_children = {};
+};
+
+
+
+} // no name namespace
+
+
+
+/** \class allowlist
+ * \brief The list of IP addresses which must never be blocked.
+ *
+ * The allowlist is defined in the iplock.conf file (the "allowlist"
+ * parameter). It includes IPv4 and IPv6 addresses and networks. Both
+ * the iplock tool and the ipwall service check the IP addresses against
+ * this list before blocking them.
+ *
+ * The prefixes are compiled in a multibit trie similar to a poptrie:
+ * each node covers 6 bits of the address and has two 64 bit bitmaps,
+ * one for the entries which are fully allowed (leaves) and one for the
+ * entries which have a child node. The children of a node are saved
+ * contiguously so the index of a child is the base index plus the number
+ * of bits set before it in the children bitmap (a popcount). Prefixes
+ * which do not end on a node boundary are expanded to all the entries
+ * they cover.
+ *
+ * IPv4 addresses are handled as IPv4 mapped IPv6 addresses so a single
+ * trie handles both families.
+ */
+
+
+/** \brief Load the allowlist from configuration files.
+ *
+ * The "allowlist" parameter of each file gets added to the list. The
+ * files which do not exist are ignored. The list of filenames is
+ * saved so the allowlist can be reloaded when one of the files changes.
+ *
+ * \param[in] filenames  The configuration files to load.
+ *
+ * \return true if all the allowlists were valid.
+ */
+bool allowlist::load(std::vector<std::string> const & filenames)
+{
+    f_filenames = filenames;
+    return reload();
+}
+
+
+/** \brief Load the allowlist files again.
+ *
+ * This function clears the allowlist and loads the files passed to
+ * load() again.
+ *
+ * The advgetopt library caches the configuration files it loads so
+ * the cache gets reset first. Otherwise the files would not be read
+ * again and the changes would be ignored.
+ *
+ * \return true if all the allowlists were valid.
+ */
+bool allowlist::reload()
+{
+    clear();
+    advgetopt::conf_file::reset_conf_files();
+
+    bool valid(true);
+    for(auto const & filename : f_filenames)
+    {
+        advgetopt::conf_file_setup conf_setup(
+                  filename
+                , advgetopt::line_continuation_t::line_continuation_unix
+                , advgetopt::ASSIGNMENT_OPERATOR_EQUAL);
+        if(!conf_setup.is_valid())
+        {
+            continue;
+        }
+        advgetopt::conf_file::pointer_t conf(advgetopt::conf_file::get_conf_file(conf_setup));
+        if(conf->has_parameter("allowlist"))
+        {
+            if(!add(conf->get_parameter("allowlist")))
+            {
+                valid = false;
+            }
+        }
+    }
+
+    return valid;
+}
+
+
+std::vector<std::string> const & allowlist::get_filenames() const
+{
+    return f_filenames;
+}
+
+
+void allowlist::clear()
+{
+    f_prefixes.clear();
+    f_nodes.clear();
+}
+
+
+/** \brief Add IP addresses and networks to the allowlist.
+ *
+ * \param[in] ips  A list of comma or space separated IP addresses with
+ * an optional mask.
+ *
+ * \return true if all the addresses were valid.
+ */
+bool allowlist::add(std::string const & ips)
+{
+    addr::addr_parser p;
+    p.set_protocol(IPPROTO_TCP);        // define a protocol because otherwise we get duplicates with various protocols...
+    p.set_allow(addr::allow_t::ALLOW_MULTI_ADDRESSES_COMMAS, true);
+    p.set_allow(addr::allow_t::ALLOW_MULTI_ADDRESSES_SPACES, true);
+    p.set_allow(addr::allow_t::ALLOW_MASK, true);
+    p.set_allow(addr::allow_t::ALLOW_PORT, false);
+    addr::addr_range::vector_t const ranges(p.parse(ips));
+    bool const valid(!p.has_errors());
+    if(!valid)
+    {
+        SNAP_LOG_ERROR
+            << "invalid allowlist: "
+            << p.error_messages()
+            << SNAP_LOG_SEND;
+    }
+
+    for(auto const & r : ranges)
+    {
+        if(r.has_from()
+        && !r.has_to())
+        {
+            add(r.get_from());
+        }
+    }
+
+    return valid;
+}
+
+
+/** \brief Add one IP address or network to the allowlist.
+ *
+ * The mask of \p a defines the size of the network. A mask which is
+ * not a CIDR is ignored (only the address is allowed).
+ *
+ * \param[in] a  The address to add.
+ */
+void allowlist::add(addr::addr const & a)
+{
+    sockaddr_in6 in6;
+    a.get_ipv6(in6);
+    address_t address;
+    memcpy(address.data(), &in6.sin6_addr, address.size());
+    int prefix(a.get_mask_size());
+    if(prefix < 0)
+    {
+        prefix = 128;
+    }
+    add(address, prefix);
+}
+
+
+/** \brief Add a prefix to the allowlist.
+ *
+ * \param[in] address  The address of the network.
+ * \param[in] prefix  The number of bits of the network, in IPv6 terms
+ * (i.e. an IPv4 /24 is a /120).
+ */
+void allowlist::add(address_t const & address, int prefix)
+{
+    f_prefixes.push_back(prefix_t{ address, std::clamp(prefix, 0, 128) });
+    compile();
+}
+
+
+bool allowlist::empty() const
+{
+    return f_prefixes.empty();
+}
+
+
+/** \brief Get the number of prefixes in the allowlist.
+ *
+ * \return The number of addresses and networks added to the list.
+ */
+std::size_t allowlist::size() const
+{
+    return f_prefixes.size();
+}
+
+
+/** \brief Check whether an IP address is allowed.
+ *
+ * \param[in] address  The IP address (IPv4 addresses are mapped).
+ *
+ * \return true if the address is part of the allowlist.
+ */
+bool allowlist::is_allowed(address_t const & address) const
+{
+    if(f_nodes.empty())
+    {
+        return false;
+    }
+
+    node_t const * n(f_nodes.data());
+    for(int offset(0);; offset += g_stride)
+    {
+        int const idx(get_index(address, offset));
+        std::uint64_t const bit(static_cast<std::uint64_t>(1) << idx);
+        if((n->f_leaves & bit) != 0)
+        {
+            return true;
+        }
+        if((n->f_children & bit) == 0)
+        {
+            return false;
+        }
+        n = f_nodes.data() + n->f_base + __builtin_popcountll(n->f_children & (bit - 1));
+    }
+}
+
+
+bool allowlist::is_allowed(addr::addr const & a) const
+{
+    sockaddr_in6 in6;
+    a.get_ipv6(in6);
+    address_t address;
+    memcpy(address.data(), &in6.sin6_addr, address.size());
+    return is_allowed(address);
+}
+
+
+/** \brief Check whether a network includes or is included in the allowlist.
+ *
+ * \param[in] address  The address of the network.
+ * \param[in] prefix  The number of bits of the network, in IPv6 terms.
+ *
+ * \return true if at least one allowed IP address is part of the network.
+ */
+bool allowlist::overlaps(address_t const & address, int prefix) const
+{
+    if(f_nodes.empty())
+    {
+        return false;
+    }
+
+    prefix = std::clamp(prefix, 0, 128);
+    node_t const * n(f_nodes.data());
+    for(int offset(0);; offset += g_stride)
+    {
+        int const remaining(prefix - offset);
+        if(remaining < g_stride)
+        {
+            // the network covers several entries of this node, any
+            // allowed entry or child in there overlaps
+            //
+            int const count(1 << (g_stride - remaining));
+            int const first(get_index(address, offset) & ~(count - 1));
+            return ((n->f_leaves | n->f_children) & get_range(first, count)) != 0;
+        }
+
+        int const idx(get_index(address, offset));
+        std::uint64_t const bit(static_cast<std::uint64_t>(1) << idx);
+        if((n->f_leaves & bit) != 0)
+        {
+            return true;
+        }
+        if((n->f_children & bit) == 0)
+        {
+            return false;
+        }
+        n = f_nodes.data() + n->f_base + __builtin_popcountll(n->f_children & (bit - 1));
+    }
+}
+
+
+/** \brief Compile the prefixes in the trie.
+ *
+ * The allowlist is small and rarely changes so the trie gets rebuilt
+ * from scratch each time a prefix is added.
+ */
+void allowlist::compile()
+{
+    f_nodes.clear();
+    if(f_prefixes.empty())
+    {
+        return;
+    }
+
+    build_node_t root;
+    for(auto const & p : f_prefixes)
+    {
+        build_node_t * n(&root);
+        int offset(0);
+        for(; p.f_prefix - offset > g_stride; offset += g_stride)
+        {
+            int const idx(get_index(p.f_address, offset));
+            if((n->f_leaves & (static_cast<std::uint64_t>(1) << idx)) != 0)
+            {
+                // already allowed by a larger network
+                //
+                break;
+            }
+            if(n->f_children[idx] == nullptr)
+            {
+                n->f_children[idx] = std::make_unique<build_node_t>();
+            }
+            n = n->f_children[idx].get();
+        }
+        if(p.f_prefix - offset > g_stride)
+        {
+            continue;
+        }
+
+        // expand the prefix to all the entries it covers in this node
+        //
+        int const count(1 << (g_stride - (p.f_prefix - offset)));
+        int const first(get_index(p.f_address, offset) & ~(count - 1));
+        n->f_leaves |= get_range(first, count);
+        for(int idx(first); idx < first + count; ++idx)
+        {
+            n->f_children[idx].reset();
+        }
+    }
+
+    // flatten the trie breadth first so the children of each node
+    // are contiguous
+    //
+    std::vector<build_node_t const *> queue{ &root };
+    f_nodes.emplace_back();
+    for(std::size_t pos(0); pos < queue.size(); ++pos)
+    {
+        build_node_t const * b(queue[pos]);
+        f_nodes[pos].f_leaves = b->f_leaves;
+        f_nodes[pos].f_base = static_cast<std::uint32_t>(f_nodes.size());
+        for(int idx(0); idx < 64; ++idx)
+        {
+            if(b->f_children[idx] != nullptr)
+            {
+                f_nodes[pos].f_children |= static_cast<std::uint64_t>(1) << idx;
+                queue.push_back(b->f_children[idx].get());
+                f_nodes.emplace_back();
+            }
+        }
+    }
+}
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
@@ -0,0 +1,97 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Declare the allowlist.
+ *
+ * This header declares the allowlist class which is used to quickly
+ * check whether an IP address must never be blocked.
+ */
+
+// libaddr
+//
+#include    <libaddr/addr.h>
+
+
+// C++
+//
+#include    <array>
+#include    <cstdint>
+#include    <memory>
+#include    <string>
+#include    <vector>
+
+
+
+namespace iplock
+{
+
+
+
+class allowlist
+{
+public:
+    typedef std::shared_ptr<allowlist>      pointer_t;
+    typedef std::array<std::uint8_t, 16>    address_t;
+
+    bool                load(std::vector<std::string> const & filenames);
+    bool                reload();
+    std::vector<std::string> const &
+                        get_filenames() const;
+
+    void                clear();
+    bool                add(std::string const & ips);
+    void                add(addr::addr const & a);
+    void                add(address_t const & address, int prefix);
+    bool                empty() const;
+    std::size_t         size() const;
+
+    bool                is_allowed(address_t const & address) const;
+    bool                is_allowed(addr::addr const & a) const;
+    bool                overlaps(address_t const & address, int prefix) const;
+
+private:
+    // one node covers 6 bits of the address; the bitmaps tell which of
+    // the 64 entries are fully allowed and which have a child node, the
+    // children of a node are contiguous starting at f_base
+    //
+    struct node_t
+    {
+        std::uint64_t                   f_leaves = 0;
+        std::uint64_t                   f_children = 0;
+        std::uint32_t                   f_base = 0;
+    };
+
+    struct prefix_t
+    {
+        address_t                       f_address = address_t();
+        int                             f_prefix = 128;
+    };
+
+    void                compile();
+
+    std::vector<std::string>            f_filenames = std::vector<std::string>();
+    std::vector<prefix_t>               f_prefixes = std::vector<prefix_t>();
+    std::vector<node_t>                 f_nodes = std::vector<node_t>();
+};
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
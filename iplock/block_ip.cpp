@@ -42,6 +42,12 @@
 #include    <snapdev/not_used.h>
 
 
+// C++
+//
+#include    <algorithm>
+#include    <iterator>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -57,6 +63,9 @@
  * and unblock IP addresses on an entire cluster. This file implements a
  * very easy to use block_ip() C++ function which communicates with that
  * ipwall service.
+ *
+ * The block_ips() function is used to block many IP addresses at once.
+ * It sends IPWALL_BLOCK_BATCH messages, each one including many blocks.
  */
 
 
@@ -71,6 +80,34 @@ namespace iplock
 
 
 
+namespace
+{
+
+
+
+/** \brief Append one field of a block to a batch.
+ *
+ * The fields are separated by tabs and the blocks by newlines so these
+ * two characters cannot appear in a field. They get replaced by spaces
+ * (in practice, only the reason may include such characters).
+ *
+ * \param[in,out] batch  The batch being built.
+ * \param[in] field  The field to append.
+ */
+void append_field(std::string & batch, std::string const & field)
+{
+    for(auto const c : field)
+    {
+        batch += c == '\t' || c == '\n' ? ' ' : c;
+    }
+}
+
+
+
+} // no name namespace
+
+
+
 /** \brief Block an IP address at the firewall level.
  *
  * This function sends a IPWALL_BLOCK message to the ipwall service in
@@ -141,6 +178,147 @@ void block_ip(
 }
 
 
+/** \brief Block many IP addresses at the firewall level.
+ *
+ * This function sends the \p blocks to the ipwall service using
+ * IPWALL_BLOCK_BATCH messages. Each message includes as many blocks
+ * as fit in \p max_size bytes (see encode_block_batch()), so blocking
+ * thousands of IP addresses only requires a few messages.
+ *
+ * Each block is handled by ipwall exactly like an IPWALL_BLOCK message
+ * would be. See block_ip() for details about the URI and period.
+ *
+ * \param[in] messenger  Your messenger used to send the messages.
+ * \param[in] blocks  The list of blocks to send.
+ * \param[in] max_size  The maximum size of the blocks in one message.
+ *
+ * \return The number of messages sent.
+ */
+std::size_t block_ips(
+      ed::connection_with_send_message::pointer_t messenger
+    , block_request::vector_t const & blocks
+    , std::size_t max_size)
+{
+    std::vector<std::string> const chunks(encode_block_batch(blocks, max_size));
+    for(auto const & c : chunks)
+    {
+        ed::message message;
+        message.set_command(iplock::g_name_iplock_cmd_ipwall_block_batch);
+        message.set_service(communicator::g_name_communicator_service_public_broadcast);
+        message.add_parameter(iplock::g_name_iplock_param_blocks, c);
+        message.add_parameter(
+                  iplock::g_name_iplock_param_count
+                , std::count(c.begin(), c.end(), '\n'));
+
+        messenger->send_message(message, true);
+    }
+
+    return chunks.size();
+}
+
+
+/** \brief Encode blocks in the IPWALL_BLOCK_BATCH format.
+ *
+ * Each block is written on its own line as the URI, the period, and the
+ * reason separated by tabs. The period and reason may be empty.
+ *
+ * The blocks are split in chunks of at most \p max_size bytes. A block
+ * which is larger than \p max_size on its own gets its own chunk.
+ *
+ * \param[in] blocks  The blocks to encode.
+ * \param[in] max_size  The maximum size of one chunk.
+ *
+ * \return The list of chunks, one per message.
+ */
+std::vector<std::string> encode_block_batch(
+      block_request::vector_t const & blocks
+    , std::size_t max_size)
+{
+    std::vector<std::string> result;
+    std::string chunk;
+    std::string line;
+    for(auto const & b : blocks)
+    {
+        if(b.f_uri.empty())
+        {
+            continue;
+        }
+
+        line.clear();
+        append_field(line, b.f_uri);
+        line += '\t';
+        append_field(line, b.f_period);
+        line += '\t';
+        append_field(line, b.f_reason);
+        line += '\n';
+
+        if(!chunk.empty()
+        && chunk.length() + line.length() > max_size)
+        {
+            result.push_back(chunk);
+            chunk.clear();
+        }
+        chunk += line;
+    }
+    if(!chunk.empty())
+    {
+        result.push_back(chunk);
+    }
+
+    return result;
+}
+
+
+/** \brief Decode blocks from the IPWALL_BLOCK_BATCH format.
+ *
+ * This function is the converse of encode_block_batch(). Empty lines
+ * are ignored. Missing fields are considered empty.
+ *
+ * \param[in] batch  One chunk as generated by encode_block_batch().
+ *
+ * \return The list of blocks found in \p batch.
+ */
+block_request::vector_t decode_block_batch(std::string const & batch)
+{
+    block_request::vector_t result;
+    std::string::size_type pos(0);
+    while(pos < batch.length())
+    {
+        std::string::size_type end(batch.find('\n', pos));
+        if(end == std::string::npos)
+        {
+            end = batch.length();
+        }
+        if(end > pos)
+        {
+            block_request b;
+            std::string * fields[] = { &b.f_uri, &b.f_period, &b.f_reason };
+            std::size_t idx(0);
+            std::string::size_type start(pos);
+            for(std::string::size_type p(pos); p <= end; ++p)
+            {
+                if(p == end || batch[p] == '\t')
+                {
+                    if(idx < std::size(fields))
+                    {
+                        fields[idx]->assign(batch, start, p - start);
+                    }
+                    ++idx;
+                    start = p + 1;
+                }
+            }
+            if(!b.f_uri.empty())
+            {
+                result.push_back(b);
+            }
+        }
+        pos = end + 1;
+    }
+
+    return result;
+}
+
+
 
 } // namespace iplock
 // vim: ts=4 sw=4 et
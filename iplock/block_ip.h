@@ -18,9 +18,10 @@
 #pragma once
 
 /** \file
- * \brief Declare the block_ip() function.
+ * \brief Declare the block_ip() and block_ips() functions.
  *
- * This header declares the block_ip() function and related parameters.
+ * This header declares the block_ip() and block_ips() functions and
+ * related parameters.
  */
 
 // eventdispatcher
@@ -28,6 +29,12 @@
 #include    <eventdispatcher/connection_with_send_message.h>
 
 
+// C++
+//
+#include    <string>
+#include    <vector>
+
+
 
 namespace iplock
 {
@@ -41,6 +48,30 @@ void block_ip(
     , std::string const & reason = std::string());
 
 
+struct block_request
+{
+    typedef std::vector<block_request>  vector_t;
+
+    std::string         f_uri = std::string();
+    std::string         f_period = std::string();
+    std::string         f_reason = std::string();
+};
+
+
+constexpr std::size_t const     BLOCK_BATCH_DEFAULT_SIZE = 64 * 1024;
+
+
+std::size_t block_ips(
+      ed::connection_with_send_message::pointer_t messenger
+    , block_request::vector_t const & blocks
+    , std::size_t max_size = BLOCK_BATCH_DEFAULT_SIZE);
+
+std::vector<std::string> encode_block_batch(
+      block_request::vector_t const & blocks
+    , std::size_t max_size = BLOCK_BATCH_DEFAULT_SIZE);
+block_request::vector_t decode_block_batch(std::string const & batch);
+
+
 
 } // namespace iplock
 // vim: ts=4 sw=4 et
@@ -41,6 +41,7 @@ DECLARE_MAIN_EXCEPTION(iplock_exception);
 
 DECLARE_EXCEPTION(iplock_exception, count_mismatch);
 DECLARE_EXCEPTION(iplock_exception, invalid_parameter);
+DECLARE_EXCEPTION(iplock_exception, ipset_error);
 
 
 
@@ -0,0 +1,101 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Declare the protocol of the iplock helper.
+ *
+ * When started with `iplock --serve`, iplock listens on an abstract Unix
+ * socket and applies block, unblock, and test requests sent by local
+ * daemons. This header declares the structures exchanged over that
+ * socket.
+ *
+ * The socket is of type SOCK_SEQPACKET so message boundaries are kept.
+ * Each packet sent to the helper includes 1 to HELPER_MAX_REQUESTS
+ * helper_request structures. The helper replies with one packet
+ * including one helper_response per request, in the same order.
+ *
+ * The numbers are in host byte order since both ends run on the same
+ * computer.
+ */
+
+// C++
+//
+#include    <cstdint>
+
+
+
+namespace iplock
+{
+
+
+
+constexpr char const *          HELPER_SOCKET_NAME = "iplock";     // abstract socket, i.e. "\0iplock"
+constexpr std::uint8_t const    HELPER_PROTOCOL_VERSION = 1;
+constexpr std::size_t const     HELPER_MAX_REQUESTS = 256;
+constexpr std::size_t const     HELPER_SET_NAME_SIZE = 32;         // IPSET_MAXNAMELEN
+
+
+enum class helper_command_t : std::uint8_t
+{
+    HELPER_COMMAND_BLOCK = 1,
+    HELPER_COMMAND_UNBLOCK = 2,
+    HELPER_COMMAND_TEST = 3,
+};
+
+
+enum class helper_status_t : std::uint8_t
+{
+    HELPER_STATUS_SUCCESS = 0,              // block/unblock applied or test found the IP
+    HELPER_STATUS_NOT_FOUND = 1,            // test did not find the IP
+    HELPER_STATUS_ALLOWLISTED = 2,          // block of an allowlisted IP, ignored
+    HELPER_STATUS_SET_NOT_ALLOWED = 3,
+    HELPER_STATUS_INVALID = 4,              // bad version, command, or CIDR
+    HELPER_STATUS_FAILED = 5,               // the kernel refused the operation
+};
+
+
+struct helper_request
+{
+    std::uint8_t        f_version = HELPER_PROTOCOL_VERSION;
+    helper_command_t    f_command = helper_command_t::HELPER_COMMAND_BLOCK;
+    std::uint8_t        f_cidr = 0;                             // in family terms, 0 for a single IP
+    std::uint8_t        f_reserved = 0;
+    std::uint32_t       f_id = 0;                               // returned as is in the response
+    std::uint8_t        f_address[16] = {};                     // IPv4 addresses are mapped (::ffff:a.b.c.d)
+    std::uint32_t       f_timeout = 0;                          // in seconds, 0 means use the set default
+    char                f_set_name[HELPER_SET_NAME_SIZE] = {};  // without the _ipv4/_ipv6 suffix, empty for the default set
+};
+
+static_assert(sizeof(helper_request) == 60, "the helper_request structure must be 60 bytes");
+
+
+struct helper_response
+{
+    std::uint8_t        f_version = HELPER_PROTOCOL_VERSION;
+    helper_status_t     f_status = helper_status_t::HELPER_STATUS_SUCCESS;
+    std::uint16_t       f_reserved = 0;
+    std::uint32_t       f_id = 0;
+};
+
+static_assert(sizeof(helper_response) == 8, "the helper_response structure must be 8 bytes");
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
@@ -0,0 +1,260 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "iplock/ipset.h"
+
+#include    "iplock/exception.h"
+
+
+// C
+//
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+
+/** \file
+ * \brief This file implements the base of the ipset client.
+ *
+ * The ipset class is an interface which gives access to the kernel IP
+ * sets. The ipset_netlink implementation talks directly to the kernel
+ * and the ipset_memory implementation keeps everything in memory which
+ * is useful for tests.
+ */
+
+
+
+namespace iplock
+{
+
+
+
+/** \class ipset_element
+ * \brief One element of an IP set.
+ *
+ * An element is an IP address with an optional CIDR (for `hash:net` sets)
+ * and an optional timeout.
+ *
+ * The address is always saved as a 16 byte IPv6 address. IPv4 addresses
+ * are saved as IPv4 mapped IPv6 addresses (i.e. `::ffff:a.b.c.d`) which
+ * is the same format as the one returned by libaddr.
+ *
+ * When listing a set which was created with counters, the f_packets and
+ * f_bytes fields are also defined.
+ */
+
+
+ipset_element::ipset_element()
+{
+}
+
+
+ipset_element::ipset_element(address_t const & address, std::uint8_t cidr)
+    : f_address(address)
+    , f_cidr(cidr)
+{
+}
+
+
+ipset_element::ipset_element(addr::addr const & a)
+{
+    sockaddr_in6 in6;
+    a.get_ipv6(in6);
+    memcpy(f_address.data(), &in6.sin6_addr, f_address.size());
+}
+
+
+/** \brief Check whether this element represents an IPv4 address.
+ *
+ * \return true if the address is an IPv4 mapped IPv6 address.
+ */
+bool ipset_element::is_ipv4() const
+{
+    for(int idx(0); idx < 10; ++idx)
+    {
+        if(f_address[idx] != 0)
+        {
+            return false;
+        }
+    }
+    return f_address[10] == 0xFF
+        && f_address[11] == 0xFF;
+}
+
+
+ipset_family_t ipset_element::get_family() const
+{
+    return is_ipv4()
+            ? ipset_family_t::IPSET_FAMILY_INET
+            : ipset_family_t::IPSET_FAMILY_INET6;
+}
+
+
+/** \brief Get the CIDR representing a single host.
+ *
+ * \return 32 for IPv4 and 128 for IPv6.
+ */
+std::uint8_t ipset_element::get_host_cidr() const
+{
+    return is_ipv4() ? 32 : 128;
+}
+
+
+addr::addr ipset_element::to_addr() const
+{
+    sockaddr_in6 in6 = {};
+    in6.sin6_family = AF_INET6;
+    memcpy(&in6.sin6_addr, f_address.data(), f_address.size());
+    return addr::addr(in6);
+}
+
+
+/** \brief Convert the element to a string.
+ *
+ * The IP address is written as IPv4 or IPv6 as required. If the element
+ * has a CIDR which is not the host CIDR, then it gets appended after a
+ * slash.
+ *
+ * \return The element as a string.
+ */
+std::string ipset_element::to_string() const
+{
+    std::string result(to_addr().to_ipv4or6_string(addr::STRING_IP_ADDRESS));
+    if(f_cidr != 0
+    && f_cidr != get_host_cidr())
+    {
+        result += '/';
+        result += std::to_string(static_cast<int>(f_cidr));
+    }
+    return result;
+}
+
+
+bool ipset_element::operator == (ipset_element const & rhs) const
+{
+    std::uint8_t const lhs_cidr(f_cidr == 0 ? get_host_cidr() : f_cidr);
+    std::uint8_t const rhs_cidr(rhs.f_cidr == 0 ? rhs.get_host_cidr() : rhs.f_cidr);
+    return f_address == rhs.f_address
+        && lhs_cidr == rhs_cidr;
+}
+
+
+bool ipset_element::operator < (ipset_element const & rhs) const
+{
+    if(f_address != rhs.f_address)
+    {
+        return f_address < rhs.f_address;
+    }
+    std::uint8_t const lhs_cidr(f_cidr == 0 ? get_host_cidr() : f_cidr);
+    std::uint8_t const rhs_cidr(rhs.f_cidr == 0 ? rhs.get_host_cidr() : rhs.f_cidr);
+    return lhs_cidr < rhs_cidr;
+}
+
+
+
+
+
+/** \class ipset
+ * \brief Interface used to manage the kernel IP sets.
+ *
+ * This class defines the commands supported against IP sets: create,
+ * destroy, flush, swap, header, add, del, test, and list. The apply()
+ * function is used to add and delete many elements at once.
+ *
+ * The functions throw an ipset_error exception when the command fails.
+ * The test() and header() functions return false instead when the
+ * element or the set do not exist.
+ *
+ * \sa ipset_netlink
+ * \sa ipset_memory
+ */
+
+
+ipset::~ipset()
+{
+}
+
+
+/** \brief Apply a list of add and del operations.
+ *
+ * This function applies all the \p operations in order. A failing
+ * operation does not prevent the following operations from being
+ * applied.
+ *
+ * The default implementation calls add() and del() for each operation.
+ * Implementations which can send many operations at once, such as
+ * ipset_netlink, override this function.
+ *
+ * \param[in] operations  The list of operations to apply.
+ *
+ * \return The number of operations which failed.
+ */
+std::size_t ipset::apply(ipset_operation::vector_t const & operations)
+{
+    std::size_t errors(0);
+    for(auto const & op : operations)
+    {
+        try
+        {
+            switch(op.f_command)
+            {
+            case ipset_command_t::IPSET_COMMAND_ADD:
+                add(op.f_set_name, op.f_element);
+                break;
+
+            case ipset_command_t::IPSET_COMMAND_DEL:
+                del(op.f_set_name, op.f_element);
+                break;
+
+            }
+        }
+        catch(ipset_error const &)
+        {
+            ++errors;
+        }
+    }
+
+    return errors;
+}
+
+
+/** \brief Check whether a set exists.
+ *
+ * \param[in] set_name  The name of the set to check.
+ *
+ * \return true if the set exists.
+ */
+bool ipset::exists(std::string const & set_name)
+{
+    ipset_header h;
+    return header(set_name, h);
+}
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
@@ -0,0 +1,160 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Declare the ipset client interface.
+ *
+ * This header declares the ipset class which is used to manage the
+ * kernel IP sets without having to run the `ipset` command line tool.
+ */
+
+// libaddr
+//
+#include    <libaddr/addr.h>
+
+
+// C++
+//
+#include    <array>
+#include    <cstdint>
+#include    <functional>
+#include    <memory>
+#include    <string>
+#include    <vector>
+
+
+
+namespace iplock
+{
+
+
+
+// the kernel saves the timeouts in milliseconds in a signed 32 bit number
+//
+constexpr std::uint32_t const   IPSET_MAX_TIMEOUT = 0x7FFFFFFF / 1000;
+
+
+enum class ipset_family_t
+{
+    IPSET_FAMILY_INET,
+    IPSET_FAMILY_INET6,
+};
+
+
+struct ipset_element
+{
+    typedef std::array<std::uint8_t, 16>    address_t;
+    typedef std::vector<ipset_element>      vector_t;
+
+                        ipset_element();
+                        ipset_element(address_t const & address, std::uint8_t cidr = 0);
+                        ipset_element(addr::addr const & a);
+
+    bool                is_ipv4() const;
+    ipset_family_t      get_family() const;
+    std::uint8_t        get_host_cidr() const;
+    addr::addr          to_addr() const;
+    std::string         to_string() const;
+
+    bool                operator == (ipset_element const & rhs) const;
+    bool                operator < (ipset_element const & rhs) const;
+
+    address_t           f_address = address_t();    // IPv4 addresses are mapped (::ffff:a.b.c.d)
+    std::uint8_t        f_cidr = 0;                 // 0 or host size means a single IP
+    std::uint32_t       f_timeout = 0;              // in seconds (up to IPSET_MAX_TIMEOUT), 0 means use the set default
+    std::uint64_t       f_packets = 0;              // only available when listing a set with counters
+    std::uint64_t       f_bytes = 0;                // only available when listing a set with counters
+};
+
+
+enum class ipset_command_t
+{
+    IPSET_COMMAND_ADD,
+    IPSET_COMMAND_DEL,
+};
+
+
+struct ipset_operation
+{
+    typedef std::vector<ipset_operation>    vector_t;
+
+    ipset_command_t     f_command = ipset_command_t::IPSET_COMMAND_ADD;
+    std::string         f_set_name = std::string();
+    ipset_element       f_element = ipset_element();
+};
+
+
+struct ipset_options
+{
+    std::string         f_type = std::string("hash:ip");
+    ipset_family_t      f_family = ipset_family_t::IPSET_FAMILY_INET;
+    bool                f_with_timeout = false;
+    std::uint32_t       f_timeout = 0;
+    bool                f_with_counters = false;
+    std::uint32_t       f_hashsize = 0;
+    std::uint32_t       f_maxelem = 0;
+};
+
+
+struct ipset_header
+{
+    std::string         f_name = std::string();
+    std::string         f_type = std::string();
+    ipset_family_t      f_family = ipset_family_t::IPSET_FAMILY_INET;
+    bool                f_with_timeout = false;
+    std::uint32_t       f_timeout = 0;
+    bool                f_with_counters = false;
+    std::uint32_t       f_hashsize = 0;
+    std::uint32_t       f_maxelem = 0;
+    std::uint32_t       f_elements = 0;
+    std::uint32_t       f_references = 0;
+    std::uint32_t       f_memsize = 0;
+};
+
+
+class ipset
+{
+public:
+    typedef std::shared_ptr<ipset>      pointer_t;
+
+    // return false to stop the listing early
+    //
+    typedef std::function<bool(ipset_element const & element)>
+                                        element_callback_t;
+
+    virtual             ~ipset();
+
+    virtual void        create(std::string const & set_name, ipset_options const & options) = 0;
+    virtual void        destroy(std::string const & set_name) = 0;
+    virtual void        flush(std::string const & set_name) = 0;
+    virtual void        swap(std::string const & set_name1, std::string const & set_name2) = 0;
+    virtual bool        header(std::string const & set_name, ipset_header & h) = 0;
+    virtual void        add(std::string const & set_name, ipset_element const & element) = 0;
+    virtual void        del(std::string const & set_name, ipset_element const & element) = 0;
+    virtual bool        test(std::string const & set_name, ipset_element const & element) = 0;
+    virtual void        list(std::string const & set_name, element_callback_t callback) = 0;
+    virtual std::size_t apply(ipset_operation::vector_t const & operations);
+
+    bool                exists(std::string const & set_name);
+};
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
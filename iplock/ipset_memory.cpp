@@ -0,0 +1,206 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "iplock/ipset_memory.h"
+
+#include    "iplock/exception.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+
+/** \file
+ * \brief This file implements the in memory version of the ipset client.
+ *
+ * The functions mimic the behavior of the kernel closely enough for the
+ * tests to verify the code using an ipset client without the need for
+ * root permissions.
+ */
+
+
+
+namespace iplock
+{
+
+
+
+/** \class ipset_memory
+ * \brief The in memory implementation of the ipset client.
+ *
+ * This class keeps the sets and their elements in memory. Like the
+ * netlink implementation, adding an element which already exists or
+ * deleting an element which does not exist is not an error. Using a
+ * set which does not exist raises an ipset_error exception.
+ */
+
+
+ipset_memory::~ipset_memory()
+{
+}
+
+
+void ipset_memory::create(std::string const & set_name, ipset_options const & options)
+{
+    auto it(f_sets.find(set_name));
+    if(it != f_sets.end())
+    {
+        if(it->second.f_options.f_type != options.f_type
+        || it->second.f_options.f_family != options.f_family)
+        {
+            throw ipset_error(
+                  "ipset create command against \""
+                + set_name
+                + "\" failed: the set already exists with a different type.");
+        }
+        return;
+    }
+
+    f_sets[set_name].f_options = options;
+}
+
+
+void ipset_memory::destroy(std::string const & set_name)
+{
+    get_set(set_name, "destroy");
+    f_sets.erase(set_name);
+}
+
+
+void ipset_memory::flush(std::string const & set_name)
+{
+    get_set(set_name, "flush").f_elements.clear();
+}
+
+
+void ipset_memory::swap(std::string const & set_name1, std::string const & set_name2)
+{
+    set_t & s1(get_set(set_name1, "swap"));
+    set_t & s2(get_set(set_name2, "swap"));
+    if(s1.f_options.f_type != s2.f_options.f_type
+    || s1.f_options.f_family != s2.f_options.f_family)
+    {
+        throw ipset_error(
+              "ipset swap command against \""
+            + set_name1
+            + "\" failed: the sets have different types.");
+    }
+    std::swap(s1, s2);
+}
+
+
+bool ipset_memory::header(std::string const & set_name, ipset_header & h)
+{
+    h = ipset_header();
+
+    auto it(f_sets.find(set_name));
+    if(it == f_sets.end())
+    {
+        return false;
+    }
+
+    h.f_name = set_name;
+    h.f_type = it->second.f_options.f_type;
+    h.f_family = it->second.f_options.f_family;
+    h.f_with_timeout = it->second.f_options.f_with_timeout;
+    h.f_timeout = it->second.f_options.f_timeout;
+    h.f_with_counters = it->second.f_options.f_with_counters;
+    h.f_hashsize = it->second.f_options.f_hashsize;
+    h.f_maxelem = it->second.f_options.f_maxelem;
+    h.f_elements = it->second.f_elements.size();
+
+    return true;
+}
+
+
+void ipset_memory::add(std::string const & set_name, ipset_element const & element)
+{
+    set_t & s(get_set(set_name, "add"));
+    if(element.get_family() != s.f_options.f_family)
+    {
+        throw ipset_error(
+              "ipset add command against \""
+            + set_name
+            + "\" failed: invalid family.");
+    }
+    if(element.f_timeout != 0
+    && !s.f_options.f_with_timeout)
+    {
+        throw ipset_error(
+              "ipset add command against \""
+            + set_name
+            + "\" failed: the set does not support timeouts.");
+    }
+    s.f_elements[element] = element;
+}
+
+
+void ipset_memory::del(std::string const & set_name, ipset_element const & element)
+{
+    get_set(set_name, "del").f_elements.erase(element);
+}
+
+
+bool ipset_memory::test(std::string const & set_name, ipset_element const & element)
+{
+    elements_t const & elements(get_set(set_name, "test").f_elements);
+    return elements.find(element) != elements.end();
+}
+
+
+void ipset_memory::list(std::string const & set_name, element_callback_t callback)
+{
+    for(auto const & e : get_set(set_name, "list").f_elements)
+    {
+        if(!callback(e.second))
+        {
+            break;
+        }
+    }
+}
+
+
+ipset_memory::set_t & ipset_memory::get_set(std::string const & set_name, std::string const & command)
+{
+    auto it(f_sets.find(set_name));
+    if(it == f_sets.end())
+    {
+        ipset_error e(
+              "ipset "
+            + command
+            + " command against \""
+            + set_name
+            + "\" failed: the set does not exist.");
+        e.set_parameter("command", command);
+        e.set_parameter("set_name", set_name);
+        throw e;
+    }
+    return it->second;
+}
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
@@ -0,0 +1,82 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Declare the in memory implementation of the ipset client.
+ *
+ * This header declares the ipset_memory class which keeps the sets in
+ * memory. It is used by the tests and by tools which want to simulate
+ * the firewall without touching the kernel.
+ */
+
+// self
+//
+#include    <iplock/ipset.h>
+
+
+// C++
+//
+#include    <map>
+
+
+
+namespace iplock
+{
+
+
+
+class ipset_memory
+    : public ipset
+{
+public:
+    typedef std::shared_ptr<ipset_memory>   pointer_t;
+
+    virtual             ~ipset_memory() override;
+
+    // ipset implementation
+    //
+    virtual void        create(std::string const & set_name, ipset_options const & options) override;
+    virtual void        destroy(std::string const & set_name) override;
+    virtual void        flush(std::string const & set_name) override;
+    virtual void        swap(std::string const & set_name1, std::string const & set_name2) override;
+    virtual bool        header(std::string const & set_name, ipset_header & h) override;
+    virtual void        add(std::string const & set_name, ipset_element const & element) override;
+    virtual void        del(std::string const & set_name, ipset_element const & element) override;
+    virtual bool        test(std::string const & set_name, ipset_element const & element) override;
+    virtual void        list(std::string const & set_name, element_callback_t callback) override;
+
+private:
+    typedef std::map<ipset_element, ipset_element>  elements_t;
+
+    struct set_t
+    {
+        ipset_options       f_options = ipset_options();
+        elements_t          f_elements = elements_t();
+    };
+    typedef std::map<std::string, set_t>    set_map_t;
+
+    set_t &             get_set(std::string const & set_name, std::string const & command);
+
+    set_map_t           f_sets = set_map_t();
+};
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
@@ -0,0 +1,1098 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "iplock/ipset_netlink.h"
+
+#include    "iplock/exception.h"
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// C
+//
+#include    <endian.h>
+#include    <linux/netfilter.h>
+#include    <linux/netfilter/ipset/ip_set.h>
+#include    <linux/netfilter/nfnetlink.h>
+#include    <string.h>
+#include    <sys/socket.h>
+#include    <time.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+
+/** \file
+ * \brief This file implements the netlink version of the ipset client.
+ *
+ * The `ipset` command line tool talks to the kernel using netlink
+ * messages. This file implements the same protocol so we can add and
+ * remove IP addresses from our sets without the need to create a
+ * new process each time.
+ */
+
+
+
+namespace iplock
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The ipset protocol version we use.
+ *
+ * Our messages are compatible with the minimum protocol version which
+ * all the kernels that support ipset accept.
+ */
+constexpr std::uint8_t const    g_protocol = IPSET_PROTOCOL_MIN;
+
+
+/** \brief The size of the buffer used to receive replies.
+ *
+ * The kernel limits the size of its dump messages to about one page
+ * and since we ask for ACKs without a copy of our requests, a 64Kb
+ * buffer is more than enough.
+ */
+constexpr std::size_t const     g_receive_buffer_size = 64 * 1024;
+
+
+/** \brief The maximum size of a batch of messages.
+ *
+ * The apply() function sends many messages with a single system call.
+ * The kernel processes the messages one after the other before it
+ * returns from that call. This size is small enough for the buffer to
+ * fit in the default socket send buffer and for the errors to fit in
+ * the receive buffer.
+ */
+constexpr std::size_t const     g_batch_size = 32 * 1024;
+
+
+std::uint8_t family_to_nfproto(ipset_family_t family)
+{
+    return family == ipset_family_t::IPSET_FAMILY_INET6
+                ? NFPROTO_IPV6
+                : NFPROTO_IPV4;
+}
+
+
+void verify_set_name(std::string const & set_name)
+{
+    if(set_name.empty()
+    || set_name.length() >= IPSET_MAXNAMELEN)
+    {
+        invalid_parameter e(
+              "set name \""
+            + set_name
+            + "\" is empty or too long (max. "
+            + std::to_string(IPSET_MAXNAMELEN - 1)
+            + " characters).");
+        e.set_parameter("set_name", set_name);
+        throw e;
+    }
+}
+
+
+std::string error_message(int code)
+{
+    switch(code)
+    {
+    case ENOENT:
+        return "the set does not exist";
+
+    case IPSET_ERR_PROTOCOL:
+        return "kernel error received: ipset protocol error";
+
+    case IPSET_ERR_FIND_TYPE:
+        return "kernel error received: set type not supported";
+
+    case IPSET_ERR_MAX_SETS:
+        return "kernel error received: maximum number of sets reached";
+
+    case IPSET_ERR_BUSY:
+        return "the set is in use by a kernel component";
+
+    case IPSET_ERR_EXIST_SETNAME2:
+        return "the second set does not exist";
+
+    case IPSET_ERR_TYPE_MISMATCH:
+        return "the sets have different types";
+
+    case IPSET_ERR_EXIST:
+        return "the set or element already exists";
+
+    case IPSET_ERR_INVALID_CIDR:
+        return "invalid CIDR";
+
+    case IPSET_ERR_INVALID_NETMASK:
+        return "invalid netmask";
+
+    case IPSET_ERR_INVALID_FAMILY:
+        return "invalid family";
+
+    case IPSET_ERR_TIMEOUT:
+        return "the set was not created with timeout support";
+
+    case IPSET_ERR_REFERENCED:
+        return "the set is referenced, it cannot be destroyed";
+
+    case IPSET_ERR_IPADDR_IPV4:
+        return "invalid IPv4 address";
+
+    case IPSET_ERR_IPADDR_IPV6:
+        return "invalid IPv6 address";
+
+    case IPSET_ERR_COUNTER:
+        return "the set was not created with counters support";
+
+    default:
+        if(code < IPSET_ERR_PRIVATE)
+        {
+            return strerror(code);
+        }
+        return "ipset error #" + std::to_string(code);
+
+    }
+}
+
+
+void parse_attributes(
+      void const * data
+    , std::size_t length
+    , nlattr const ** table
+    , int max)
+{
+    std::fill(table, table + max + 1, nullptr);
+
+    nlattr const * a(reinterpret_cast<nlattr const *>(data));
+    while(length >= NLA_HDRLEN
+       && a->nla_len >= NLA_HDRLEN
+       && a->nla_len <= length)
+    {
+        int const type(a->nla_type & NLA_TYPE_MASK);
+        if(type <= max)
+        {
+            table[type] = a;
+        }
+        std::size_t const aligned(NLA_ALIGN(a->nla_len));
+        if(aligned >= length)
+        {
+            break;
+        }
+        length -= aligned;
+        a = reinterpret_cast<nlattr const *>(reinterpret_cast<char const *>(a) + aligned);
+    }
+}
+
+
+void parse_nested(nlattr const * nested, nlattr const ** table, int max)
+{
+    parse_attributes(
+              reinterpret_cast<char const *>(nested) + NLA_HDRLEN
+            , nested->nla_len - NLA_HDRLEN
+            , table
+            , max);
+}
+
+
+void parse_message(nlmsghdr const * h, nlattr const ** table, int max)
+{
+    std::size_t const offset(NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(nfgenmsg)));
+    if(h->nlmsg_len < offset)
+    {
+        std::fill(table, table + max + 1, nullptr);
+        return;
+    }
+    parse_attributes(
+              reinterpret_cast<char const *>(h) + offset
+            , h->nlmsg_len - offset
+            , table
+            , max);
+}
+
+
+void const * attribute_data(nlattr const * a)
+{
+    return reinterpret_cast<char const *>(a) + NLA_HDRLEN;
+}
+
+
+std::uint8_t attribute_u8(nlattr const * a)
+{
+    return *reinterpret_cast<std::uint8_t const *>(attribute_data(a));
+}
+
+
+std::uint32_t attribute_u32(nlattr const * a)
+{
+    std::uint32_t value(0);
+    memcpy(&value, attribute_data(a), sizeof(value));
+    return be32toh(value);
+}
+
+
+std::uint64_t attribute_u64(nlattr const * a)
+{
+    std::uint64_t value(0);
+    memcpy(&value, attribute_data(a), sizeof(value));
+    return be64toh(value);
+}
+
+
+std::string attribute_string(nlattr const * a)
+{
+    char const * s(reinterpret_cast<char const *>(attribute_data(a)));
+    return std::string(s, strnlen(s, a->nla_len - NLA_HDRLEN));
+}
+
+
+void parse_header(nlmsghdr const * h, ipset_header & result)
+{
+    nlattr const * tb[IPSET_ATTR_CMD_MAX + 1];
+    parse_message(h, tb, IPSET_ATTR_CMD_MAX);
+
+    if(tb[IPSET_ATTR_SETNAME] != nullptr)
+    {
+        result.f_name = attribute_string(tb[IPSET_ATTR_SETNAME]);
+    }
+    if(tb[IPSET_ATTR_TYPENAME] != nullptr)
+    {
+        result.f_type = attribute_string(tb[IPSET_ATTR_TYPENAME]);
+    }
+    if(tb[IPSET_ATTR_FAMILY] != nullptr)
+    {
+        result.f_family = attribute_u8(tb[IPSET_ATTR_FAMILY]) == NFPROTO_IPV6
+                            ? ipset_family_t::IPSET_FAMILY_INET6
+                            : ipset_family_t::IPSET_FAMILY_INET;
+    }
+    if(tb[IPSET_ATTR_DATA] != nullptr)
+    {
+        nlattr const * data[IPSET_ATTR_CREATE_MAX + 1];
+        parse_nested(tb[IPSET_ATTR_DATA], data, IPSET_ATTR_CREATE_MAX);
+        if(data[IPSET_ATTR_HASHSIZE] != nullptr)
+        {
+            result.f_hashsize = attribute_u32(data[IPSET_ATTR_HASHSIZE]);
+        }
+        if(data[IPSET_ATTR_MAXELEM] != nullptr)
+        {
+            result.f_maxelem = attribute_u32(data[IPSET_ATTR_MAXELEM]);
+        }
+        if(data[IPSET_ATTR_ELEMENTS] != nullptr)
+        {
+            result.f_elements = attribute_u32(data[IPSET_ATTR_ELEMENTS]);
+        }
+        if(data[IPSET_ATTR_REFERENCES] != nullptr)
+        {
+            result.f_references = attribute_u32(data[IPSET_ATTR_REFERENCES]);
+        }
+        if(data[IPSET_ATTR_MEMSIZE] != nullptr)
+        {
+            result.f_memsize = attribute_u32(data[IPSET_ATTR_MEMSIZE]);
+        }
+        if(data[IPSET_ATTR_TIMEOUT] != nullptr)
+        {
+            result.f_with_timeout = true;
+            result.f_timeout = attribute_u32(data[IPSET_ATTR_TIMEOUT]);
+        }
+        if(data[IPSET_ATTR_CADT_FLAGS] != nullptr)
+        {
+            result.f_with_counters = (attribute_u32(data[IPSET_ATTR_CADT_FLAGS]) & IPSET_FLAG_WITH_COUNTERS) != 0;
+        }
+    }
+}
+
+
+bool parse_element(nlattr const * data, ipset_element & element)
+{
+    nlattr const * tb[IPSET_ATTR_ADT_MAX + 1];
+    parse_nested(data, tb, IPSET_ATTR_ADT_MAX);
+    if(tb[IPSET_ATTR_IP] == nullptr)
+    {
+        return false;
+    }
+
+    nlattr const * ip[IPSET_ATTR_IPADDR_MAX + 1];
+    parse_nested(tb[IPSET_ATTR_IP], ip, IPSET_ATTR_IPADDR_MAX);
+
+    element = ipset_element();
+    if(ip[IPSET_ATTR_IPADDR_IPV4] != nullptr)
+    {
+        element.f_address[10] = 0xFF;
+        element.f_address[11] = 0xFF;
+        memcpy(element.f_address.data() + 12, attribute_data(ip[IPSET_ATTR_IPADDR_IPV4]), 4);
+    }
+    else if(ip[IPSET_ATTR_IPADDR_IPV6] != nullptr)
+    {
+        memcpy(element.f_address.data(), attribute_data(ip[IPSET_ATTR_IPADDR_IPV6]), 16);
+    }
+    else
+    {
+        return false;
+    }
+
+    if(tb[IPSET_ATTR_CIDR] != nullptr)
+    {
+        element.f_cidr = attribute_u8(tb[IPSET_ATTR_CIDR]);
+    }
+    if(tb[IPSET_ATTR_TIMEOUT] != nullptr)
+    {
+        element.f_timeout = attribute_u32(tb[IPSET_ATTR_TIMEOUT]);
+    }
+    if(tb[IPSET_ATTR_PACKETS] != nullptr)
+    {
+        element.f_packets = attribute_u64(tb[IPSET_ATTR_PACKETS]);
+    }
+    if(tb[IPSET_ATTR_BYTES] != nullptr)
+    {
+        element.f_bytes = attribute_u64(tb[IPSET_ATTR_BYTES]);
+    }
+
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Buffer used to build netlink messages.
+ *
+ * This class is used to build one or more netlink messages in a
+ * buffer which then gets sent to the kernel with one system call.
+ */
+class ipset_netlink::message
+{
+public:
+    void start(std::uint8_t command, std::uint16_t flags, std::uint32_t sequence)
+    {
+        f_start = f_buffer.size();
+        f_buffer.resize(f_start + NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(nfgenmsg)), 0);
+
+        nlmsghdr * h(reinterpret_cast<nlmsghdr *>(f_buffer.data() + f_start));
+        h->nlmsg_type = (NFNL_SUBSYS_IPSET << 8) | command;
+        h->nlmsg_flags = flags;
+        h->nlmsg_seq = sequence;
+
+        nfgenmsg * g(reinterpret_cast<nfgenmsg *>(f_buffer.data() + f_start + NLMSG_HDRLEN));
+        g->nfgen_family = AF_INET;
+        g->version = NFNETLINK_V0;
+        g->res_id = htobe16(0);
+
+        f_sequence = sequence;
+
+        add_u8(IPSET_ATTR_PROTOCOL, g_protocol);
+    }
+
+    void finish()
+    {
+        nlmsghdr * h(reinterpret_cast<nlmsghdr *>(f_buffer.data() + f_start));
+        h->nlmsg_len = f_buffer.size() - f_start;
+    }
+
+    void request_ack()
+    {
+        nlmsghdr * h(reinterpret_cast<nlmsghdr *>(f_buffer.data() + f_start));
+        h->nlmsg_flags |= NLM_F_ACK;
+    }
+
+    void add_attribute(std::uint16_t type, void const * data, std::size_t size)
+    {
+        std::size_t const offset(f_buffer.size());
+        f_buffer.resize(offset + NLA_ALIGN(NLA_HDRLEN + size), 0);
+
+        nlattr * a(reinterpret_cast<nlattr *>(f_buffer.data() + offset));
+        a->nla_len = NLA_HDRLEN + size;
+        a->nla_type = type;
+        if(size > 0)
+        {
+            memcpy(f_buffer.data() + offset + NLA_HDRLEN, data, size);
+        }
+    }
+
+    void add_u8(std::uint16_t type, std::uint8_t value)
+    {
+        add_attribute(type, &value, sizeof(value));
+    }
+
+    void add_u32(std::uint16_t type, std::uint32_t value)
+    {
+        value = htobe32(value);
+        add_attribute(type | NLA_F_NET_BYTEORDER, &value, sizeof(value));
+    }
+
+    void add_string(std::uint16_t type, std::string const & value)
+    {
+        add_attribute(type, value.c_str(), value.length() + 1);
+    }
+
+    std::size_t begin_nested(std::uint16_t type)
+    {
+        std::size_t const offset(f_buffer.size());
+        add_attribute(type | NLA_F_NESTED, nullptr, 0);
+        return offset;
+    }
+
+    void end_nested(std::size_t offset)
+    {
+        nlattr * a(reinterpret_cast<nlattr *>(f_buffer.data() + offset));
+        a->nla_len = f_buffer.size() - offset;
+    }
+
+    void add_element(ipset_element const & element)
+    {
+        std::size_t const data(begin_nested(IPSET_ATTR_DATA));
+        {
+            std::size_t const ip(begin_nested(IPSET_ATTR_IP));
+            if(element.is_ipv4())
+            {
+                add_attribute(
+                          IPSET_ATTR_IPADDR_IPV4 | NLA_F_NET_BYTEORDER
+                        , element.f_address.data() + 12
+                        , 4);
+            }
+            else
+            {
+                add_attribute(
+                          IPSET_ATTR_IPADDR_IPV6 | NLA_F_NET_BYTEORDER
+                        , element.f_address.data()
+                        , 16);
+            }
+            end_nested(ip);
+        }
+        if(element.f_cidr != 0
+        && element.f_cidr != element.get_host_cidr())
+        {
+            add_u8(IPSET_ATTR_CIDR, element.f_cidr);
+        }
+        if(element.f_timeout != 0)
+        {
+            add_u32(IPSET_ATTR_TIMEOUT, element.f_timeout);
+        }
+        end_nested(data);
+    }
+
+    char const * data() const
+    {
+        return f_buffer.data();
+    }
+
+    std::size_t size() const
+    {
+        return f_buffer.size();
+    }
+
+    std::uint32_t get_last_sequence() const
+    {
+        return f_sequence;
+    }
+
+private:
+    std::vector<char>   f_buffer = std::vector<char>();
+    std::size_t         f_start = 0;
+    std::uint32_t       f_sequence = 0;
+};
+
+
+
+
+
+/** \class ipset_netlink
+ * \brief The netlink implementation of the ipset client.
+ *
+ * This class opens a netlink socket to the netfilter subsystem and sends
+ * ipset commands to the kernel. This is the same protocol the `ipset`
+ * command line tool uses, without the need to create a process each time
+ * we want to add or remove an IP address.
+ *
+ * The process must have the CAP_NET_ADMIN capability for the kernel to
+ * accept the commands.
+ *
+ * The add() and del() functions behave like the `-exist` command line
+ * option: adding an element which already exists or deleting an element
+ * which does not exist is not an error.
+ */
+
+
+/** \brief Open the netlink socket.
+ *
+ * \exception ipset_error
+ * This exception is raised if the socket cannot be created.
+ */
+ipset_netlink::ipset_netlink()
+    : f_sequence(static_cast<std::uint32_t>(time(nullptr)))
+    , f_buffer(g_receive_buffer_size)
+{
+    open_socket();
+}
+
+
+ipset_netlink::~ipset_netlink()
+{
+    if(f_socket >= 0)
+    {
+        close(f_socket);
+    }
+}
+
+
+/** \brief Open and bind the netlink socket.
+ *
+ * This function creates the netlink socket used to talk to the kernel.
+ * It is also used to replace the socket when a dump gets abandoned (see
+ * execute()).
+ */
+void ipset_netlink::open_socket()
+{
+    f_socket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+    if(f_socket < 0)
+    {
+        int const e(errno);
+        throw ipset_error(
+              "could not create netlink socket: "
+            + std::to_string(e)
+            + ", "
+            + strerror(e));
+    }
+
+    sockaddr_nl local = {};
+    local.nl_family = AF_NETLINK;
+    if(bind(f_socket, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0)
+    {
+        int const e(errno);
+        close(f_socket);
+        f_socket = -1;
+        throw ipset_error(
+              "could not bind netlink socket: "
+            + std::to_string(e)
+            + ", "
+            + strerror(e));
+    }
+
+    // we do not need a copy of our requests in the ACK messages
+    //
+    int const cap_ack(1);
+    setsockopt(f_socket, SOL_NETLINK, NETLINK_CAP_ACK, &cap_ack, sizeof(cap_ack));
+}
+
+
+/** \brief Create a set.
+ *
+ * This function creates a new set with the specified \p options. If
+ * the set already exists with the same options, nothing happens.
+ *
+ * \param[in] set_name  The name of the new set.
+ * \param[in] options  The type, family, and parameters of the new set.
+ */
+void ipset_netlink::create(std::string const & set_name, ipset_options const & options)
+{
+    verify_set_name(set_name);
+
+    std::uint8_t const revision(get_revision(options.f_type, options.f_family));
+
+    message msg;
+    msg.start(IPSET_CMD_CREATE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.add_string(IPSET_ATTR_TYPENAME, options.f_type);
+    msg.add_u8(IPSET_ATTR_REVISION, revision);
+    msg.add_u8(IPSET_ATTR_FAMILY, family_to_nfproto(options.f_family));
+    std::size_t const data(msg.begin_nested(IPSET_ATTR_DATA));
+    if(options.f_with_timeout)
+    {
+        msg.add_u32(IPSET_ATTR_TIMEOUT, options.f_timeout);
+    }
+    if(options.f_with_counters)
+    {
+        msg.add_u32(IPSET_ATTR_CADT_FLAGS, IPSET_FLAG_WITH_COUNTERS);
+    }
+    if(options.f_hashsize != 0)
+    {
+        msg.add_u32(IPSET_ATTR_HASHSIZE, options.f_hashsize);
+    }
+    if(options.f_maxelem != 0)
+    {
+        msg.add_u32(IPSET_ATTR_MAXELEM, options.f_maxelem);
+    }
+    msg.end_nested(data);
+    msg.finish();
+
+    verify(execute(msg), "create", set_name);
+}
+
+
+void ipset_netlink::destroy(std::string const & set_name)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_DESTROY, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.finish();
+
+    verify(execute(msg), "destroy", set_name);
+}
+
+
+void ipset_netlink::flush(std::string const & set_name)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_FLUSH, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.finish();
+
+    verify(execute(msg), "flush", set_name);
+}
+
+
+/** \brief Swap two sets.
+ *
+ * The kernel swaps the contents of the two sets atomically. The two
+ * sets must be of compatible types.
+ *
+ * \param[in] set_name1  The name of the first set.
+ * \param[in] set_name2  The name of the second set.
+ */
+void ipset_netlink::swap(std::string const & set_name1, std::string const & set_name2)
+{
+    verify_set_name(set_name1);
+    verify_set_name(set_name2);
+
+    message msg;
+    msg.start(IPSET_CMD_SWAP, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name1);
+    msg.add_string(IPSET_ATTR_SETNAME2, set_name2);
+    msg.finish();
+
+    verify(execute(msg), "swap", set_name1);
+}
+
+
+/** \brief Retrieve the header of a set.
+ *
+ * The header includes the type, family, and number of elements of the
+ * set. This is obtained without listing the elements.
+ *
+ * \param[in] set_name  The name of the set.
+ * \param[out] h  The header of the set.
+ *
+ * \return true if the set exists, false otherwise.
+ */
+bool ipset_netlink::header(std::string const & set_name, ipset_header & h)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_LIST, NLM_F_REQUEST | NLM_F_DUMP, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.add_u32(IPSET_ATTR_FLAGS, IPSET_FLAG_LIST_HEADER);
+    msg.finish();
+
+    h = ipset_header();
+    int const code(execute(msg, [&h](nlmsghdr const * reply)
+        {
+            parse_header(reply, h);
+            return true;
+        }));
+    if(code == ENOENT)
+    {
+        return false;
+    }
+    verify(code, "header", set_name);
+
+    return true;
+}
+
+
+void ipset_netlink::add(std::string const & set_name, ipset_element const & element)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_ADD, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.add_element(element);
+    msg.finish();
+
+    verify(execute(msg), "add", set_name);
+}
+
+
+void ipset_netlink::del(std::string const & set_name, ipset_element const & element)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_DEL, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.add_element(element);
+    msg.finish();
+
+    verify(execute(msg), "del", set_name);
+}
+
+
+/** \brief Check whether an element is part of a set.
+ *
+ * \param[in] set_name  The name of the set to search.
+ * \param[in] element  The element to search.
+ *
+ * \return true if the element is in the set.
+ */
+bool ipset_netlink::test(std::string const & set_name, ipset_element const & element)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_TEST, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.add_element(element);
+    msg.finish();
+
+    int const code(execute(msg));
+    if(code == IPSET_ERR_EXIST)
+    {
+        return false;
+    }
+    verify(code, "test", set_name);
+
+    return true;
+}
+
+
+/** \brief List the elements of a set.
+ *
+ * This function streams the elements of the set to the \p callback
+ * function, one element at a time, as the kernel sends them. The
+ * elements are never all held in memory.
+ *
+ * If the callback returns false, the listing stops and the rest of the
+ * dump is not read (see execute()).
+ *
+ * \param[in] set_name  The name of the set to list.
+ * \param[in] callback  The function called with each element.
+ */
+void ipset_netlink::list(std::string const & set_name, element_callback_t callback)
+{
+    verify_set_name(set_name);
+
+    message msg;
+    msg.start(IPSET_CMD_LIST, NLM_F_REQUEST | NLM_F_DUMP, ++f_sequence);
+    msg.add_string(IPSET_ATTR_SETNAME, set_name);
+    msg.finish();
+
+    int const code(execute(msg, [&callback](nlmsghdr const * reply)
+        {
+            nlattr const * tb[IPSET_ATTR_CMD_MAX + 1];
+            parse_message(reply, tb, IPSET_ATTR_CMD_MAX);
+            if(tb[IPSET_ATTR_ADT] == nullptr)
+            {
+                return true;
+            }
+
+            nlattr const * adt(tb[IPSET_ATTR_ADT]);
+            char const * ptr(reinterpret_cast<char const *>(adt) + NLA_HDRLEN);
+            std::size_t length(adt->nla_len - NLA_HDRLEN);
+            ipset_element element;
+            while(length >= NLA_HDRLEN)
+            {
+                nlattr const * a(reinterpret_cast<nlattr const *>(ptr));
+                if(a->nla_len < NLA_HDRLEN
+                || a->nla_len > length)
+                {
+                    break;
+                }
+                if((a->nla_type & NLA_TYPE_MASK) == IPSET_ATTR_DATA
+                && parse_element(a, element))
+                {
+                    if(!callback(element))
+                    {
+                        return false;
+                    }
+                }
+                std::size_t const aligned(NLA_ALIGN(a->nla_len));
+                if(aligned >= length)
+                {
+                    break;
+                }
+                ptr += aligned;
+                length -= aligned;
+            }
+            return true;
+        }));
+    verify(code, "list", set_name);
+}
+
+
+/** \brief Apply many add and del operations at once.
+ *
+ * This function sends the operations to the kernel in batches. Each
+ * batch is one buffer with one message per operation sent with a
+ * single system call. Only the last message of a batch requests an
+ * acknowledgement, the other messages only generate a reply on errors.
+ *
+ * Like add() and del(), adding an element which already exists and
+ * deleting an element which does not exist are not errors.
+ *
+ * \param[in] operations  The list of operations to apply.
+ *
+ * \return The number of operations which failed.
+ */
+std::size_t ipset_netlink::apply(ipset_operation::vector_t const & operations)
+{
+    std::size_t errors(0);
+    std::size_t const max(operations.size());
+    for(std::size_t idx(0); idx < max; )
+    {
+        message msg;
+        do
+        {
+            ipset_operation const & op(operations[idx]);
+            verify_set_name(op.f_set_name);
+
+            ++idx;
+            msg.start(
+                      op.f_command == ipset_command_t::IPSET_COMMAND_ADD
+                            ? IPSET_CMD_ADD
+                            : IPSET_CMD_DEL
+                    , NLM_F_REQUEST
+                    , ++f_sequence);
+            msg.add_string(IPSET_ATTR_SETNAME, op.f_set_name);
+            msg.add_element(op.f_element);
+            msg.finish();
+        }
+        while(idx < max && msg.size() < g_batch_size);
+
+        // make sure the last message gets acknowledged so we know when
+        // the kernel is done with this batch
+        //
+        msg.request_ack();
+
+        execute(msg, reply_callback_t(), &errors);
+    }
+
+    return errors;
+}
+
+
+/** \brief Get the latest revision of a set type the kernel supports.
+ *
+ * The kernel requires the revision of the set type when creating a set.
+ * This function asks the kernel for the latest revision it supports.
+ *
+ * \param[in] type  The name of the set type (i.e. "hash:ip").
+ * \param[in] family  The family of the set.
+ *
+ * \return The revision to use to create a set of that type.
+ */
+std::uint8_t ipset_netlink::get_revision(std::string const & type, ipset_family_t family)
+{
+    message msg;
+    msg.start(IPSET_CMD_TYPE, NLM_F_REQUEST | NLM_F_ACK, ++f_sequence);
+    msg.add_string(IPSET_ATTR_TYPENAME, type);
+    msg.add_u8(IPSET_ATTR_FAMILY, family_to_nfproto(family));
+    msg.finish();
+
+    std::uint8_t revision(0);
+    int const code(execute(msg, [&revision](nlmsghdr const * reply)
+        {
+            nlattr const * tb[IPSET_ATTR_CMD_MAX + 1];
+            parse_message(reply, tb, IPSET_ATTR_CMD_MAX);
+            if(tb[IPSET_ATTR_REVISION] != nullptr)
+            {
+                revision = attribute_u8(tb[IPSET_ATTR_REVISION]);
+            }
+            return true;
+        }));
+    verify(code, "type", type);
+
+    return revision;
+}
+
+
+/** \brief Send the messages and wait for the replies.
+ *
+ * This function sends the messages found in \p msg to the kernel and
+ * then reads the replies until the acknowledgement (or the end of the
+ * dump) of the last message is received.
+ *
+ * Replies other than errors and acknowledgements are passed to the
+ * \p callback function. Once the callback returns false, the function
+ * returns immediately. The kernel only builds the next part of a dump
+ * when the previous one was read, so the socket gets replaced: closing
+ * it stops the dump and the replies which were already sent cannot be
+ * mistaken for the replies of the next request.
+ *
+ * When \p errors is not nullptr, it gets incremented by one for each
+ * error received. This is used when \p msg includes many messages.
+ *
+ * \param[in] msg  The messages to send to the kernel.
+ * \param[in] callback  A function called with each reply.
+ * \param[in,out] errors  A counter of errors or nullptr.
+ *
+ * \return 0 on success or the first error code returned by the kernel.
+ */
+int ipset_netlink::execute(
+      message const & msg
+    , reply_callback_t callback
+    , std::size_t * errors)
+{
+    sockaddr_nl kernel = {};
+    kernel.nl_family = AF_NETLINK;
+    for(;;)
+    {
+        ssize_t const r(sendto(
+                      f_socket
+                    , msg.data()
+                    , msg.size()
+                    , 0
+                    , reinterpret_cast<sockaddr *>(&kernel)
+                    , sizeof(kernel)));
+        if(r == static_cast<ssize_t>(msg.size()))
+        {
+            break;
+        }
+        int const e(errno);
+        if(r < 0 && e == EINTR)
+        {
+            continue;
+        }
+        throw ipset_error(
+              "could not send netlink message: "
+            + std::to_string(e)
+            + ", "
+            + strerror(e));
+    }
+
+    std::uint32_t const last(msg.get_last_sequence());
+    int result(0);
+    for(;;)
+    {
+        ssize_t const r(recv(f_socket, f_buffer.data(), f_buffer.size(), MSG_TRUNC));
+        if(r < 0)
+        {
+            int const e(errno);
+            if(e == EINTR)
+            {
+                continue;
+            }
+            throw ipset_error(
+                  "could not receive netlink message: "
+                + std::to_string(e)
+                + ", "
+                + strerror(e));
+        }
+        if(static_cast<std::size_t>(r) > f_buffer.size())
+        {
+            throw ipset_error("netlink reply was truncated.");
+        }
+
+        unsigned int length(r);
+        for(nlmsghdr const * h(reinterpret_cast<nlmsghdr const *>(f_buffer.data()));
+            NLMSG_OK(h, length);
+            h = NLMSG_NEXT(h, length))
+        {
+            switch(h->nlmsg_type)
+            {
+            case NLMSG_NOOP:
+                break;
+
+            case NLMSG_ERROR:
+                {
+                    nlmsgerr const * err(reinterpret_cast<nlmsgerr const *>(NLMSG_DATA(h)));
+                    if(err->error != 0)
+                    {
+                        if(result == 0)
+                        {
+                            result = -err->error;
+                        }
+                        if(errors != nullptr)
+                        {
+                            ++*errors;
+                        }
+                    }
+                    if(h->nlmsg_seq == last)
+                    {
+                        return result;
+                    }
+                }
+                break;
+
+            case NLMSG_DONE:
+                if(h->nlmsg_seq == last)
+                {
+                    return result;
+                }
+                break;
+
+            default:
+                if(callback != nullptr
+                && !callback(h))
+                {
+                    close(f_socket);
+                    f_socket = -1;
+                    open_socket();
+                    return result;
+                }
+                break;
+
+            }
+        }
+    }
+}
+
+
+void ipset_netlink::verify(int code, std::string const & command, std::string const & set_name)
+{
+    if(code != 0)
+    {
+        ipset_error e(
+              "ipset "
+            + command
+            + " command against \""
+            + set_name
+            + "\" failed: "
+            + error_message(code)
+            + ".");
+        e.set_parameter("command", command);
+        e.set_parameter("set_name", set_name);
+        e.set_parameter("error_code", std::to_string(code));
+        throw e;
+    }
+}
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
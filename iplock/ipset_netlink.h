@@ -0,0 +1,90 @@
+// Copyright (c) 2011-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Declare the netlink implementation of the ipset client.
+ *
+ * This header declares the ipset_netlink class which sends the ipset
+ * commands directly to the kernel using the NFNL_SUBSYS_IPSET netlink
+ * subsystem.
+ */
+
+// self
+//
+#include    <iplock/ipset.h>
+
+
+// C
+//
+#include    <linux/netlink.h>
+
+
+
+namespace iplock
+{
+
+
+
+class ipset_netlink
+    : public ipset
+{
+public:
+    typedef std::shared_ptr<ipset_netlink>  pointer_t;
+
+                        ipset_netlink();
+                        ipset_netlink(ipset_netlink const &) = delete;
+    virtual             ~ipset_netlink() override;
+
+    ipset_netlink &     operator = (ipset_netlink const &) = delete;
+
+    // ipset implementation
+    //
+    virtual void        create(std::string const & set_name, ipset_options const & options) override;
+    virtual void        destroy(std::string const & set_name) override;
+    virtual void        flush(std::string const & set_name) override;
+    virtual void        swap(std::string const & set_name1, std::string const & set_name2) override;
+    virtual bool        header(std::string const & set_name, ipset_header & h) override;
+    virtual void        add(std::string const & set_name, ipset_element const & element) override;
+    virtual void        del(std::string const & set_name, ipset_element const & element) override;
+    virtual bool        test(std::string const & set_name, ipset_element const & element) override;
+    virtual void        list(std::string const & set_name, element_callback_t callback) override;
+    virtual std::size_t apply(ipset_operation::vector_t const & operations) override;
+
+private:
+    class message;
+
+    typedef std::function<bool(nlmsghdr const * h)>     reply_callback_t;
+
+    void                open_socket();
+    std::uint8_t        get_revision(std::string const & type, ipset_family_t family);
+    int                 execute(
+                              message const & msg
+                            , reply_callback_t callback = reply_callback_t()
+                            , std::size_t * errors = nullptr);
+    void                verify(int code, std::string const & command, std::string const & set_name);
+
+    int                 f_socket = -1;
+    std::uint32_t       f_sequence = 0;
+    std::vector<char>   f_buffer = std::vector<char>();
+};
+
+
+
+} // namespace iplock
+// vim: ts=4 sw=4 et
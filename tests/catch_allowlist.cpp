@@ -0,0 +1,202 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// iplock
+//
+#include    <iplock/allowlist.h>
+#include    <iplock/ipset.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+namespace
+{
+
+
+
+bool is_allowed(iplock::allowlist const & a, std::string const & ip)
+{
+    return a.is_allowed(addr::string_to_addr(ip, "0.0.0.0", 0, "tcp"));
+}
+
+
+iplock::allowlist::address_t to_address(std::string const & ip)
+{
+    iplock::ipset_element const e(addr::string_to_addr(ip, "0.0.0.0", 0, "tcp"));
+    return e.f_address;
+}
+
+
+std::string write_conf(std::string const & name, std::string const & ips)
+{
+    std::string const filename(SNAP_CATCH2_NAMESPACE::g_tmp_dir() + "/" + name);
+    std::ofstream out(filename, std::ios::trunc);
+    out << "# allowlist test\n"
+        << "allowlist=" << ips << "\n";
+    return filename;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("allowlist", "[allowlist]")
+{
+    CATCH_START_SECTION("allowlist: empty list")
+    {
+        iplock::allowlist a;
+        CATCH_REQUIRE(a.empty());
+        CATCH_REQUIRE(a.size() == 0);
+        CATCH_REQUIRE_FALSE(is_allowed(a, "10.0.0.1"));
+        CATCH_REQUIRE_FALSE(a.overlaps(to_address("10.0.0.0"), 96));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("allowlist: IPv4 addresses and networks")
+    {
+        iplock::allowlist a;
+        CATCH_REQUIRE(a.add("127.0.0.0/8, 192.168.3.7 10.1.2.0/255.255.254.0"));
+        CATCH_REQUIRE(a.size() == 3);
+
+        CATCH_REQUIRE(is_allowed(a, "127.0.0.1"));
+        CATCH_REQUIRE(is_allowed(a, "127.255.255.255"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "128.0.0.1"));
+
+        CATCH_REQUIRE(is_allowed(a, "192.168.3.7"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "192.168.3.6"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "192.168.3.8"));
+
+        CATCH_REQUIRE(is_allowed(a, "10.1.2.1"));
+        CATCH_REQUIRE(is_allowed(a, "10.1.3.254"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "10.1.4.1"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "10.1.1.255"));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("allowlist: IPv6 addresses and networks")
+    {
+        iplock::allowlist a;
+        CATCH_REQUIRE(a.add("[2001:db8::]/32,[fe80::1]"));
+
+        CATCH_REQUIRE(is_allowed(a, "2001:db8::1"));
+        CATCH_REQUIRE(is_allowed(a, "2001:db8:ffff::1"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "2001:db9::1"));
+        CATCH_REQUIRE(is_allowed(a, "fe80::1"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "fe80::2"));
+
+        // an IPv4 address never matches an IPv6 network
+        //
+        CATCH_REQUIRE_FALSE(is_allowed(a, "32.1.13.184"));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("allowlist: overlapping networks")
+    {
+        iplock::allowlist a;
+        a.add(to_address("10.1.2.3"), 128);
+
+        // the /24 includes the allowed address
+        //
+        CATCH_REQUIRE(a.overlaps(to_address("10.1.2.0"), 96 + 24));
+        CATCH_REQUIRE_FALSE(a.overlaps(to_address("10.1.3.0"), 96 + 24));
+
+        // the allowed /16 includes the /24
+        //
+        a.add(to_address("172.16.0.0"), 96 + 16);
+        CATCH_REQUIRE(a.overlaps(to_address("172.16.5.0"), 96 + 24));
+        CATCH_REQUIRE(is_allowed(a, "172.16.5.9"));
+
+        a.clear();
+        CATCH_REQUIRE(a.empty());
+        CATCH_REQUIRE_FALSE(a.overlaps(to_address("10.1.2.0"), 96 + 24));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("allowlist: load() and reload() configuration files")
+    {
+        std::string const first(write_conf("allowlist-1.conf", "10.0.0.1, 192.168.0.0/16"));
+        std::string const second(write_conf("allowlist-2.conf", "2001:db8::/32"));
+        std::string const missing(SNAP_CATCH2_NAMESPACE::g_tmp_dir() + "/allowlist-missing.conf");
+
+        iplock::allowlist a;
+        CATCH_REQUIRE(a.load({ first, second, missing }));
+        CATCH_REQUIRE(a.get_filenames() == std::vector<std::string>{ first, second, missing });
+        CATCH_REQUIRE(a.size() == 3);
+        CATCH_REQUIRE(is_allowed(a, "10.0.0.1"));
+        CATCH_REQUIRE(is_allowed(a, "192.168.7.3"));
+        CATCH_REQUIRE(is_allowed(a, "2001:db8::55"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "10.0.0.2"));
+
+        // the files changed, reload() must see the new content and not
+        // a cached copy
+        //
+        write_conf("allowlist-1.conf", "10.0.0.2");
+        write_conf("allowlist-missing.conf", "172.16.0.0/12");
+        CATCH_REQUIRE(a.reload());
+        CATCH_REQUIRE(a.size() == 3);
+        CATCH_REQUIRE(is_allowed(a, "10.0.0.2"));
+        CATCH_REQUIRE(is_allowed(a, "172.20.1.1"));
+        CATCH_REQUIRE(is_allowed(a, "2001:db8::55"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "10.0.0.1"));
+        CATCH_REQUIRE_FALSE(is_allowed(a, "192.168.7.3"));
+
+        // an invalid file is reported, the other files are still loaded
+        //
+        write_conf("allowlist-2.conf", "10.0.0.0/40");
+        CATCH_REQUIRE_FALSE(a.reload());
+        CATCH_REQUIRE(is_allowed(a, "10.0.0.2"));
+        CATCH_REQUIRE(is_allowed(a, "172.20.1.1"));
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("allowlist_errors", "[allowlist][error]")
+{
+    CATCH_START_SECTION("allowlist_errors: invalid address")
+    {
+        iplock::allowlist a;
+        CATCH_REQUIRE_FALSE(a.add("10.0.0.1, 10.0.0.0/40"));
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,492 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <ban_journal.h>
+#include    <ip_parser.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+// C
+//
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+snapdev::timespec_ex const          g_now(1'700'000'000, 0);
+constexpr off_t const               g_header_size = 8;
+constexpr off_t const               g_record_size = 56;
+
+
+/** \brief Create an empty directory for a journal.
+ *
+ * The files of a previous run get deleted.
+ */
+std::string journal_path(std::string const & name)
+{
+    std::string const path(SNAP_CATCH2_NAMESPACE::g_tmp_dir() + "/" + name);
+    mkdir(path.c_str(), 0700);
+    unlink((path + "/bans.journal").c_str());
+    unlink((path + "/bans.snapshot").c_str());
+    unlink((path + "/bans.journal.old").c_str());
+    return path;
+}
+
+
+off_t file_size(std::string const & filename)
+{
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0)
+    {
+        return -1;
+    }
+    return st.st_size;
+}
+
+
+ipwall::block_info make_block(
+      std::string const & ip
+    , std::string const & scheme
+    , std::int64_t seconds
+    , std::string const & reason = std::string())
+{
+    ipwall::block_info::address_t address;
+    CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+    ipwall::block_info info(address, scheme, g_now + snapdev::timespec_ex(seconds, 0));
+    info.set_ban_count(1);
+    info.set_reason(reason);
+    return info;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("ban_journal", "[ban_journal][ipwall]")
+{
+    CATCH_START_SECTION("ban_journal: a new journal has no state")
+    {
+        std::string const path(journal_path("journal-new"));
+        {
+            ipwall::ban_journal j(path);
+            CATCH_REQUIRE(j.load(g_now).empty());
+            CATCH_REQUIRE_FALSE(j.has_state());
+        }
+
+        // the journal was created so the next start has a state
+        //
+        CATCH_REQUIRE(file_size(path + "/bans.journal") == g_header_size);
+        {
+            ipwall::ban_journal j(path);
+            CATCH_REQUIRE(j.load(g_now).empty());
+            CATCH_REQUIRE(j.has_state());
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: blocks and unblocks are replayed")
+    {
+        std::string const path(journal_path("journal-replay"));
+        {
+            ipwall::ban_journal j(path);
+            CATCH_REQUIRE(j.load(g_now).empty());
+
+            ipwall::block_info a(make_block("1.2.3.4", "http", 60 * 60, "port scan"));
+            a.set_ban_count(3);
+            j.record_block(a);
+            j.record_block(make_block("1.2.3.5", "http", 2 * 60 * 60));
+            j.record_block(make_block("2a00:1450::1", "smtp", 30 * 60, "spam"));
+            j.record_unblock(make_block("1.2.3.5", "http", 0).get_address(), "http");
+            j.sync();
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(j.has_state());
+
+            // sorted by block limit
+            //
+            CATCH_REQUIRE(blocks.size() == 2);
+            CATCH_REQUIRE(blocks[0].get_ip() == "2a00:1450::1");
+            CATCH_REQUIRE(blocks[0].get_scheme() == "smtp");
+            CATCH_REQUIRE(blocks[0].get_reason() == "spam");
+            CATCH_REQUIRE(blocks[0].get_block_limit() == g_now + snapdev::timespec_ex(30 * 60, 0));
+            CATCH_REQUIRE(blocks[0].get_ban_count() == 1);
+            CATCH_REQUIRE(blocks[1].get_ip() == "1.2.3.4");
+            CATCH_REQUIRE(blocks[1].get_scheme() == "http");
+            CATCH_REQUIRE(blocks[1].get_reason() == "port scan");
+            CATCH_REQUIRE(blocks[1].get_block_limit() == g_now + snapdev::timespec_ex(60 * 60, 0));
+            CATCH_REQUIRE(blocks[1].get_ban_count() == 3);
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: the last record of a block wins")
+    {
+        std::string const path(journal_path("journal-last"));
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            j.record_block(make_block("1.2.3.4", "http", 60 * 60));
+            j.record_block(make_block("1.2.3.4", "http", 24 * 60 * 60));
+
+            // same address, another scheme, is another block
+            //
+            j.record_block(make_block("1.2.3.4", "smtp", 60));
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 2);
+            CATCH_REQUIRE(blocks[0].get_scheme() == "smtp");
+            CATCH_REQUIRE(blocks[1].get_scheme() == "http");
+            CATCH_REQUIRE(blocks[1].get_block_limit() == g_now + snapdev::timespec_ex(24 * 60 * 60, 0));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: blocks which timed out are not loaded")
+    {
+        std::string const path(journal_path("journal-timeout"));
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            j.record_block(make_block("1.2.3.4", "http", 10));
+            j.record_block(make_block("1.2.3.5", "http", 60));
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t expired;
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now + snapdev::timespec_ex(10, 0), &expired));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.5");
+
+            // ipwall still needs to know about those to remove them
+            // from the IP sets
+            //
+            CATCH_REQUIRE(expired.size() == 1);
+            CATCH_REQUIRE(expired[0].get_ip() == "1.2.3.4");
+        }
+
+        // the same applies to the blocks found in a snapshot
+        //
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            ipwall::block_info const a(make_block("1.2.3.4", "http", 10));
+            ipwall::block_info const b(make_block("1.2.3.5", "http", 60));
+            std::vector<ipwall::block_info const *> entries{ &a, &b };
+            j.save_snapshot(entries);
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t expired;
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now + snapdev::timespec_ex(10, 0), &expired));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.5");
+            CATCH_REQUIRE(expired.size() == 1);
+            CATCH_REQUIRE(expired[0].get_ip() == "1.2.3.4");
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: the journal is replayed over the snapshot")
+    {
+        std::string const path(journal_path("journal-snapshot"));
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            ipwall::block_info const a(make_block("1.2.3.4", "http", 60 * 60, "port scan"));
+            ipwall::block_info const b(make_block("1.2.3.5", "http", 2 * 60 * 60, "port scan"));
+            j.record_block(a);
+            j.record_block(b);
+            j.sync();
+
+            std::vector<ipwall::block_info const *> entries{ &b, &a };
+            j.save_snapshot(entries);
+
+            // the snapshot includes everything so the journal gets truncated
+            //
+            CATCH_REQUIRE(file_size(path + "/bans.snapshot") > 0);
+            CATCH_REQUIRE(file_size(path + "/bans.journal") == g_header_size);
+
+            j.record_unblock(a.get_address(), "http");
+            j.record_block(make_block("1.2.3.6", "smtp", 3 * 60 * 60));
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(j.has_state());
+            CATCH_REQUIRE(blocks.size() == 2);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.5");
+            CATCH_REQUIRE(blocks[0].get_reason() == "port scan");
+            CATCH_REQUIRE(blocks[1].get_ip() == "1.2.3.6");
+            CATCH_REQUIRE(blocks[1].get_scheme() == "smtp");
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: records written during a compaction are kept")
+    {
+        std::string const path(journal_path("journal-compaction"));
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            ipwall::block_info const a(make_block("1.2.3.4", "http", 60 * 60));
+            ipwall::block_info const b(make_block("1.2.3.5", "http", 2 * 60 * 60));
+            j.record_block(a);
+            j.record_block(b);
+
+            std::vector<ipwall::block_info const *> entries{ &a, &b };
+            ipwall::ban_journal::job_t job(j.start_compaction(entries));
+            CATCH_REQUIRE(job);
+            CATCH_REQUIRE(file_size(path + "/bans.journal.old") > g_header_size);
+            CATCH_REQUIRE(file_size(path + "/bans.journal") == g_header_size);
+
+            // the job would run in the kernel worker thread
+            //
+            j.record_unblock(a.get_address(), "http");
+            CATCH_REQUIRE_FALSE(j.start_compaction(entries));
+            job();
+            j.sync();
+
+            CATCH_REQUIRE(file_size(path + "/bans.journal.old") == -1);
+            CATCH_REQUIRE(file_size(path + "/bans.snapshot") > 0);
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.5");
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: an interrupted compaction completes on load()")
+    {
+        std::string const path(journal_path("journal-interrupted"));
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            ipwall::block_info const a(make_block("1.2.3.4", "http", 60 * 60));
+            ipwall::block_info const b(make_block("1.2.3.5", "http", 2 * 60 * 60));
+            j.record_block(a);
+            j.record_block(b);
+
+            // the job never runs, as if ipwall crashed
+            //
+            std::vector<ipwall::block_info const *> entries{ &a, &b };
+            CATCH_REQUIRE(j.start_compaction(entries));
+            j.record_unblock(a.get_address(), "http");
+            j.record_block(make_block("1.2.3.6", "smtp", 3 * 60 * 60));
+        }
+        CATCH_REQUIRE(file_size(path + "/bans.journal.old") > g_header_size);
+        CATCH_REQUIRE(file_size(path + "/bans.snapshot") == -1);
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(j.has_state());
+            CATCH_REQUIRE(blocks.size() == 2);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.5");
+            CATCH_REQUIRE(blocks[1].get_ip() == "1.2.3.6");
+
+            CATCH_REQUIRE(file_size(path + "/bans.journal.old") == -1);
+            CATCH_REQUIRE(file_size(path + "/bans.snapshot") > 0);
+            CATCH_REQUIRE(file_size(path + "/bans.journal") == g_header_size);
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 2);
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal: a snapshot is not saved before load()")
+    {
+        std::string const path(journal_path("journal-no-load"));
+        ipwall::ban_journal j(path);
+        ipwall::block_info const a(make_block("1.2.3.4", "http", 60 * 60));
+        std::vector<ipwall::block_info const *> entries{ &a };
+        j.save_snapshot(entries);
+        CATCH_REQUIRE(file_size(path + "/bans.snapshot") == -1);
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("ban_journal_errors", "[ban_journal][ipwall][error]")
+{
+    CATCH_START_SECTION("ban_journal_errors: an incomplete record gets truncated")
+    {
+        std::string const path(journal_path("journal-incomplete"));
+        std::string const filename(path + "/bans.journal");
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            j.record_block(make_block("1.2.3.4", "http", 60 * 60));
+            j.record_block(make_block("1.2.3.5", "http", 60 * 60));
+        }
+
+        // simulate a crash while the last record was being written
+        //
+        off_t const record_size(g_record_size + 4);     // "http", no reason
+        CATCH_REQUIRE(file_size(filename) == g_header_size + record_size * 2);
+        CATCH_REQUIRE(truncate(filename.c_str(), g_header_size + record_size + 10) == 0);
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.4");
+
+            // the partial record is gone so new records can be read back
+            //
+            CATCH_REQUIRE(file_size(filename) == g_header_size + record_size);
+            j.record_block(make_block("1.2.3.6", "http", 2 * 60 * 60));
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 2);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.4");
+            CATCH_REQUIRE(blocks[1].get_ip() == "1.2.3.6");
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal_errors: garbage after the last record gets truncated")
+    {
+        std::string const path(journal_path("journal-garbage"));
+        std::string const filename(path + "/bans.journal");
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            j.record_block(make_block("1.2.3.4", "http", 60 * 60));
+        }
+        off_t const size(file_size(filename));
+        {
+            std::ofstream out(filename, std::ios::app | std::ios::binary);
+            out << std::string(g_record_size * 2, 'x');
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(file_size(filename) == size);
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal_errors: a corrupted record stops the replay")
+    {
+        std::string const path(journal_path("journal-corrupted"));
+        std::string const filename(path + "/bans.journal");
+        {
+            ipwall::ban_journal j(path);
+            j.load(g_now);
+            j.record_block(make_block("1.2.3.4", "http", 60 * 60));
+            j.record_block(make_block("1.2.3.5", "http", 60 * 60));
+            j.record_block(make_block("1.2.3.6", "http", 60 * 60));
+        }
+
+        // change one character of the scheme of the second record
+        //
+        {
+            std::fstream io(filename, std::ios::in | std::ios::out | std::ios::binary);
+            io.seekp(g_header_size + (g_record_size + 4) + g_record_size);
+            io.put('H');
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.4");
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal_errors: an invalid journal is replaced")
+    {
+        std::string const path(journal_path("journal-invalid"));
+        std::string const filename(path + "/bans.journal");
+        {
+            std::ofstream out(filename, std::ios::binary);
+            out << "this is not a journal";
+        }
+        {
+            ipwall::ban_journal j(path);
+            CATCH_REQUIRE(j.load(g_now).empty());
+            CATCH_REQUIRE(j.has_state());
+            CATCH_REQUIRE(file_size(filename) == g_header_size);
+            j.record_block(make_block("1.2.3.4", "http", 60 * 60));
+        }
+        {
+            ipwall::ban_journal j(path);
+            ipwall::block_info::block_info_vector_t const blocks(j.load(g_now));
+            CATCH_REQUIRE(blocks.size() == 1);
+            CATCH_REQUIRE(blocks[0].get_ip() == "1.2.3.4");
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ban_journal_errors: an invalid snapshot is ignored")
+    {
+        std::string const path(journal_path("journal-invalid-snapshot"));
+        {
+            std::ofstream out(path + "/bans.snapshot", std::ios::binary);
+            out << std::string(100, 'x');
+        }
+        {
+            ipwall::ban_journal j(path);
+            CATCH_REQUIRE(j.load(g_now).empty());
+            CATCH_REQUIRE(j.has_state());
+            j.record_block(make_block("1.2.3.4", "http", 60 * 60));
+        }
+        {
+            ipwall::ban_journal j(path);
+            CATCH_REQUIRE(j.load(g_now).size() == 1);
+        }
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
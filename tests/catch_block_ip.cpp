@@ -0,0 +1,96 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// iplock
+//
+#include    <iplock/block_ip.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+CATCH_TEST_CASE("block_batch", "[block_ip]")
+{
+    CATCH_START_SECTION("block_batch: encode and decode")
+    {
+        iplock::block_request::vector_t const blocks = {
+            { "http://10.0.0.1", "week", "scanning for wp-admin" },
+            { "smtp://2001:db8::1", "", "" },
+            { "10.0.0.2", "forever", "bad\tbot\nreally" },
+            { "", "day", "ignored, no URI" },
+        };
+        std::vector<std::string> const chunks(iplock::encode_block_batch(blocks));
+        CATCH_REQUIRE(chunks.size() == 1);
+
+        iplock::block_request::vector_t const decoded(iplock::decode_block_batch(chunks[0]));
+        CATCH_REQUIRE(decoded.size() == 3);
+        CATCH_REQUIRE(decoded[0].f_uri == "http://10.0.0.1");
+        CATCH_REQUIRE(decoded[0].f_period == "week");
+        CATCH_REQUIRE(decoded[0].f_reason == "scanning for wp-admin");
+        CATCH_REQUIRE(decoded[1].f_uri == "smtp://2001:db8::1");
+        CATCH_REQUIRE(decoded[1].f_period.empty());
+        CATCH_REQUIRE(decoded[1].f_reason.empty());
+        CATCH_REQUIRE(decoded[2].f_uri == "10.0.0.2");
+        CATCH_REQUIRE(decoded[2].f_period == "forever");
+        CATCH_REQUIRE(decoded[2].f_reason == "bad bot really");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_batch: chunks")
+    {
+        iplock::block_request::vector_t blocks;
+        for(int idx(0); idx < 1000; ++idx)
+        {
+            blocks.push_back({ "10.0." + std::to_string(idx / 256) + '.' + std::to_string(idx % 256), "day", "" });
+        }
+        std::vector<std::string> const chunks(iplock::encode_block_batch(blocks, 1024));
+        CATCH_REQUIRE(chunks.size() > 1);
+
+        std::size_t count(0);
+        for(auto const & c : chunks)
+        {
+            CATCH_REQUIRE(c.length() <= 1024);
+            count += iplock::decode_block_batch(c).size();
+        }
+        CATCH_REQUIRE(count == blocks.size());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_batch: decode without optional fields")
+    {
+        iplock::block_request::vector_t const decoded(iplock::decode_block_batch("10.0.0.1\n\nhttp://10.0.0.2\tday"));
+        CATCH_REQUIRE(decoded.size() == 2);
+        CATCH_REQUIRE(decoded[0].f_uri == "10.0.0.1");
+        CATCH_REQUIRE(decoded[0].f_period.empty());
+        CATCH_REQUIRE(decoded[1].f_uri == "http://10.0.0.2");
+        CATCH_REQUIRE(decoded[1].f_period == "day");
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,459 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <block_store.h>
+#include    <ip_parser.h>
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+#include    <iplock/ipset_memory.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+constexpr std::int64_t const        g_hour = 60 * 60;
+constexpr std::int64_t const        g_day = 24 * 60 * 60;
+
+
+/** \brief An unknown scheme.
+ *
+ * Unknown schemes use the default IP sets, the same as "http" unless
+ * an http.conf file says otherwise.
+ */
+constexpr char const *              g_other_scheme = "catch-test";
+
+
+iplock::ipset_memory::pointer_t create_sets(bool with_timeout)
+{
+    iplock::ipset_memory::pointer_t s(std::make_shared<iplock::ipset_memory>());
+    for(auto const & name : ipwall::block_info::get_set_names())
+    {
+        bool const ipv6(name.length() > 5 && name.substr(name.length() - 5) == "_ipv6");
+        iplock::ipset_options options;
+        options.f_family = ipv6
+                    ? iplock::ipset_family_t::IPSET_FAMILY_INET6
+                    : iplock::ipset_family_t::IPSET_FAMILY_INET;
+        options.f_with_timeout = with_timeout;
+        s->create(name, options);
+    }
+    return s;
+}
+
+
+ipwall::block_info make_block(
+      std::string const & ip
+    , std::string const & scheme
+    , std::int64_t seconds)
+{
+    ipwall::block_info::address_t address;
+    CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+    return ipwall::block_info(
+              address
+            , scheme
+            , snapdev::timespec_ex::gettime() + snapdev::timespec_ex(seconds, 0));
+}
+
+
+bool is_member(iplock::ipset & s, ipwall::block_info const & info)
+{
+    return s.test(info.get_set_name(), info.get_element());
+}
+
+
+/** \brief Get the timeout of a member.
+ *
+ * \return The timeout of the member or -1 if not found.
+ */
+std::int64_t get_timeout(iplock::ipset & s, ipwall::block_info const & info)
+{
+    std::int64_t timeout(-1);
+    iplock::ipset_element const e(info.get_element());
+    s.list(info.get_set_name(), [&timeout, &e](iplock::ipset_element const & element)
+        {
+            if(element == e)
+            {
+                timeout = element.f_timeout;
+                return false;
+            }
+            return true;
+        });
+    return timeout;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("block_store", "[block_store][ipwall]")
+{
+    CATCH_START_SECTION("block_store: block and unblock")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+        CATCH_REQUIRE(store.empty());
+        CATCH_REQUIRE_FALSE(store.has_kernel_timeouts());
+
+        ipwall::block_info a(make_block("1.2.3.4", "http", g_hour));
+        CATCH_REQUIRE(store.block(a));
+        CATCH_REQUIRE(store.size() == 1);
+        CATCH_REQUIRE(store.is_blocked(a));
+        CATCH_REQUIRE(is_member(*s, a));
+        CATCH_REQUIRE(get_timeout(*s, a) == 0);
+
+        // a second block of the same address only updates the entry
+        //
+        ipwall::block_info longer(make_block("1.2.3.4", "http", g_day));
+        CATCH_REQUIRE_FALSE(store.block(longer));
+        CATCH_REQUIRE(store.size() == 1);
+
+        CATCH_REQUIRE(store.unblock(a) == 1);
+        CATCH_REQUIRE(store.empty());
+        CATCH_REQUIRE_FALSE(store.is_blocked(a));
+        CATCH_REQUIRE_FALSE(is_member(*s, a));
+
+        CATCH_REQUIRE(store.unblock(a) == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: invalid blocks are ignored")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info invalid("http://");
+        CATCH_REQUIRE_FALSE(invalid.is_valid());
+        CATCH_REQUIRE_FALSE(store.block(invalid));
+        CATCH_REQUIRE(store.unblock(invalid) == 0);
+        CATCH_REQUIRE(store.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: the \"all\" scheme replaces the other schemes")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info a(make_block("1.2.3.4", "http", g_hour));
+        CATCH_REQUIRE(store.block(a));
+
+        ipwall::block_info all(make_block("1.2.3.4", "all", g_hour));
+        CATCH_REQUIRE_FALSE(store.block(all));
+        CATCH_REQUIRE(store.size() == 1);
+        CATCH_REQUIRE(store.get_counts().size() == 1);
+        CATCH_REQUIRE(store.get_counts().begin()->first.first == ipwall::block_info::SCHEME_ALL);
+        CATCH_REQUIRE(is_member(*s, all));
+
+        // the "all" entry matches any scheme
+        //
+        CATCH_REQUIRE(store.unblock(a) == 1);
+        CATCH_REQUIRE(store.empty());
+        CATCH_REQUIRE_FALSE(is_member(*s, all));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: counts per scheme and family")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info a(make_block("1.2.3.4", "http", g_hour));
+        ipwall::block_info b(make_block("1.2.3.5", "http", g_hour));
+        ipwall::block_info c(make_block("2a00:1450::1", "http", g_hour));
+        CATCH_REQUIRE(store.block(a));
+        CATCH_REQUIRE(store.block(b));
+        CATCH_REQUIRE(store.block(c));
+        CATCH_REQUIRE(is_member(*s, c));
+
+        ipwall::block_store::count_map_t const & counts(store.get_counts());
+        CATCH_REQUIRE(counts.size() == 2);
+        CATCH_REQUIRE(counts.at({ ipwall::block_info::SCHEME_HTTP, true }) == 2);
+        CATCH_REQUIRE(counts.at({ ipwall::block_info::SCHEME_HTTP, false }) == 1);
+
+        CATCH_REQUIRE(store.unblock(c) == 1);
+        CATCH_REQUIRE(counts.size() == 1);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: schemes sharing the same set")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info http(make_block("1.2.3.4", "http", g_hour));
+        ipwall::block_info other(make_block("1.2.3.4", g_other_scheme, g_day));
+        CATCH_REQUIRE(store.block(http));
+        CATCH_REQUIRE(store.block(other));
+        CATCH_REQUIRE(store.size() == 2);
+
+        // the member is kept as long as one scheme still blocks it
+        //
+        CATCH_REQUIRE(store.unblock(http) == 1);
+        CATCH_REQUIRE(store.size() == 1);
+        CATCH_REQUIRE(is_member(*s, other));
+
+        CATCH_REQUIRE(store.unblock(other) == 1);
+        CATCH_REQUIRE_FALSE(is_member(*s, other));
+        CATCH_REQUIRE_FALSE(is_member(*s, http));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: expire() unblocks the entries which timed out")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info a(make_block("1.2.3.4", "http", g_hour));
+        ipwall::block_info b(make_block("1.2.3.5", "http", g_day));
+        CATCH_REQUIRE(store.block(a));
+        CATCH_REQUIRE(store.block(b));
+
+        snapdev::timespec_ex const now(snapdev::timespec_ex::gettime());
+        CATCH_REQUIRE(store.next_expiry() > now);
+        CATCH_REQUIRE(store.next_expiry() <= now + snapdev::timespec_ex(g_hour + 1, 0));
+
+        CATCH_REQUIRE(store.expire(now) == 0);
+        CATCH_REQUIRE(store.expire(now + snapdev::timespec_ex(2 * g_hour, 0)) == 1);
+        CATCH_REQUIRE(store.size() == 1);
+        CATCH_REQUIRE_FALSE(is_member(*s, a));
+        CATCH_REQUIRE(is_member(*s, b));
+
+        CATCH_REQUIRE(store.expire(now + snapdev::timespec_ex(2 * g_day, 0)) == 1);
+        CATCH_REQUIRE(store.empty());
+        CATCH_REQUIRE_FALSE(is_member(*s, b));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: an unblocked entry does not expire later")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info a(make_block("1.2.3.4", "http", g_hour));
+        CATCH_REQUIRE(store.block(a));
+        CATCH_REQUIRE(store.unblock(a) == 1);
+
+        // a new block of another scheme must not be removed by the
+        // timeout of the old entry
+        //
+        ipwall::block_info b(make_block("1.2.3.4", g_other_scheme, g_day));
+        CATCH_REQUIRE(store.block(b));
+        CATCH_REQUIRE(store.expire(snapdev::timespec_ex::gettime() + snapdev::timespec_ex(2 * g_hour, 0)) == 0);
+        CATCH_REQUIRE(is_member(*s, b));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: kernel timeouts")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(true));
+        ipwall::block_store store(s);
+        CATCH_REQUIRE(store.detect_kernel_timeouts());
+        CATCH_REQUIRE(store.has_kernel_timeouts());
+
+        ipwall::block_info http(make_block("1.2.3.4", "http", g_hour));
+        CATCH_REQUIRE(store.block(http));
+        CATCH_REQUIRE(get_timeout(*s, http) > g_hour - 10);
+        CATCH_REQUIRE(get_timeout(*s, http) <= g_hour);
+
+        // the member uses the longest timeout of the schemes sharing the set
+        //
+        ipwall::block_info other(make_block("1.2.3.4", g_other_scheme, g_day));
+        CATCH_REQUIRE(store.block(other));
+        CATCH_REQUIRE(get_timeout(*s, other) > g_day - 10);
+        CATCH_REQUIRE(get_timeout(*s, other) <= g_day);
+
+        // a shorter block does not shorten the member
+        //
+        ipwall::block_info shorter(make_block("1.2.3.4", "http", g_hour / 2));
+        CATCH_REQUIRE_FALSE(store.block(shorter));
+        CATCH_REQUIRE(get_timeout(*s, other) > g_day - 10);
+
+        // once the longest block is gone, the member uses the next one
+        //
+        CATCH_REQUIRE(store.unblock(other) == 1);
+        CATCH_REQUIRE(get_timeout(*s, http) > g_hour - 10);
+        CATCH_REQUIRE(get_timeout(*s, http) <= g_hour);
+
+        CATCH_REQUIRE(store.unblock(http) == 1);
+        CATCH_REQUIRE(get_timeout(*s, http) == -1);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: blocks too long for the kernel are permanent members")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(true));
+        ipwall::block_store store(s);
+        CATCH_REQUIRE(store.detect_kernel_timeouts());
+
+        ipwall::block_info http(make_block("1.2.3.4", "http", g_hour));
+        ipwall::block_info other(make_block("1.2.3.4", g_other_scheme, 100 * g_day));
+        CATCH_REQUIRE(store.block(http));
+        CATCH_REQUIRE(store.block(other));
+
+        // no timeout is the longest timeout
+        //
+        CATCH_REQUIRE(get_timeout(*s, other) == 0);
+
+        // and ipwall removes the member itself
+        //
+        CATCH_REQUIRE(store.unblock(http) == 1);
+        CATCH_REQUIRE(get_timeout(*s, other) == 0);
+        CATCH_REQUIRE(store.expire(snapdev::timespec_ex::gettime() + snapdev::timespec_ex(101 * g_day, 0)) == 1);
+        CATCH_REQUIRE(get_timeout(*s, other) == -1);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: sync_sets() adds the restored blocks")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        ipwall::block_info::block_info_vector_t blocks;
+        blocks.push_back(make_block("1.2.3.4", "http", g_hour));
+        blocks.push_back(make_block("2a00:1450::1", "http", g_day));
+        store.restore(blocks);
+        CATCH_REQUIRE(store.size() == 2);
+
+        // restore() does not update the firewall
+        //
+        CATCH_REQUIRE_FALSE(is_member(*s, blocks[0]));
+        CATCH_REQUIRE_FALSE(is_member(*s, blocks[1]));
+
+        CATCH_REQUIRE(store.sync_sets());
+        CATCH_REQUIRE(is_member(*s, blocks[0]));
+        CATCH_REQUIRE(is_member(*s, blocks[1]));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: sync_sets() only deletes the members of ipwall")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+
+        // "iplock --block" added a member and ipwall added another which
+        // timed out while it was not running
+        //
+        ipwall::block_info const foreign(make_block("5.6.7.8", "http", g_hour));
+        ipwall::block_info const expired(make_block("9.9.9.9", "http", -g_hour));
+        s->add(foreign.get_set_name(), foreign.get_element());
+        s->add(expired.get_set_name(), expired.get_element());
+
+        ipwall::block_info::block_info_vector_t blocks;
+        blocks.push_back(make_block("1.2.3.4", "http", g_hour));
+        store.restore(blocks);
+
+        CATCH_REQUIRE(store.sync_sets({ expired }));
+        CATCH_REQUIRE(is_member(*s, blocks[0]));
+        CATCH_REQUIRE(is_member(*s, foreign));
+        CATCH_REQUIRE_FALSE(is_member(*s, expired));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: sync_sets() keeps the other members when adding the counters")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+        store.set_counters(true);
+
+        ipwall::block_info const foreign(make_block("5.6.7.8", "http", g_hour));
+        ipwall::block_info const expired(make_block("9.9.9.9", "http", -g_hour));
+        s->add(foreign.get_set_name(), foreign.get_element());
+        s->add(expired.get_set_name(), expired.get_element());
+
+        ipwall::block_info::block_info_vector_t blocks;
+        blocks.push_back(make_block("1.2.3.4", "http", g_hour));
+        store.restore(blocks);
+
+        CATCH_REQUIRE(store.sync_sets({ expired }));
+
+        iplock::ipset_header h;
+        CATCH_REQUIRE(s->header(foreign.get_set_name(), h));
+        CATCH_REQUIRE(h.f_with_counters);
+        CATCH_REQUIRE(h.f_elements == 2);
+        CATCH_REQUIRE(is_member(*s, blocks[0]));
+        CATCH_REQUIRE(is_member(*s, foreign));
+        CATCH_REQUIRE_FALSE(is_member(*s, expired));
+        CATCH_REQUIRE_FALSE(s->exists("ipwall_rebuild"));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store: sync_sets() uses the longest timeout of a shared member")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(true));
+        ipwall::block_store store(s);
+        CATCH_REQUIRE(store.detect_kernel_timeouts());
+
+        // the 100 days block is too long for the kernel, ipwall removes
+        // that member itself so it must not get a timeout
+        //
+        ipwall::block_info::block_info_vector_t blocks;
+        blocks.push_back(make_block("1.2.3.4", "http", g_hour));
+        blocks.push_back(make_block("1.2.3.4", g_other_scheme, 100 * g_day));
+        store.restore(blocks);
+        CATCH_REQUIRE(store.size() == 2);
+
+        CATCH_REQUIRE(store.sync_sets());
+        CATCH_REQUIRE(get_timeout(*s, blocks[0]) == 0);
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("block_store_errors", "[block_store][ipwall][error]")
+{
+    CATCH_START_SECTION("block_store_errors: kernel timeouts must be detected before blocking")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(true));
+        ipwall::block_store store(s);
+
+        ipwall::block_info a(make_block("1.2.3.4", "http", g_hour));
+        CATCH_REQUIRE(store.block(a));
+        CATCH_REQUIRE_THROWS_AS(store.detect_kernel_timeouts(), iplock::logic_error);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("block_store_errors: sets without timeouts")
+    {
+        iplock::ipset_memory::pointer_t s(create_sets(false));
+        ipwall::block_store store(s);
+        CATCH_REQUIRE_FALSE(store.detect_kernel_timeouts());
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,200 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <dedupe_filter.h>
+#include    <ip_parser.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+snapdev::timespec_ex const          g_now(1'700'000'000, 0);
+snapdev::timespec_ex const          g_window(60, 0);
+snapdev::timespec_ex const          g_day(24 * 60 * 60, 0);
+
+
+ipwall::block_info make_block(
+      std::string const & ip
+    , std::string const & scheme = "http"
+    , snapdev::timespec_ex const & limit = g_now + g_day)
+{
+    ipwall::block_info::address_t address;
+    CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+    return ipwall::block_info(address, scheme, limit);
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("dedupe_filter", "[dedupe_filter][ipwall]")
+{
+    CATCH_START_SECTION("dedupe_filter: a window of zero disables the filter")
+    {
+        ipwall::dedupe_filter filter(1000, snapdev::timespec_ex());
+        CATCH_REQUIRE_FALSE(filter.is_enabled());
+
+        ipwall::block_info const a(make_block("1.2.3.4"));
+        CATCH_REQUIRE(filter.insert(a, g_now));
+        CATCH_REQUIRE_FALSE(filter.contains(a, g_now));
+        CATCH_REQUIRE(filter.size() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("dedupe_filter: only the same tuple is a duplicate")
+    {
+        ipwall::dedupe_filter filter(1000, g_window);
+        CATCH_REQUIRE(filter.is_enabled());
+
+        ipwall::block_info const a(make_block("1.2.3.4"));
+        CATCH_REQUIRE_FALSE(filter.contains(a, g_now));
+        CATCH_REQUIRE(filter.insert(a, g_now));
+        CATCH_REQUIRE(filter.size() == 1);
+        CATCH_REQUIRE(filter.contains(a, g_now));
+
+        // inserting the same tuple again does not add it twice
+        //
+        CATCH_REQUIRE(filter.insert(a, g_now));
+        CATCH_REQUIRE(filter.size() == 1);
+
+        // a limit within the same window is a duplicate
+        //
+        CATCH_REQUIRE(filter.contains(make_block("1.2.3.4", "http", g_now + g_day + snapdev::timespec_ex(0, 1)), g_now));
+
+        CATCH_REQUIRE_FALSE(filter.contains(make_block("1.2.3.5"), g_now));
+        CATCH_REQUIRE_FALSE(filter.contains(make_block("::ffff:1.2.3.5"), g_now));
+        CATCH_REQUIRE_FALSE(filter.contains(make_block("2a00:1450::1"), g_now));
+        CATCH_REQUIRE_FALSE(filter.contains(make_block("1.2.3.4", "smtp"), g_now));
+        CATCH_REQUIRE(filter.contains(make_block("::ffff:1.2.3.4"), g_now));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("dedupe_filter: a longer block is never a duplicate")
+    {
+        ipwall::dedupe_filter filter(1000, g_window);
+
+        ipwall::block_info const day(make_block("1.2.3.4"));
+        CATCH_REQUIRE(filter.insert(day, g_now));
+
+        ipwall::block_info const week(make_block("1.2.3.4", "http", g_now + snapdev::timespec_ex(7 * 24 * 60 * 60, 0)));
+        CATCH_REQUIRE_FALSE(filter.contains(week, g_now));
+
+        // the same period sent a little later is not a duplicate either
+        // since the limit moved to another window
+        //
+        ipwall::block_info const later(make_block("1.2.3.4", "http", g_now + g_day + g_window));
+        CATCH_REQUIRE_FALSE(filter.contains(later, g_now + g_window - snapdev::timespec_ex(1, 0)));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("dedupe_filter: tuples are remembered for one to two windows")
+    {
+        ipwall::dedupe_filter filter(1000, g_window);
+
+        ipwall::block_info const a(make_block("1.2.3.4"));
+        CATCH_REQUIRE(filter.insert(a, g_now));
+
+        CATCH_REQUIRE(filter.contains(a, g_now + g_window - snapdev::timespec_ex(1, 0)));
+
+        // the generations rotated, the tuple is in the previous generation
+        //
+        CATCH_REQUIRE(filter.contains(a, g_now + g_window + snapdev::timespec_ex(1, 0)));
+
+        // the generations rotated again, the tuple is gone
+        //
+        CATCH_REQUIRE_FALSE(filter.contains(a, g_now + snapdev::timespec_ex(2 * 60 + 2, 0)));
+        CATCH_REQUIRE(filter.size() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("dedupe_filter: an idle filter forgets everything")
+    {
+        ipwall::dedupe_filter filter(1000, g_window);
+
+        ipwall::block_info const a(make_block("1.2.3.4"));
+        ipwall::block_info const b(make_block("1.2.3.5"));
+        CATCH_REQUIRE(filter.insert(a, g_now));
+        CATCH_REQUIRE(filter.insert(b, g_now + snapdev::timespec_ex(30, 0)));
+        CATCH_REQUIRE(filter.size() == 2);
+
+        CATCH_REQUIRE_FALSE(filter.contains(a, g_now + snapdev::timespec_ex(3 * 60, 0)));
+        CATCH_REQUIRE_FALSE(filter.contains(b, g_now + snapdev::timespec_ex(3 * 60, 0)));
+        CATCH_REQUIRE(filter.size() == 0);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("dedupe_filter: clear()")
+    {
+        ipwall::dedupe_filter filter(1000, g_window);
+
+        ipwall::block_info const a(make_block("1.2.3.4"));
+        CATCH_REQUIRE(filter.insert(a, g_now));
+        CATCH_REQUIRE(filter.contains(a, g_now));
+
+        filter.clear();
+        CATCH_REQUIRE(filter.size() == 0);
+        CATCH_REQUIRE_FALSE(filter.contains(a, g_now));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("dedupe_filter: a full filter starts a new generation")
+    {
+        ipwall::dedupe_filter filter(100, g_window);
+
+        bool full(false);
+        for(int idx(0); idx < 1000; ++idx)
+        {
+            ipwall::block_info const info(make_block(
+                      "8.8."
+                    + std::to_string(idx / 256)
+                    + "."
+                    + std::to_string(idx % 256)));
+            if(!filter.insert(info, g_now))
+            {
+                full = true;
+            }
+
+            // the last tuple is always remembered
+            //
+            CATCH_REQUIRE(filter.contains(info, g_now));
+        }
+        CATCH_REQUIRE(full);
+        CATCH_REQUIRE(filter.size() < 1000);
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
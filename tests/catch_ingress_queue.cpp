@@ -0,0 +1,300 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <ingress_queue.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+iplock::block_request request(
+      std::string const & uri
+    , std::string const & period = std::string()
+    , std::string const & reason = std::string())
+{
+    iplock::block_request result;
+    result.f_uri = uri;
+    result.f_period = period;
+    result.f_reason = reason;
+    return result;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("ingress_queue", "[ingress_queue][ipwall]")
+{
+    CATCH_START_SECTION("ingress_queue: blocks are returned in order")
+    {
+        ipwall::ingress_queue q(100);
+        CATCH_REQUIRE(q.empty());
+        CATCH_REQUIRE(q.get_capacity() == 100);
+
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.5"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.6"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 3);
+
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3.4");
+        CATCH_REQUIRE_FALSE(item.f_unblock);
+        CATCH_REQUIRE(std::string(item.f_command) == "IPWALL_BLOCK");
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3.5");
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3.6");
+        CATCH_REQUIRE_FALSE(q.pop(item));
+        CATCH_REQUIRE(q.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: pending blocks of the same URI are merged")
+    {
+        ipwall::ingress_queue q(100);
+
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4", "hour"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4", "week", "port scan"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4", "day", "other reason"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 1);
+
+        // the longest period and the first reason are kept
+        //
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_period == "week");
+        CATCH_REQUIRE(item.f_request.f_reason == "port scan");
+        CATCH_REQUIRE_FALSE(q.pop(item));
+
+        // once popped, the same URI is queued again
+        //
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4", "hour"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 1);
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_period == "hour");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: unblocks go first and cancel the pending blocks")
+    {
+        ipwall::ingress_queue q(100);
+
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.5"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_unblock(request("http://1.2.3.4"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.push_unblock(request("http://1.2.3.4"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.size() == 2);
+
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3.4");
+        CATCH_REQUIRE(item.f_unblock);
+        CATCH_REQUIRE(std::string(item.f_command) == "IPWALL_UNBLOCK");
+
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3.5");
+        CATCH_REQUIRE_FALSE(item.f_unblock);
+
+        CATCH_REQUIRE_FALSE(q.pop(item));
+        CATCH_REQUIRE(q.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: a block after an unblock is kept")
+    {
+        ipwall::ingress_queue q(100);
+
+        CATCH_REQUIRE(q.push_unblock(request("http://1.2.3.4"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.4"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 2);
+
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_unblock);
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE_FALSE(item.f_unblock);
+        CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3.4");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: the same address written differently is one request")
+    {
+        ipwall::ingress_queue q(100);
+
+        CATCH_REQUIRE(q.push_block(request("http://2a00:1450::1", "hour"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_block(request("2a00:1450:0::1", "week"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 1);
+
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_request.f_uri == "http://2a00:1450::1");
+        CATCH_REQUIRE(item.f_request.f_period == "week");
+        CATCH_REQUIRE_FALSE(q.pop(item));
+
+        // the unblock cancels the block whatever the spelling
+        //
+        CATCH_REQUIRE(q.push_block(request("http://2a00:1450::1"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.push_unblock(request("HTTP://2a00:1450:0:0::1"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.size() == 1);
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_unblock);
+        CATCH_REQUIRE_FALSE(q.pop(item));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: invalid requests are not queued")
+    {
+        ipwall::ingress_queue q(100);
+
+        CATCH_REQUIRE_FALSE(q.push_block(request("http://10.0.0.1"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE_FALSE(q.push_unblock(request("http://127.0.0.1"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: a full queue drops new blocks")
+    {
+        ipwall::ingress_queue q(4);
+
+        for(int idx(0); idx < 4; ++idx)
+        {
+            CATCH_REQUIRE(q.push_block(request("http://1.2.3." + std::to_string(idx + 1)), "IPWALL_BLOCK"));
+        }
+        CATCH_REQUIRE(q.size() == 4);
+        CATCH_REQUIRE_FALSE(q.push_block(request("http://1.2.3.10"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 4);
+
+        // a duplicate is merged even when the queue is full
+        //
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.1", "week"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 4);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: an unblock replaces the newest block of a full queue")
+    {
+        ipwall::ingress_queue q(4);
+
+        for(int idx(0); idx < 4; ++idx)
+        {
+            CATCH_REQUIRE(q.push_block(request("http://1.2.3." + std::to_string(idx + 1)), "IPWALL_BLOCK"));
+        }
+        CATCH_REQUIRE(q.push_unblock(request("http://5.6.7.8"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.size() == 4);
+
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_unblock);
+        CATCH_REQUIRE(item.f_request.f_uri == "http://5.6.7.8");
+        for(int idx(0); idx < 3; ++idx)
+        {
+            CATCH_REQUIRE(q.pop(item));
+            CATCH_REQUIRE(item.f_request.f_uri == "http://1.2.3." + std::to_string(idx + 1));
+        }
+        CATCH_REQUIRE_FALSE(q.pop(item));
+
+        // a queue full of unblocks drops the new unblocks
+        //
+        for(int idx(0); idx < 4; ++idx)
+        {
+            CATCH_REQUIRE(q.push_unblock(request("http://1.2.3." + std::to_string(idx + 1)), "IPWALL_UNBLOCK"));
+        }
+        CATCH_REQUIRE_FALSE(q.push_unblock(request("http://1.2.3.10"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.size() == 4);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: cancelled blocks free their room")
+    {
+        ipwall::ingress_queue q(4);
+
+        for(int idx(0); idx < 4; ++idx)
+        {
+            CATCH_REQUIRE(q.push_block(request("http://1.2.3." + std::to_string(idx + 1)), "IPWALL_BLOCK"));
+        }
+
+        // the unblock cancels the newest block so it takes its room
+        //
+        CATCH_REQUIRE(q.push_unblock(request("http://1.2.3.4"), "IPWALL_UNBLOCK"));
+        CATCH_REQUIRE(q.size() == 4);
+        CATCH_REQUIRE_FALSE(q.push_block(request("http://1.2.3.10"), "IPWALL_BLOCK"));
+
+        ipwall::ingress_item item;
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE(item.f_unblock);
+        CATCH_REQUIRE(q.size() == 3);
+        CATCH_REQUIRE(q.push_block(request("http://1.2.3.10"), "IPWALL_BLOCK"));
+        CATCH_REQUIRE(q.size() == 4);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ingress_queue: the load callback uses hysteresis")
+    {
+        ipwall::ingress_queue q(8);
+        std::vector<bool> calls;
+        q.set_load_callback([&calls](bool overloaded)
+            {
+                calls.push_back(overloaded);
+            });
+
+        // overloaded at 75% of the capacity
+        //
+        for(int idx(0); idx < 6; ++idx)
+        {
+            CATCH_REQUIRE_FALSE(q.is_overloaded());
+            CATCH_REQUIRE(q.push_block(request("http://1.2.3." + std::to_string(idx + 1)), "IPWALL_BLOCK"));
+        }
+        CATCH_REQUIRE(q.is_overloaded());
+        CATCH_REQUIRE(calls == std::vector<bool>{ true });
+
+        // back to normal at 25% of the capacity
+        //
+        ipwall::ingress_item item;
+        for(int idx(0); idx < 3; ++idx)
+        {
+            CATCH_REQUIRE(q.pop(item));
+            CATCH_REQUIRE(q.is_overloaded());
+        }
+        CATCH_REQUIRE(q.size() == 3);
+        CATCH_REQUIRE(q.pop(item));
+        CATCH_REQUIRE_FALSE(q.is_overloaded());
+        CATCH_REQUIRE(calls == std::vector<bool>{ true, false });
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,357 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <ip_parser.h>
+
+
+// C
+//
+#include    <arpa/inet.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+typedef std::array<std::uint8_t, 16>    address_t;
+
+
+/** \brief Convert an IP address with inet_pton().
+ *
+ * IPv4 addresses are returned as IPv4 mapped IPv6 addresses like
+ * parse_ip() does.
+ */
+address_t pton(std::string const & ip)
+{
+    address_t result = {};
+    if(ip.find(':') == std::string::npos)
+    {
+        result[10] = 0xFF;
+        result[11] = 0xFF;
+        CATCH_REQUIRE(inet_pton(AF_INET, ip.c_str(), result.data() + 12) == 1);
+    }
+    else
+    {
+        CATCH_REQUIRE(inet_pton(AF_INET6, ip.c_str(), result.data()) == 1);
+    }
+    return result;
+}
+
+
+bool blockable(std::string const & ip)
+{
+    address_t address;
+    CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+    return ipwall::is_blockable_ip(address);
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("ip_parser", "[ip_parser][ipwall]")
+{
+    CATCH_START_SECTION("ip_parser: IPv4 addresses")
+    {
+        for(std::string const ip : {
+                      "0.0.0.0"
+                    , "1.2.3.4"
+                    , "10.0.0.1"
+                    , "100.200.250.255"
+                    , "255.255.255.255"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+            CATCH_REQUIRE(address == pton(ip));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser: IPv6 addresses and \"::\" compression")
+    {
+        for(std::string const ip : {
+                      "::"
+                    , "::1"
+                    , "1::"
+                    , "1::8"
+                    , "1:2:3:4:5:6:7:8"
+                    , "1:2:3:4:5:6:7::"
+                    , "::2:3:4:5:6:7:8"
+                    , "1:2:3::6:7:8"
+                    , "2001:db8::1"
+                    , "fe80::1:2"
+                    , "ABCD:ef01::"
+                    , "0001:0002::000a"
+                    , "0:0:0:0:0:0:0:0"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+            CATCH_REQUIRE(address == pton(ip));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser: IPv6 addresses with an embedded IPv4 address")
+    {
+        for(std::string const ip : {
+                      "::ffff:1.2.3.4"
+                    , "::1.2.3.4"
+                    , "1:2:3:4:5:6:1.2.3.4"
+                    , "1::6:1.2.3.4"
+                    , "64:ff9b::192.0.2.33"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE(ipwall::parse_ip(ip, address));
+            CATCH_REQUIRE(address == pton(ip));
+        }
+
+        // an IPv4 mapped address is the same as the plain IPv4 address
+        //
+        address_t mapped;
+        address_t ipv4;
+        CATCH_REQUIRE(ipwall::parse_ip("::ffff:5.6.7.8", mapped));
+        CATCH_REQUIRE(ipwall::parse_ip("5.6.7.8", ipv4));
+        CATCH_REQUIRE(mapped == ipv4);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser: IPv6 addresses between square brackets")
+    {
+        address_t address;
+        CATCH_REQUIRE(ipwall::parse_ip("[::1]", address));
+        CATCH_REQUIRE(address == pton("::1"));
+        CATCH_REQUIRE(ipwall::parse_ip("[2001:db8::1]", address));
+        CATCH_REQUIRE(address == pton("2001:db8::1"));
+        CATCH_REQUIRE(ipwall::parse_ip("[::ffff:1.2.3.4]", address));
+        CATCH_REQUIRE(address == pton("::ffff:1.2.3.4"));
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("ip_parser_errors", "[ip_parser][ipwall][error]")
+{
+    CATCH_START_SECTION("ip_parser_errors: invalid IPv4 addresses")
+    {
+        for(std::string const ip : {
+                      ""
+                    , "1"
+                    , "1.2.3"
+                    , "1.2.3.4.5"
+                    , "1..3.4"
+                    , ".1.2.3"
+                    , "256.1.1.1"
+                    , "1.2.3.256"
+                    , "1234.1.1.1"
+                    , "1.2.3.4444"
+                    , "a.b.c.d"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE_FALSE(ipwall::parse_ip(ip, address));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser_errors: IPv4 addresses with leading zeroes")
+    {
+        // inet_aton() would read these as octal numbers
+        //
+        for(std::string const ip : {
+                      "01.2.3.4"
+                    , "1.02.3.4"
+                    , "1.2.3.00"
+                    , "00.0.0.0"
+                    , "1.2.3.010"
+                    , "::ffff:01.2.3.4"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE_FALSE(ipwall::parse_ip(ip, address));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser_errors: invalid \"::\" compression")
+    {
+        for(std::string const ip : {
+                      ":"
+                    , ":::"
+                    , ":1"
+                    , ":1::"
+                    , "1:"
+                    , "1::2:"
+                    , "1:::2"
+                    , "1::2::3"
+                    , "::1::"
+                    , "1:2:3:4:5:6:7"
+                    , "1:2:3:4:5:6:7:8:9"
+                    , "1:2:3:4:5:6:7:8::"
+                    , "::1:2:3:4:5:6:7:8"
+                    , "1:2:3:4::5:6:7:8"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE_FALSE(ipwall::parse_ip(ip, address));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser_errors: invalid embedded IPv4 addresses")
+    {
+        for(std::string const ip : {
+                      "1:2:3:4:5:6:7:1.2.3.4"
+                    , "1:2:3:4:5:6:7:8:1.2.3.4"
+                    , "::1.2.3"
+                    , "::1.2.3.4.5"
+                    , "::256.1.1.1"
+                    , "::1.2.3.4:1"
+                    , "::1.2.3.4::"
+                    , "1.2.3.4::"
+                    , "::a.b.c.d"
+                    , "::12345.1.1.1"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE_FALSE(ipwall::parse_ip(ip, address));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser_errors: overlong groups")
+    {
+        for(std::string const ip : {
+                      "12345::"
+                    , "::fffff"
+                    , "00000::1"
+                    , "1:2:3:4:5:6:7:00008"
+                    , "1:23456:3:4:5:6:7:8"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE_FALSE(ipwall::parse_ip(ip, address));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ip_parser_errors: trailing garbage")
+    {
+        for(std::string const ip : {
+                      "1.2.3.4 "
+                    , " 1.2.3.4"
+                    , "1.2.3.4x"
+                    , "1.2.3.4."
+                    , "1.2.3.4/24"
+                    , "1.2.3.4:80"
+                    , "::1 "
+                    , "::1%eth0"
+                    , "::1/128"
+                    , "::g"
+                    , "[::1"
+                    , "::1]"
+                    , "[::1]x"
+                    , "[::1]:80"
+                    , "[]"
+                    , "["
+                    , "[1.2.3.4]"
+                })
+        {
+            address_t address;
+            CATCH_REQUIRE_FALSE(ipwall::parse_ip(ip, address));
+        }
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("is_blockable_ip", "[ip_parser][ipwall]")
+{
+    CATCH_START_SECTION("is_blockable_ip: local and reserved networks are never blocked")
+    {
+        for(std::string const ip : {
+                      "0.0.0.0"
+                    , "10.1.2.3"
+                    , "127.0.0.1"
+                    , "172.16.0.1"
+                    , "172.31.255.255"
+                    , "192.168.1.1"
+                    , "100.64.0.1"
+                    , "100.127.255.255"
+                    , "169.254.1.1"
+                    , "192.0.2.1"
+                    , "198.51.100.1"
+                    , "203.0.113.1"
+                    , "::"
+                    , "::1"
+                    , "fc00::1"
+                    , "fd12:3456::1"
+                    , "fe80::1"
+                    , "febf::1"
+                    , "2001:db8::1"
+                })
+        {
+            CATCH_REQUIRE_FALSE(blockable(ip));
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("is_blockable_ip: public and multicast addresses can be blocked")
+    {
+        for(std::string const ip : {
+                      "1.2.3.4"
+                    , "8.8.8.8"
+                    , "172.15.255.255"
+                    , "172.32.0.1"
+                    , "100.63.255.255"
+                    , "100.128.0.1"
+                    , "192.0.3.1"
+                    , "224.0.0.1"
+                    , "::2"
+                    , "fec0::1"
+                    , "2001:db9::1"
+                    , "2a00:1450::1"
+                    , "ff02::1"
+                })
+        {
+            CATCH_REQUIRE(blockable(ip));
+        }
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,241 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+#include    <iplock/ipset_memory.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+
+CATCH_TEST_CASE("ipset_element", "[ipset]")
+{
+    CATCH_START_SECTION("ipset_element: IPv4 address")
+    {
+        iplock::ipset_element const e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        CATCH_REQUIRE(e.is_ipv4());
+        CATCH_REQUIRE(e.get_family() == iplock::ipset_family_t::IPSET_FAMILY_INET);
+        CATCH_REQUIRE(e.get_host_cidr() == 32);
+        CATCH_REQUIRE(e.to_string() == "10.0.0.1");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_element: IPv6 address")
+    {
+        iplock::ipset_element const e(addr::string_to_addr("2001:db8::1", "::", 0, "tcp"));
+        CATCH_REQUIRE_FALSE(e.is_ipv4());
+        CATCH_REQUIRE(e.get_family() == iplock::ipset_family_t::IPSET_FAMILY_INET6);
+        CATCH_REQUIRE(e.get_host_cidr() == 128);
+        CATCH_REQUIRE(e.to_string() == "2001:db8::1");
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_element: network and host CIDR")
+    {
+        iplock::ipset_element e(addr::string_to_addr("10.0.0.0", "0.0.0.0", 0, "tcp"));
+        iplock::ipset_element host(e);
+        host.f_cidr = 32;
+        CATCH_REQUIRE(e == host);
+        CATCH_REQUIRE_FALSE(e < host);
+        CATCH_REQUIRE_FALSE(host < e);
+
+        e.f_cidr = 8;
+        CATCH_REQUIRE(e.to_string() == "10.0.0.0/8");
+        CATCH_REQUIRE_FALSE(e == host);
+        CATCH_REQUIRE(e < host);
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("ipset_memory", "[ipset]")
+{
+    CATCH_START_SECTION("ipset_memory: add, test, del")
+    {
+        iplock::ipset_memory s;
+        CATCH_REQUIRE_FALSE(s.exists("unwanted_ipv4"));
+        s.create("unwanted_ipv4", iplock::ipset_options());
+        CATCH_REQUIRE(s.exists("unwanted_ipv4"));
+
+        iplock::ipset_element const e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        CATCH_REQUIRE_FALSE(s.test("unwanted_ipv4", e));
+        s.add("unwanted_ipv4", e);
+        s.add("unwanted_ipv4", e);      // like -exist, not an error
+        CATCH_REQUIRE(s.test("unwanted_ipv4", e));
+
+        iplock::ipset_header h;
+        CATCH_REQUIRE(s.header("unwanted_ipv4", h));
+        CATCH_REQUIRE(h.f_name == "unwanted_ipv4");
+        CATCH_REQUIRE(h.f_type == "hash:ip");
+        CATCH_REQUIRE(h.f_elements == 1);
+
+        s.del("unwanted_ipv4", e);
+        s.del("unwanted_ipv4", e);      // like -exist, not an error
+        CATCH_REQUIRE_FALSE(s.test("unwanted_ipv4", e));
+
+        s.destroy("unwanted_ipv4");
+        CATCH_REQUIRE_FALSE(s.header("unwanted_ipv4", h));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory: list stops when the callback returns false")
+    {
+        iplock::ipset_memory s;
+        s.create("unwanted_ipv4", iplock::ipset_options());
+        for(int idx(1); idx <= 10; ++idx)
+        {
+            s.add("unwanted_ipv4", addr::string_to_addr("10.0.0." + std::to_string(idx), "0.0.0.0", 0, "tcp"));
+        }
+
+        int count(0);
+        s.list("unwanted_ipv4", [&count](iplock::ipset_element const &)
+            {
+                ++count;
+                return true;
+            });
+        CATCH_REQUIRE(count == 10);
+
+        count = 0;
+        s.list("unwanted_ipv4", [&count](iplock::ipset_element const &)
+            {
+                ++count;
+                return count < 3;
+            });
+        CATCH_REQUIRE(count == 3);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory: apply a batch of operations")
+    {
+        iplock::ipset_memory s;
+        s.create("unwanted_ipv4", iplock::ipset_options());
+
+        iplock::ipset_element const e1(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        iplock::ipset_element const e2(addr::string_to_addr("10.0.0.2", "0.0.0.0", 0, "tcp"));
+        s.add("unwanted_ipv4", e2);
+
+        iplock::ipset_operation::vector_t const operations = {
+            { iplock::ipset_command_t::IPSET_COMMAND_ADD, "unwanted_ipv4", e1 },
+            { iplock::ipset_command_t::IPSET_COMMAND_ADD, "unknown", e1 },
+            { iplock::ipset_command_t::IPSET_COMMAND_DEL, "unwanted_ipv4", e2 },
+        };
+        CATCH_REQUIRE(s.apply(operations) == 1);
+        CATCH_REQUIRE(s.test("unwanted_ipv4", e1));
+        CATCH_REQUIRE_FALSE(s.test("unwanted_ipv4", e2));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory: element timeouts")
+    {
+        iplock::ipset_memory s;
+        iplock::ipset_options options;
+        options.f_with_timeout = true;
+        s.create("unwanted_ipv4", options);
+
+        iplock::ipset_element e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        e.f_timeout = 60;
+        s.add("unwanted_ipv4", e);
+        e.f_timeout = 3600;
+        s.add("unwanted_ipv4", e);      // like -exist, the timeout gets updated
+
+        std::uint32_t timeout(0);
+        s.list("unwanted_ipv4", [&timeout](iplock::ipset_element const & element)
+            {
+                timeout = element.f_timeout;
+                return true;
+            });
+        CATCH_REQUIRE(timeout == 3600);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory: swap")
+    {
+        iplock::ipset_memory s;
+        s.create("unwanted_ipv4", iplock::ipset_options());
+        s.create("unwanted_ipv4_tmp", iplock::ipset_options());
+
+        iplock::ipset_element const e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        s.add("unwanted_ipv4_tmp", e);
+        s.swap("unwanted_ipv4", "unwanted_ipv4_tmp");
+        CATCH_REQUIRE(s.test("unwanted_ipv4", e));
+        CATCH_REQUIRE_FALSE(s.test("unwanted_ipv4_tmp", e));
+    }
+    CATCH_END_SECTION()
+}
+
+
+CATCH_TEST_CASE("ipset_memory_errors", "[ipset][error]")
+{
+    CATCH_START_SECTION("ipset_memory_errors: unknown set")
+    {
+        iplock::ipset_memory s;
+        iplock::ipset_element const e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        CATCH_REQUIRE_THROWS_AS(s.add("unknown", e), iplock::ipset_error);
+        CATCH_REQUIRE_THROWS_AS(s.flush("unknown"), iplock::ipset_error);
+        CATCH_REQUIRE_THROWS_AS(s.destroy("unknown"), iplock::ipset_error);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory_errors: wrong family")
+    {
+        iplock::ipset_memory s;
+        s.create("unwanted_ipv4", iplock::ipset_options());
+        iplock::ipset_element const e(addr::string_to_addr("2001:db8::1", "::", 0, "tcp"));
+        CATCH_REQUIRE_THROWS_AS(s.add("unwanted_ipv4", e), iplock::ipset_error);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory_errors: timeout without timeout support")
+    {
+        iplock::ipset_memory s;
+        s.create("unwanted_ipv4", iplock::ipset_options());
+        iplock::ipset_element e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        e.f_timeout = 60;
+        CATCH_REQUIRE_THROWS_AS(s.add("unwanted_ipv4", e), iplock::ipset_error);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_memory_errors: create with a different type")
+    {
+        iplock::ipset_memory s;
+        s.create("unwanted_ipv4", iplock::ipset_options());
+        iplock::ipset_options options;
+        options.f_type = "hash:net";
+        CATCH_REQUIRE_THROWS_AS(s.create("unwanted_ipv4", options), iplock::ipset_error);
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,208 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <ipset_queue.h>
+
+
+// iplock
+//
+#include    <iplock/ipset_memory.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+std::uint32_t get_timeout(iplock::ipset & s, std::string const & set_name, iplock::ipset_element const & e)
+{
+    std::uint32_t timeout(0);
+    s.list(set_name, [&timeout, &e](iplock::ipset_element const & element)
+        {
+            if(element == e)
+            {
+                timeout = element.f_timeout;
+                return false;
+            }
+            return true;
+        });
+    return timeout;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("ipset_queue", "[ipset][ipwall]")
+{
+    CATCH_START_SECTION("ipset_queue: operations are coalesced")
+    {
+        iplock::ipset_memory::pointer_t s(std::make_shared<iplock::ipset_memory>());
+        s->create("unwanted_ipv4", iplock::ipset_options());
+        ipwall::ipset_queue q(s);
+
+        iplock::ipset_element const e1(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        iplock::ipset_element const e2(addr::string_to_addr("10.0.0.2", "0.0.0.0", 0, "tcp"));
+        q.add("unwanted_ipv4", e1);
+        q.add("unwanted_ipv4", e1);
+        q.add("unwanted_ipv4", e2);
+        q.del("unwanted_ipv4", e2);
+        CATCH_REQUIRE(q.pending() == 2);
+        CATCH_REQUIRE_FALSE(s->test("unwanted_ipv4", e1));
+
+        CATCH_REQUIRE(q.commit() == 2);
+        CATCH_REQUIRE(q.pending() == 0);
+        CATCH_REQUIRE(s->test("unwanted_ipv4", e1));
+        CATCH_REQUIRE_FALSE(s->test("unwanted_ipv4", e2));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_queue: the last timeout wins")
+    {
+        iplock::ipset_memory::pointer_t s(std::make_shared<iplock::ipset_memory>());
+        iplock::ipset_options options;
+        options.f_with_timeout = true;
+        s->create("unwanted_ipv4", options);
+        ipwall::ipset_queue q(s);
+
+        // a block extended within the same batch window
+        //
+        iplock::ipset_element e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        e.f_timeout = 60;
+        q.add("unwanted_ipv4", e);
+        e.f_timeout = 3600;
+        q.add("unwanted_ipv4", e);
+        q.commit();
+        CATCH_REQUIRE(get_timeout(*s, "unwanted_ipv4", e) == 3600);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_queue: unblock then block again keeps the new timeout")
+    {
+        iplock::ipset_memory::pointer_t s(std::make_shared<iplock::ipset_memory>());
+        iplock::ipset_options options;
+        options.f_with_timeout = true;
+        s->create("unwanted_ipv4", options);
+        ipwall::ipset_queue q(s);
+
+        // the del is queued first so the key holds an element without
+        // timeout; the add must not reuse it (0 means permanent)
+        //
+        iplock::ipset_element e(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        q.del("unwanted_ipv4", e);
+        e.f_timeout = 300;
+        q.add("unwanted_ipv4", e);
+        CATCH_REQUIRE(q.pending() == 1);
+        q.commit();
+        CATCH_REQUIRE(s->test("unwanted_ipv4", e));
+        CATCH_REQUIRE(get_timeout(*s, "unwanted_ipv4", e) == 300);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_queue: commit once the maximum is reached")
+    {
+        iplock::ipset_memory::pointer_t s(std::make_shared<iplock::ipset_memory>());
+        s->create("unwanted_ipv4", iplock::ipset_options());
+        ipwall::ipset_queue q(s);
+        q.set_max_operations(3);
+
+        std::size_t committed(0);
+        q.set_commit_callback([&committed](std::size_t operations, std::size_t errors)
+            {
+                CATCH_REQUIRE(errors == 0);
+                committed += operations;
+            });
+
+        for(int idx(1); idx <= 3; ++idx)
+        {
+            q.add("unwanted_ipv4", addr::string_to_addr("10.0.0." + std::to_string(idx), "0.0.0.0", 0, "tcp"));
+        }
+        CATCH_REQUIRE(q.pending() == 0);
+        CATCH_REQUIRE(committed == 3);
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("ipset_queue: list_sets() and run() commit first")
+    {
+        iplock::ipset_memory::pointer_t s(std::make_shared<iplock::ipset_memory>());
+        s->create("unwanted_ipv4", iplock::ipset_options());
+        ipwall::ipset_queue q(s);
+
+        iplock::ipset_element const e1(addr::string_to_addr("10.0.0.1", "0.0.0.0", 0, "tcp"));
+        q.add("unwanted_ipv4", e1);
+
+        // without a worker, the callback is called immediately
+        //
+        bool listed(false);
+        q.list_sets({ "unwanted_ipv4", "unknown_ipv4" }, [&listed, &e1](ipwall::kernel_listing::vector_t & listings)
+            {
+                listed = true;
+                CATCH_REQUIRE(listings.size() == 2);
+                CATCH_REQUIRE(listings[0].f_set_name == "unwanted_ipv4");
+                CATCH_REQUIRE(listings[0].f_exists);
+                CATCH_REQUIRE(listings[0].f_error_message.empty());
+                CATCH_REQUIRE(listings[0].f_elements.size() == 1);
+                CATCH_REQUIRE(listings[0].f_elements[0] == e1);
+                CATCH_REQUIRE(listings[1].f_set_name == "unknown_ipv4");
+                CATCH_REQUIRE_FALSE(listings[1].f_exists);
+                CATCH_REQUIRE(listings[1].f_elements.empty());
+            });
+        CATCH_REQUIRE(listed);
+        CATCH_REQUIRE(q.pending() == 0);
+
+        iplock::ipset_element const e2(addr::string_to_addr("10.0.0.2", "0.0.0.0", 0, "tcp"));
+        q.add("unwanted_ipv4", e2);
+        bool ran(false);
+        q.run([&ran, &s, &e2]()
+            {
+                ran = true;
+                CATCH_REQUIRE(s->test("unwanted_ipv4", e2));
+            });
+        CATCH_REQUIRE(ran);
+        CATCH_REQUIRE(q.pending() == 0);
+
+        // an empty job does nothing
+        //
+        q.run(ipwall::job_t());
+    }
+    CATCH_END_SECTION()
+}
+
+
+
+// vim: ts=4 sw=4 et
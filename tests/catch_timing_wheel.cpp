@@ -0,0 +1,274 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "catch_main.h"
+
+
+// ipwall
+//
+#include    <timing_wheel.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+// the wheel only keeps pointers, it never dereferences them
+//
+ipwall::block_key const * const     g_a(reinterpret_cast<ipwall::block_key const *>(0x1000));
+ipwall::block_key const * const     g_b(reinterpret_cast<ipwall::block_key const *>(0x2000));
+ipwall::block_key const * const     g_c(reinterpret_cast<ipwall::block_key const *>(0x3000));
+
+snapdev::timespec_ex const          g_start(1'700'000'000, 0);
+
+
+/** \brief Advance the wheel one second at a time until \p value is due.
+ *
+ * \return The number of seconds from g_start to the tick when \p value
+ * was returned or -1 if it was not returned within \p max seconds.
+ */
+std::int64_t due_after(
+      ipwall::timing_wheel & wheel
+    , ipwall::timing_wheel::value_t value
+    , std::int64_t max)
+{
+    for(std::int64_t s(0); s <= max; ++s)
+    {
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(s, 0), due);
+        if(std::find(due.begin(), due.end(), value) != due.end())
+        {
+            return s;
+        }
+    }
+    return -1;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("timing_wheel", "[timing_wheel][ipwall]")
+{
+    CATCH_START_SECTION("timing_wheel: empty wheel")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        CATCH_REQUIRE(wheel.empty());
+        CATCH_REQUIRE(wheel.size() == 0);
+        CATCH_REQUIRE(wheel.next_tick() == snapdev::timespec_ex());
+
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(100, 0), due);
+        CATCH_REQUIRE(due.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: entries are due on the tick following their limit")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        wheel.insert(g_a, g_start + snapdev::timespec_ex(5, 0));
+        wheel.insert(g_b, g_start + snapdev::timespec_ex(5, 500'000'000));
+        CATCH_REQUIRE(wheel.size() == 2);
+        CATCH_REQUIRE(wheel.next_tick() == g_start + snapdev::timespec_ex(6, 0));
+
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(5, 999'999'999), due);
+        CATCH_REQUIRE(due.empty());
+        CATCH_REQUIRE(wheel.size() == 2);
+
+        wheel.advance(g_start + snapdev::timespec_ex(6, 0), due);
+        CATCH_REQUIRE(due.size() == 2);
+        CATCH_REQUIRE(std::find(due.begin(), due.end(), g_a) != due.end());
+        CATCH_REQUIRE(std::find(due.begin(), due.end(), g_b) != due.end());
+        CATCH_REQUIRE(wheel.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: entries in the past are due on the next advance")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        wheel.insert(g_a, g_start - snapdev::timespec_ex(10, 0));
+        CATCH_REQUIRE(wheel.size() == 1);
+        CATCH_REQUIRE(wheel.next_tick() == g_start);
+
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start, due);
+        CATCH_REQUIRE(due.size() == 1);
+        CATCH_REQUIRE(due[0] == g_a);
+        CATCH_REQUIRE(wheel.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: erased entries are never returned")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        ipwall::timing_wheel::handle_t a(wheel.insert(g_a, g_start + snapdev::timespec_ex(3, 0)));
+        ipwall::timing_wheel::handle_t b(wheel.insert(g_b, g_start + snapdev::timespec_ex(3, 0)));
+        CATCH_REQUIRE(a.is_valid());
+        CATCH_REQUIRE(b.is_valid());
+
+        wheel.erase(a);
+        CATCH_REQUIRE_FALSE(a.is_valid());
+        CATCH_REQUIRE(wheel.size() == 1);
+
+        // erasing twice does nothing
+        //
+        wheel.erase(a);
+        CATCH_REQUIRE(wheel.size() == 1);
+
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(10, 0), due);
+        CATCH_REQUIRE(due.size() == 1);
+        CATCH_REQUIRE(due[0] == g_b);
+        CATCH_REQUIRE(wheel.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: entries cascade from the higher levels on time")
+    {
+        // one entry per level: seconds, minutes, hours, days
+        //
+        for(std::int64_t const limit : {
+                      static_cast<std::int64_t>(59)
+                    , static_cast<std::int64_t>(61)
+                    , static_cast<std::int64_t>(3599)
+                    , static_cast<std::int64_t>(3661)
+                    , static_cast<std::int64_t>(86399)
+                    , static_cast<std::int64_t>(90061)
+                    , static_cast<std::int64_t>(2 * 86400 + 7)
+                })
+        {
+            ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+            wheel.insert(g_a, g_start + snapdev::timespec_ex(limit, 0));
+            CATCH_REQUIRE(due_after(wheel, g_a, limit + 2) == limit + 1);
+            CATCH_REQUIRE(wheel.empty());
+        }
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: next_tick() never skips a due entry")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        wheel.insert(g_a, g_start + snapdev::timespec_ex(30, 0));
+        wheel.insert(g_b, g_start + snapdev::timespec_ex(2 * 60 * 60 + 30, 0));
+        wheel.insert(g_c, g_start + snapdev::timespec_ex(3 * 24 * 60 * 60, 0));
+
+        // jump from one next_tick() to the next like the server does
+        //
+        std::vector<std::pair<ipwall::timing_wheel::value_t, snapdev::timespec_ex>> results;
+        for(int count(0); count < 1000 && !wheel.empty(); ++count)
+        {
+            snapdev::timespec_ex const next(wheel.next_tick());
+            CATCH_REQUIRE(next != snapdev::timespec_ex());
+            ipwall::timing_wheel::value_vector_t due;
+            wheel.advance(next, due);
+            for(auto const & v : due)
+            {
+                results.emplace_back(v, next);
+            }
+        }
+        CATCH_REQUIRE(wheel.empty());
+        CATCH_REQUIRE(results.size() == 3);
+        CATCH_REQUIRE(results[0].first == g_a);
+        CATCH_REQUIRE(results[0].second == g_start + snapdev::timespec_ex(31, 0));
+        CATCH_REQUIRE(results[1].first == g_b);
+        CATCH_REQUIRE(results[1].second == g_start + snapdev::timespec_ex(2 * 60 * 60 + 31, 0));
+        CATCH_REQUIRE(results[2].first == g_c);
+        CATCH_REQUIRE(results[2].second == g_start + snapdev::timespec_ex(3 * 24 * 60 * 60 + 1, 0));
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: a large jump returns all the due entries at once")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        wheel.insert(g_a, g_start + snapdev::timespec_ex(10, 0));
+        wheel.insert(g_b, g_start + snapdev::timespec_ex(5 * 24 * 60 * 60, 0));
+        wheel.insert(g_c, g_start + snapdev::timespec_ex(20 * 24 * 60 * 60, 0));
+
+        // i.e. the computer was suspended for 10 days
+        //
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(10 * 24 * 60 * 60, 0), due);
+        CATCH_REQUIRE(due.size() == 2);
+        CATCH_REQUIRE(std::find(due.begin(), due.end(), g_a) != due.end());
+        CATCH_REQUIRE(std::find(due.begin(), due.end(), g_b) != due.end());
+        CATCH_REQUIRE(wheel.size() == 1);
+
+        due.clear();
+        wheel.advance(g_start + snapdev::timespec_ex(20 * 24 * 60 * 60, 0), due);
+        CATCH_REQUIRE(due.empty());
+        wheel.advance(g_start + snapdev::timespec_ex(20 * 24 * 60 * 60 + 1, 0), due);
+        CATCH_REQUIRE(due.size() == 1);
+        CATCH_REQUIRE(due[0] == g_c);
+        CATCH_REQUIRE(wheel.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: blocks longer than the last level")
+    {
+        // "forever" is 5 years, make sure even longer blocks time out
+        //
+        std::int64_t const limit(6 * 366 * 24 * 60 * 60);
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(1, 0), g_start);
+        wheel.insert(g_a, g_start + snapdev::timespec_ex(limit, 0));
+
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(limit, 0), due);
+        CATCH_REQUIRE(due.empty());
+        CATCH_REQUIRE(wheel.size() == 1);
+
+        wheel.advance(g_start + snapdev::timespec_ex(limit + 1, 0), due);
+        CATCH_REQUIRE(due.size() == 1);
+        CATCH_REQUIRE(wheel.empty());
+    }
+    CATCH_END_SECTION()
+
+    CATCH_START_SECTION("timing_wheel: a coarse precision groups the entries")
+    {
+        ipwall::timing_wheel wheel(snapdev::timespec_ex(10, 0), g_start);
+        wheel.insert(g_a, g_start + snapdev::timespec_ex(11, 0));
+        wheel.insert(g_b, g_start + snapdev::timespec_ex(19, 0));
+        CATCH_REQUIRE(wheel.next_tick() == g_start + snapdev::timespec_ex(20, 0));
+
+        ipwall::timing_wheel::value_vector_t due;
+        wheel.advance(g_start + snapdev::timespec_ex(19, 999'999'999), due);
+        CATCH_REQUIRE(due.empty());
+        wheel.advance(g_start + snapdev::timespec_ex(20, 0), due);
+        CATCH_REQUIRE(due.size() == 2);
+    }
+    CATCH_END_SECTION()
+}
+
+
+// vim: ts=4 sw=4 et
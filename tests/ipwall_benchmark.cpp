@@ -0,0 +1,522 @@
+// Copyright (c) 2022-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Measure the throughput of the ipwall pipeline.
+ *
+ * This tool replays synthetic IPWALL_BLOCK and IPWALL_UNBLOCK streams
+ * through the same objects the ipwall server wires together: the
+ * ingress queue, the block store, the network aggregator, and the
+ * ipset queue. The kernel is replaced by the in memory ipset client
+ * so the numbers do not depend on the kernel or the permissions of
+ * the user running the benchmark.
+ *
+ * The scenarios are:
+ *
+ * \li zipf -- blocks of IP addresses following a Zipf distribution (a
+ * few addresses are reported very often) with 5% of unblocks;
+ * \li expiry -- all the blocks time out on the same tick;
+ * \li upgrade -- blocks of IP addresses already blocked with the "http"
+ * scheme get upgraded to the "all" scheme (see block_info::keep_longest()).
+ *
+ * For each scenario, the tool reports the number of messages per second,
+ * the 50th, 99th and 99.9th percentiles of the apply latency (the time
+ * between the reception of a message and the end of the kernel
+ * transaction including it), and the resident memory.
+ */
+
+// ipwall
+//
+#include    "block_store.h"
+#include    "ingress_queue.h"
+#include    "ipset_queue.h"
+#include    "net_aggregator.h"
+#include    "stats.h"
+
+
+// iplock
+//
+#include    <iplock/allowlist.h>
+#include    <iplock/ipset_memory.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <cmath>
+#include    <fstream>
+#include    <iomanip>
+#include    <iostream>
+#include    <random>
+#include    <sstream>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace
+{
+
+
+
+struct options_t
+{
+    std::size_t         f_messages = 1'000'000;
+    std::size_t         f_ips = 100'000;
+    std::size_t         f_slice = 1'000;
+    double              f_zipf = 1.1;
+    std::uint32_t       f_seed = 1;
+    std::string         f_scenario = std::string();
+};
+
+
+struct result_t
+{
+    std::string         f_scenario = std::string();
+    std::size_t         f_messages = 0;
+    double              f_seconds = 0.0;
+    std::vector<double> f_latencies = std::vector<double>();     // in microseconds
+};
+
+
+/** \brief The pipeline of ipwall, without the messenger and timers.
+ *
+ * The objects are created the same way as in ipwall's server
+ * constructor.
+ */
+class pipeline
+{
+public:
+    pipeline(std::size_t slice)
+        : f_memory(std::make_shared<iplock::ipset_memory>())
+        , f_queue(std::make_shared<ipwall::ipset_queue>(f_memory))
+        , f_aggregator(std::make_shared<ipwall::net_aggregator>(f_queue, std::make_shared<iplock::allowlist>()))
+        , f_blocks(f_aggregator)
+        , f_ingress(std::max(static_cast<std::size_t>(100'000), slice * 2))
+    {
+        for(auto const & name : ipwall::block_info::get_set_names())
+        {
+            bool const ipv6(name.length() > 5 && name.substr(name.length() - 5) == "_ipv6");
+            iplock::ipset_options options;
+            options.f_family = ipv6
+                        ? iplock::ipset_family_t::IPSET_FAMILY_INET6
+                        : iplock::ipset_family_t::IPSET_FAMILY_INET;
+            f_memory->create(name, options);
+
+            options.f_type = "hash:net";
+            f_memory->create(name.substr(0, name.length() - 5) + "_net" + name.substr(name.length() - 5), options);
+        }
+
+        f_queue->set_max_operations(1000);
+        f_aggregator->set_threshold(16);
+        f_aggregator->set_window(snapdev::timespec_ex(24 * 60 * 60, 0));
+        f_aggregator->set_prefixes(24, 64);
+        f_aggregator->set_stats(&f_stats);
+        f_aggregator->setup(ipwall::block_info::get_set_names());
+        f_blocks.set_stats(&f_stats);
+        f_ingress.set_stats(&f_stats);
+    }
+
+    void push(iplock::block_request const & request, bool unblock)
+    {
+        if(unblock)
+        {
+            f_ingress.push_unblock(request, "IPWALL_UNBLOCK");
+        }
+        else
+        {
+            f_ingress.push_block(request, "IPWALL_BLOCK");
+        }
+    }
+
+    /** \brief Apply the queued requests like server::apply_ingress().
+     */
+    void apply()
+    {
+        ipwall::ingress_item item;
+        while(f_ingress.pop(item))
+        {
+            try
+            {
+                ipwall::block_info info(item.f_request.f_uri);
+                if(item.f_unblock)
+                {
+                    f_aggregator->release(info.get_address());
+                    f_blocks.unblock(info);
+                }
+                else
+                {
+                    info.set_block_limit(item.f_request.f_period);
+                    info.set_ban_count(1);
+                    f_blocks.block(info);
+                }
+            }
+            catch(std::exception const & e)
+            {
+                std::cerr << "error: " << e.what() << "\n";
+            }
+        }
+        f_queue->commit();
+    }
+
+    ipwall::block_store & get_blocks()
+    {
+        return f_blocks;
+    }
+
+    ipwall::ipset_queue & get_queue()
+    {
+        return *f_queue;
+    }
+
+private:
+    iplock::ipset_memory::pointer_t     f_memory;
+    ipwall::ipset_queue::pointer_t      f_queue;
+    ipwall::net_aggregator::pointer_t   f_aggregator;
+    ipwall::block_store                 f_blocks;
+    ipwall::ingress_queue               f_ingress;
+    ipwall::stats                       f_stats = ipwall::stats();
+};
+
+
+std::string get_ip(std::size_t rank)
+{
+    // 1 in 10 addresses is an IPv6 address; the consecutive ranks land
+    // in the same networks so the aggregator gets exercised too
+    //
+    // (ipwall refuses to block private and documentation addresses so
+    // we use public ranges; the kernel is never involved)
+    //
+    if(rank % 10 == 9)
+    {
+        std::stringstream ss;
+        ss << "[2a0b:4e00:" << std::hex << (rank >> 16) << "::" << (rank & 0xFFFF) << "]";
+        return ss.str();
+    }
+    std::uint32_t const ip(0x2C000000 + static_cast<std::uint32_t>(rank));
+    return std::to_string((ip >> 24) & 255)
+         + '.' + std::to_string((ip >> 16) & 255)
+         + '.' + std::to_string((ip >> 8) & 255)
+         + '.' + std::to_string(ip & 255);
+}
+
+
+double elapsed_us(snapdev::timespec_ex const & start, snapdev::timespec_ex const & end)
+{
+    return static_cast<double>((end - start).to_usec());
+}
+
+
+double elapsed_sec(snapdev::timespec_ex const & start, snapdev::timespec_ex const & end)
+{
+    return elapsed_us(start, end) / 1'000'000.0;
+}
+
+
+/** \brief Replay a stream of requests in slices.
+ *
+ * Each slice is pushed in the ingress queue, applied, and committed
+ * like ipwall does between two iterations of its event loop. The
+ * latency of a request is the time between its push and the end of
+ * the commit.
+ */
+void replay(
+      pipeline & p
+    , std::vector<std::pair<iplock::block_request, bool>> const & requests
+    , std::size_t slice
+    , result_t & result)
+{
+    std::vector<snapdev::timespec_ex> pushed;
+    pushed.reserve(slice);
+    result.f_latencies.reserve(result.f_latencies.size() + requests.size());
+
+    snapdev::timespec_ex const start(snapdev::timespec_ex::gettime());
+    for(std::size_t idx(0); idx < requests.size(); idx += slice)
+    {
+        pushed.clear();
+        std::size_t const max(std::min(requests.size(), idx + slice));
+        for(std::size_t j(idx); j < max; ++j)
+        {
+            pushed.push_back(snapdev::timespec_ex::gettime());
+            p.push(requests[j].first, requests[j].second);
+        }
+        p.apply();
+        snapdev::timespec_ex const done(snapdev::timespec_ex::gettime());
+        for(auto const & t : pushed)
+        {
+            result.f_latencies.push_back(elapsed_us(t, done));
+        }
+    }
+    result.f_seconds += elapsed_sec(start, snapdev::timespec_ex::gettime());
+    result.f_messages += requests.size();
+}
+
+
+result_t run_zipf(options_t const & opts)
+{
+    // the cumulative distribution of the ranks
+    //
+    std::vector<double> cdf(opts.f_ips);
+    double sum(0.0);
+    for(std::size_t rank(0); rank < opts.f_ips; ++rank)
+    {
+        sum += 1.0 / std::pow(static_cast<double>(rank + 1), opts.f_zipf);
+        cdf[rank] = sum;
+    }
+
+    std::mt19937_64 random(opts.f_seed);
+    std::uniform_real_distribution<double> uniform(0.0, sum);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::vector<std::pair<iplock::block_request, bool>> requests;
+    requests.reserve(opts.f_messages);
+    for(std::size_t idx(0); idx < opts.f_messages; ++idx)
+    {
+        std::size_t const rank(std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin());
+        iplock::block_request r;
+        r.f_uri = "http://" + get_ip(std::min(rank, opts.f_ips - 1));
+        r.f_period = "day";
+        requests.emplace_back(r, percent(random) < 5);
+    }
+
+    pipeline p(opts.f_slice);
+    result_t result;
+    result.f_scenario = "zipf";
+    replay(p, requests, opts.f_slice, result);
+    return result;
+}
+
+
+result_t run_expiry(options_t const & opts)
+{
+    std::vector<std::pair<iplock::block_request, bool>> requests;
+    requests.reserve(opts.f_ips);
+    for(std::size_t rank(0); rank < opts.f_ips; ++rank)
+    {
+        iplock::block_request r;
+        r.f_uri = "http://" + get_ip(rank);
+        r.f_period = "hour";
+        requests.emplace_back(r, false);
+    }
+
+    pipeline p(opts.f_slice);
+    result_t ignore;
+    replay(p, requests, opts.f_slice, ignore);
+
+    // all the blocks time out on the same tick; the latency is the
+    // time it takes to remove them from the store and the kernel
+    //
+    result_t result;
+    result.f_scenario = "expiry";
+    snapdev::timespec_ex const later(snapdev::timespec_ex::gettime() + snapdev::timespec_ex(2 * 60 * 60, 0));
+    snapdev::timespec_ex const start(snapdev::timespec_ex::gettime());
+    std::size_t const count(p.get_blocks().expire(later));
+    p.get_queue().commit();
+    snapdev::timespec_ex const done(snapdev::timespec_ex::gettime());
+    result.f_seconds = elapsed_sec(start, done);
+    result.f_messages = count;
+    result.f_latencies.assign(count, elapsed_us(start, done));
+    return result;
+}
+
+
+result_t run_upgrade(options_t const & opts)
+{
+    std::vector<std::pair<iplock::block_request, bool>> http;
+    std::vector<std::pair<iplock::block_request, bool>> all;
+    http.reserve(opts.f_ips);
+    all.reserve(opts.f_ips);
+    for(std::size_t rank(0); rank < opts.f_ips; ++rank)
+    {
+        iplock::block_request r;
+        r.f_uri = "http://" + get_ip(rank);
+        r.f_period = "day";
+        http.emplace_back(r, false);
+
+        r.f_uri = "all://" + get_ip(rank);
+        r.f_period = "week";
+        all.emplace_back(r, false);
+    }
+
+    pipeline p(opts.f_slice);
+    result_t ignore;
+    replay(p, http, opts.f_slice, ignore);
+
+    result_t result;
+    result.f_scenario = "upgrade";
+    replay(p, all, opts.f_slice, result);
+    return result;
+}
+
+
+std::string get_memory(std::string const & field)
+{
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.compare(0, field.length() + 1, field + ":") == 0)
+        {
+            std::string value(line.substr(field.length() + 1));
+            value.erase(0, value.find_first_not_of(" \t"));
+            return value;
+        }
+    }
+    return "?";
+}
+
+
+double percentile(std::vector<double> & latencies, double p)
+{
+    if(latencies.empty())
+    {
+        return 0.0;
+    }
+    std::size_t const idx(std::min(
+              latencies.size() - 1
+            , static_cast<std::size_t>(p * static_cast<double>(latencies.size()))));
+    std::nth_element(latencies.begin(), latencies.begin() + idx, latencies.end());
+    return latencies[idx];
+}
+
+
+void report(result_t & result)
+{
+    std::cout
+        << std::left << std::setw(10) << result.f_scenario
+        << std::right << std::fixed << std::setprecision(0)
+        << std::setw(12) << result.f_messages
+        << std::setw(14) << (result.f_seconds > 0.0 ? static_cast<double>(result.f_messages) / result.f_seconds : 0.0)
+        << std::setprecision(1)
+        << std::setw(12) << percentile(result.f_latencies, 0.50)
+        << std::setw(12) << percentile(result.f_latencies, 0.99)
+        << std::setw(12) << percentile(result.f_latencies, 0.999)
+        << std::setw(14) << get_memory("VmRSS")
+        << "\n";
+}
+
+
+void usage()
+{
+    std::cout << "Usage: ipwall-benchmark [--messages <count>] [--ips <count>] [--slice <count>]\n"
+                 "                        [--zipf <exponent>] [--seed <number>] [zipf|expiry|upgrade]\n";
+}
+
+
+
+} // no name namespace
+
+
+
+int main(int argc, char * argv[])
+{
+    options_t opts;
+    for(int idx(1); idx < argc; ++idx)
+    {
+        std::string const arg(argv[idx]);
+        if(arg == "-h" || arg == "--help")
+        {
+            usage();
+            return 0;
+        }
+        if(arg.compare(0, 2, "--") == 0)
+        {
+            if(idx + 1 >= argc)
+            {
+                std::cerr << "error: " << arg << " expects a value.\n";
+                return 1;
+            }
+            std::string const value(argv[++idx]);
+            if(arg == "--messages")
+            {
+                opts.f_messages = std::stoul(value);
+            }
+            else if(arg == "--ips")
+            {
+                opts.f_ips = std::max(1UL, std::stoul(value));
+            }
+            else if(arg == "--slice")
+            {
+                opts.f_slice = std::max(1UL, std::stoul(value));
+            }
+            else if(arg == "--zipf")
+            {
+                opts.f_zipf = std::stod(value);
+            }
+            else if(arg == "--seed")
+            {
+                opts.f_seed = std::stoul(value);
+            }
+            else
+            {
+                std::cerr << "error: unknown option \"" << arg << "\".\n";
+                usage();
+                return 1;
+            }
+            continue;
+        }
+        opts.f_scenario = arg;
+    }
+
+    std::cout
+        << std::left << std::setw(10) << "scenario"
+        << std::right
+        << std::setw(12) << "messages"
+        << std::setw(14) << "messages/s"
+        << std::setw(12) << "p50 (us)"
+        << std::setw(12) << "p99 (us)"
+        << std::setw(12) << "p999 (us)"
+        << std::setw(14) << "RSS"
+        << "\n";
+
+    struct scenario_t
+    {
+        char const *    f_name = nullptr;
+        result_t        (*f_run)(options_t const & opts) = nullptr;
+    };
+    scenario_t const scenarios[] =
+    {
+        { "zipf", run_zipf },
+        { "expiry", run_expiry },
+        { "upgrade", run_upgrade },
+    };
+    bool found(false);
+    for(auto const & s : scenarios)
+    {
+        if(opts.f_scenario.empty()
+        || opts.f_scenario == s.f_name)
+        {
+            result_t result(s.f_run(opts));
+            report(result);
+            found = true;
+        }
+    }
+    if(!found)
+    {
+        std::cerr << "error: unknown scenario \"" << opts.f_scenario << "\".\n";
+        return 1;
+    }
+
+    std::cout << "peak RSS: " << get_memory("VmHWM") << "\n";
+
+    return 0;
+}
+
+// vim: ts=4 sw=4 et
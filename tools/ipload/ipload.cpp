@@ -1998,6 +1998,7 @@ bool ipload::create_sets()
                 for(auto const & r : rules)
                 {
                     std::string const & type(r->get_set_type());
+                    std::string const & options(r->get_set_options());
                     advgetopt::string_list_t const & data(r->get_set_data());
                     bool const set_has_ip(r->set_has_ip());
                     advgetopt::string_list_t const & sets(r->get_set());
@@ -2018,12 +2019,17 @@ bool ipload::create_sets()
                                         << SNAP_LOG_SEND;
                                     return false;
                                 }
-                                std::string const cmd_ipv4(snapdev::string_replace_many(
+                                std::string cmd_ipv4(snapdev::string_replace_many(
                                           f_create_set_ipv4
                                         , {
                                             { "[name]", name + "_ipv4" },
                                             { "[type]", type },
                                           }));
+                                if(!options.empty())
+                                {
+                                    cmd_ipv4 += ' ';
+                                    cmd_ipv4 += options;
+                                }
                                 int const exit_code_v4(system(cmd_ipv4.c_str()));
                                 if(exit_code_v4 != 0)
                                 {
@@ -2053,12 +2059,17 @@ bool ipload::create_sets()
                                         << SNAP_LOG_SEND;
                                     return false;
                                 }
-                                std::string const cmd_ipv6(snapdev::string_replace_many(
+                                std::string cmd_ipv6(snapdev::string_replace_many(
                                           f_create_set_ipv6
                                         , {
                                             { "[name]", name + "_ipv6" },
                                             { "[type]", type },
                                           }));
+                                if(!options.empty())
+                                {
+                                    cmd_ipv6 += ' ';
+                                    cmd_ipv6 += options;
+                                }
                                 int const exit_code_v6(system(cmd_ipv6.c_str()));
                                 if(exit_code_v6 != 0)
                                 {
@@ -2128,6 +2139,11 @@ bool ipload::create_sets()
                                               + '-'
                                               + std::to_string(max_port);
                                 }
+                                if(!options.empty())
+                                {
+                                    cmd += ' ';
+                                    cmd += options;
+                                }
                                 int const exit_code(system(cmd.c_str()));
                                 if(exit_code != 0)
                                 {
@@ -2298,7 +2314,7 @@ bool ipload::create_sets()
                                 }
                                 if(is_ipv4)
                                 {
-                                    std::string const cmd_ipv4(snapdev::string_replace_many(
+                                    std::string cmd_ipv4(snapdev::string_replace_many(
                                               f_add_to_set_ipv4
                                             , {
                                                 { "[name]", name + "_ipv4" },
@@ -2349,7 +2365,7 @@ bool ipload::create_sets()
                                             << SNAP_LOG_SEND;
                                         return false;
                                     }
-                                    std::string const cmd_ipv6(snapdev::string_replace_many(
+                                    std::string cmd_ipv6(snapdev::string_replace_many(
                                               f_add_to_set_ipv6
                                             , {
                                                 { "[name]", name + "_ipv6" },
@@ -746,6 +746,10 @@ rule::rule(
             {
                 load_file(value, f_set_data);
             }
+            else if(param_name == "set-options")
+            {
+                f_set_options = value;
+            }
             else if(param_name == "set-type")
             {
                 std::string::size_type colon(value.find(':'));
@@ -2042,6 +2046,12 @@ std::string const & rule::get_set_type() const
 }
 
 
+std::string const & rule::get_set_options() const
+{
+    return f_set_options;
+}
+
+
 bool rule::set_has_ip() const
 {
     return f_set_has_ip;
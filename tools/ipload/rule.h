@@ -131,6 +131,7 @@ public:
 
     advgetopt::string_list_t const &    get_set() const;
     std::string const &                 get_set_type() const;
+    std::string const &                 get_set_options() const;
     bool                                set_has_ip() const;
     advgetopt::string_list_t const &    get_set_data() const;
     advgetopt::string_list_t const &    get_source_interfaces() const;
@@ -272,6 +273,7 @@ private:
     advgetopt::string_list_t            f_set = advgetopt::string_list_t();
     std::string                         f_set_type = std::string("hash:ip");
     bool                                f_set_has_ip = true;
+    std::string                         f_set_options = std::string();
     advgetopt::string_list_t            f_set_data = advgetopt::string_list_t();
     advgetopt::string_list_t            f_source_interfaces = advgetopt::string_list_t();
     addr::addr::vector_t                f_sources = addr::addr::vector_t();
@@ -0,0 +1,584 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+/** \file
+ * \brief iplock tool.
+ *
+ * This implementation reads a stream of block and unblock commands and
+ * sends them to the kernel in a few ipset netlink batches.
+ */
+
+
+// self
+//
+#include    "batch.h"
+
+#include    "controller.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+#include    <iplock/ipset_netlink.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <fstream>
+#include    <iostream>
+
+
+// C
+//
+#include    <arpa/inet.h>
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace tool
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief Maximum number of fields on one line.
+ *
+ * A line has a command, an IP address, and an optional set name. We
+ * keep one more field to detect lines with too many fields.
+ */
+constexpr int const     MAX_FIELDS = 4;
+
+
+/** \brief Number of operations read before the first compaction.
+ *
+ * The operations get compacted (sorted and deduplicated) whenever their
+ * number doubles from the last compaction, starting at this number. This
+ * way, a file with many duplicates does not use more memory than twice
+ * the number of distinct operations.
+ */
+constexpr std::size_t const     COMPACT_THRESHOLD = 64 * 1024;
+
+
+/** \brief Number of operations sent to the kernel at once.
+ *
+ * The compact operations are converted to iplock::ipset_operation
+ * objects a chunk at a time so the conversion does not double the
+ * memory used by a large batch.
+ */
+constexpr std::size_t const     APPLY_CHUNK = 16 * 1024;
+
+
+
+} // no name namespace
+
+
+
+/** \class batch
+ * \brief Block and unblock many IP addresses at once.
+ *
+ * This class reads the file specified with the `--batch` command line
+ * option (or stdin when the filename is "-"). Each line is one of:
+ *
+ * \code
+ *     block <ip>[/<cidr>] [<set>]
+ *     unblock <ip>[/<cidr>] [<set>]
+ * \endcode
+ *
+ * When no set is specified, the one defined with `--set` is used. The
+ * set must be one of the allowed sets. The IPv4 and IPv6 addresses go
+ * to the `<set>_ipv4` and `<set>_ipv6` sets respectively. Empty lines
+ * and comments (introduced by `#` or `;`) are ignored.
+ *
+ * The input is read one line at a time so only the resulting operations
+ * are kept in memory. Each operation is saved in a small record with the
+ * set name interned. The operations are sorted per set (and thus per
+ * family) and address and duplicates are removed whenever their number
+ * doubles and once all the lines were read: the last command found for
+ * an address in a set wins. The result is then sent to the kernel in
+ * chunks.
+ *
+ * Like with `--block`, the allowlisted IP addresses are never blocked.
+ */
+
+batch::batch(controller * parent)
+    : command(parent, "batch")
+{
+    if(f_controller->opts().is_defined("reset"))
+    {
+        throw iplock::invalid_parameter("--reset is not supported by the --batch command.");
+    }
+    if(f_controller->opts().is_defined("total"))
+    {
+        throw iplock::invalid_parameter("--total is not supported by the --batch command.");
+    }
+    if(f_controller->opts().is_defined("ips"))
+    {
+        throw iplock::invalid_parameter("--ips is not supported by the --batch command.");
+    }
+    if(f_controller->opts().is_defined("--"))
+    {
+        throw iplock::invalid_parameter("the --batch command does not accept IP addresses on the command line.");
+    }
+}
+
+
+batch::~batch()
+{
+}
+
+
+void batch::run()
+{
+    // make sure the default set is valid
+    //
+    get_set_name();
+
+    get_allowlist();
+
+    std::string const filename(f_controller->opts().get_string("batch"));
+    std::ifstream file;
+    std::istream * in(&std::cin);
+    if(filename != "-")
+    {
+        file.open(filename);
+        if(!file.is_open())
+        {
+            SNAP_LOG_ERROR
+                << "could not open batch file \""
+                << filename
+                << "\"."
+                << SNAP_LOG_SEND;
+            f_exit_code = 1;
+            return;
+        }
+        in = &file;
+    }
+
+    std::string line;
+    while(std::getline(*in, line))
+    {
+        ++f_line;
+        parse_line(line);
+    }
+    if(in->bad())
+    {
+        SNAP_LOG_ERROR
+            << "an I/O error occurred while reading batch file \""
+            << filename
+            << "\"."
+            << SNAP_LOG_SEND;
+        f_exit_code = 1;
+        return;
+    }
+
+    compact();
+
+    if(f_verbose)
+    {
+        SNAP_LOG_VERBOSE
+            << "iplock:notice: read "
+            << f_line
+            << " lines; "
+            << f_operations.size()
+            << " operations to apply ("
+            << f_duplicates
+            << " duplicates, "
+            << f_allowlisted
+            << " allowlisted)."
+            << SNAP_LOG_SEND;
+    }
+
+    if(f_operations.empty())
+    {
+        return;
+    }
+
+    std::size_t const errors(apply());
+    if(errors != 0)
+    {
+        SNAP_LOG_ERROR
+            << errors
+            << " of the "
+            << f_operations.size()
+            << " batch operations failed."
+            << SNAP_LOG_SEND;
+        f_exit_code = 1;
+    }
+}
+
+
+void batch::get_allowlist()
+{
+    if(!f_iplock_config->is_defined("allowlist"))
+    {
+        return;
+    }
+
+    f_allowlist.add(f_iplock_config->get_string("allowlist"));
+}
+
+
+/** \brief Parse one line of the batch file.
+ *
+ * The line is split in fields without making copies. Invalid lines are
+ * reported and skipped; the exit code is then set to 1 but the other
+ * lines still get applied.
+ *
+ * \param[in] line  The line to parse.
+ */
+void batch::parse_line(std::string_view line)
+{
+    std::string_view::size_type const comment(line.find_first_of("#;"));
+    if(comment != std::string_view::npos)
+    {
+        line = line.substr(0, comment);
+    }
+
+    std::string_view fields[MAX_FIELDS];
+    int count(0);
+    for(std::string_view::size_type pos(0);;)
+    {
+        pos = line.find_first_not_of(" \t\r", pos);
+        if(pos == std::string_view::npos)
+        {
+            break;
+        }
+        std::string_view::size_type end(line.find_first_of(" \t\r", pos));
+        if(end == std::string_view::npos)
+        {
+            end = line.length();
+        }
+        if(count >= MAX_FIELDS)
+        {
+            break;
+        }
+        fields[count] = line.substr(pos, end - pos);
+        ++count;
+        pos = end;
+    }
+    if(count == 0)
+    {
+        return;
+    }
+
+    auto error = [this](std::string const & message)
+    {
+        SNAP_LOG_ERROR
+            << "batch line "
+            << f_line
+            << ": "
+            << message
+            << SNAP_LOG_SEND;
+        f_exit_code = 1;
+    };
+
+    if(count < 2
+    || count > 3)
+    {
+        error("expected \"block|unblock <ip> [<set>]\".");
+        return;
+    }
+
+    operation_t op;
+    if(fields[0] == "block")
+    {
+        op.f_add = true;
+    }
+    else if(fields[0] == "unblock")
+    {
+        op.f_add = false;
+    }
+    else
+    {
+        error("unknown command \"" + std::string(fields[0]) + "\".");
+        return;
+    }
+
+    // the address may be followed by a CIDR
+    //
+    std::string_view ip(fields[1]);
+    int cidr(-1);
+    std::string_view::size_type const slash(ip.find('/'));
+    if(slash != std::string_view::npos)
+    {
+        std::string_view const mask(ip.substr(slash + 1));
+        ip = ip.substr(0, slash);
+        if(mask.empty()
+        || mask.length() > 3)
+        {
+            error("invalid CIDR in \"" + std::string(fields[1]) + "\".");
+            return;
+        }
+        cidr = 0;
+        for(char const c : mask)
+        {
+            if(c < '0' || c > '9')
+            {
+                error("invalid CIDR in \"" + std::string(fields[1]) + "\".");
+                return;
+            }
+            cidr = cidr * 10 + c - '0';
+        }
+
+        // an f_cidr of 0 means a single host, so "/0" cannot be kept
+        // as is and blocking the entire Internet is never wanted anyway
+        //
+        if(cidr == 0)
+        {
+            error("CIDR of 0 not allowed in \"" + std::string(fields[1]) + "\".");
+            return;
+        }
+    }
+
+    // inet_pton() needs a null terminated string
+    //
+    char buf[INET6_ADDRSTRLEN];
+    if(ip.length() >= sizeof(buf))
+    {
+        error("invalid IP address \"" + std::string(fields[1]) + "\".");
+        return;
+    }
+    memcpy(buf, ip.data(), ip.length());
+    buf[ip.length()] = '\0';
+
+    iplock::ipset_element::address_t & address(op.f_address);
+    bool const dotted(ip.find(':') == std::string_view::npos);
+    int r(0);
+    if(dotted)
+    {
+        address[10] = 0xFF;
+        address[11] = 0xFF;
+        r = inet_pton(AF_INET, buf, address.data() + 12);
+    }
+    else
+    {
+        r = inet_pton(AF_INET6, buf, address.data());
+    }
+    if(r != 1)
+    {
+        error("invalid IP address \"" + std::string(fields[1]) + "\".");
+        return;
+    }
+
+    // "::ffff:a.b.c.d" is an IPv4 address for the sets; the family and
+    // the set suffix both come from that same test
+    //
+    bool const ipv4(iplock::ipset_element(address).is_ipv4());
+    if(ipv4
+    && !dotted
+    && cidr >= 0)
+    {
+        if(cidr < 96)
+        {
+            error("CIDR too small for an IPv4 mapped address in \"" + std::string(fields[1]) + "\".");
+            return;
+        }
+        cidr -= 96;
+        if(cidr == 0)
+        {
+            error("CIDR of 0 not allowed in \"" + std::string(fields[1]) + "\".");
+            return;
+        }
+    }
+
+    // keep the CIDR in family terms (as the kernel) and clear the host
+    // bits so "10.0.0.1/24" and "10.0.0.0/24" are the same network
+    //
+    int const host_cidr(ipv4 ? 32 : 128);
+    if(cidr > host_cidr)
+    {
+        error("CIDR too large in \"" + std::string(fields[1]) + "\".");
+        return;
+    }
+    int prefix(128);
+    if(cidr >= 0
+    && cidr != host_cidr)
+    {
+        op.f_cidr = static_cast<std::uint8_t>(cidr);
+        prefix = cidr + (ipv4 ? 96 : 0);
+        for(int bit(prefix); bit < 128; ++bit)
+        {
+            address[bit / 8] &= ~(0x80 >> (bit % 8));
+        }
+    }
+
+    if(op.f_add)
+    {
+        bool const allowed(prefix == 128
+                ? f_allowlist.is_allowed(address)
+                : f_allowlist.overlaps(address, prefix));
+        if(allowed)
+        {
+            ++f_allowlisted;
+            if(f_verbose)
+            {
+                SNAP_LOG_VERBOSE
+                    << "iplock:notice: ip address "
+                    << fields[1]
+                    << " is allowlisted, ignoring."
+                    << SNAP_LOG_SEND;
+            }
+            return;
+        }
+    }
+
+    std::string set_name(count == 3 ? std::string(fields[2]) : get_set_name());
+    if(!is_set_allowed(set_name))
+    {
+        error("set \"" + set_name + "\" is not allowed.");
+        return;
+    }
+    set_name += ipv4 ? "_ipv4" : "_ipv6";
+    op.f_set = get_set_index(set_name);
+
+    f_operations.push_back(op);
+    if(f_operations.size() >= std::max(f_compact_at, COMPACT_THRESHOLD))
+    {
+        compact();
+    }
+}
+
+
+/** \brief Get the index of a set name.
+ *
+ * The operations only keep the index of their set name. There are only
+ * a few allowed sets so a linear search is enough.
+ *
+ * \param[in] set_name  The name of the set.
+ *
+ * \return The index of \p set_name in f_set_names.
+ */
+std::uint16_t batch::get_set_index(std::string const & set_name)
+{
+    auto const it(std::find(f_set_names.begin(), f_set_names.end(), set_name));
+    if(it != f_set_names.end())
+    {
+        return static_cast<std::uint16_t>(it - f_set_names.begin());
+    }
+    f_set_names.push_back(set_name);
+    return static_cast<std::uint16_t>(f_set_names.size() - 1);
+}
+
+
+/** \brief Sort the operations and remove duplicates.
+ *
+ * The operations are sorted by set and address. Since the sort is
+ * stable, the last operation of a run of equal set and address is the
+ * last one found in the input and it is the one we keep. This remains
+ * true when compacting again after more lines were read since the
+ * operations which were already compacted come first.
+ *
+ * The order of the sets is the order in which they were first found,
+ * which is fine since the kernel does not care.
+ */
+void batch::compact()
+{
+    std::stable_sort(
+          f_operations.begin()
+        , f_operations.end()
+        , [](operation_t const & lhs, operation_t const & rhs)
+        {
+            if(lhs.f_set != rhs.f_set)
+            {
+                return lhs.f_set < rhs.f_set;
+            }
+            if(lhs.f_address != rhs.f_address)
+            {
+                return lhs.f_address < rhs.f_address;
+            }
+            return lhs.f_cidr < rhs.f_cidr;
+        });
+
+    auto out(f_operations.begin());
+    for(auto it(f_operations.begin()); it != f_operations.end(); ++it)
+    {
+        auto const next(it + 1);
+        if(next != f_operations.end()
+        && next->f_set == it->f_set
+        && next->f_address == it->f_address
+        && next->f_cidr == it->f_cidr)
+        {
+            ++f_duplicates;
+            continue;
+        }
+        if(out != it)
+        {
+            *out = *it;
+        }
+        ++out;
+    }
+    f_operations.erase(out, f_operations.end());
+
+    f_compact_at = f_operations.size() * 2;
+}
+
+
+/** \brief Send the operations to the kernel.
+ *
+ * The operations are converted and sent to the kernel APPLY_CHUNK at
+ * a time.
+ *
+ * \return The number of operations which failed.
+ */
+std::size_t batch::apply()
+{
+    iplock::ipset_netlink s;
+    std::size_t errors(0);
+    iplock::ipset_operation::vector_t chunk;
+    chunk.reserve(std::min(f_operations.size(), APPLY_CHUNK));
+    for(std::size_t idx(0); idx < f_operations.size(); )
+    {
+        chunk.clear();
+        std::size_t const end(std::min(f_operations.size(), idx + APPLY_CHUNK));
+        for(; idx < end; ++idx)
+        {
+            operation_t const & op(f_operations[idx]);
+            iplock::ipset_operation o;
+            o.f_command = op.f_add
+                    ? iplock::ipset_command_t::IPSET_COMMAND_ADD
+                    : iplock::ipset_command_t::IPSET_COMMAND_DEL;
+            o.f_set_name = f_set_names[op.f_set];
+            o.f_element = iplock::ipset_element(op.f_address, op.f_cidr);
+            chunk.push_back(std::move(o));
+        }
+        errors += s.apply(chunk);
+    }
+
+    return errors;
+}
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
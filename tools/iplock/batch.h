@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Definition of the iplock --batch command.
+ *
+ * The batch command reads a list of block and unblock commands and
+ * applies them all at once.
+ */
+
+// self
+//
+#include    "command.h"
+
+
+// iplock
+//
+#include    <iplock/allowlist.h>
+#include    <iplock/ipset.h>
+
+
+// C++
+//
+#include    <string_view>
+#include    <vector>
+
+
+
+namespace tool
+{
+
+
+
+class batch
+    : public command
+{
+public:
+                        batch(controller * parent);
+    virtual             ~batch() override;
+
+    virtual void        run() override;
+
+private:
+    // an operation takes 20 bytes instead of the ~90 bytes of an
+    // iplock::ipset_operation with its set name
+    //
+    struct operation_t
+    {
+        typedef std::vector<operation_t>    vector_t;
+
+        iplock::ipset_element::address_t
+                            f_address = iplock::ipset_element::address_t();
+        std::uint8_t        f_cidr = 0;
+        bool                f_add = true;
+        std::uint16_t       f_set = 0;          // index in f_set_names
+    };
+
+    void                get_allowlist();
+    void                parse_line(std::string_view line);
+    std::uint16_t       get_set_index(std::string const & set_name);
+    void                compact();
+    std::size_t         apply();
+
+    iplock::allowlist   f_allowlist = iplock::allowlist();
+    std::vector<std::string>
+                        f_set_names = std::vector<std::string>();
+    operation_t::vector_t
+                        f_operations = operation_t::vector_t();
+    std::size_t         f_compact_at = 0;
+    std::size_t         f_line = 0;
+    std::size_t         f_allowlisted = 0;
+    std::size_t         f_duplicates = 0;
+};
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
@@ -199,13 +199,10 @@ void block_or_unblock::get_allowlist()
         return;
     }
 
-    addr::addr_parser p;
-    p.set_protocol(IPPROTO_TCP);        // define a protocol because otherwise we get duplicates with various protocols...
-    p.set_allow(addr::allow_t::ALLOW_MULTI_ADDRESSES_COMMAS, true);
-    p.set_allow(addr::allow_t::ALLOW_MULTI_ADDRESSES_SPACES, true);
-    p.set_allow(addr::allow_t::ALLOW_MASK, true);
-    p.set_allow(addr::allow_t::ALLOW_PORT, false);
-    f_allowlist_ips = p.parse(f_iplock_config->get_string("allowlist"));
+    // the allowlist compiles the addresses in a trie so checking
+    // each IP address does not depend on the size of the allowlist
+    //
+    f_allowlist.add(f_iplock_config->get_string("allowlist"));
 }
 
 
@@ -250,7 +247,7 @@ void block_or_unblock::add_ips(std::string const & ips)
         // then skip that IP
         //
         if(f_mode == mode_t::MODE_BLOCK
-        && addr::address_match_ranges(f_allowlist_ips, a))
+        && f_allowlist.is_allowed(a))
         {
             if(f_verbose)
             {
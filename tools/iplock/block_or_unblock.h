@@ -32,6 +32,11 @@
 #include    "command.h"
 
 
+// iplock
+//
+#include    <iplock/allowlist.h>
+
+
 // libaddr
 //
 #include    <libaddr/addr_parser.h>
@@ -68,8 +73,7 @@ private:
     std::string         f_command = std::string();
     mode_t              f_mode = mode_t::MODE_BLOCK;
     bool                f_found_ips = false;
-    addr::addr_range::vector_t
-                        f_allowlist_ips = addr::addr_range::vector_t();
+    iplock::allowlist   f_allowlist = iplock::allowlist();
     std::string         f_set_rules = std::string();
 };
 
@@ -121,6 +121,13 @@ advgetopt::option const g_iplock_configuration_options[] =
         , advgetopt::DefaultValue("INPUT")
         , advgetopt::Help("The name of the chain to take counters from.")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("chain6")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Help("The name of the ip6tables chain to take counters from; defaults to \"chain\".")
+    ),
     advgetopt::define_option(
           advgetopt::Name("ignore_line_starting_with")
         , advgetopt::Flags(advgetopt::any_flags<
@@ -166,6 +173,24 @@ advgetopt::option const g_iplock_configuration_options[] =
         , advgetopt::Help("Column specifying the target (action).")
     ),
 
+    // options used by the --serve command
+    advgetopt::define_option(
+          advgetopt::Name("serve_groups")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("")
+        , advgetopt::Help("Comma separated list of groups allowed to send requests to the iplock helper.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("serve_users")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_CONFIGURATION_FILE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("")
+        , advgetopt::Help("Comma separated list of users allowed to send requests to the iplock helper.")
+    ),
+
     advgetopt::end_options()
 };
 
@@ -271,11 +296,7 @@ std::string & command::get_set_name()
         //
         f_set_name = f_controller->opts().get_string("set");
 
-        // the list of allowed sets comes from the /etc/iplock/iplock.conf file
-        // (so only admins and other packages can change the list)
-        //
-        advgetopt::split_string(f_iplock_config->get_string("allowed_sets"), f_allowed_set_names, {","});
-        if(std::find(f_allowed_set_names.begin(), f_allowed_set_names.end(), f_set_name) == f_allowed_set_names.end())
+        if(!is_set_allowed(f_set_name))
         {
             iplock::invalid_parameter e(
                   "set \""
@@ -294,6 +315,26 @@ std::string & command::get_set_name()
 }
 
 
+/** \brief Check whether iplock can access the named set.
+ *
+ * The list of allowed sets comes from the /etc/iplock/iplock.conf file
+ * (so only admins and other packages can change the list). It is loaded
+ * the first time this function gets called.
+ *
+ * \param[in] set_name  The name of the set without the _ipv4/_ipv6 suffix.
+ *
+ * \return true if the set is one of the allowed sets.
+ */
+bool command::is_set_allowed(std::string const & set_name)
+{
+    if(f_allowed_set_names.empty())
+    {
+        advgetopt::split_string(f_iplock_config->get_string("allowed_sets"), f_allowed_set_names, {","});
+    }
+    return std::find(f_allowed_set_names.begin(), f_allowed_set_names.end(), set_name) != f_allowed_set_names.end();
+}
+
+
 bool command::needs_root() const
 {
     return true;
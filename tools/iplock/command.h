@@ -68,6 +68,7 @@ public:
 
 protected:
     std::string &       get_set_name();
+    bool                is_set_allowed(std::string const & set_name);
 
     controller *                    f_controller = nullptr; // just in case, unused at this time...
     std::string                     f_command_name = std::string();
@@ -33,11 +33,13 @@
 //
 #include    "controller.h"
 
+#include    "batch.h"
 #include    "block.h"
 #include    "count.h"
 #include    "list.h"
 #include    "list_allowed_sets.h"
 #include    "flush.h"
+#include    "serve.h"
 #include    "unblock.h"
 
 
@@ -108,6 +110,14 @@ advgetopt::option const g_iplock_options[] =
 {
     // COMMANDS
     //
+    advgetopt::define_option(
+          advgetopt::Name("batch")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_COMMANDS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Help("Read \"block <ip> [<set>]\" and \"unblock <ip> [<set>]\" lines from the named file (\"-\" for stdin) and apply them at once.")
+    ),
     advgetopt::define_option(
           advgetopt::Name("block")
         , advgetopt::ShortName('b')
@@ -149,6 +159,12 @@ advgetopt::option const g_iplock_options[] =
                     , advgetopt::GETOPT_FLAG_SHOW_USAGE_ON_ERROR>())
         , advgetopt::Help("Display a list of sets that iplock has access to.")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("serve")
+        , advgetopt::Flags(advgetopt::standalone_command_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_COMMANDS>())
+        , advgetopt::Help("Run as a helper daemon applying the block, unblock, and test requests received on the \"@iplock\" Unix socket.")
+    ),
     advgetopt::define_option(
           advgetopt::Name("unblock")
         , advgetopt::ShortName('u')
@@ -160,6 +176,23 @@ advgetopt::option const g_iplock_options[] =
 
     // OPTIONS
     //
+    advgetopt::define_option(
+          advgetopt::Name("count-only")
+        , advgetopt::Flags(advgetopt::option_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE>())
+        , advgetopt::Help("Use with the --list command to only show the number of members of each set.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("filter")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Help("Use with the --list command to only show the members within the specified IP address or network (i.e. 10.0.0.0/8).")
+    ),
     advgetopt::define_option(
           advgetopt::Name("ips")
         , advgetopt::Flags(advgetopt::any_flags<
@@ -169,6 +202,34 @@ advgetopt::option const g_iplock_options[] =
                     , advgetopt::GETOPT_FLAG_REQUIRED>())
         , advgetopt::Help("Define the name of a file with a list of IPs to --block or --unblock.")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("json")
+        , advgetopt::Flags(advgetopt::option_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE>())
+        , advgetopt::Help("Use with the --count command to write the counters in JSON.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("limit")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Validator("integer(1...1000000000)")
+        , advgetopt::Help("Use with the --list command to show at most N members of each set.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("offset")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Validator("integer(0...1000000000)")
+        , advgetopt::Help("Use with the --list command to skip the first N members of each set.")
+    ),
     advgetopt::define_option(
           advgetopt::Name("quiet")
         , advgetopt::ShortName('q')
@@ -198,6 +259,25 @@ advgetopt::option const g_iplock_options[] =
         , advgetopt::DefaultValue("unwanted")
         , advgetopt::Help("Define the name of the set where the IP is added or removed. Defaults to \"unwanted\".")
     ),
+    advgetopt::define_option(
+          advgetopt::Name("sort")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Help("Use with the --count or --list command to sort the output by \"ip\", \"packets\", \"bytes\", or \"timeout\" (largest first; \"timeout\" is only for --list).")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("top")
+        , advgetopt::Flags(advgetopt::any_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_COMMAND_LINE
+                    , advgetopt::GETOPT_FLAG_ENVIRONMENT_VARIABLE
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Validator("integer(1...1000000000)")
+        , advgetopt::Help("Use with the --count command to only show the N IP addresses with the most bytes (or see --sort).")
+    ),
     advgetopt::define_option(
           advgetopt::Name("total")
         , advgetopt::ShortName('t')
@@ -394,6 +474,10 @@ int controller::run_command()
     // gets set... if theuser has more on the command line, then
     // we print an error and exit with 1.
     //
+    if(f_opts.is_defined("batch"))
+    {
+        set_command(std::make_shared<batch>(this));
+    }
     if(f_opts.is_defined("block"))
     {
         set_command(std::make_shared<block>(this));
@@ -414,6 +498,10 @@ int controller::run_command()
     {
         set_command(std::make_shared<list_allowed_sets>(this));
     }
+    if(f_opts.is_defined("serve"))
+    {
+        set_command(std::make_shared<serve>(this));
+    }
     if(f_opts.is_defined("unblock"))
     {
         set_command(std::make_shared<unblock>(this));
@@ -424,7 +512,7 @@ int controller::run_command()
     if(f_command == nullptr)
     {
         SNAP_LOG_ERROR
-            << "you must specify a command such as: --block, --unblock, --count, or --flush."
+            << "you must specify a command such as: --block, --unblock, --batch, --count, or --flush."
             << SNAP_LOG_SEND;
         return 1;
     }
@@ -41,11 +41,6 @@
 #include    <iplock/exception.h>
 
 
-// advgetopt
-//
-#include    <advgetopt/validator_integer.h>
-
-
 // snaplogger
 //
 #include    <snaplogger/message.h>
@@ -63,9 +58,18 @@
 
 // C++
 //
+#include    <algorithm>
+#include    <charconv>
 #include    <iostream>
 
 
+// C
+//
+#include    <arpa/inet.h>
+#include    <string.h>
+#include    <unistd.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -90,6 +94,54 @@ void pipe_deleter(FILE * pipe)
 }
 
 
+namespace
+{
+
+
+
+/** \brief Check whether an address is an IPv4 mapped address.
+ *
+ * \param[in] address  The 16 bytes of the address.
+ *
+ * \return true if the address starts with ::ffff:.
+ */
+bool is_ipv4(std::array<std::uint8_t, 16> const & address)
+{
+    for(int idx(0); idx < 10; ++idx)
+    {
+        if(address[idx] != 0)
+        {
+            return false;
+        }
+    }
+    return address[10] == 0xFF && address[11] == 0xFF;
+}
+
+
+/** \brief Convert a binary address to a string.
+ *
+ * IPv4 mapped addresses are written in dotted notation.
+ *
+ * \param[in] address  The 16 bytes of the address.
+ * \param[out] ip  The buffer receiving the address.
+ */
+void address_to_string(std::array<std::uint8_t, 16> const & address, char (&ip)[INET6_ADDRSTRLEN])
+{
+    if(is_ipv4(address))
+    {
+        inet_ntop(AF_INET, address.data() + 12, ip, sizeof(ip));
+    }
+    else
+    {
+        inet_ntop(AF_INET6, address.data(), ip, sizeof(ip));
+    }
+}
+
+
+
+} // no name namespace
+
+
 
 
 
@@ -102,7 +154,13 @@ void pipe_deleter(FILE * pipe)
  * \brief Generate a count of all the entries by IP address.
  *
  * This class goes through the list of rules we added so far in the
- * named chain and prints out the results to stdout.
+ * named iptables and ip6tables chains and prints out the results to
+ * stdout.
+ *
+ * The output of the commands is read in large blocks and parsed in
+ * place. The IP addresses specified on the command line are parsed once
+ * and saved in a hash set, and the totals are saved in a hash map
+ * indexed by the binary IP address.
  *
  * If multiple ports get blocked, then the total for all those ports
  * is reported.
@@ -112,7 +170,42 @@ void pipe_deleter(FILE * pipe)
 count::count(controller * parent)
     : command(parent, "count")
     , f_reset(f_controller->opts().is_defined("reset"))
+    , f_merge_totals(f_controller->opts().is_defined("total"))
+    , f_json(f_controller->opts().is_defined("json"))
 {
+    // by default the IPs with the most bytes are shown first with --top
+    //
+    if(f_controller->opts().is_defined("top"))
+    {
+        f_top = f_controller->opts().get_long("top");
+        f_sort = sort_t::SORT_BYTES;
+    }
+    if(f_controller->opts().is_defined("sort"))
+    {
+        std::string const sort(f_controller->opts().get_string("sort"));
+        if(sort == "ip")
+        {
+            f_sort = sort_t::SORT_IP;
+        }
+        else if(sort == "packets")
+        {
+            f_sort = sort_t::SORT_PACKETS;
+        }
+        else if(sort == "bytes")
+        {
+            f_sort = sort_t::SORT_BYTES;
+        }
+        else
+        {
+            iplock::invalid_parameter e(
+                  "unsupported --sort \""
+                + sort
+                + "\", expected \"ip\", \"packets\", or \"bytes\".");
+            e.set_parameter("sort", sort);
+            throw e;
+        }
+    }
+
     // parse the list of targets
     //
     std::string const targets(f_iplock_config->get_string("acceptable_targets"));
@@ -150,34 +243,20 @@ count::count(controller * parent)
         f_targets.push_back(target);
     }
 
-    // verify the chain name
+    // verify the chain names, the IPv6 chain defaults to the IPv4 chain
     //
-    f_chain = f_iplock_config->get_string("chain");
-    if(f_chain.empty()
-    || f_chain.size() > 30)
+    f_chain = get_chain("chain", std::string());
+    f_chain6 = get_chain("chain6", f_chain);
+
+    f_ignore_line_starting_with = f_iplock_config->get_string("ignore_line_starting_with");
+
+    // the IPs to filter on are parsed once here instead of once per line
+    //
+    int const ip_max(f_controller->opts().size("--"));
+    for(int idx(0); idx < ip_max; ++idx)
     {
-        throw iplock::invalid_parameter("the \"chain\" parameter cannot be empty or larger than 30 characters.");
+        f_filters.insert(parse_ip(f_controller->opts().get_string("--", idx)));
     }
-    std::for_each(
-              f_chain.begin()
-            , f_chain.end()
-            , [&](auto const & c)
-            {
-                if((c < 'a' || c > 'z')
-                && (c < 'A' || c > 'Z')
-                && (c < '0' || c > '9')
-                && c != '_'
-                && c != '-')
-                {
-                    iplock::invalid_parameter e(
-                          "invalid \"chain=...\" option \""
-                        + f_chain
-                        + "\", only [a-zA-Z0-9_-]+ are supported.");
-                    e.set_parameter("chain", f_chain);
-                    throw e;
-                }
-            });
-
 }
 
 
@@ -186,6 +265,23 @@ count::~count()
 }
 
 
+std::size_t count::address_hash::operator () (address_t const & address) const
+{
+    return std::hash<std::string_view>()(std::string_view(
+                  reinterpret_cast<char const *>(address.data())
+                , address.size()));
+}
+
+
+count::counters_t & count::counters_t::operator += (counters_t const & rhs)
+{
+    f_packets += rhs.f_packets;
+    f_bytes += rhs.f_bytes;
+
+    return *this;
+}
+
+
 void count::run()
 {
 // TODO: the count uses the iptables counters, but now we make use of ipset
@@ -193,97 +289,93 @@ void count::run()
 //       can keep the iptables feature and have a way to distinguish between
 //       whether the user wants to see a chain or the ipset counters...
 
-    // the iptables -L command line option does not give you any formatting
-    // or filtering power so we instead define many parameters in the
-    // count.conf configuration file which we use here to parse the data
-    // out
-    //
-    struct data_t
+    if(!verify_columns())
     {
-        typedef std::map<std::string, data_t>   ip_map_t;
-
-                        data_t(int64_t packets = 0, int64_t bytes = 0)
-                            : f_packets(packets)
-                            , f_bytes(bytes)
-                        {
-                        }
-
-        data_t &        operator += (data_t const & rhs)
-                        {
-                            f_packets += rhs.f_packets;
-                            f_bytes += rhs.f_bytes;
+        f_exit_code = 1;
+        return;
+    }
 
-                            return *this;
-                        }
+    if(!read_counters("iptables", f_chain, false)
+    || !read_counters("ip6tables", f_chain6, true))
+    {
+        f_exit_code = 1;
+        return;
+    }
 
-        int64_t         f_packets = 0;
-        int64_t         f_bytes = 0;
-    };
+    output();
+}
 
-    // run the command and retrieve its output
-    //
-    std::string cmd("[command] -t filter -L [reset] [chain] -nvx");
-    std::string iptables("iptables");
-    // TODO:
-    //if(ipv6) {
-    //    iptables = "ip6tables";
-    //}
-    cmd = snapdev::string_replace_many(cmd, {
-                { "[command]",   iptables },
-                { "[reset]",     (f_reset ? "-Z" : "") },
-                { "[chain]",     f_chain },
-            });
 
-    if(f_verbose)
+/** \brief Get and verify the name of a chain.
+ *
+ * \param[in] name  The name of the configuration parameter.
+ * \param[in] default_chain  The chain to use if the parameter is not
+ * defined; if empty, the parameter default is used.
+ *
+ * \return The name of the chain.
+ */
+std::string count::get_chain(char const * name, std::string const & default_chain)
+{
+    std::string const chain(
+            default_chain.empty() || f_iplock_config->is_defined(name)
+                ? f_iplock_config->get_string(name)
+                : default_chain);
+    if(chain.empty()
+    || chain.size() > 30)
     {
-        SNAP_LOG_VERBOSE
-            << "command to read counters: \""
-            << cmd
-            << "\"."
-            << SNAP_LOG_SEND;
+        throw iplock::invalid_parameter(
+                  std::string("the \"")
+                + name
+                + "\" parameter cannot be empty or larger than 30 characters.");
     }
+    std::for_each(
+              chain.begin()
+            , chain.end()
+            , [&](auto const & c)
+            {
+                if((c < 'a' || c > 'z')
+                && (c < 'A' || c > 'Z')
+                && (c < '0' || c > '9')
+                && c != '_'
+                && c != '-')
+                {
+                    iplock::invalid_parameter e(
+                          std::string("invalid \"")
+                        + name
+                        + "=...\" option \""
+                        + chain
+                        + "\", only [a-zA-Z0-9_-]+ are supported.");
+                    e.set_parameter("chain", chain);
+                    throw e;
+                }
+            });
 
-    std::shared_ptr<FILE> f(popen(cmd.c_str(), "r"), pipe_deleter);
+    return chain;
+}
 
-    // we have a first very simple loop that allows us to read
-    // lines to be ignored by not saving them anywhere
-    //
-    for(long lines_to_ignore(f_iplock_config->get_long("lines_to_ignore")); lines_to_ignore > 0; --lines_to_ignore)
-    {
-        for(;;)
-        {
-            int const c(fgetc(f.get()));
-            if(c == EOF)
-            {
-                SNAP_LOG_ERROR
-                    << "unexpected EOF while reading a line of output."
-                    << SNAP_LOG_SEND;
-                f_exit_code = 1;
-                return;
-            }
-            if(c == '\n' || c == '\r')
-            {
-                break;
-            }
-        }
-    }
 
+/** \brief Load and verify the column numbers.
+ *
+ * \return true if the column numbers are valid.
+ */
+bool count::verify_columns()
+{
     // the column we are currently interested in
     //
     // WARNING: in the configuration file, those column numbers are 1 based
     //          just like the rule number in iptables...
     //
-    long const packets_column(f_iplock_config->get_long("packets_column") - 1);
-    long const bytes_column(f_iplock_config->get_long("bytes_column") - 1);
-    long const target_column(f_iplock_config->get_long("target_column") - 1);
-    long const ip_column(f_iplock_config->get_long("ip_column") - 1);
+    f_packets_column = f_iplock_config->get_long("packets_column") - 1;
+    f_bytes_column = f_iplock_config->get_long("bytes_column") - 1;
+    f_target_column = f_iplock_config->get_long("target_column") - 1;
+    f_ip_column = f_iplock_config->get_long("ip_column") - 1;
 
     // make sure it is not completely out of range
     //
-    if(packets_column < 0 || packets_column >= 100
-    || bytes_column < 0   || bytes_column >= 100
-    || target_column < 0  || target_column >= 100
-    || ip_column < 0      || ip_column >= 100)
+    if(f_packets_column < 0 || f_packets_column >= 100
+    || f_bytes_column < 0   || f_bytes_column >= 100
+    || f_target_column < 0  || f_target_column >= 100
+    || f_ip_column < 0      || f_ip_column >= 100)
     {
         // WARNING: by now we have `<value> - 1` for each column number, so we
         //          really expect a column number from 1 to 100 even though
@@ -292,208 +384,553 @@ void count::run()
         SNAP_LOG_ERROR
             << "unexpectendly small or large column number (number is expected to be between 1 and 100)."
             << SNAP_LOG_SEND;
-        f_exit_code = 1;
-        return;
+        return false;
     }
 
     // make sure the user is not trying to get different values from
     // the exact same column (that is a configuration bug!)
     //
-    if(packets_column == bytes_column
-    || packets_column == target_column
-    || packets_column == ip_column
-    || bytes_column == target_column
-    || bytes_column == ip_column
-    || target_column == ip_column)
+    if(f_packets_column == f_bytes_column
+    || f_packets_column == f_target_column
+    || f_packets_column == f_ip_column
+    || f_bytes_column == f_target_column
+    || f_bytes_column == f_ip_column
+    || f_target_column == f_ip_column)
     {
         SNAP_LOG_ERROR
             << "all column numbers defined in iplock.conf must be different."
             << SNAP_LOG_SEND;
-        f_exit_code = 1;
-        return;
+        return false;
     }
 
     // compute the minimum size that the `columns` vector must be to
     // be considered valid
     //
-    size_t const min_column_count(std::max({packets_column, bytes_column, target_column, ip_column}) + 1);
+    f_min_column_count = std::max({f_packets_column, f_bytes_column, f_target_column, f_ip_column}) + 1;
 
-    // get the starting column to be ignored (i.e. the -Z option adds
-    // a line at the bottom which says "Zeroing chain `<chain-name>`"
-    //
-    std::string const ignore_line_starting_with(f_iplock_config->get_string("ignore_line_starting_with"));
+    return true;
+}
 
-    // number of IP addresses allowed in the output or 0 for all
-    //
-    int const ip_max(f_controller->opts().size("--"));
 
-    // a map indexed by IP addresses with all the totals
-    //
-    data_t::ip_map_t totals;
+/** \brief Read the counters of one chain.
+ *
+ * The iptables -L command line option does not give you any formatting
+ * or filtering power so we instead define many parameters in the
+ * iplock.conf configuration file which we use here to parse the data.
+ *
+ * The output is read in large blocks and each line is parsed in place
+ * so the cost does not depend on the number of allocations.
+ *
+ * \param[in] iptables  The name of the command ("iptables" or "ip6tables").
+ * \param[in] chain  The name of the chain to read.
+ * \param[in] ipv6  Whether the output is from ip6tables.
+ *
+ * \return true if the output was read successfully.
+ */
+bool count::read_counters(char const * iptables, std::string const & chain, bool ipv6)
+{
+    std::string const cmd(snapdev::string_replace_many(
+            std::string("[command] -t filter -L [reset] [chain] -nvx"),
+            {
+                { "[command]",   iptables },
+                { "[reset]",     (f_reset ? "-Z" : "") },
+                { "[chain]",     chain },
+            }));
 
-    bool const merge_totals(f_controller->opts().is_defined("total"));
+    if(f_verbose)
+    {
+        SNAP_LOG_VERBOSE
+            << "command to read counters: \""
+            << cmd
+            << "\"."
+            << SNAP_LOG_SEND;
+    }
+
+    std::shared_ptr<FILE> f(popen(cmd.c_str(), "r"), pipe_deleter);
+    if(f == nullptr)
+    {
+        SNAP_LOG_ERROR
+            << "could not run \""
+            << cmd
+            << "\"."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+    int const fd(fileno(f.get()));
+
+    long lines_to_ignore(f_iplock_config->get_long("lines_to_ignore"));
 
+    // lines are much shorter than the buffer so any line which does not
+    // fit is an error
+    //
+    std::vector<char> buffer(64 * 1024);
+    std::size_t used(0);
     for(;;)
     {
-        // read one line of output, immediately break it up in columns
-        //
-        std::vector<std::string> columns;
-        std::string column;
-        for(;;)
+        ssize_t const r(read(fd, buffer.data() + used, buffer.size() - used));
+        if(r < 0)
         {
-            int const c(fgetc(f.get()));
-            if(c == EOF)
+            if(errno == EINTR)
             {
-                if(!column.empty())
-                {
-                    SNAP_LOG_ERROR
-                        << "unexpected EOF while reading a line of output."
-                        << SNAP_LOG_SEND;
-                    f_exit_code = 1;
-                    return;
-                }
-                break;
+                continue;
             }
-            if(c == '\n' || c == '\r')
+            int const e(errno);
+            SNAP_LOG_ERROR
+                << "error reading the output of \""
+                << cmd
+                << "\": "
+                << strerror(e)
+                << SNAP_LOG_SEND;
+            return false;
+        }
+        if(r == 0)
+        {
+            break;
+        }
+        used += r;
+
+        char const * s(buffer.data());
+        char const * const end(s + used);
+        for(;;)
+        {
+            char const * eol(static_cast<char const *>(memchr(s, '\n', end - s)));
+            if(eol == nullptr)
             {
                 break;
             }
-            if(c == ' ')
+            std::string_view const line(s, eol - s);
+            s = eol + 1;
+
+            if(lines_to_ignore > 0)
             {
-                // ignore empty columns (this happens because there are
-                // many spaces between each column)
-                //
-                if(!column.empty()
-                && (!columns.empty() || ignore_line_starting_with != column))
-                {
-                    columns.push_back(column);
-                    column.clear();
-                }
+                --lines_to_ignore;
                 continue;
             }
-            column += c;
-
-            // prevent columns that are too wide
-            //
-            if(column.length() > 256)
+            if(!parse_line(line, ipv6))
             {
-                SNAP_LOG_ERROR
-                    << "unexpected long column, stop processing."
-                    << SNAP_LOG_SEND;
-                f_exit_code = 1;
-                return;
+                return false;
             }
         }
 
-        // are we done? (found EOF after the last line, thus no columns)
+        // move the partial line at the start of the buffer
         //
-        if(columns.empty())
+        used = end - s;
+        if(used >= buffer.size())
+        {
+            SNAP_LOG_ERROR
+                << "unexpected long line, stop processing."
+                << SNAP_LOG_SEND;
+            return false;
+        }
+        memmove(buffer.data(), s, used);
+    }
+
+    if(used > 0)
+    {
+        if(lines_to_ignore > 0)
+        {
+            --lines_to_ignore;
+        }
+        else if(!parse_line(std::string_view(buffer.data(), used), ipv6))
+        {
+            return false;
+        }
+    }
+    if(lines_to_ignore > 0)
+    {
+        if(ipv6)
+        {
+            // many systems do not setup an IPv6 firewall
+            //
+            SNAP_LOG_WARNING
+                << "no counters found in the \""
+                << chain
+                << "\" chain of ip6tables."
+                << SNAP_LOG_SEND;
+            return true;
+        }
+        SNAP_LOG_ERROR
+            << "unexpected EOF while reading a line of output."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    // done with the pipe
+    //
+    f.reset();
+
+    return true;
+}
+
+
+/** \brief Parse one line of iptables output.
+ *
+ * The line is broken up in columns without copying it. The columns are
+ * separated by one or more spaces.
+ *
+ * \param[in] line  The line to parse.
+ * \param[in] ipv6  Whether the line comes from ip6tables.
+ *
+ * \return false if the line is invalid and the processing has to stop.
+ */
+bool count::parse_line(std::string_view line, bool ipv6)
+{
+    // we only need the first f_min_column_count columns
+    //
+    std::string_view columns[100];
+    std::size_t column_count(0);
+    for(std::string_view::size_type pos(0);
+        column_count < f_min_column_count;)
+    {
+        pos = line.find_first_not_of(" \t\r", pos);
+        if(pos == std::string_view::npos)
         {
             break;
         }
+        std::string_view::size_type end(line.find_first_of(" \t\r", pos));
+        if(end == std::string_view::npos)
+        {
+            end = line.length();
+        }
 
-        // make sure we have enough columns
+        // prevent columns that are too wide
         //
-        if(columns.size() < min_column_count)
+        if(end - pos > 256)
         {
             SNAP_LOG_ERROR
-                << "not enough columns to satisfy the configuration column numbers."
+                << "unexpected long column, stop processing."
                 << SNAP_LOG_SEND;
-            f_exit_code = 1;
-            return;
+            return false;
         }
 
-        // filter by targets?
+        columns[column_count] = line.substr(pos, end - pos);
+        ++column_count;
+        pos = end;
+    }
+
+    // ignore empty lines and the "Zeroing chain ..." line added by -Z
+    //
+    if(column_count == 0
+    || columns[0] == f_ignore_line_starting_with)
+    {
+        return true;
+    }
+
+    // make sure we have enough columns
+    //
+    if(column_count < f_min_column_count)
+    {
+        SNAP_LOG_ERROR
+            << "not enough columns to satisfy the configuration column numbers."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    // filter by targets?
+    //
+    std::string_view const target(columns[f_target_column]);
+    if(!f_targets.empty()
+    && std::find(f_targets.begin(), f_targets.end(), target) == f_targets.end())
+    {
+        // target filtering missed
         //
-        if(!f_targets.empty()
-        && std::find(f_targets.begin(), f_targets.end(), columns[target_column]) == f_targets.end())
+        return true;
+    }
+
+    // get the source IP
+    // make sure to remove the mask if present
+    //
+    // ip6tables leaves the "opt" column empty, so the source IP may be
+    // found one column before the configured one; check that column
+    // first since the configured one is then the destination IP (i.e.
+    // "::/0"); when "opt" is present, that column is the "out" interface
+    // which is not an IP address
+    //
+    address_t address = {};
+    bool found_ip(false);
+    for(long column(ipv6 && f_ip_column > 0 ? f_ip_column - 1 : f_ip_column); column <= f_ip_column; ++column)
+    {
+        std::string_view source_ip(columns[column]);
+        std::string_view::size_type const slash(source_ip.find('/'));
+        if(slash != std::string_view::npos)
         {
-            // target filtering missed
-            //
-            continue;
+            source_ip = source_ip.substr(0, slash);
         }
 
-        // get the source IP
-        // make sure to remove the mask if present
+        // inet_pton() needs a null terminated string
         //
-        std::string source_ip(columns[ip_column]);
-        std::string::size_type pos(source_ip.find('/'));
-        if(pos != std::string::npos)
+        char ip[INET6_ADDRSTRLEN];
+        if(source_ip.length() >= sizeof(ip))
         {
-            source_ip = source_ip.substr(0, pos);
+            continue;
+        }
+        memcpy(ip, source_ip.data(), source_ip.length());
+        ip[source_ip.length()] = '\0';
+        if(ipv6)
+        {
+            found_ip = inet_pton(AF_INET6, ip, address.data()) == 1;
+        }
+        else
+        {
+            address[10] = 0xFF;
+            address[11] = 0xFF;
+            found_ip = inet_pton(AF_INET, ip, address.data() + 12) == 1;
         }
+        if(found_ip)
+        {
+            break;
+        }
+    }
+    if(!found_ip)
+    {
+        SNAP_LOG_ERROR
+            << "source IP ("
+            << columns[f_ip_column]
+            << ") is not a valid IP address."
+            << SNAP_LOG_SEND;
+        f_exit_code = 1;
+        return true;
+    }
 
-        // filter by IP?
+    // filter by IP?
+    //
+    if(!f_filters.empty()
+    && f_filters.find(address) == f_filters.end())
+    {
+        // ip filter missed
         //
-        if(ip_max > 0)
+        return true;
+    }
+
+    // we got a valid set of columns, get the counters
+    //
+    counters_t line_counters;
+    std::string_view const packets(columns[f_packets_column]);
+    std::string_view const bytes(columns[f_bytes_column]);
+    auto const p(std::from_chars(packets.data(), packets.data() + packets.length(), line_counters.f_packets));
+    auto const b(std::from_chars(bytes.data(), bytes.data() + bytes.length(), line_counters.f_bytes));
+    if(p.ec != std::errc()
+    || p.ptr != packets.data() + packets.length()
+    || b.ec != std::errc()
+    || b.ptr != bytes.data() + bytes.length())
+    {
+        SNAP_LOG_ERROR
+            << "packets ("
+            << packets
+            << ") and/or bytes ("
+            << bytes
+            << ") column(s) are not valid integers."
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    // add this line's counters to the existing totals
+    //
+    // the same IP may appear in several rules (i.e. one per port) so we
+    // need one entry per IP, even with --top
+    //
+    f_total += line_counters;
+    if(!f_merge_totals)
+    {
+        f_counters[address] += line_counters;
+    }
+
+    return true;
+}
+
+
+/** \brief Check whether \p lhs is output before \p rhs.
+ *
+ * The IP addresses are sorted by address, IPv4 first, or by the number
+ * of packets or bytes, largest first. Equal counters are sorted by
+ * address so the output does not depend on the hash map order.
+ *
+ * \param[in] lhs  The left hand side entry.
+ * \param[in] rhs  The right hand side entry.
+ *
+ * \return true if \p lhs comes first.
+ */
+bool count::before(
+      counter_map_t::const_iterator const & lhs
+    , counter_map_t::const_iterator const & rhs) const
+{
+    switch(f_sort)
+    {
+    case sort_t::SORT_PACKETS:
+        if(lhs->second.f_packets != rhs->second.f_packets)
         {
-            bool found(false);
-            for(int idx(0); idx < ip_max; ++idx)
-            {
-                std::string const ip(f_controller->opts().get_string("--", idx));
-                parse_ip(ip); // TODO: this should be done in a loop ahead of time instead of each time we loop here!
+            return lhs->second.f_packets > rhs->second.f_packets;
+        }
+        if(lhs->second.f_bytes != rhs->second.f_bytes)
+        {
+            return lhs->second.f_bytes > rhs->second.f_bytes;
+        }
+        break;
 
-                if(source_ip == ip)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if(!found)
-            {
-                // ip filter missed
-                //
-                continue;
-            }
+    case sort_t::SORT_BYTES:
+        if(lhs->second.f_bytes != rhs->second.f_bytes)
+        {
+            return lhs->second.f_bytes > rhs->second.f_bytes;
         }
+        if(lhs->second.f_packets != rhs->second.f_packets)
+        {
+            return lhs->second.f_packets > rhs->second.f_packets;
+        }
+        break;
 
-        // we got a valid set of columns, get the counters
-        //
-        std::int64_t packets;
-        std::int64_t bytes;
-        if(!advgetopt::validator_integer::convert_string(columns[packets_column], packets)
-        || !advgetopt::validator_integer::convert_string(columns[bytes_column], bytes))
+    case sort_t::SORT_IP:
+        break;
+
+    }
+
+    bool const lhs_ipv4(is_ipv4(lhs->first));
+    bool const rhs_ipv4(is_ipv4(rhs->first));
+    if(lhs_ipv4 != rhs_ipv4)
+    {
+        return lhs_ipv4;
+    }
+    return lhs->first < rhs->first;
+}
+
+
+/** \brief Select and sort the entries to output.
+ *
+ * With --top, the entries are selected with a heap bounded to the
+ * requested number of entries. The top of the heap is the entry which
+ * would be output last, so a new entry only goes in the heap if it comes
+ * before that one. This costs O(M log N) instead of sorting all the M
+ * entries and the selection never holds more than N iterators.
+ *
+ * \return The entries to output, in order.
+ */
+count::selection_t count::select() const
+{
+    auto const cmp([this](auto const & lhs, auto const & rhs)
         {
-            SNAP_LOG_ERROR
-                << "packets ("
-                << columns[packets_column]
-                << ") and/or bytes ("
-                << columns[bytes_column]
-                << ") column(s) are not valid integers."
-                << SNAP_LOG_SEND;
-            f_exit_code = 1;
-            return;
+            return before(lhs, rhs);
+        });
+
+    selection_t selection;
+    if(f_top == 0
+    || f_top >= f_counters.size())
+    {
+        selection.reserve(f_counters.size());
+        for(auto it(f_counters.cbegin()); it != f_counters.cend(); ++it)
+        {
+            selection.push_back(it);
         }
+        std::sort(selection.begin(), selection.end(), cmp);
+        return selection;
+    }
 
-        // add this line's counters to the existing totals
-        //
-        data_t const line_counters(packets, bytes);
-        if(merge_totals)
+    selection.reserve(f_top);
+    for(auto it(f_counters.cbegin()); it != f_counters.cend(); ++it)
+    {
+        if(selection.size() < f_top)
         {
-            // user wants one grand total, ignore source_ip
-            //
-            totals["0.0.0.0"] += line_counters;
+            selection.push_back(it);
+            std::push_heap(selection.begin(), selection.end(), cmp);
         }
-        else
+        else if(before(it, selection.front()))
         {
-            totals[source_ip] += line_counters;
+            std::pop_heap(selection.begin(), selection.end(), cmp);
+            selection.back() = it;
+            std::push_heap(selection.begin(), selection.end(), cmp);
         }
     }
+    std::sort_heap(selection.begin(), selection.end(), cmp);
 
-    // done with the pipe
-    //
-    f.reset();
+    return selection;
+}
 
-    // got the totals now!
-    //
-    for(auto const & t : totals)
+
+/** \brief Print the counters.
+ *
+ * By default, each line shows one IP address followed by its number of
+ * packets and bytes. With --total, only one line with the grand total
+ * is printed, using "0.0.0.0" as the IP address.
+ */
+void count::output()
+{
+    selection_t const selection(f_merge_totals ? selection_t() : select());
+
+    if(f_json)
+    {
+        output_json(selection);
+        return;
+    }
+
+    if(f_merge_totals)
     {
-        std::cout << t.first << " " << t.second.f_packets << " " << t.second.f_bytes << std::endl;
+        std::cout << "0.0.0.0 " << f_total.f_packets << " " << f_total.f_bytes << std::endl;
+        return;
+    }
+
+    for(auto const & it : selection)
+    {
+        char ip[INET6_ADDRSTRLEN];
+        address_to_string(it->first, ip);
+        std::cout << ip << ' ' << it->second.f_packets << ' ' << it->second.f_bytes << '\n';
+    }
+    std::cout << std::flush;
+}
+
+
+/** \brief Print the counters in JSON.
+ *
+ * The output is one object with the grand total and, unless --total
+ * was used, the array of counters per IP address:
+ *
+ * \code
+ * {
+ *   "total": {"ips": 2, "packets": 15, "bytes": 900},
+ *   "counters": [
+ *     {"ip": "192.0.2.7", "packets": 10, "bytes": 600},
+ *     {"ip": "2001:db8::3", "packets": 5, "bytes": 300}
+ *   ]
+ * }
+ * \endcode
+ *
+ * The number of IPs is not available with --total.
+ *
+ * \param[in] selection  The entries to output.
+ */
+void count::output_json(selection_t const & selection)
+{
+    std::cout << "{\n  \"total\": {";
+    if(!f_merge_totals)
+    {
+        std::cout << "\"ips\": " << f_counters.size() << ", ";
     }
+    std::cout
+        << "\"packets\": " << f_total.f_packets
+        << ", \"bytes\": " << f_total.f_bytes
+        << '}';
+
+    if(!f_merge_totals)
+    {
+        std::cout << ",\n  \"counters\": [";
+        char const * separator("\n");
+        for(auto const & it : selection)
+        {
+            char ip[INET6_ADDRSTRLEN];
+            address_to_string(it->first, ip);
+            std::cout
+                << separator
+                << "    {\"ip\": \"" << ip
+                << "\", \"packets\": " << it->second.f_packets
+                << ", \"bytes\": " << it->second.f_bytes
+                << '}';
+            separator = ",\n";
+        }
+        std::cout << "\n  ]";
+    }
+
+    std::cout << "\n}" << std::endl;
 }
 
 
-addr::addr count::parse_ip(std::string const & ip)
+count::address_t count::parse_ip(std::string const & ip)
 {
     addr::addr_parser p;
     p.set_protocol(IPPROTO_TCP);
@@ -512,7 +949,12 @@ addr::addr count::parse_ip(std::string const & ip)
         e.set_parameter("parse_error", p.error_messages());
         throw e;
     }
-    return addresses[0].get_from();
+
+    sockaddr_in6 in6;
+    addresses[0].get_from().get_ipv6(in6);
+    address_t address;
+    memcpy(address.data(), &in6.sin6_addr, address.size());
+    return address;
 }
 
 
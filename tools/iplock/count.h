@@ -32,6 +32,14 @@
 #include    "command.h"
 
 
+// C++
+//
+#include    <array>
+#include    <string_view>
+#include    <unordered_map>
+#include    <unordered_set>
+
+
 
 namespace tool
 {
@@ -48,12 +56,64 @@ public:
     virtual void                    run() override;
 
 private:
-    addr::addr                      parse_ip(std::string const & ip);
+    typedef std::array<std::uint8_t, 16>    address_t;      // IPv4 addresses are mapped (::ffff:a.b.c.d)
+
+    struct address_hash
+    {
+        std::size_t                 operator () (address_t const & address) const;
+    };
+
+    struct counters_t
+    {
+        counters_t &                operator += (counters_t const & rhs);
+
+        std::int64_t                f_packets = 0;
+        std::int64_t                f_bytes = 0;
+    };
+
+    typedef std::unordered_map<address_t, counters_t, address_hash>
+                                    counter_map_t;
+    typedef std::unordered_set<address_t, address_hash>
+                                    address_set_t;
+    typedef std::vector<counter_map_t::const_iterator>
+                                    selection_t;
+
+    enum class sort_t
+    {
+        SORT_IP,
+        SORT_PACKETS,
+        SORT_BYTES,
+    };
+
+    std::string                     get_chain(char const * name, std::string const & default_chain);
+    address_t                       parse_ip(std::string const & ip);
+    bool                            verify_columns();
+    bool                            read_counters(char const * iptables, std::string const & chain, bool ipv6);
+    bool                            parse_line(std::string_view line, bool ipv6);
+    bool                            before(
+                                          counter_map_t::const_iterator const & lhs
+                                        , counter_map_t::const_iterator const & rhs) const;
+    selection_t                     select() const;
+    void                            output();
+    void                            output_json(selection_t const & selection);
 
     bool const                      f_reset;  // since it is const, you must specify it in the constructor
-    //advgetopt::getopt::pointer_t    f_count_opts = advgetopt::getopt::pointer_t();
+    bool const                      f_merge_totals;
+    bool const                      f_json;
+    std::size_t                     f_top = 0;      // 0 means all
+    sort_t                          f_sort = sort_t::SORT_IP;
     std::vector<std::string>        f_targets = std::vector<std::string>();
     std::string                     f_chain = std::string();
+    std::string                     f_chain6 = std::string();
+    std::string                     f_ignore_line_starting_with = std::string();
+    long                            f_packets_column = 0;
+    long                            f_bytes_column = 0;
+    long                            f_target_column = 0;
+    long                            f_ip_column = 0;
+    std::size_t                     f_min_column_count = 0;
+    address_set_t                   f_filters = address_set_t();
+    counter_map_t                   f_counters = counter_map_t();
+    counters_t                      f_total = counters_t();
 };
 
 
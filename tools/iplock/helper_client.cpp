@@ -0,0 +1,190 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "helper_client.h"
+
+#include    "serve.h"
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C
+//
+#include    <string.h>
+#include    <sys/socket.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace tool
+{
+
+
+
+/** \class helper_client
+ * \brief One connection to the iplock helper.
+ *
+ * Each packet received from the client is one array of requests. The
+ * requests are handed to the serve command and the responses are sent
+ * back in one packet.
+ *
+ * The client is expected to read its responses. If it does not and the
+ * socket buffer fills up, the connection is closed instead of blocking
+ * the helper.
+ */
+
+
+/** \brief Initialize the client connection.
+ *
+ * \param[in] s  The serve command handling the requests.
+ * \param[in] fd  The socket returned by accept().
+ * \param[in] pid  The process identifier of the peer, used in logs.
+ */
+helper_client::helper_client(serve * s, int fd, pid_t pid)
+    : fd_connection(fd, ed::fd_connection::mode_t::FD_MODE_READ)
+    , f_serve(s)
+    , f_pid(pid)
+{
+    set_name("helper_client");
+}
+
+
+helper_client::~helper_client()
+{
+    close(get_socket());
+}
+
+
+/** \brief Read and process the request packets.
+ *
+ * The socket is non-blocking so all the packets received so far get
+ * processed at once.
+ */
+void helper_client::process_read()
+{
+    iplock::helper_request requests[iplock::HELPER_MAX_REQUESTS];
+    iplock::helper_response responses[iplock::HELPER_MAX_REQUESTS];
+
+    for(;;)
+    {
+        ssize_t const r(recv(get_socket(), requests, sizeof(requests), MSG_TRUNC));
+        if(r == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN
+            && errno != EWOULDBLOCK)
+            {
+                int const e(errno);
+                SNAP_LOG_ERROR
+                    << "helper recv() from pid "
+                    << f_pid
+                    << " failed: "
+                    << strerror(e)
+                    << SNAP_LOG_SEND;
+                disconnect();
+            }
+            return;
+        }
+        if(r == 0)
+        {
+            disconnect();
+            return;
+        }
+
+        // with MSG_TRUNC, r is the real size of the packet
+        //
+        if(static_cast<std::size_t>(r) > sizeof(requests)
+        || r % sizeof(iplock::helper_request) != 0)
+        {
+            SNAP_LOG_ERROR
+                << "helper received an invalid packet of "
+                << r
+                << " bytes from pid "
+                << f_pid
+                << "."
+                << SNAP_LOG_SEND;
+            disconnect();
+            return;
+        }
+
+        std::size_t const count(r / sizeof(iplock::helper_request));
+        f_serve->process(requests, responses, count);
+
+        std::size_t const size(count * sizeof(iplock::helper_response));
+        ssize_t w(-1);
+        do
+        {
+            w = send(get_socket(), responses, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        while(w == -1 && errno == EINTR);
+        if(w != static_cast<ssize_t>(size))
+        {
+            int const e(errno);
+            SNAP_LOG_ERROR
+                << "helper could not reply to pid "
+                << f_pid
+                << ": "
+                << strerror(e)
+                << SNAP_LOG_SEND;
+            disconnect();
+            return;
+        }
+    }
+}
+
+
+void helper_client::process_hup()
+{
+    disconnect();
+}
+
+
+void helper_client::process_error()
+{
+    disconnect();
+}
+
+
+void helper_client::disconnect()
+{
+    ed::communicator::instance()->remove_connection(shared_from_this());
+}
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
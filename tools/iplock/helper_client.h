@@ -0,0 +1,63 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// eventdispatcher
+//
+#include    <eventdispatcher/fd_connection.h>
+
+
+
+namespace tool
+{
+
+
+
+class serve;
+
+
+
+class helper_client
+    : public ed::fd_connection
+{
+public:
+    typedef std::shared_ptr<helper_client>      pointer_t;
+
+                        helper_client(serve * s, int fd, pid_t pid);
+                        helper_client(helper_client const &) = delete;
+    virtual             ~helper_client() override;
+
+    helper_client &     operator = (helper_client const &) = delete;
+
+    // ed::fd_connection implementation
+    //
+    virtual void        process_read() override;
+    virtual void        process_hup() override;
+    virtual void        process_error() override;
+
+private:
+    void                disconnect();
+
+    serve *             f_serve = nullptr;
+    pid_t               f_pid = -1;
+};
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
@@ -0,0 +1,205 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "helper_listener.h"
+
+#include    "helper_client.h"
+#include    "serve.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C
+//
+#include    <stddef.h>
+#include    <string.h>
+#include    <sys/socket.h>
+#include    <sys/un.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace tool
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief Create the abstract Unix socket the helper listens on.
+ *
+ * The socket is of type SOCK_SEQPACKET so each request packet is
+ * received whole. Being abstract, it does not appear in the file system
+ * and goes away with the process.
+ *
+ * \param[in] name  The name of the socket, without the leading '\0'.
+ *
+ * \return The listening socket.
+ */
+int create_socket(char const * name)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::size_t const length(strlen(name));
+    if(length + 1 >= sizeof(address.sun_path))
+    {
+        throw iplock::invalid_parameter(
+                  std::string("helper socket name \"")
+                + name
+                + "\" is too long.");
+    }
+    memcpy(address.sun_path + 1, name, length);
+
+    int const s(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if(s == -1)
+    {
+        int const e(errno);
+        throw iplock::ipset_error(
+                  std::string("could not create the helper socket: ")
+                + strerror(e));
+    }
+    socklen_t const size(offsetof(sockaddr_un, sun_path) + 1 + length);
+    if(bind(s, reinterpret_cast<sockaddr const *>(&address), size) != 0
+    || listen(s, SOMAXCONN) != 0)
+    {
+        int const e(errno);
+        close(s);
+        throw iplock::ipset_error(
+                  std::string("could not listen on helper socket \"@")
+                + name
+                + "\": "
+                + strerror(e));
+    }
+
+    return s;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class helper_listener
+ * \brief Accept the connections of the helper clients.
+ *
+ * The listener accepts new connections on the abstract Unix socket. The
+ * credentials of the peer are retrieved with SO_PEERCRED and checked
+ * against the list of users and groups allowed to send requests. Peers
+ * which are not authorized are disconnected immediately.
+ */
+
+
+/** \brief Create the listening socket.
+ *
+ * \param[in] s  The serve command handling the requests.
+ * \param[in] name  The name of the abstract socket.
+ */
+helper_listener::helper_listener(serve * s, char const * name)
+    : fd_connection(create_socket(name), ed::fd_connection::mode_t::FD_MODE_READ)
+    , f_serve(s)
+{
+    set_name("helper_listener");
+}
+
+
+helper_listener::~helper_listener()
+{
+    close(get_socket());
+}
+
+
+/** \brief Accept the pending connections.
+ *
+ * The socket is non-blocking so we accept connections until none are
+ * left.
+ */
+void helper_listener::process_read()
+{
+    for(;;)
+    {
+        int const fd(accept4(get_socket(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+        if(fd == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN
+            && errno != EWOULDBLOCK)
+            {
+                int const e(errno);
+                SNAP_LOG_ERROR
+                    << "helper accept() failed: "
+                    << strerror(e)
+                    << SNAP_LOG_SEND;
+            }
+            return;
+        }
+
+        ucred cred = {};
+        socklen_t size(sizeof(cred));
+        if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) != 0
+        || !f_serve->is_authorized(cred))
+        {
+            SNAP_LOG_WARNING
+                << "refused helper connection from pid "
+                << cred.pid
+                << " (uid "
+                << cred.uid
+                << ", gid "
+                << cred.gid
+                << ")."
+                << SNAP_LOG_SEND;
+            close(fd);
+            continue;
+        }
+
+        ed::communicator::instance()->add_connection(
+                std::make_shared<helper_client>(f_serve, fd, cred.pid));
+    }
+}
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
@@ -0,0 +1,58 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// eventdispatcher
+//
+#include    <eventdispatcher/fd_connection.h>
+
+
+
+namespace tool
+{
+
+
+
+class serve;
+
+
+
+class helper_listener
+    : public ed::fd_connection
+{
+public:
+    typedef std::shared_ptr<helper_listener>    pointer_t;
+
+                        helper_listener(serve * s, char const * name);
+                        helper_listener(helper_listener const &) = delete;
+    virtual             ~helper_listener() override;
+
+    helper_listener &   operator = (helper_listener const &) = delete;
+
+    // ed::fd_connection implementation
+    //
+    virtual void        process_read() override;
+
+private:
+    serve *             f_serve = nullptr;
+};
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
@@ -36,9 +36,15 @@
 #include    "controller.h"
 
 
-// snapdev
+// iplock
 //
-#include    <snapdev/string_replace_many.h>
+#include    <iplock/exception.h>
+#include    <iplock/ipset_netlink.h>
+
+
+// libaddr
+//
+#include    <libaddr/addr_parser.h>
 
 
 // snaplogger
@@ -48,9 +54,16 @@
 
 // C++
 //
+#include    <algorithm>
 #include    <iostream>
 
 
+// C
+//
+#include    <netinet/in.h>
+#include    <string.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -65,16 +78,101 @@ namespace tool
 /** \class list
  * \brief List the IP addresses of a set.
  *
- * This class prints out the contents of a set using the `ipset list ...`
- * command.
+ * This class prints out the contents of a set. The members are read
+ * directly from the kernel through netlink and streamed to stdout, so
+ * even very large sets can be listed.
+ *
+ * The output can be limited with:
  *
- * \todo
- * Add options to allow things such as tweaking the formatting.
+ * \li `--filter <cidr>` -- only list the members within that network;
+ * \li `--offset <n>` and `--limit <n>` -- skip the first \em n members
+ *     and show at most \em n members (i.e. pagination);
+ * \li `--sort ip|packets|bytes|timeout` -- sort the members; the
+ *     counters and timeout are sorted largest first;
+ * \li `--count-only` -- only print the number of members as found in
+ *     the header of the set, without listing the members.
+ *
+ * Without --sort, the listing stops as soon as the limit is reached.
+ * With --sort and --limit, only the first offset + limit members are
+ * kept in memory.
  */
 
 list::list(controller * parent)
     : command(parent, "list")
+    , f_count_only(f_controller->opts().is_defined("count-only"))
 {
+    if(f_controller->opts().is_defined("sort"))
+    {
+        std::string const sort(f_controller->opts().get_string("sort"));
+        if(sort == "ip")
+        {
+            f_sort = sort_t::SORT_IP;
+        }
+        else if(sort == "packets")
+        {
+            f_sort = sort_t::SORT_PACKETS;
+        }
+        else if(sort == "bytes")
+        {
+            f_sort = sort_t::SORT_BYTES;
+        }
+        else if(sort == "timeout")
+        {
+            f_sort = sort_t::SORT_TIMEOUT;
+        }
+        else
+        {
+            iplock::invalid_parameter e(
+                  "unsupported --sort \""
+                + sort
+                + "\", expected \"ip\", \"packets\", \"bytes\", or \"timeout\".");
+            e.set_parameter("sort", sort);
+            throw e;
+        }
+    }
+
+    if(f_controller->opts().is_defined("offset"))
+    {
+        f_offset = f_controller->opts().get_long("offset");
+    }
+    if(f_controller->opts().is_defined("limit"))
+    {
+        f_limit = f_controller->opts().get_long("limit");
+    }
+
+    if(f_controller->opts().is_defined("filter"))
+    {
+        std::string const filter(f_controller->opts().get_string("filter"));
+        addr::addr_parser p;
+        p.set_protocol(IPPROTO_TCP);
+        p.set_allow(addr::allow_t::ALLOW_REQUIRED_ADDRESS, true);
+        p.set_allow(addr::allow_t::ALLOW_MASK, true);
+        p.set_allow(addr::allow_t::ALLOW_PORT, false);
+        addr::addr_range::vector_t ranges(p.parse(filter));
+        if(ranges.size() != 1
+        || !ranges[0].has_from()
+        || ranges[0].has_to())
+        {
+            iplock::invalid_parameter e(
+                  "--filter \""
+                + filter
+                + "\" is not a valid IP address or network: "
+                + p.error_messages()
+                + ".");
+            e.set_parameter("filter", filter);
+            throw e;
+        }
+        addr::addr const a(ranges[0].get_from());
+        sockaddr_in6 in6;
+        a.get_ipv6(in6);
+        memcpy(f_filter_address.data(), &in6.sin6_addr, f_filter_address.size());
+        f_filter_prefix = a.get_mask_size();
+        if(f_filter_prefix < 0)
+        {
+            f_filter_prefix = 128;
+        }
+        f_filter = true;
+    }
 }
 
 
@@ -85,6 +183,8 @@ list::~list()
 
 void list::run()
 {
+    iplock::ipset_netlink s;
+
     bool found(false);
     bool newline(false);
     for(int i(0); tool::g_suffixes[i] != nullptr; ++i)
@@ -94,18 +194,8 @@ void list::run()
         // check whether an ipset with that suffix exists
         // if not, just skip that one
         //
-        if(newline)
-        {
-            // add a newline between each list
-            //
-            std::cout << '\n';
-        }
-        std::string const exists("ipset list [set] 2>/dev/null");
-        std::string test_exists(snapdev::string_replace_many(exists, {
-                    { "[set]", set_name }
-                }));
-        int const e(system(test_exists.c_str()));
-        if(e != 0)
+        iplock::ipset_header h;
+        if(!s.header(set_name, h))
         {
             if(f_verbose)
             {
@@ -114,13 +204,28 @@ void list::run()
                     << set_name
                     << "\" does not exist. Nothing to list."
                     << SNAP_LOG_SEND;
-                newline = true;
             }
             continue;
         }
         found = true;
+
+        if(f_count_only)
+        {
+            std::cout << set_name << ' ' << h.f_elements << '\n';
+            continue;
+        }
+
+        if(newline)
+        {
+            // add a newline between each list
+            //
+            std::cout << '\n';
+        }
         newline = true;
+
+        list_set(s, set_name, h);
     }
+    std::cout << std::flush;
 
     if(!found)
     {
@@ -133,6 +238,201 @@ void list::run()
 }
 
 
+/** \brief Print the header and the members of one set.
+ *
+ * \param[in] s  The ipset client.
+ * \param[in] set_name  The name of the set to list.
+ * \param[in] h  The header of the set.
+ */
+void list::list_set(iplock::ipset & s, std::string const & set_name, iplock::ipset_header const & h)
+{
+    std::cout
+        << "Name: " << set_name << '\n'
+        << "Type: " << h.f_type << '\n'
+        << "Number of entries: " << h.f_elements << '\n'
+        << "Members:\n";
+
+    // the members of a list:set are names of sets, not IP addresses
+    //
+    if(h.f_type.compare(0, 5, "list:") == 0)
+    {
+        return;
+    }
+
+    if(f_sort == sort_t::SORT_NONE)
+    {
+        // stream the members; stop as soon as the limit is reached
+        //
+        std::size_t skip(f_offset);
+        std::size_t printed(0);
+        s.list(set_name, [&](iplock::ipset_element const & element)
+            {
+                if(!matches(element))
+                {
+                    return true;
+                }
+                if(skip > 0)
+                {
+                    --skip;
+                    return true;
+                }
+                print(element, h);
+                ++printed;
+                return f_limit == 0 || printed < f_limit;
+            });
+        return;
+    }
+
+    // with a limit, keep the first offset + limit members in a heap
+    // which top is the member that would be output last
+    //
+    auto const cmp([this](iplock::ipset_element const & lhs, iplock::ipset_element const & rhs)
+        {
+            return before(lhs, rhs);
+        });
+    std::size_t const keep(f_limit == 0 ? 0 : f_offset + f_limit);
+    iplock::ipset_element::vector_t members;
+    if(keep != 0)
+    {
+        // the offset and limit come from the command line, do not let
+        // them define the size of the buffer
+        //
+        members.reserve(std::min(keep, static_cast<std::size_t>(h.f_elements)));
+    }
+    s.list(set_name, [&](iplock::ipset_element const & element)
+        {
+            if(!matches(element))
+            {
+                return true;
+            }
+            if(keep == 0)
+            {
+                members.push_back(element);
+            }
+            else if(members.size() < keep)
+            {
+                members.push_back(element);
+                std::push_heap(members.begin(), members.end(), cmp);
+            }
+            else if(before(element, members.front()))
+            {
+                std::pop_heap(members.begin(), members.end(), cmp);
+                members.back() = element;
+                std::push_heap(members.begin(), members.end(), cmp);
+            }
+            return true;
+        });
+    if(keep == 0)
+    {
+        std::sort(members.begin(), members.end(), cmp);
+    }
+    else
+    {
+        std::sort_heap(members.begin(), members.end(), cmp);
+    }
+
+    for(std::size_t idx(f_offset); idx < members.size(); ++idx)
+    {
+        print(members[idx], h);
+    }
+}
+
+
+/** \brief Check whether an element is within the --filter network.
+ *
+ * \param[in] element  The element to check.
+ *
+ * \return true if there is no filter or the element matches it.
+ */
+bool list::matches(iplock::ipset_element const & element) const
+{
+    if(!f_filter)
+    {
+        return true;
+    }
+
+    int const bytes(f_filter_prefix / 8);
+    if(memcmp(element.f_address.data(), f_filter_address.data(), bytes) != 0)
+    {
+        return false;
+    }
+    int const bits(f_filter_prefix % 8);
+    if(bits == 0)
+    {
+        return true;
+    }
+    std::uint8_t const mask(static_cast<std::uint8_t>(0xFF << (8 - bits)));
+    return (element.f_address[bytes] & mask) == (f_filter_address[bytes] & mask);
+}
+
+
+/** \brief Check whether \p lhs is output before \p rhs.
+ *
+ * The addresses are sorted in ascending order. The counters and the
+ * timeouts are sorted largest first, then by address.
+ *
+ * \param[in] lhs  The left hand side element.
+ * \param[in] rhs  The right hand side element.
+ *
+ * \return true if \p lhs comes first.
+ */
+bool list::before(
+      iplock::ipset_element const & lhs
+    , iplock::ipset_element const & rhs) const
+{
+    switch(f_sort)
+    {
+    case sort_t::SORT_PACKETS:
+        if(lhs.f_packets != rhs.f_packets)
+        {
+            return lhs.f_packets > rhs.f_packets;
+        }
+        break;
+
+    case sort_t::SORT_BYTES:
+        if(lhs.f_bytes != rhs.f_bytes)
+        {
+            return lhs.f_bytes > rhs.f_bytes;
+        }
+        break;
+
+    case sort_t::SORT_TIMEOUT:
+        if(lhs.f_timeout != rhs.f_timeout)
+        {
+            return lhs.f_timeout > rhs.f_timeout;
+        }
+        break;
+
+    case sort_t::SORT_NONE:
+    case sort_t::SORT_IP:
+        break;
+
+    }
+
+    return lhs < rhs;
+}
+
+
+/** \brief Print one member the way `ipset list` does.
+ *
+ * \param[in] element  The element to print.
+ * \param[in] h  The header of the set, to know which extensions exist.
+ */
+void list::print(iplock::ipset_element const & element, iplock::ipset_header const & h)
+{
+    std::cout << element.to_string();
+    if(h.f_with_timeout)
+    {
+        std::cout << " timeout " << element.f_timeout;
+    }
+    if(h.f_with_counters)
+    {
+        std::cout << " packets " << element.f_packets << " bytes " << element.f_bytes;
+    }
+    std::cout << '\n';
+}
+
+
 
 } // namespace tool
 // vim: ts=4 sw=4 et
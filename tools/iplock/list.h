@@ -32,6 +32,11 @@
 #include    "command.h"
 
 
+// iplock
+//
+#include    <iplock/ipset.h>
+
+
 
 namespace tool
 {
@@ -46,6 +51,32 @@ public:
     virtual             ~list() override;
 
     virtual void        run() override;
+
+private:
+    enum class sort_t
+    {
+        SORT_NONE,
+        SORT_IP,
+        SORT_PACKETS,
+        SORT_BYTES,
+        SORT_TIMEOUT,
+    };
+
+    bool                matches(iplock::ipset_element const & element) const;
+    bool                before(
+                              iplock::ipset_element const & lhs
+                            , iplock::ipset_element const & rhs) const;
+    void                list_set(iplock::ipset & s, std::string const & set_name, iplock::ipset_header const & h);
+    void                print(iplock::ipset_element const & element, iplock::ipset_header const & h);
+
+    bool const          f_count_only;
+    sort_t              f_sort = sort_t::SORT_NONE;
+    std::size_t         f_offset = 0;
+    std::size_t         f_limit = 0;        // 0 means no limit
+    bool                f_filter = false;
+    iplock::ipset_element::address_t
+                        f_filter_address = iplock::ipset_element::address_t();
+    int                 f_filter_prefix = 128;   // in IPv6 terms
 };
 
 
@@ -0,0 +1,426 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+/** \file
+ * \brief iplock tool.
+ *
+ * This implementation runs iplock as a helper daemon. Local daemons send
+ * their block, unblock, and test requests over a Unix socket instead of
+ * running one iplock process per request.
+ */
+
+
+// self
+//
+#include    "serve.h"
+
+#include    "controller.h"
+#include    "helper_listener.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+#include    <iplock/ipset_netlink.h>
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/communicator.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// C
+//
+#include    <grp.h>
+#include    <pwd.h>
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace tool
+{
+
+
+
+/** \class serve
+ * \brief Run iplock as a helper daemon.
+ *
+ * Running iplock for each IP address to block means parsing the command
+ * line and the configuration files, compiling the allowlist, becoming
+ * root, and opening a netlink socket each time. With `--serve`, all of
+ * that is done once and the requests are received over the abstract
+ * Unix socket "@iplock" (see iplock/helper_protocol.h).
+ *
+ * The peers are authorized using their credentials (SO_PEERCRED). Root
+ * is always accepted. Other users and groups must be listed in the
+ * `serve_users` and `serve_groups` parameters of iplock.conf.
+ *
+ * The requests are checked the same way as the command line: the set
+ * must be one of the allowed sets and allowlisted IP addresses do not
+ * get blocked. The block and unblock requests found in one packet are
+ * applied in one ipset transaction.
+ */
+
+serve::serve(controller * parent)
+    : command(parent, "serve")
+{
+    if(f_controller->opts().is_defined("reset"))
+    {
+        throw iplock::invalid_parameter("--reset is not supported by the --serve command.");
+    }
+    if(f_controller->opts().is_defined("total"))
+    {
+        throw iplock::invalid_parameter("--total is not supported by the --serve command.");
+    }
+    if(f_controller->opts().is_defined("ips"))
+    {
+        throw iplock::invalid_parameter("--ips is not supported by the --serve command.");
+    }
+    if(f_controller->opts().is_defined("--"))
+    {
+        throw iplock::invalid_parameter("the --serve command does not accept IP addresses on the command line.");
+    }
+}
+
+
+serve::~serve()
+{
+}
+
+
+void serve::run()
+{
+    // make sure the default set is valid
+    //
+    get_set_name();
+
+    get_allowlist();
+    get_peers();
+
+    f_ipset = std::make_shared<iplock::ipset_netlink>();
+
+    ed::communicator::pointer_t communicator(ed::communicator::instance());
+    communicator->add_connection(std::make_shared<helper_listener>(this, iplock::HELPER_SOCKET_NAME));
+
+    SNAP_LOG_INFO
+        << "iplock helper listening on \"@"
+        << iplock::HELPER_SOCKET_NAME
+        << "\"."
+        << SNAP_LOG_SEND;
+
+    communicator->run();
+}
+
+
+/** \brief Check whether a peer can send requests.
+ *
+ * \param[in] cred  The credentials of the peer as returned by SO_PEERCRED.
+ *
+ * \return true if the peer is root or one of the allowed users or groups.
+ */
+bool serve::is_authorized(ucred const & cred) const
+{
+    return cred.uid == 0
+        || f_uids.find(cred.uid) != f_uids.end()
+        || f_gids.find(cred.gid) != f_gids.end();
+}
+
+
+/** \brief Process one packet of requests.
+ *
+ * The block and unblock requests are gathered and applied in one
+ * transaction. A test request first applies the operations gathered so
+ * far so it sees the effect of the requests sent before it.
+ *
+ * \param[in] requests  The array of requests.
+ * \param[out] responses  The array of responses, one per request.
+ * \param[in] count  The number of requests.
+ */
+void serve::process(
+      iplock::helper_request const * requests
+    , iplock::helper_response * responses
+    , std::size_t count)
+{
+    iplock::ipset_operation::vector_t operations;
+    std::vector<std::size_t> indexes;
+    operations.reserve(count);
+    indexes.reserve(count);
+
+    for(std::size_t idx(0); idx < count; ++idx)
+    {
+        responses[idx] = iplock::helper_response();
+        responses[idx].f_id = requests[idx].f_id;
+
+        iplock::ipset_operation op;
+        responses[idx].f_status = prepare(requests[idx], op);
+        if(responses[idx].f_status != iplock::helper_status_t::HELPER_STATUS_SUCCESS)
+        {
+            continue;
+        }
+
+        if(requests[idx].f_command == iplock::helper_command_t::HELPER_COMMAND_TEST)
+        {
+            apply(operations, indexes, responses);
+            try
+            {
+                if(!f_ipset->test(op.f_set_name, op.f_element))
+                {
+                    responses[idx].f_status = iplock::helper_status_t::HELPER_STATUS_NOT_FOUND;
+                }
+            }
+            catch(iplock::ipset_error const & e)
+            {
+                SNAP_LOG_ERROR
+                    << e
+                    << SNAP_LOG_SEND;
+                responses[idx].f_status = iplock::helper_status_t::HELPER_STATUS_FAILED;
+            }
+            continue;
+        }
+
+        operations.push_back(std::move(op));
+        indexes.push_back(idx);
+    }
+
+    apply(operations, indexes, responses);
+}
+
+
+void serve::get_allowlist()
+{
+    if(!f_iplock_config->is_defined("allowlist"))
+    {
+        return;
+    }
+
+    f_allowlist.add(f_iplock_config->get_string("allowlist"));
+}
+
+
+/** \brief Load the users and groups allowed to connect.
+ *
+ * The names are converted to identifiers once on startup. Names which
+ * do not exist are reported and ignored.
+ */
+void serve::get_peers()
+{
+    advgetopt::string_list_t users;
+    advgetopt::split_string(f_iplock_config->get_string("serve_users"), users, {","});
+    for(auto const & name : users)
+    {
+        passwd const * pw(getpwnam(name.c_str()));
+        if(pw == nullptr)
+        {
+            SNAP_LOG_WARNING
+                << "unknown user \""
+                << name
+                << "\" in serve_users, ignoring."
+                << SNAP_LOG_SEND;
+            continue;
+        }
+        f_uids.insert(pw->pw_uid);
+    }
+
+    advgetopt::string_list_t groups;
+    advgetopt::split_string(f_iplock_config->get_string("serve_groups"), groups, {","});
+    for(auto const & name : groups)
+    {
+        group const * gr(getgrnam(name.c_str()));
+        if(gr == nullptr)
+        {
+            SNAP_LOG_WARNING
+                << "unknown group \""
+                << name
+                << "\" in serve_groups, ignoring."
+                << SNAP_LOG_SEND;
+            continue;
+        }
+        f_gids.insert(gr->gr_gid);
+    }
+}
+
+
+/** \brief Verify a request and convert it to an ipset operation.
+ *
+ * \param[in] request  The request to verify.
+ * \param[out] op  The resulting operation.
+ *
+ * \return HELPER_STATUS_SUCCESS if the operation can be applied.
+ */
+iplock::helper_status_t serve::prepare(
+      iplock::helper_request const & request
+    , iplock::ipset_operation & op)
+{
+    if(request.f_version != iplock::HELPER_PROTOCOL_VERSION)
+    {
+        return iplock::helper_status_t::HELPER_STATUS_INVALID;
+    }
+
+    switch(request.f_command)
+    {
+    case iplock::helper_command_t::HELPER_COMMAND_BLOCK:
+    case iplock::helper_command_t::HELPER_COMMAND_TEST:
+        op.f_command = iplock::ipset_command_t::IPSET_COMMAND_ADD;
+        break;
+
+    case iplock::helper_command_t::HELPER_COMMAND_UNBLOCK:
+        op.f_command = iplock::ipset_command_t::IPSET_COMMAND_DEL;
+        break;
+
+    default:
+        return iplock::helper_status_t::HELPER_STATUS_INVALID;
+
+    }
+
+    std::size_t const length(strnlen(request.f_set_name, sizeof(request.f_set_name)));
+    if(length >= sizeof(request.f_set_name))
+    {
+        return iplock::helper_status_t::HELPER_STATUS_INVALID;
+    }
+    std::string set_name(length == 0
+            ? get_set_name()
+            : std::string(request.f_set_name, length));
+    if(!is_set_allowed(set_name))
+    {
+        return iplock::helper_status_t::HELPER_STATUS_SET_NOT_ALLOWED;
+    }
+
+    iplock::ipset_element & element(op.f_element);
+    memcpy(element.f_address.data(), request.f_address, element.f_address.size());
+    element.f_timeout = std::min(request.f_timeout, iplock::IPSET_MAX_TIMEOUT);
+
+    // clear the host bits so the same network is always the same element
+    //
+    bool const ipv4(element.is_ipv4());
+    int const host_cidr(element.get_host_cidr());
+    if(request.f_cidr > host_cidr)
+    {
+        return iplock::helper_status_t::HELPER_STATUS_INVALID;
+    }
+    int prefix(128);
+    if(request.f_cidr != 0
+    && request.f_cidr != host_cidr)
+    {
+        element.f_cidr = request.f_cidr;
+        prefix = request.f_cidr + (ipv4 ? 96 : 0);
+        for(int bit(prefix); bit < 128; ++bit)
+        {
+            element.f_address[bit / 8] &= ~(0x80 >> (bit % 8));
+        }
+    }
+
+    if(request.f_command == iplock::helper_command_t::HELPER_COMMAND_BLOCK)
+    {
+        bool const allowed(prefix == 128
+                ? f_allowlist.is_allowed(element.f_address)
+                : f_allowlist.overlaps(element.f_address, prefix));
+        if(allowed)
+        {
+            return iplock::helper_status_t::HELPER_STATUS_ALLOWLISTED;
+        }
+    }
+
+    set_name += ipv4 ? "_ipv4" : "_ipv6";
+    op.f_set_name = std::move(set_name);
+
+    return iplock::helper_status_t::HELPER_STATUS_SUCCESS;
+}
+
+
+/** \brief Send the gathered operations to the kernel.
+ *
+ * The operations are sent in one transaction. The kernel only tells us
+ * how many operations failed, so on errors each operation is sent again
+ * on its own to know which responses to mark as failed. Adding an
+ * element which already exists or deleting one which does not are not
+ * errors so doing so is safe.
+ *
+ * On return, \p operations and \p indexes are empty.
+ *
+ * \param[in,out] operations  The operations to apply.
+ * \param[in,out] indexes  The index of the response of each operation.
+ * \param[out] responses  The responses to update on errors.
+ */
+void serve::apply(
+      iplock::ipset_operation::vector_t & operations
+    , std::vector<std::size_t> & indexes
+    , iplock::helper_response * responses)
+{
+    if(operations.empty())
+    {
+        return;
+    }
+
+    std::size_t errors(0);
+    try
+    {
+        errors = f_ipset->apply(operations);
+    }
+    catch(iplock::ipset_error const & e)
+    {
+        SNAP_LOG_ERROR
+            << e
+            << SNAP_LOG_SEND;
+        errors = operations.size();
+    }
+
+    if(errors != 0)
+    {
+        std::size_t const max(operations.size());
+        for(std::size_t idx(0); idx < max; ++idx)
+        {
+            iplock::ipset_operation::vector_t const one{ operations[idx] };
+            bool failed(true);
+            try
+            {
+                failed = f_ipset->apply(one) != 0;
+            }
+            catch(iplock::ipset_error const &)
+            {
+            }
+            if(failed)
+            {
+                responses[indexes[idx]].f_status = iplock::helper_status_t::HELPER_STATUS_FAILED;
+            }
+        }
+    }
+
+    operations.clear();
+    indexes.clear();
+}
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
@@ -0,0 +1,92 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Definition of the iplock --serve command.
+ *
+ * The serve command runs iplock as a helper daemon which applies the
+ * block, unblock, and test requests sent over a Unix socket.
+ */
+
+// self
+//
+#include    "command.h"
+
+
+// iplock
+//
+#include    <iplock/allowlist.h>
+#include    <iplock/helper_protocol.h>
+#include    <iplock/ipset.h>
+
+
+// C++
+//
+#include    <set>
+
+
+// C
+//
+#include    <sys/socket.h>
+
+
+
+namespace tool
+{
+
+
+
+class serve
+    : public command
+{
+public:
+                        serve(controller * parent);
+    virtual             ~serve() override;
+
+    virtual void        run() override;
+
+    bool                is_authorized(ucred const & cred) const;
+    void                process(
+                              iplock::helper_request const * requests
+                            , iplock::helper_response * responses
+                            , std::size_t count);
+
+private:
+    void                get_allowlist();
+    void                get_peers();
+    iplock::helper_status_t
+                        prepare(
+                              iplock::helper_request const & request
+                            , iplock::ipset_operation & op);
+    void                apply(
+                              iplock::ipset_operation::vector_t & operations
+                            , std::vector<std::size_t> & indexes
+                            , iplock::helper_response * responses);
+
+    iplock::allowlist   f_allowlist = iplock::allowlist();
+    iplock::ipset::pointer_t
+                        f_ipset = iplock::ipset::pointer_t();
+    std::set<uid_t>     f_uids = std::set<uid_t>();
+    std::set<gid_t>     f_gids = std::set<gid_t>();
+};
+
+
+
+} // namespace tool
+// vim: ts=4 sw=4 et
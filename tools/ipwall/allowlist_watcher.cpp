@@ -0,0 +1,148 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "allowlist_watcher.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <set>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \class allowlist_watcher
+ * \brief Watch the allowlist files for changes.
+ *
+ * This connection uses inotify to get notified whenever one of the
+ * files defining the allowlist changes. When that happens, the
+ * allowlist gets reloaded so administrators do not have to restart
+ * ipwall after adding an IP address to the allowlist.
+ *
+ * The networks which were aggregated before one of their addresses
+ * got added to the allowlist are broken at that time.
+ */
+
+
+/** \brief Start watching the directories of the allowlist files.
+ *
+ * The directories are watched instead of the files themselves since
+ * editors often replace the files instead of writing to them.
+ *
+ * \param[in] allowlist  The allowlist to reload on changes.
+ * \param[in] aggregator  The aggregator to check against the new allowlist.
+ */
+allowlist_watcher::allowlist_watcher(
+          iplock::allowlist::pointer_t allowlist
+        , net_aggregator::pointer_t aggregator)
+    : f_allowlist(allowlist)
+    , f_aggregator(aggregator)
+{
+    set_name("allowlist_watcher");
+
+    std::set<std::string> directories;
+    for(auto const & filename : f_allowlist->get_filenames())
+    {
+        std::string::size_type const pos(filename.rfind('/'));
+        if(pos != std::string::npos)
+        {
+            directories.insert(filename.substr(0, pos));
+        }
+    }
+
+    ed::file_event_mask_t const events(
+              ed::SNAP_FILE_CHANGED_EVENT_WRITE
+            | ed::SNAP_FILE_CHANGED_EVENT_CREATED
+            | ed::SNAP_FILE_CHANGED_EVENT_DELETED);
+    for(auto const & path : directories)
+    {
+        try
+        {
+            watch_directory(path, events);
+        }
+        catch(std::exception const & e)
+        {
+            // the directory may not exist
+            //
+            SNAP_LOG_WARNING
+                << "could not watch \""
+                << path
+                << "\" for changes: "
+                << e.what()
+                << SNAP_LOG_SEND;
+        }
+    }
+}
+
+
+void allowlist_watcher::process_event(ed::file_event const & watch_event)
+{
+    // other files in the same directories are ignored
+    //
+    auto basename = [](std::string const & path)
+    {
+        std::string::size_type const pos(path.rfind('/'));
+        return pos == std::string::npos ? path : path.substr(pos + 1);
+    };
+    std::string const filename(basename(watch_event.get_filename()));
+    auto const & filenames(f_allowlist->get_filenames());
+    if(std::none_of(
+              filenames.begin()
+            , filenames.end()
+            , [&basename, &filename](std::string const & f)
+            {
+                return basename(f) == filename;
+            }))
+    {
+        return;
+    }
+
+    SNAP_LOG_INFO
+        << "allowlist file \""
+        << filename
+        << "\" changed; reloading the allowlist."
+        << SNAP_LOG_SEND;
+
+    f_allowlist->reload();
+    if(f_aggregator != nullptr)
+    {
+        f_aggregator->check_allowlist();
+    }
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,68 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "net_aggregator.h"
+
+
+// iplock
+//
+#include    <iplock/allowlist.h>
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/file_changed.h>
+
+
+
+namespace ipwall
+{
+
+
+
+class allowlist_watcher
+    : public ed::file_changed
+{
+public:
+    typedef std::shared_ptr<allowlist_watcher>  pointer_t;
+
+                        allowlist_watcher(
+                              iplock::allowlist::pointer_t allowlist
+                            , net_aggregator::pointer_t aggregator);
+                        allowlist_watcher(allowlist_watcher const &) = delete;
+
+    allowlist_watcher & operator = (allowlist_watcher const &) = delete;
+
+    // ed::file_changed implementation
+    //
+    virtual void        process_event(ed::file_event const & watch_event) override;
+
+private:
+    iplock::allowlist::pointer_t
+                        f_allowlist = iplock::allowlist::pointer_t();
+    net_aggregator::pointer_t
+                        f_aggregator = net_aggregator::pointer_t();
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
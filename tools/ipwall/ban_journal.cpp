@@ -0,0 +1,1013 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "ban_journal.h"
+
+#include    "block_store.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// snapdev
+//
+#include    <snapdev/raii_generic_deleter.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <cstddef>
+#include    <unordered_map>
+
+
+// C
+//
+#include    <fcntl.h>
+#include    <string.h>
+#include    <sys/mman.h>
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+constexpr char const            g_journal_magic[4] = { 'I', 'P', 'W', 'J' };
+constexpr char const            g_snapshot_magic[4] = { 'I', 'P', 'W', 'S' };
+constexpr std::uint32_t const   g_version = 1;
+constexpr char const            g_record_block = 'B';
+constexpr char const            g_record_unblock = 'U';
+
+
+/** \brief The number of journal records we accept before a compaction.
+ *
+ * The journal gets compacted once it has more than this many records
+ * and more than twice as many records as there are entries in the store.
+ */
+constexpr std::size_t const     g_compaction_minimum = 100'000;
+
+
+/** \brief Size at which the journal buffer gets written to disk.
+ *
+ * Records are written to disk on a sync() or once the buffer reaches
+ * this size, whichever comes first.
+ */
+constexpr std::size_t const     g_buffer_size = 64 * 1024;
+
+
+/** \brief The longest reason we save in the journal and snapshot.
+ *
+ * The reason is only informational. Longer reasons get truncated.
+ */
+constexpr std::size_t const     g_max_reason_length = 1024;
+
+
+struct journal_header_t
+{
+    char                f_magic[4];
+    std::uint32_t       f_version;
+};
+
+
+struct journal_record_t
+{
+    std::int64_t        f_limit_sec = 0;
+    std::int64_t        f_limit_nsec = 0;
+    std::int64_t        f_ban_count = 0;
+    std::uint8_t        f_address[16] = {};
+    std::uint32_t       f_checksum = 0;
+    std::uint16_t       f_size = 0;             // including scheme and reason
+    std::uint16_t       f_reason_length = 0;
+    char                f_type = 0;
+    std::uint8_t        f_scheme_length = 0;
+    std::uint16_t       f_reserved1 = 0;
+    std::uint32_t       f_reserved2 = 0;
+};
+static_assert(sizeof(journal_record_t) == 56);
+
+
+struct snapshot_header_t
+{
+    char                f_magic[4];
+    std::uint32_t       f_version;
+    std::uint64_t       f_count;
+    std::uint64_t       f_strings_offset;
+    std::uint64_t       f_strings_size;
+};
+
+
+struct snapshot_record_t
+{
+    std::int64_t        f_limit_sec = 0;
+    std::int64_t        f_limit_nsec = 0;
+    std::int64_t        f_ban_count = 0;
+    std::uint8_t        f_address[16] = {};
+    std::uint32_t       f_scheme_offset = 0;
+    std::uint32_t       f_reason_offset = 0;
+    std::uint16_t       f_scheme_length = 0;
+    std::uint16_t       f_reason_length = 0;
+    std::uint32_t       f_reserved = 0;
+};
+static_assert(sizeof(snapshot_record_t) == 56);
+
+
+typedef std::unordered_map<block_key, block_info, block_key_hash>
+                                    state_t;
+
+
+std::uint32_t checksum(char const * data, std::size_t size)
+{
+    // FNV-1a
+    //
+    std::uint32_t h(2166136261U);
+    for(std::size_t idx(0); idx < size; ++idx)
+    {
+        h ^= static_cast<std::uint8_t>(data[idx]);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+
+bool write_all(int fd, char const * data, std::size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t const r(::write(fd, data, size));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += r;
+        size -= r;
+    }
+    return true;
+}
+
+
+/** \brief Make a rename() durable.
+ *
+ * A rename() is only saved once the directory holding the file gets
+ * synchronized. Until then, a crash may bring back the old file.
+ *
+ * \param[in] filename  The name of the file which was renamed.
+ *
+ * \return true if the directory was synchronized.
+ */
+bool sync_directory(std::string const & filename)
+{
+    std::string::size_type const pos(filename.rfind('/'));
+    std::string const dir(pos == std::string::npos
+                ? std::string(".")
+                : (pos == 0 ? std::string("/") : filename.substr(0, pos)));
+    int const fd(open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if(fd < 0)
+    {
+        return false;
+    }
+    snapdev::raii_fd_t safe_fd(fd);
+    return fsync(fd) == 0;
+}
+
+
+/** \brief A snapshot ready to be written to disk.
+ *
+ * The records and strings are prepared by the event loop since the
+ * block_info objects cannot be accessed from another thread. The
+ * sorting and the writing can then happen in the kernel worker thread.
+ */
+struct snapshot_t
+{
+    std::vector<snapshot_record_t>      f_records = std::vector<snapshot_record_t>();
+    std::string                         f_strings = std::string();
+};
+
+
+void serialize_snapshot(std::vector<block_info const *> const & entries, snapshot_t & snapshot)
+{
+    std::unordered_map<std::string, std::uint32_t> offsets;
+    auto intern = [&snapshot, &offsets](std::string const & s)
+    {
+        auto const it(offsets.find(s));
+        if(it != offsets.end())
+        {
+            return it->second;
+        }
+        std::uint32_t const offset(snapshot.f_strings.length());
+        snapshot.f_strings += s;
+        offsets[s] = offset;
+        return offset;
+    };
+
+    snapshot.f_records.reserve(entries.size());
+    for(auto const * info : entries)
+    {
+        std::string const scheme(info->get_scheme().substr(0, 255));
+        std::string const reason(info->get_reason().substr(0, g_max_reason_length));
+
+        snapshot_record_t r;
+        r.f_limit_sec = info->get_block_limit().tv_sec;
+        r.f_limit_nsec = info->get_block_limit().tv_nsec;
+        r.f_ban_count = info->get_ban_count();
+        memcpy(r.f_address, info->get_address().data(), sizeof(r.f_address));
+        r.f_scheme_offset = intern(scheme);
+        r.f_scheme_length = scheme.length();
+        r.f_reason_offset = intern(reason);
+        r.f_reason_length = reason.length();
+        snapshot.f_records.push_back(r);
+    }
+}
+
+
+/** \brief Sort and save a snapshot.
+ *
+ * The snapshot is first saved in a temporary file which then gets
+ * renamed. The function returns once the rename() is on disk.
+ *
+ * This function does not access any block_info so it can be called
+ * from the kernel worker thread.
+ *
+ * \param[in] filename  The name of the snapshot file.
+ * \param[in,out] snapshot  The snapshot to save; the records get sorted.
+ *
+ * \return true if the snapshot was saved.
+ */
+bool write_snapshot(std::string const & filename, snapshot_t & snapshot)
+{
+    std::sort(
+          snapshot.f_records.begin()
+        , snapshot.f_records.end()
+        , [](snapshot_record_t const & lhs, snapshot_record_t const & rhs)
+        {
+            return lhs.f_limit_sec < rhs.f_limit_sec
+                || (lhs.f_limit_sec == rhs.f_limit_sec && lhs.f_limit_nsec < rhs.f_limit_nsec);
+        });
+
+    snapshot_header_t header;
+    memcpy(header.f_magic, g_snapshot_magic, sizeof(header.f_magic));
+    header.f_version = g_version;
+    header.f_count = snapshot.f_records.size();
+    header.f_strings_offset = sizeof(header) + snapshot.f_records.size() * sizeof(snapshot_record_t);
+    header.f_strings_size = snapshot.f_strings.length();
+
+    std::string const tmp(filename + ".tmp");
+    {
+        int const fd(open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+        snapdev::raii_fd_t safe_fd(fd);
+        if(fd < 0
+        || !write_all(fd, reinterpret_cast<char const *>(&header), sizeof(header))
+        || !write_all(fd, reinterpret_cast<char const *>(snapshot.f_records.data()), snapshot.f_records.size() * sizeof(snapshot_record_t))
+        || !write_all(fd, snapshot.f_strings.data(), snapshot.f_strings.length())
+        || fsync(fd) != 0)
+        {
+            int const e(errno);
+            SNAP_LOG_ERROR
+                << "could not save snapshot \""
+                << tmp
+                << "\": "
+                << strerror(e)
+                << SNAP_LOG_SEND;
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+    if(rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not rename snapshot \""
+            << tmp
+            << "\": "
+            << strerror(e)
+            << SNAP_LOG_SEND;
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    // the journal can only be dropped once the rename() is on disk,
+    // otherwise a crash could leave us with the old snapshot and an
+    // empty journal
+    //
+    if(!sync_directory(filename))
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not synchronize the directory of snapshot \""
+            << filename
+            << "\": "
+            << strerror(e)
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    SNAP_LOG_INFO
+        << "saved a snapshot of "
+        << snapshot.f_records.size()
+        << " blocks."
+        << SNAP_LOG_SEND;
+
+    return true;
+}
+
+
+void load_snapshot(
+      std::string const & filename
+    , state_t & state)
+{
+    int const fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if(fd < 0)
+    {
+        // no snapshot yet
+        //
+        return;
+    }
+    snapdev::raii_fd_t safe_fd(fd);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0
+    || static_cast<std::size_t>(st.st_size) < sizeof(snapshot_header_t))
+    {
+        SNAP_LOG_ERROR
+            << "snapshot \""
+            << filename
+            << "\" is too small; ignoring."
+            << SNAP_LOG_SEND;
+        return;
+    }
+    std::size_t const size(st.st_size);
+
+    void * ptr(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    if(ptr == MAP_FAILED)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not memory map snapshot \""
+            << filename
+            << "\": "
+            << strerror(e)
+            << SNAP_LOG_SEND;
+        return;
+    }
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    std::shared_ptr<void> unmap(ptr, [size](void * p) { munmap(p, size); });
+
+    char const * data(reinterpret_cast<char const *>(ptr));
+    snapshot_header_t const * header(reinterpret_cast<snapshot_header_t const *>(data));
+    if(memcmp(header->f_magic, g_snapshot_magic, sizeof(g_snapshot_magic)) != 0
+    || header->f_version != g_version
+    || header->f_strings_offset != sizeof(snapshot_header_t) + header->f_count * sizeof(snapshot_record_t)
+    || header->f_strings_offset + header->f_strings_size != size)
+    {
+        SNAP_LOG_ERROR
+            << "snapshot \""
+            << filename
+            << "\" is invalid; ignoring."
+            << SNAP_LOG_SEND;
+        return;
+    }
+
+    char const * strings(data + header->f_strings_offset);
+    snapshot_record_t const * records(reinterpret_cast<snapshot_record_t const *>(data + sizeof(snapshot_header_t)));
+    state.reserve(header->f_count);
+    for(std::uint64_t idx(0); idx < header->f_count; ++idx)
+    {
+        snapshot_record_t const & r(records[idx]);
+        if(static_cast<std::uint64_t>(r.f_scheme_offset) + r.f_scheme_length > header->f_strings_size
+        || static_cast<std::uint64_t>(r.f_reason_offset) + r.f_reason_length > header->f_strings_size)
+        {
+            continue;
+        }
+
+        snapdev::timespec_ex const limit(r.f_limit_sec, r.f_limit_nsec);
+        block_info::address_t address;
+        memcpy(address.data(), r.f_address, address.size());
+        std::string const scheme(strings + r.f_scheme_offset, r.f_scheme_length);
+        block_info info(address, scheme, limit);
+        info.set_ban_count(r.f_ban_count);
+        info.set_reason(std::string(strings + r.f_reason_offset, r.f_reason_length));
+        state.emplace(block_key{ address, info.get_scheme_id() }, info);
+    }
+}
+
+
+off_t replay_journal(std::string const & filename, state_t & state)
+{
+    int const fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if(fd < 0)
+    {
+        return 0;
+    }
+    snapdev::raii_fd_t safe_fd(fd);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0
+    || static_cast<std::size_t>(st.st_size) < sizeof(journal_header_t))
+    {
+        return 0;
+    }
+    std::size_t const size(st.st_size);
+
+    void * ptr(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    if(ptr == MAP_FAILED)
+    {
+        return 0;
+    }
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    std::shared_ptr<void> unmap(ptr, [size](void * p) { munmap(p, size); });
+
+    char const * data(reinterpret_cast<char const *>(ptr));
+    journal_header_t const * header(reinterpret_cast<journal_header_t const *>(data));
+    if(memcmp(header->f_magic, g_journal_magic, sizeof(g_journal_magic)) != 0
+    || header->f_version != g_version)
+    {
+        SNAP_LOG_ERROR
+            << "journal \""
+            << filename
+            << "\" is invalid; ignoring."
+            << SNAP_LOG_SEND;
+        return 0;
+    }
+
+    // the last record may be incomplete if we crashed while writing it;
+    // we stop on the first invalid record and return the size of the
+    // valid part of the journal
+    //
+    std::size_t pos(sizeof(journal_header_t));
+    while(pos + sizeof(journal_record_t) <= size)
+    {
+        journal_record_t r;
+        memcpy(&r, data + pos, sizeof(r));
+        if(r.f_size != sizeof(r) + r.f_scheme_length + r.f_reason_length
+        || pos + r.f_size > size)
+        {
+            break;
+        }
+
+        std::uint32_t const expected(r.f_checksum);
+        r.f_checksum = 0;
+        std::string record(reinterpret_cast<char const *>(&r), sizeof(r));
+        record.append(data + pos + sizeof(r), r.f_size - sizeof(r));
+        if(checksum(record.data(), record.size()) != expected)
+        {
+            break;
+        }
+
+        block_info::address_t address;
+        memcpy(address.data(), r.f_address, address.size());
+        std::string const scheme(record.data() + sizeof(r), r.f_scheme_length);
+        block_key const key{ address, block_info::get_scheme_id(scheme) };
+        switch(r.f_type)
+        {
+        case g_record_block:
+            {
+                block_info info(address, scheme, snapdev::timespec_ex(r.f_limit_sec, r.f_limit_nsec));
+                info.set_ban_count(r.f_ban_count);
+                info.set_reason(record.substr(sizeof(r) + r.f_scheme_length));
+                state.insert_or_assign(key, info);
+            }
+            break;
+
+        case g_record_unblock:
+            state.erase(key);
+            break;
+
+        }
+
+        pos += r.f_size;
+    }
+
+    if(pos != size)
+    {
+        SNAP_LOG_WARNING
+            << "journal \""
+            << filename
+            << "\" ends with an invalid record; it will be truncated at "
+            << pos
+            << " bytes."
+            << SNAP_LOG_SEND;
+    }
+
+    return pos;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class ban_journal
+ * \brief Save the ipwall blocks on disk.
+ *
+ * Since the database is not available, the blocks are saved locally
+ * so a restart of ipwall does not lose all the blocks which did not
+ * yet time out.
+ *
+ * The state is saved in two files:
+ *
+ * \li A snapshot of all the blocks sorted by block limit. This file is
+ * memory mapped on startup which makes it very fast to load even with
+ * a very large number of blocks.
+ * \li An append only journal of the blocks and unblocks which happened
+ * since the last snapshot was saved.
+ *
+ * The journal records the resulting state of a block (i.e. after
+ * keep_longest() was applied) so replaying the journal over the
+ * snapshot is idempotent. A crash between the creation of a new
+ * snapshot and the truncation of the journal is therefore harmless.
+ *
+ * The journal is written and synchronized to disk in batches (see
+ * sync() and start_sync()). A crash may lose the last few records.
+ *
+ * Once the journal grows too large (see needs_compaction()), a new
+ * snapshot gets saved and the journal records are dropped. The journal
+ * gets renamed and a new one started so the snapshot can be saved in
+ * another thread while new records get added (see start_compaction()).
+ */
+
+
+/** \brief Initialize the journal.
+ *
+ * The \p path is the directory where the journal and snapshot files
+ * are saved. It must be writable by ipwall.
+ *
+ * \param[in] path  The directory where the files are saved.
+ */
+ban_journal::ban_journal(std::string const & path)
+    : f_journal_filename(path + "/bans.journal")
+    , f_old_journal_filename(path + "/bans.journal.old")
+    , f_snapshot_filename(path + "/bans.snapshot")
+{
+}
+
+
+ban_journal::~ban_journal()
+{
+    if(f_fd >= 0)
+    {
+        sync();
+        close(f_fd);
+    }
+}
+
+
+/** \brief Load the snapshot and replay the journal.
+ *
+ * This function loads the blocks saved in the snapshot and then applies
+ * the journal records found after it. Blocks which timed out before
+ * \p now are not returned. They are saved in \p expired instead, if
+ * defined, since ipwall added those IP addresses to the IP sets and it
+ * may have to remove them (see block_store::sync_sets()).
+ *
+ * Once loaded, the journal is opened for writing.
+ *
+ * \param[in] now  The current time.
+ * \param[out] expired  The blocks which timed out or nullptr.
+ *
+ * \return The list of blocks sorted by block limit.
+ */
+block_info::block_info_vector_t ban_journal::load(
+      snapdev::timespec_ex const & now
+    , block_info::block_info_vector_t * expired)
+{
+    struct stat st;
+    bool const old_journal(stat(f_old_journal_filename.c_str(), &st) == 0);
+    f_has_state = old_journal
+               || stat(f_snapshot_filename.c_str(), &st) == 0
+               || stat(f_journal_filename.c_str(), &st) == 0;
+
+    // the old journal is only present if a compaction did not complete
+    //
+    state_t state;
+    load_snapshot(f_snapshot_filename, state);
+    if(old_journal)
+    {
+        replay_journal(f_old_journal_filename, state);
+    }
+    off_t const size(replay_journal(f_journal_filename, state));
+
+    block_info::block_info_vector_t result;
+    result.reserve(state.size());
+    for(auto const & s : state)
+    {
+        if(s.second.get_block_limit() > now)
+        {
+            result.push_back(s.second);
+        }
+        else if(expired != nullptr)
+        {
+            expired->push_back(s.second);
+        }
+    }
+    std::sort(result.begin(), result.end());
+
+    open_journal(size);
+    f_loaded = true;
+
+    if(old_journal)
+    {
+        std::vector<block_info const *> entries;
+        entries.reserve(state.size());
+        for(auto const & s : state)
+        {
+            entries.push_back(&s.second);
+        }
+        complete_compaction(entries);
+    }
+
+    return result;
+}
+
+
+/** \brief Check whether a snapshot or journal was found by load().
+ *
+ * When ipwall runs for the first time, or its journal was deleted, it
+ * has no state of its own. In that case the IP sets are the only source
+ * of truth about the blocked IP addresses.
+ *
+ * \return true if load() found a snapshot or a journal.
+ */
+bool ban_journal::has_state() const
+{
+    return f_has_state;
+}
+
+
+void ban_journal::record_block(block_info const & info)
+{
+    append(
+          g_record_block
+        , info.get_address()
+        , info.get_scheme()
+        , info.get_block_limit()
+        , info.get_ban_count()
+        , info.get_reason());
+}
+
+
+void ban_journal::record_unblock(
+      block_info::address_t const & address
+    , std::string const & scheme)
+{
+    append(
+          g_record_unblock
+        , address
+        , scheme
+        , snapdev::timespec_ex()
+        , 0
+        , std::string());
+}
+
+
+/** \brief Write the pending records and synchronize the journal.
+ *
+ * This function runs the job returned by start_sync() in the calling
+ * thread.
+ */
+void ban_journal::sync()
+{
+    job_t job(start_sync());
+    if(job)
+    {
+        job();
+    }
+}
+
+
+/** \brief Write the pending records and prepare their synchronization.
+ *
+ * The records get written to the journal immediately, which only
+ * copies them to the kernel buffers. The returned job calls
+ * fdatasync() which may take a while so the server runs it in the
+ * kernel worker thread, right after the batch of ipset operations
+ * committed at the same time. This way the journal and the firewall
+ * stay in sync without blocking the event loop.
+ *
+ * \return The job to run or an empty job if nothing changed.
+ */
+ban_journal::job_t ban_journal::start_sync()
+{
+    if(!f_dirty)
+    {
+        return job_t();
+    }
+    write_buffer();
+    f_dirty = false;
+    if(f_fd < 0)
+    {
+        return job_t();
+    }
+
+    int const fd(f_fd);
+    return [fd]()
+        {
+            fdatasync(fd);
+        };
+}
+
+
+/** \brief Check whether the journal should be compacted.
+ *
+ * \param[in] entries  The number of entries currently in the store.
+ *
+ * \return true if the journal is large enough to warrant a new snapshot.
+ */
+bool ban_journal::needs_compaction(std::size_t entries) const
+{
+    return f_records > g_compaction_minimum
+        && f_records > entries * 2;
+}
+
+
+/** \brief Save a new snapshot and drop the journal records.
+ *
+ * This function runs the job returned by start_compaction() in the
+ * calling thread. It is used when ipwall stops.
+ *
+ * \param[in] entries  The blocks to save.
+ */
+void ban_journal::save_snapshot(std::vector<block_info const *> const & entries)
+{
+    job_t job(start_compaction(entries));
+    if(job)
+    {
+        job();
+    }
+}
+
+
+/** \brief Prepare the compaction of the journal.
+ *
+ * The records of the snapshot are prepared from \p entries and the
+ * journal gets renamed to bans.journal.old. A new, empty journal gets
+ * created for the records written from now on. The returned job then
+ * does the slow part, which can run in another thread:
+ *
+ * \li synchronize the old journal and the directory;
+ * \li sort and save the snapshot (see write_snapshot());
+ * \li delete the old journal.
+ *
+ * If ipwall crashes or the snapshot cannot be saved, load() replays
+ * the old journal between the snapshot and the new journal. Since the
+ * journal records the resulting state of each block, the result is
+ * the same.
+ *
+ * The jobs returned by start_sync() and start_compaction() must run
+ * in the order they were returned since this job closes the file
+ * descriptor of the old journal.
+ *
+ * \param[in] entries  The blocks to save.
+ *
+ * \return The job to run or an empty job if no compaction can happen
+ * now (i.e. load() was not yet called or a previous compaction did not
+ * complete).
+ */
+ban_journal::job_t ban_journal::start_compaction(std::vector<block_info const *> const & entries)
+{
+    if(!f_loaded)
+    {
+        // we must not overwrite a snapshot we did not load
+        //
+        return job_t();
+    }
+
+    struct stat st;
+    if(stat(f_old_journal_filename.c_str(), &st) == 0)
+    {
+        // a previous compaction is still running or failed, the old
+        // journal must not be overwritten
+        //
+        return job_t();
+    }
+
+    std::shared_ptr<snapshot_t> snapshot(std::make_shared<snapshot_t>());
+    serialize_snapshot(entries, *snapshot);
+
+    write_buffer();
+    if(rename(f_journal_filename.c_str(), f_old_journal_filename.c_str()) != 0)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not rename journal \""
+            << f_journal_filename
+            << "\": "
+            << strerror(e)
+            << ". The journal is not compacted."
+            << SNAP_LOG_SEND;
+        return job_t();
+    }
+    int const old_fd(f_fd);
+    f_fd = -1;
+    open_journal(0);
+    f_records = 0;
+
+    std::string const snapshot_filename(f_snapshot_filename);
+    std::string const old_journal_filename(f_old_journal_filename);
+    return [snapshot, old_fd, snapshot_filename, old_journal_filename]()
+        {
+            if(old_fd >= 0)
+            {
+                fdatasync(old_fd);
+                close(old_fd);
+            }
+
+            // the rename of the journal and the new journal must be on
+            // disk before the records written in the new journal count
+            //
+            bool const synced(sync_directory(old_journal_filename));
+            if(!synced
+            || !write_snapshot(snapshot_filename, *snapshot))
+            {
+                SNAP_LOG_ERROR
+                    << "the ban journal will be compacted on the next restart."
+                    << SNAP_LOG_SEND;
+                return;
+            }
+
+            unlink(old_journal_filename.c_str());
+        };
+}
+
+
+/** \brief Complete a compaction which was interrupted.
+ *
+ * When load() finds an old journal, the last compaction did not
+ * complete. Another compaction cannot start as long as that file
+ * exists so the loaded state gets saved in a new snapshot right away.
+ *
+ * The old journal gets deleted before the journal gets truncated.
+ * Replaying the old journal without the journal which followed it
+ * could bring back blocks which were removed since.
+ *
+ * \param[in] entries  All the blocks loaded from the files.
+ */
+void ban_journal::complete_compaction(std::vector<block_info const *> const & entries)
+{
+    snapshot_t snapshot;
+    serialize_snapshot(entries, snapshot);
+    if(!write_snapshot(f_snapshot_filename, snapshot)
+    || unlink(f_old_journal_filename.c_str()) != 0
+    || !sync_directory(f_old_journal_filename))
+    {
+        SNAP_LOG_ERROR
+            << "could not complete the compaction of the ban journal."
+            << SNAP_LOG_SEND;
+        return;
+    }
+
+    if(f_fd >= 0
+    && ftruncate(f_fd, sizeof(journal_header_t)) == 0)
+    {
+        fdatasync(f_fd);
+    }
+    f_records = 0;
+}
+
+
+void ban_journal::open_journal(off_t size)
+{
+    f_fd = open(f_journal_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(f_fd < 0)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not open journal \""
+            << f_journal_filename
+            << "\": "
+            << strerror(e)
+            << ". Blocks will not survive a restart."
+            << SNAP_LOG_SEND;
+        return;
+    }
+
+    if(size < static_cast<off_t>(sizeof(journal_header_t)))
+    {
+        // new or invalid journal, start over
+        //
+        journal_header_t header;
+        memcpy(header.f_magic, g_journal_magic, sizeof(header.f_magic));
+        header.f_version = g_version;
+        if(ftruncate(f_fd, 0) != 0
+        || !write_all(f_fd, reinterpret_cast<char const *>(&header), sizeof(header)))
+        {
+            close(f_fd);
+            f_fd = -1;
+            return;
+        }
+
+        // the next sync() saves the header on disk
+        //
+        f_dirty = true;
+    }
+    else if(ftruncate(f_fd, size) != 0)
+    {
+        // could not remove an invalid record at the end
+        //
+        close(f_fd);
+        f_fd = -1;
+    }
+}
+
+
+void ban_journal::append(
+      char type
+    , block_info::address_t const & address
+    , std::string const & scheme
+    , snapdev::timespec_ex const & block_limit
+    , std::int64_t ban_count
+    , std::string const & reason)
+{
+    std::size_t const scheme_length(std::min(scheme.length(), static_cast<std::size_t>(255)));
+    std::size_t const reason_length(std::min(reason.length(), g_max_reason_length));
+
+    journal_record_t r;
+    r.f_limit_sec = block_limit.tv_sec;
+    r.f_limit_nsec = block_limit.tv_nsec;
+    r.f_ban_count = ban_count;
+    memcpy(r.f_address, address.data(), sizeof(r.f_address));
+    r.f_size = sizeof(r) + scheme_length + reason_length;
+    r.f_reason_length = reason_length;
+    r.f_type = type;
+    r.f_scheme_length = scheme_length;
+
+    std::size_t const pos(f_buffer.length());
+    f_buffer.append(reinterpret_cast<char const *>(&r), sizeof(r));
+    f_buffer.append(scheme, 0, scheme_length);
+    f_buffer.append(reason, 0, reason_length);
+
+    std::uint32_t const sum(checksum(f_buffer.data() + pos, r.f_size));
+    memcpy(f_buffer.data() + pos + offsetof(journal_record_t, f_checksum), &sum, sizeof(sum));
+
+    ++f_records;
+    f_dirty = true;
+
+    if(f_buffer.length() >= g_buffer_size)
+    {
+        write_buffer();
+    }
+}
+
+
+void ban_journal::write_buffer()
+{
+    if(f_buffer.empty())
+    {
+        return;
+    }
+
+    if(f_fd >= 0
+    && !write_all(f_fd, f_buffer.data(), f_buffer.length()))
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not write to journal \""
+            << f_journal_filename
+            << "\": "
+            << strerror(e)
+            << SNAP_LOG_SEND;
+    }
+    f_buffer.clear();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
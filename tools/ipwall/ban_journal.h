@@ -0,0 +1,91 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+
+// self
+//
+#include    "block_info.h"
+
+
+// C++
+//
+#include    <functional>
+#include    <memory>
+
+
+
+namespace ipwall
+{
+
+
+
+class ban_journal
+{
+public:
+    typedef std::shared_ptr<ban_journal>    pointer_t;
+    typedef std::function<void()>           job_t;
+
+                        ban_journal(std::string const & path);
+                        ban_journal(ban_journal const &) = delete;
+                        ~ban_journal();
+
+    ban_journal &       operator = (ban_journal const &) = delete;
+
+    block_info::block_info_vector_t
+                        load(
+                              snapdev::timespec_ex const & now
+                            , block_info::block_info_vector_t * expired = nullptr);
+    bool                has_state() const;
+    void                record_block(block_info const & info);
+    void                record_unblock(
+                              block_info::address_t const & address
+                            , std::string const & scheme);
+    void                sync();
+    job_t               start_sync();
+    bool                needs_compaction(std::size_t entries) const;
+    void                save_snapshot(std::vector<block_info const *> const & entries);
+    job_t               start_compaction(std::vector<block_info const *> const & entries);
+
+private:
+    void                complete_compaction(std::vector<block_info const *> const & entries);
+    void                open_journal(off_t size);
+    void                append(
+                              char type
+                            , block_info::address_t const & address
+                            , std::string const & scheme
+                            , snapdev::timespec_ex const & block_limit
+                            , std::int64_t ban_count
+                            , std::string const & reason);
+    void                write_buffer();
+
+    std::string         f_journal_filename = std::string();
+    std::string         f_old_journal_filename = std::string();
+    std::string         f_snapshot_filename = std::string();
+    int                 f_fd = -1;
+    std::string         f_buffer = std::string();
+    std::size_t         f_records = 0;
+    bool                f_dirty = false;
+    bool                f_loaded = false;
+    bool                f_has_state = false;
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
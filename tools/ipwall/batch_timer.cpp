@@ -0,0 +1,66 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "batch_timer.h"
+
+#include    "server.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \brief Initializes the timer with a pointer to the server.
+ *
+ * The timer is "off" by default. It gets a timeout date each time an
+ * operation is added to an empty ipset queue.
+ *
+ * \param[in] s  A pointer to the server object.
+ */
+batch_timer::batch_timer(server * s)
+    : timer(-1)
+    , f_server(s)
+{
+    set_name("batch_timer");
+}
+
+
+/** \brief The coalescing window is over.
+ *
+ * This function asks the server to send the pending ipset operations
+ * to the kernel.
+ */
+void batch_timer::process_timeout()
+{
+    f_server->process_batch();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
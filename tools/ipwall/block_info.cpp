@@ -21,10 +21,13 @@
 //
 #include    "block_info.h"
 
+#include    "ip_parser.h"
+#include    "scheme_registry.h"
 
-// cppprocess
+
+// iplock
 //
-#include <cppprocess/io_capture_pipe.h>
+#include    <iplock/exception.h>
 
 
 // snaplogger
@@ -38,6 +41,18 @@
 #include    <libaddr/exception.h>
 
 
+// C++
+//
+#include    <algorithm>
+#include    <limits>
+
+
+// C
+//
+#include    <arpa/inet.h>
+#include    <string.h>
+
+
 // last include
 //
 #include    <snapdev/poison.h>
@@ -49,6 +64,64 @@ namespace ipwall
 
 
 
+namespace
+{
+
+
+
+/** \brief The schemes of the blocks.
+ *
+ * The first two schemes are predefined so their identifiers are known
+ * at compile time (see block_info::SCHEME_HTTP and block_info::SCHEME_ALL).
+ */
+string_pool g_schemes{ "http", "all" };
+
+
+/** \brief The reasons of the blocks.
+ *
+ * Reasons are defined by the services which send the blocks so the
+ * same few strings repeat in most blocks. However, they come from the
+ * network and a service could send a different reason with each block,
+ * so the pool is bounded and recycles the least recently used reasons.
+ * A block whose reason was recycled has an empty reason.
+ */
+string_pool g_reasons{ {}, 4096, true };
+
+
+/** \brief Maximum length of a reason.
+ *
+ * Longer reasons are truncated.
+ */
+constexpr std::string_view::size_type const g_max_reason_length = 256;
+
+
+/** \brief Maximum length of a scheme.
+ *
+ * Longer schemes are considered invalid.
+ */
+constexpr std::string_view::size_type const g_max_scheme_length = 20;
+
+
+
+} // no name namespace
+
+
+
+/** \class block_info
+ * \brief One block of an IP address.
+ *
+ * ipwall may have to keep millions of blocks in memory. The strings
+ * (scheme and reason) are interned in a pool and the object only keeps
+ * their identifier. The block limit is saved in seconds in a 32 bit
+ * number which is enough until 2106. The IP address is only kept in
+ * binary; get_ip() converts it back to a string when needed.
+ *
+ * The IP addresses are parsed with parse_ip() which does not allocate
+ * memory nor throw. Only addresses it does not understand go through
+ * libaddr.
+ */
+
+
 block_info::block_info(ed::message const & msg, status_t status)
 {
     // retrieve scheme and IP
@@ -76,7 +149,7 @@ block_info::block_info(ed::message const & msg, status_t status)
 
     if(msg.has_parameter("reason"))
     {
-        f_reason = msg.get_parameter("reason");
+        set_reason(msg.get_parameter("reason"));
     }
 
     f_status = status;
@@ -93,6 +166,28 @@ block_info::block_info(std::string const & uri)
 }
 
 
+/** \brief Restore a block info.
+ *
+ * This constructor is used to restore a block which was saved earlier
+ * (see ban_journal). The address and scheme were verified when the
+ * block was first created so they are not verified again.
+ *
+ * \param[in] address  The binary IP address.
+ * \param[in] scheme  The scheme of the block.
+ * \param[in] block_limit  The date when the block times out.
+ */
+block_info::block_info(
+          address_t const & address
+        , std::string const & scheme
+        , snapdev::timespec_ex const & block_limit)
+    : f_address(address)
+    , f_scheme(get_scheme_id(scheme))
+    , f_valid(true)
+{
+    set_limit(block_limit);
+}
+
+
 /** \brief Check whether this block info is considered valid.
  *
  * A block info may be setup to an invalid IP address or some other
@@ -110,7 +205,7 @@ block_info::block_info(std::string const & uri)
  */
 bool block_info::is_valid() const
 {
-    return !f_ip.empty();
+    return f_valid;
 }
 
 
@@ -275,10 +370,10 @@ bool block_info::is_valid() const
 //}
 
 
-void block_info::set_uri(std::string const & uri)
+void block_info::set_uri(std::string_view uri)
 {
-    std::string::size_type const pos(uri.find("://"));
-    if(pos > 0)
+    std::string_view::size_type const pos(uri.find("://"));
+    if(pos != std::string_view::npos)
     {
         // there is a scheme and an IP
         //
@@ -294,8 +389,10 @@ void block_info::set_uri(std::string const & uri)
 }
 
 
-void block_info::set_ip(std::string const & ip)
+void block_info::set_ip(std::string_view ip)
 {
+    f_valid = false;
+
     // make sure IP is not empty
     //
     if(ip.empty())
@@ -306,6 +403,23 @@ void block_info::set_ip(std::string const & ip)
         return;
     }
 
+    // the common case: a plain IPv4 or IPv6 address
+    //
+    if(parse_ip(ip, f_address))
+    {
+        if(!is_blockable_ip(f_address))
+        {
+            SNAP_LOG_ERROR
+                << "IPWALL_BLOCK with an unexpected IP address type in \""
+                << ip
+                << "\". IPWALL_BLOCK will be ignored."
+                << SNAP_LOG_SEND;
+            return;
+        }
+        f_valid = true;
+        return;
+    }
+
     try
     {
         // at some point we could support "udp"?
@@ -313,7 +427,7 @@ void block_info::set_ip(std::string const & ip)
         // it does not matter much here, I would think, since we will ignore the
         // port from the addr object, we are just verifying the IP address
         //
-        addr::addr a(addr::string_to_addr(ip, "", 123, "tcp"));
+        addr::addr a(addr::string_to_addr(std::string(ip), "", 123, "tcp"));
 
         switch(a.get_network_type())
         {
@@ -336,6 +450,13 @@ void block_info::set_ip(std::string const & ip)
             break;
 
         }
+
+        // keep a binary version of the address (IPv4 addresses are
+        // mapped to IPv6) which we use as the key in the block_store
+        //
+        sockaddr_in6 in6;
+        a.get_ipv6(in6);
+        memcpy(f_address.data(), &in6.sin6_addr, f_address.size());
     }
     catch(addr::addr_invalid_argument const & e)
     {
@@ -348,11 +469,11 @@ void block_info::set_ip(std::string const & ip)
         return;
     }
 
-    f_ip = ip;
+    f_valid = true;
 }
 
 
-void block_info::set_scheme(std::string scheme)
+void block_info::set_scheme(std::string_view scheme)
 {
     // verify the scheme
     //
@@ -361,48 +482,40 @@ void block_info::set_scheme(std::string scheme)
     // See:
     // https://tools.ietf.org/html/rfc3986#section-3.1
     //
-    bool bad_scheme(false);
-    int const max(scheme.length());
-    if(max > 0)
+    // further we limit the length of the scheme to 20 characters
+    //
+    // the canonicalized (lowercase) scheme is built in a buffer on the
+    // stack so we do not allocate memory
+    //
+    char lower[g_max_scheme_length];
+    bool bad_scheme(scheme.length() > g_max_scheme_length);
+    std::string_view::size_type const max(bad_scheme ? 0 : scheme.length());
+    for(std::string_view::size_type idx(0); idx < max; ++idx)
     {
-        int const c(scheme[0]);
+        char const c(scheme[idx]);
         if(c >= 'A' && c <= 'Z')
         {
             // transform to lowercase (canonicalization)
             //
-            scheme[0] = c | 0x20;
+            lower[idx] = c | 0x20;
         }
-        else
+        else if((c >= 'a' && c <= 'z')
+             || (idx > 0
+                && ((c >= '0' && c <= '9')
+                    || c == '+'
+                    || c == '-'
+                    || c == '.')))
         {
-            bad_scheme = c < 'a' || c > 'z';
+            lower[idx] = c;
         }
-    }
-    if(!bad_scheme)
-    {
-        for(int idx(1); idx < max; ++idx)
+        else
         {
-            int const c(scheme[idx]);
-            if(c >= 'A' && c <= 'Z')
-            {
-                // transform to lowercase (canonicalization)
-                //
-                scheme[idx] = c | 0x20;
-            }
-            else if((c < 'a' || c > 'z')
-                 && (c < '0' || c > '9')
-                 && c != '+'
-                 && c != '-'
-                 && c != '.')
-            {
-                bad_scheme = true;
-                break;
-            }
+            bad_scheme = true;
+            break;
         }
     }
 
-    // further we limit the length of the scheme to 20 characters
-    //
-    if(bad_scheme || scheme.length() > 20)
+    if(bad_scheme)
     {
         // invalid protocol, forget about the wrong one
         //
@@ -413,54 +526,65 @@ void block_info::set_scheme(std::string scheme)
             << scheme
             << "\" to block an IP address. We will use the default of \"http\"."
             << SNAP_LOG_SEND;
-        scheme.clear();
+        f_scheme = SCHEME_HTTP;
+        return;
     }
 
-    if(scheme.empty())
+    if(max == 0)
     {
         // TODO: make this a fluid setting so the user can choose what the
-        //       default scheme should be
+        //       default scheme should be (i.e. an empty scheme is "http")
         //
-        scheme = "http";
+        f_scheme = SCHEME_HTTP;
+        return;
     }
 
     // now that we have a valid scheme, make sure there is a
-    // corresponding iplock configuration file
+    // corresponding iplock configuration file before we intern it so
+    // random schemes sent over the network do not fill the pool
+    //
+    // the registry caches the list of schemes so this is just a
+    // hash lookup; names over 15 characters do not fit the libstdc++
+    // small string buffer so this copy may allocate memory (the
+    // name is at most 20 characters so it stays small)
     //
-    std::string filename("/etc/iplock/schemes/");
-    filename += scheme;
-    filename += ".conf";
-    if(access(filename.c_str(), F_OK) != 0)
+    std::string const name(lower, max);
+    scheme_registry::pointer_t registry(scheme_registry::instance());
+    if(registry->find(name) == nullptr)
     {
-        filename = "/etc/iplock/schemes/schemes.d/";
-        // TODO: under the .d we need to test with numbers (??-<scheme>.conf)
-        filename += scheme;
-        filename += ".conf";
-        if(access(filename.c_str(), F_OK) != 0)
+        // no message if http.conf does not exist; the iplock.conf
+        // is the default and is to block HTTP so all good anyway
+        //
+        if(name != "http"
+        && registry->warn_once(name))
         {
-            if(scheme != "http")
-            {
-                // no message if http.conf does not exist; the iplock.conf
-                // is the default and is to block HTTP so all good anyway
-                //
-                SNAP_LOG_WARNING
-                    << "unsupported scheme \""
-                    << scheme
-                    << "\" to block an IP address. The iplock default will be used."
-                    << SNAP_LOG_SEND;
-            }
-            return;
+            SNAP_LOG_WARNING
+                << "unsupported scheme \""
+                << name
+                << "\" to block an IP address. The iplock default will be used."
+                << SNAP_LOG_SEND;
         }
+        return;
     }
 
-    f_scheme = scheme;
+    scheme_id_t const id(g_schemes.intern(name));
+    f_scheme = id == string_pool::NO_STRING ? SCHEME_HTTP : id;
 }
 
 
-void block_info::set_block_limit(std::string const & period)
+/** \brief Convert a period name to a duration.
+ *
+ * The supported periods are "hour", "day", "week", "month", "year",
+ * and "forever". An empty period represents the default, one day.
+ * Any other period is an error which gets logged and the default is
+ * returned.
+ *
+ * \param[in] period  The name of the period.
+ *
+ * \return The duration of the period.
+ */
+snapdev::timespec_ex block_info::get_period_duration(std::string const & period)
 {
-    snapdev::timespec_ex now(snapdev::timespec_ex::gettime());
-    //std::int64_t const now(ed::communicator::get_current_date());
     if(!period.empty())
     {
         // IMPORTANT NOTE: We have a "5min" period for test purposes
@@ -472,40 +596,33 @@ void block_info::set_block_limit(std::string const & period)
         //
         if(period == "5min")
         {
-            f_block_limit = now + snapdev::timespec_ex(5.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(5.0 * 60.0);
         }
         else if(period == "hour")
         {
-            f_block_limit = now + snapdev::timespec_ex(60.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(60.0 * 60.0);
         }
         else if(period == "day")
         {
-            f_block_limit = now + snapdev::timespec_ex(24.0 * 60.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(24.0 * 60.0 * 60.0);
         }
         else if(period == "week")
         {
-            f_block_limit = now + snapdev::timespec_ex(7.0 * 24.0 * 60.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(7.0 * 24.0 * 60.0 * 60.0);
         }
         else if(period == "month")
         {
-            f_block_limit = now + snapdev::timespec_ex(31.0 * 24.0 * 60.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(31.0 * 24.0 * 60.0 * 60.0);
         }
         else if(period == "year")
         {
-            f_block_limit = now + snapdev::timespec_ex(366.0 * 24.0 * 60.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(366.0 * 24.0 * 60.0 * 60.0);
         }
         else if(period == "forever")
         {
             // 5 years is certainly very much like forever on the Internet!
             //
-            f_block_limit = now + snapdev::timespec_ex(5.0 * 366.0 * 24.0 * 60.0 * 60.0);
-            return;
+            return snapdev::timespec_ex(5.0 * 366.0 * 24.0 * 60.0 * 60.0);
         }
         else
         {
@@ -519,9 +636,54 @@ void block_info::set_block_limit(std::string const & period)
         }
     }
 
-    // default is now + 1 day
+    // default is 1 day
     //
-    f_block_limit = now + snapdev::timespec_ex(24.0 * 60.0 * 60.0);
+    return snapdev::timespec_ex(24.0 * 60.0 * 60.0);
+}
+
+
+void block_info::set_block_limit(std::string const & period)
+{
+    set_limit(snapdev::timespec_ex::gettime() + get_period_duration(period));
+}
+
+
+/** \brief Make sure the block lasts at least the specified period.
+ *
+ * If the block limit is before now plus \p period, it gets moved to
+ * that date. This is used to escalate the block of repeat offenders.
+ *
+ * \param[in] period  The minimum period for this block.
+ *
+ * \return true if the block limit was extended.
+ */
+bool block_info::extend_block_limit(std::string const & period)
+{
+    std::uint32_t const previous(f_block_limit);
+    set_limit(snapdev::timespec_ex::gettime() + get_period_duration(period));
+    if(f_block_limit > previous)
+    {
+        return true;
+    }
+    f_block_limit = previous;
+    return false;
+}
+
+
+/** \brief Save the block limit in seconds.
+ *
+ * The limit gets rounded up to the next second so a block never ends
+ * early. Limits past 2106 are clamped.
+ *
+ * \param[in] limit  The date when the block ends.
+ */
+void block_info::set_limit(snapdev::timespec_ex const & limit)
+{
+    std::int64_t const seconds(limit.tv_sec + (limit.tv_nsec > 0 ? 1 : 0));
+    f_block_limit = static_cast<std::uint32_t>(std::clamp(
+              seconds
+            , static_cast<std::int64_t>(0)
+            , static_cast<std::int64_t>(std::numeric_limits<std::uint32_t>::max())));
 }
 
 
@@ -541,19 +703,11 @@ void block_info::set_block_limit(std::string const & period)
  */
 void block_info::keep_longest(block_info const & block)
 {
-    if(block.f_scheme == "all"
-    && f_scheme != "all")
+    if(block.f_scheme == SCHEME_ALL)
     {
-        // for obvious security reasons, we first block with the "all"
-        // scheme then unblock with the specific scheme used by that
-        // entry before the change
+        // the firewall gets updated by the caller (see block_store)
         //
-        std::string const old_scheme(f_scheme);
-        f_scheme = "all";
-        iplock_block();
-        f_scheme = old_scheme;
-        iplock_unblock();
-        f_scheme = "all";
+        f_scheme = SCHEME_ALL;
     }
 
     if(f_block_limit < block.f_block_limit)
@@ -561,15 +715,41 @@ void block_info::keep_longest(block_info const & block)
         f_block_limit = block.f_block_limit;
     }
 
-    f_ban_count += block.f_ban_count;
+    f_ban_count = static_cast<std::uint32_t>(std::min(
+              static_cast<std::uint64_t>(f_ban_count) + block.f_ban_count
+            , static_cast<std::uint64_t>(std::numeric_limits<std::uint32_t>::max())));
     f_packet_count += block.f_packet_count;
     f_byte_count += block.f_byte_count;
 }
 
 
+/** \brief Set the reason of this block.
+ *
+ * The reason is truncated to g_max_reason_length characters and interned
+ * in a bounded pool. If that pool later recycles the reason, get_reason()
+ * returns an empty string.
+ *
+ * \param[in] reason  The reason for this block.
+ */
+void block_info::set_reason(std::string_view reason)
+{
+    f_reason = g_reasons.intern(reason.substr(0, g_max_reason_length));
+    f_reason_generation = g_reasons.get_generation(f_reason);
+}
+
+
+std::string const & block_info::get_reason() const
+{
+    return g_reasons.get(f_reason, f_reason_generation);
+}
+
+
 void block_info::set_ban_count(int64_t count)
 {
-    f_ban_count = count;
+    f_ban_count = static_cast<std::uint32_t>(std::clamp(
+              count
+            , static_cast<std::int64_t>(0)
+            , static_cast<std::int64_t>(std::numeric_limits<std::uint32_t>::max())));
 }
 
 
@@ -628,40 +808,166 @@ std::string block_info::canonicalized_uri() const
 {
     // if no IP defined, return an empty string
     //
-    if(f_ip.empty())
+    if(!f_valid)
     {
-        return f_ip;
+        return std::string();
     }
 
-    // if no scheme is defined (maybe it was invalid) then just return
-    // the IP
+    // the scheme is always valid (it defaults to "http")
     //
-    if(f_scheme.empty())
-    {
-        return f_ip;
-    }
+    return get_scheme() + "://" + get_ip();
+}
 
-    // both scheme and IP are valid, return both
-    //
-    return f_scheme + "://" + f_ip;
+
+std::string const & block_info::get_scheme() const
+{
+    return g_schemes.get(f_scheme);
 }
 
 
-std::string block_info::get_scheme() const
+block_info::scheme_id_t block_info::get_scheme_id() const
 {
     return f_scheme;
 }
 
 
+/** \brief Get the identifier of a scheme.
+ *
+ * The scheme is interned if it was not seen before. This function does
+ * not verify the scheme.
+ *
+ * \param[in] scheme  The canonicalized scheme.
+ *
+ * \return The identifier of \p scheme.
+ */
+block_info::scheme_id_t block_info::get_scheme_id(std::string_view scheme)
+{
+    scheme_id_t const id(g_schemes.intern(scheme));
+    return id == string_pool::NO_STRING ? SCHEME_HTTP : id;
+}
+
+
+std::string const & block_info::get_scheme_name(scheme_id_t id)
+{
+    return g_schemes.get(id);
+}
+
+
+/** \brief Get the IP address as a string.
+ *
+ * The IP address is only saved in binary. This function converts it to
+ * its canonical string.
+ *
+ * \return The IP address or an empty string if not valid.
+ */
 std::string block_info::get_ip() const
 {
-    return f_ip;
+    if(!f_valid)
+    {
+        return std::string();
+    }
+
+    char buf[INET6_ADDRSTRLEN];
+    bool const ipv4(IN6_IS_ADDR_V4MAPPED(reinterpret_cast<in6_addr const *>(f_address.data())));
+    if(inet_ntop(
+              ipv4 ? AF_INET : AF_INET6
+            , f_address.data() + (ipv4 ? 12 : 0)
+            , buf
+            , sizeof(buf)) == nullptr)
+    {
+        return std::string();
+    }
+    return buf;
+}
+
+
+/** \brief Get the binary IP address.
+ *
+ * The IP address is saved as a 16 byte IPv6 address. IPv4 addresses
+ * are saved as IPv4 mapped IPv6 addresses (i.e. `::ffff:a.b.c.d`).
+ *
+ * \return The binary version of the IP address.
+ */
+block_info::address_t const & block_info::get_address() const
+{
+    return f_address;
+}
+
+
+/** \brief Get the name of the IP set used to block this IP address.
+ *
+ * The scheme configuration file may define the set used to block IP
+ * addresses with that scheme (see scheme_registry). By default, we use
+ * the "unwanted" sets, one per family, like the iplock tool.
+ *
+ * \return The name of the IP set for this IP address.
+ */
+std::string const & block_info::get_set_name() const
+{
+    scheme_registry::pointer_t registry(scheme_registry::instance());
+    scheme_info const * info(registry->find(get_scheme()));
+    if(info == nullptr)
+    {
+        info = &registry->get_default_info();
+    }
+    return get_element().is_ipv4()
+                ? info->f_set_ipv4
+                : info->f_set_ipv6;
+}
+
+
+/** \brief Get the names of all the IP sets used to block IP addresses.
+ *
+ * \return The list of IP set names that get_set_name() may return.
+ */
+std::vector<std::string> block_info::get_set_names()
+{
+    return scheme_registry::instance()->get_set_names();
+}
+
+
+iplock::ipset_element block_info::get_element() const
+{
+    return iplock::ipset_element(f_address);
 }
 
 
-snapdev::timespec_ex const & block_info::get_block_limit() const
+snapdev::timespec_ex block_info::get_block_limit() const
+{
+    return snapdev::timespec_ex(f_block_limit, 0);
+}
+
+
+/** \brief Get the timeout to use with an IP set supporting timeouts.
+ *
+ * This function computes the number of seconds remaining until the
+ * block limit, rounded up so the kernel never unblocks the IP address
+ * early.
+ *
+ * The kernel limits the timeouts to iplock::IPSET_MAX_TIMEOUT (about
+ * 24 days). When the block lasts longer, this function returns 0 and
+ * ipwall has to unblock the IP address itself.
+ *
+ * \param[in] now  The current time.
+ *
+ * \return The timeout in seconds or 0 if the kernel cannot handle it.
+ */
+std::uint32_t block_info::get_kernel_timeout(snapdev::timespec_ex const & now) const
 {
-    return f_block_limit;
+    snapdev::timespec_ex const limit(get_block_limit());
+    if(limit <= now)
+    {
+        return 1;
+    }
+
+    snapdev::timespec_ex const remaining(limit - now);
+    std::int64_t const seconds(remaining.tv_sec + (remaining.tv_nsec > 0 ? 1 : 0));
+    if(seconds > static_cast<std::int64_t>(iplock::IPSET_MAX_TIMEOUT))
+    {
+        return 0;
+    }
+
+    return static_cast<std::uint32_t>(seconds);
 }
 
 
@@ -677,14 +983,15 @@ snapdev::timespec_ex const & block_info::get_block_limit() const
  */
 bool block_info::operator == (block_info const & rhs) const
 {
-    if(f_scheme == "all"
-    || rhs.f_scheme == "all")
+    if(f_valid != rhs.f_valid
+    || f_address != rhs.f_address)
     {
-        return f_ip == rhs.f_ip;
+        return false;
     }
 
     return f_scheme == rhs.f_scheme
-        && f_ip == rhs.f_ip;
+        || f_scheme == SCHEME_ALL
+        || rhs.f_scheme == SCHEME_ALL;
 }
 
 
@@ -694,22 +1001,24 @@ bool block_info::operator < (block_info const & rhs) const
 }
 
 
-bool block_info::iplock_block()
+/** \brief Add the IP address to the firewall.
+ *
+ * This function adds the IP address to the IP set corresponding to
+ * this block's scheme and family.
+ *
+ * When the IP set supports timeouts, the \p timeout parameter can be
+ * set to the number of seconds after which the kernel removes the IP
+ * address by itself (see get_kernel_timeout()). If the IP address is
+ * already in the set, its timeout gets updated.
+ *
+ * \param[in] s  The ipset client used to talk to the kernel.
+ * \param[in] timeout  The kernel timeout in seconds or 0.
+ *
+ * \return true if the IP address was added.
+ */
+bool block_info::iplock_block(iplock::ipset & s, std::uint32_t timeout)
 {
     f_status = status_t::BLOCK_INFO_BANNED;
-    return iplock("--block");
-}
-
-
-bool block_info::iplock_unblock()
-{
-    f_status = status_t::BLOCK_INFO_UNBANNED;
-    return iplock("--unblock");
-}
-
-
-bool block_info::iplock(std::string const & cmd)
-{
     if(!is_valid())
     {
         // the IP or period are missing
@@ -717,86 +1026,63 @@ bool block_info::iplock(std::string const & cmd)
         return false;
     }
 
-    cppprocess::process::pointer_t iplock_process(std::make_shared<cppprocess::process>("block/unblock an IP address"));
-    iplock_process->set_command("iplock");
-
-    // whether we block or unblock the specified IP address
-    //
-    iplock_process->add_argument(cmd);
-    iplock_process->add_argument(f_ip);
-
-    // once we have support for configuration files and varying schemes
-    //
-    if(!f_scheme.empty())
+    try
     {
-        iplock_process->add_argument("--scheme");
-        iplock_process->add_argument(f_scheme);
+        iplock::ipset_element element(get_element());
+        element.f_timeout = timeout;
+        s.add(get_set_name(), element);
     }
-
-    // keep the stderr output withe stdout
-    //
-    iplock_process->add_argument("2>&1");
-
-    cppprocess::io_capture_pipe::pointer_t output_pipe(std::make_shared<cppprocess::io_capture_pipe>());
-    iplock_process->set_output_io(output_pipe);
-
-    int const r(iplock_process->start());
-    if(r != 0)
+    catch(iplock::ipset_error const & e)
     {
-        // Note: if the IP was not already defined, this command
-        //       generates an error
-        //
-        int const e(errno);
         SNAP_LOG_ERROR
-            << "an error occurred ("
-            << r
-            << ") trying to start \""
-            << iplock_process->get_command_line()
-            << "\", errno: "
-            << e
-            << " -- "
-            << strerror(e)
+            << "could not block \""
+            << get_ip()
+            << "\": "
+            << e.what()
             << SNAP_LOG_SEND;
         return false;
     }
 
-    // get a signal on the child's death to log errors if such happens
-    //
-    ed::signal_child::pointer_t child_signal(ed::signal_child::get_instance());
-    child_signal->add_listener(
-              iplock_process->process_pid()
-            , std::bind(&block_info::process_done, this, std::placeholders::_1, iplock_process));
-
     return true;
 }
 
 
-void block_info::process_done(
-      ed::child_status status
-    , cppprocess::process::pointer_t iplock_process)
+/** \brief Remove the IP address from the firewall.
+ *
+ * This function removes the IP address from the IP set corresponding
+ * to this block's scheme and family. If the IP address is not in the
+ * set, nothing happens.
+ *
+ * \param[in] s  The ipset client used to talk to the kernel.
+ *
+ * \return true if the IP address is not in the set anymore.
+ */
+bool block_info::iplock_unblock(iplock::ipset & s)
 {
-    cppprocess::io_capture_pipe::pointer_t output_pipe(std::dynamic_pointer_cast<cppprocess::io_capture_pipe>(iplock_process->get_output_io()));
-    if(status.is_signaled())
+    f_status = status_t::BLOCK_INFO_UNBANNED;
+    if(!is_valid())
     {
-        SNAP_LOG_ERROR
-            << "iploack received a signal and died: "
-            << status.terminate_signal()
-            << " -- Console Output:\n"
-            << output_pipe->get_output()
-            << SNAP_LOG_SEND;
+        // the IP or period are missing
+        //
+        return false;
     }
-    else if(status.is_exited())
+
+    try
     {
-        if(status.exit_code() != 0)
-        {
-            SNAP_LOG_RECOVERABLE_ERROR
-                << "an error occurred running iplock: "
-                << status.exit_code()
-                << " -- Console Output:\n"
-                << output_pipe->get_output()
-                << SNAP_LOG_SEND;
-        }
+        s.del(get_set_name(), get_element());
     }
+    catch(iplock::ipset_error const & e)
+    {
+        SNAP_LOG_ERROR
+            << "could not unblock \""
+            << get_ip()
+            << "\": "
+            << e.what()
+            << SNAP_LOG_SEND;
+        return false;
+    }
+
+    return true;
 }
 
 
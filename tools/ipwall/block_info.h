@@ -17,15 +17,18 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
+// self
+//
+#include    "string_pool.h"
+
 
-// cppprocess
+// iplock
 //
-#include    <cppprocess/process.h>
+#include    <iplock/ipset.h>
 
 
 // eventdispatcher
 //
-#include    <eventdispatcher/signal_child.h>
 #include    <eventdispatcher/message.h>
 
 
@@ -36,6 +39,8 @@
 
 // C++
 //
+#include <array>
+#include <string_view>
 #include <vector>
 
 
@@ -45,7 +50,7 @@ namespace ipwall
 
 
 
-enum class status_t
+enum class status_t : std::uint8_t
 {
     BLOCK_INFO_BANNED,
     BLOCK_INFO_UNBANNED,        // has been banned before
@@ -57,19 +62,34 @@ class block_info
 {
 public:
     typedef std::vector<block_info>   block_info_vector_t;
+    typedef std::array<std::uint8_t, 16>
+                                      address_t;
+    typedef string_pool::id_t         scheme_id_t;
+
+    static constexpr scheme_id_t const  SCHEME_HTTP = 1;
+    static constexpr scheme_id_t const  SCHEME_ALL = 2;
 
                         block_info(std::string const & uri);
                         block_info(ed::message const & message, status_t status);
+                        block_info(
+                              address_t const & address
+                            , std::string const & scheme
+                            , snapdev::timespec_ex const & block_limit);
 
     bool                is_valid() const;
 
     //void                save(libdbproxy::table::pointer_t firewall_table, std::string const & server_name);
 
-    void                set_uri(std::string const & uri);
-    void                set_scheme(std::string scheme);
-    void                set_ip(std::string const & ip);
+    void                set_uri(std::string_view uri);
+    void                set_scheme(std::string_view scheme);
+    void                set_ip(std::string_view ip);
+    static snapdev::timespec_ex
+                        get_period_duration(std::string const & period);
     void                set_block_limit(std::string const & period);
+    bool                extend_block_limit(std::string const & period);
     void                keep_longest(block_info const & block);
+    void                set_reason(std::string_view reason);
+    std::string const & get_reason() const;
 
     void                set_ban_count(std::int64_t count);
     std::int64_t        get_ban_count() const;
@@ -80,32 +100,45 @@ public:
     std::int64_t        get_byte_count() const;
 
     std::string         canonicalized_uri() const;
-    std::string         get_scheme() const;
+    std::string const & get_scheme() const;
+    scheme_id_t         get_scheme_id() const;
+    static scheme_id_t  get_scheme_id(std::string_view scheme);
+    static std::string const &
+                        get_scheme_name(scheme_id_t id);
     std::string         get_ip() const;
-    snapdev::timespec_ex const &
+    address_t const &   get_address() const;
+    std::string const & get_set_name() const;
+    static std::vector<std::string>
+                        get_set_names();
+    iplock::ipset_element
+                        get_element() const;
+    snapdev::timespec_ex
                         get_block_limit() const;
+    std::uint32_t       get_kernel_timeout(snapdev::timespec_ex const & now) const;
 
     bool                operator == (block_info const & rhs) const;
     bool                operator < (block_info const & rhs) const;
 
-    bool                iplock_block();
-    bool                iplock_unblock();
+    bool                iplock_block(iplock::ipset & s, std::uint32_t timeout = 0);
+    bool                iplock_unblock(iplock::ipset & s);
 
 private:
-    bool                iplock(std::string const & cmd);
-    void                process_done(
-                              ed::child_status status
-                            , cppprocess::process::pointer_t iplock_process);
     void                check_if_active(std::string const & ipwall_service_name);
     void                firewall_is_active();
-
+    void                set_limit(snapdev::timespec_ex const & limit);
+
+    // ipwall keeps millions of these in memory so the fields are packed
+    // (48 bytes); the strings are interned and the limit is in seconds
+    //
+    address_t           f_address = address_t();
+    std::uint32_t       f_block_limit = 0;
+    std::uint32_t       f_ban_count = 0;
+    scheme_id_t         f_scheme = SCHEME_HTTP;
+    string_pool::id_t   f_reason = string_pool::NO_STRING;
     status_t            f_status = status_t::BLOCK_INFO_BANNED;
-    std::string         f_scheme = std::string("http");
-    std::string         f_ip = std::string();
-    std::string         f_reason = std::string();
-    snapdev::timespec_ex
-                        f_block_limit = snapdev::timespec_ex();
-    std::int64_t        f_ban_count = 0LL;
+    bool                f_valid = false;
+    string_pool::generation_t
+                        f_reason_generation = 0;
     std::int64_t        f_packet_count = 0LL;
     std::int64_t        f_byte_count = 0LL;
 };
@@ -0,0 +1,1530 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "block_store.h"
+
+#include    "scheme_registry.h"
+#include    "stats.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <limits>
+#include    <map>
+#include    <string_view>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The scheme which matches all the other schemes.
+ *
+ * A block with the "all" scheme blocks all the ports. It therefore
+ * includes any other block of the same IP address.
+ */
+constexpr block_info::scheme_id_t const g_scheme_all = block_info::SCHEME_ALL;
+
+
+
+} // no name namespace
+
+
+
+bool block_key::operator == (block_key const & rhs) const
+{
+    return f_address == rhs.f_address
+        && f_scheme == rhs.f_scheme;
+}
+
+
+std::size_t block_key_hash::operator () (block_key const & key) const
+{
+    std::size_t const h(std::hash<std::string_view>()(std::string_view(
+                  reinterpret_cast<char const *>(key.f_address.data())
+                , key.f_address.size())));
+
+    return h ^ (key.f_scheme * 1099511628211ULL);
+}
+
+
+
+/** \class block_store
+ * \brief Index of the IP addresses currently blocked by ipwall.
+ *
+ * The store keeps one entry per IP address and scheme. The entries are
+ * indexed by a hash map using the binary IP address and the scheme as
+ * the key so finding an existing block is O(1).
+ *
+ * A timing wheel indexes the entries by block limit. Adding and removing
+ * an entry is O(1) and all the entries which time out within the same
+ * tick (one second by default) are unblocked together, which means the
+ * ipset queue sends them to the kernel in a single batch.
+ *
+ * The "all" scheme is special: it matches any other scheme for the same
+ * IP address (see block_info::operator == ()). Since there are only a
+ * few schemes, we search for such matches by checking each scheme we
+ * have seen so far instead of scanning the whole store.
+ *
+ * The store also updates the firewall by adding and removing the IP
+ * addresses to and from the IP sets using the ipset client.
+ *
+ * When the IP sets support timeouts (see the unwanted_set_options
+ * variable of ipload), the IP addresses are added with their remaining
+ * block duration and the kernel unblocks them by itself. These entries
+ * are kept in a separate wheel which is only checked by reconcile() so
+ * they do not wake ipwall up.
+ *
+ * When the IP sets have counters, harvest_counters() reads the number
+ * of packets dropped for each IP address. These numbers are used to
+ * release the blocks of IP addresses which went silent early and to
+ * extend the blocks of IP addresses which keep sending packets.
+ */
+
+
+/** \brief Initialize the store.
+ *
+ * \param[in] s  The ipset client used to update the firewall.
+ */
+block_store::block_store(iplock::ipset::pointer_t s)
+    : f_ipset(s)
+    , f_wheel(snapdev::timespec_ex(1, 0), snapdev::timespec_ex::gettime())
+    , f_kernel_wheel(snapdev::timespec_ex(1, 0), snapdev::timespec_ex::gettime())
+{
+}
+
+
+/** \brief Change the precision of the block timeouts.
+ *
+ * The blocks are unblocked on the first tick following their block
+ * limit. By default a tick is one second. A larger precision groups
+ * more unblocks together at the cost of keeping some IP addresses
+ * blocked a little longer.
+ *
+ * This function must be called before any block gets added to the store.
+ *
+ * \param[in] precision  The duration of one tick.
+ */
+void block_store::set_expiry_precision(snapdev::timespec_ex const & precision)
+{
+    if(!f_blocks.empty())
+    {
+        throw iplock::logic_error("set_expiry_precision() called after blocks were added to the store.");
+    }
+
+    f_wheel = timing_wheel(precision, snapdev::timespec_ex::gettime());
+    f_kernel_wheel = timing_wheel(precision, snapdev::timespec_ex::gettime());
+}
+
+
+
+/** \brief Save the changes to the store in a journal.
+ *
+ * Once a journal is defined, all the blocks and unblocks are recorded
+ * in it so the store can be restored after a restart.
+ *
+ * Note that the expired blocks are not recorded. They get dropped when
+ * the journal is loaded.
+ *
+ * \param[in] journal  The journal used to record the changes.
+ */
+void block_store::set_journal(ban_journal::pointer_t journal)
+{
+    f_journal = journal;
+}
+
+
+/** \brief Check whether the IP sets support timeouts.
+ *
+ * This function checks the headers of the IP sets used by ipwall. If
+ * all the sets were created with timeout support, then the IP addresses
+ * get added with a timeout and the kernel takes care of unblocking them.
+ *
+ * This function must be called before any block gets added to the store.
+ *
+ * \return true if the kernel timeouts are used.
+ */
+bool block_store::detect_kernel_timeouts()
+{
+    if(!f_blocks.empty())
+    {
+        throw iplock::logic_error("detect_kernel_timeouts() called after blocks were added to the store.");
+    }
+
+    f_kernel_timeouts = true;
+    for(auto const & name : block_info::get_set_names())
+    {
+        iplock::ipset_header h;
+        try
+        {
+            if(!f_ipset->header(name, h)
+            || !h.f_with_timeout)
+            {
+                f_kernel_timeouts = false;
+                break;
+            }
+        }
+        catch(iplock::ipset_error const & e)
+        {
+            SNAP_LOG_ERROR
+                << "could not read the header of IP set \""
+                << name
+                << "\": "
+                << e.what()
+                << SNAP_LOG_SEND;
+            f_kernel_timeouts = false;
+            break;
+        }
+    }
+
+    return f_kernel_timeouts;
+}
+
+
+bool block_store::has_kernel_timeouts() const
+{
+    return f_kernel_timeouts;
+}
+
+
+/** \brief Restore blocks loaded from the journal.
+ *
+ * This function adds the \p blocks to the store. The blocks are not
+ * recorded in the journal again and the firewall is not updated. Call
+ * sync_sets() once the store is ready to update the firewall.
+ *
+ * The store is expected to be empty.
+ *
+ * \param[in] blocks  The blocks to restore.
+ */
+void block_store::restore(block_info::block_info_vector_t const & blocks)
+{
+    f_blocks.reserve(f_blocks.size() + blocks.size());
+    for(auto const & info : blocks)
+    {
+        auto const r(f_blocks.emplace(block_key{ info.get_address(), info.get_scheme_id() }, entry_t{ info }));
+        if(!r.second)
+        {
+            continue;
+        }
+        index(r.first);
+        count(r.first, 1);
+        f_schemes.insert(info.get_scheme_id());
+    }
+}
+
+
+/** \brief Make the IP sets match the store with the minimum of changes.
+ *
+ * On startup, the IP sets may include addresses which timed out while
+ * ipwall was not running and miss addresses which are still expected to
+ * be blocked. This function lists the live members of each set with
+ * their remaining timeout, sorts them, and merges them with the sorted
+ * list of addresses found in the store. Only the differences get sent
+ * to the kernel:
+ *
+ * \li a member which is not in the store gets deleted if ipwall owns it;
+ * \li an address of the store missing from the set gets added;
+ * \li a member whose timeout is shorter than expected gets added again
+ * with the expected timeout.
+ *
+ * So a restart costs a number of kernel operations proportional to the
+ * number of changes instead of the total number of blocks.
+ *
+ * The IP sets are shared with the iplock tool (i.e. `iplock --block`)
+ * so a member which is not in the store is not necessarily stale. Only
+ * the members found in \p expired, the blocks which ipwall added and
+ * which timed out while it was not running (see ban_journal::load()),
+ * get deleted. The other members are left alone.
+ *
+ * When the store requires counters (see set_counters()) and a set was
+ * created without them, that set gets rebuilt in a temporary set which
+ * is then swapped with the live set instead. The rebuilt set includes
+ * the members of the live set which are kept as well.
+ *
+ * \param[in] expired  The blocks of ipwall which timed out.
+ *
+ * \return true if all the sets could be listed and updated.
+ */
+bool block_store::sync_sets(block_info::block_info_vector_t const & expired)
+{
+    typedef std::pair<block_info::address_t, std::uint32_t> member_t;   // address, timeout
+    typedef std::vector<member_t>                           member_vector_t;
+    typedef std::vector<block_info::address_t>             address_vector_t;
+
+    std::map<std::string, member_vector_t> expected;
+    for(auto const & name : block_info::get_set_names())
+    {
+        expected[name];
+    }
+    for(auto const & b : f_blocks)
+    {
+        expected[b.second.f_info.get_set_name()].emplace_back(
+                  b.first.f_address
+                , kernel_timeout(b.second.f_info));
+    }
+
+    std::map<std::string, address_vector_t> owned;
+    for(auto const & info : expired)
+    {
+        owned[info.get_set_name()].push_back(info.get_address());
+    }
+    for(auto & o : owned)
+    {
+        std::sort(o.second.begin(), o.second.end());
+    }
+
+    auto add = [](iplock::ipset_operation::vector_t & operations, std::string const & name, member_t const & m)
+    {
+        operations.push_back({
+                  iplock::ipset_command_t::IPSET_COMMAND_ADD
+                , name
+                , iplock::ipset_element(m.first) });
+        operations.back().f_element.f_timeout = m.second;
+    };
+
+    // a timeout of 0 means that ipwall removes the address itself so it
+    // is longer than any kernel timeout
+    //
+    auto longer = [](std::uint32_t lhs, std::uint32_t rhs)
+    {
+        return lhs == 0 ? rhs != 0 : rhs != 0 && lhs > rhs;
+    };
+
+    bool result(true);
+    iplock::ipset_operation::vector_t operations;
+    std::size_t added(0);
+    std::size_t deleted(0);
+    for(auto & e : expected)
+    {
+        // the same address may be blocked with several schemes using
+        // the same set, keep the longest timeout
+        //
+        member_vector_t & store(e.second);
+        std::sort(
+                  store.begin()
+                , store.end()
+                , [&longer](member_t const & lhs, member_t const & rhs)
+                {
+                    return lhs.first < rhs.first
+                        || (lhs.first == rhs.first && longer(lhs.second, rhs.second));
+                });
+        store.erase(std::unique(
+                      store.begin()
+                    , store.end()
+                    , [](member_t const & lhs, member_t const & rhs)
+                    {
+                        return lhs.first == rhs.first;
+                    })
+                , store.end());
+
+        member_vector_t kernel;
+        bool rebuild(false);
+        try
+        {
+            iplock::ipset_header h;
+            if(!f_ipset->header(e.first, h))
+            {
+                SNAP_LOG_ERROR
+                    << "IP set \""
+                    << e.first
+                    << "\" does not exist; was ipload run?"
+                    << SNAP_LOG_SEND;
+                result = false;
+                continue;
+            }
+            rebuild = f_counters && !h.f_with_counters;
+
+            kernel.reserve(h.f_elements);
+            f_ipset->list(e.first, [&kernel](iplock::ipset_element const & element)
+                {
+                    kernel.emplace_back(element.f_address, element.f_timeout);
+                    return true;
+                });
+        }
+        catch(iplock::ipset_error const & ex)
+        {
+            SNAP_LOG_ERROR
+                << "could not list IP set \""
+                << e.first
+                << "\" to synchronize it: "
+                << ex.what()
+                << SNAP_LOG_SEND;
+            result = false;
+            continue;
+        }
+        std::sort(kernel.begin(), kernel.end());
+
+        address_vector_t const & stale(owned[e.first]);
+
+        // when the set gets rebuilt, all the members to keep are added
+        // to the new set instead
+        //
+        iplock::ipset_operation::vector_t all;
+        if(rebuild)
+        {
+            all.reserve(std::max(kernel.size(), store.size()));
+        }
+
+        auto k(kernel.cbegin());
+        auto x(store.cbegin());
+        while(k != kernel.cend() || x != store.cend())
+        {
+            if(x == store.cend()
+            || (k != kernel.cend() && k->first < x->first))
+            {
+                if(std::binary_search(stale.begin(), stale.end(), k->first))
+                {
+                    if(!rebuild)
+                    {
+                        operations.push_back({
+                                  iplock::ipset_command_t::IPSET_COMMAND_DEL
+                                , e.first
+                                , iplock::ipset_element(k->first) });
+                    }
+                    ++deleted;
+                }
+                else if(rebuild)
+                {
+                    add(all, e.first, *k);
+                }
+                ++k;
+            }
+            else if(k == kernel.cend()
+                 || x->first < k->first)
+            {
+                add(rebuild ? all : operations, e.first, *x);
+                ++added;
+                ++x;
+            }
+            else
+            {
+                // entries which ipwall times out itself have no timeout
+                //
+                if(x->second == 0
+                        ? k->second != 0
+                        : k->second + 1 < x->second)
+                {
+                    add(rebuild ? all : operations, e.first, *x);
+                    ++added;
+                }
+                else if(rebuild)
+                {
+                    add(all, e.first, *k);
+                }
+                ++k;
+                ++x;
+            }
+        }
+
+        if(rebuild
+        && !rebuild_set(e.first, all))
+        {
+            // at least make sure the addresses are blocked
+            //
+            result = false;
+            f_ipset->apply(all);
+        }
+    }
+
+    if(!operations.empty())
+    {
+        std::size_t const errors(f_ipset->apply(operations));
+        if(errors != 0)
+        {
+            SNAP_LOG_ERROR
+                << errors
+                << " out of "
+                << operations.size()
+                << " operations failed while synchronizing the IP sets."
+                << SNAP_LOG_SEND;
+            result = false;
+        }
+    }
+
+    SNAP_LOG_INFO
+        << "IP sets synchronized with "
+        << added
+        << " additions and "
+        << deleted
+        << " deletions."
+        << SNAP_LOG_SEND;
+
+    return result;
+}
+
+
+/** \brief Use the IP sets as the source of truth.
+ *
+ * When ipwall has no saved state (first start or the journal was
+ * deleted), the addresses found in the IP sets get added to the store
+ * instead of being removed. The scheme is guessed from the name of the
+ * set (see scheme_registry::find_scheme_by_set()). The block ends when
+ * the kernel timeout ends or, if the member has no timeout, after the
+ * default block period.
+ *
+ * The adopted blocks are recorded in the journal.
+ *
+ * The store is expected to be empty.
+ *
+ * \param[in] now  The current time.
+ *
+ * \return The number of blocks adopted.
+ */
+std::size_t block_store::adopt_sets(snapdev::timespec_ex const & now)
+{
+    snapdev::timespec_ex const default_limit(now + block_info::get_period_duration(std::string()));
+    std::size_t adopted(0);
+    for(auto const & name : block_info::get_set_names())
+    {
+        std::string const scheme(scheme_registry::instance()->find_scheme_by_set(name));
+        if(scheme.empty())
+        {
+            SNAP_LOG_WARNING
+                << "no scheme uses IP set \""
+                << name
+                << "\"; its members are not adopted."
+                << SNAP_LOG_SEND;
+            continue;
+        }
+
+        try
+        {
+            f_ipset->list(name, [this, &scheme, &now, &default_limit, &adopted](iplock::ipset_element const & element)
+                {
+                    block_info info(
+                              element.f_address
+                            , scheme
+                            , element.f_timeout == 0
+                                ? default_limit
+                                : now + snapdev::timespec_ex(element.f_timeout, 0));
+                    auto const r(f_blocks.emplace(block_key{ info.get_address(), info.get_scheme_id() }, entry_t{ info }));
+                    if(r.second)
+                    {
+                        index(r.first);
+                        count(r.first, 1);
+                        f_schemes.insert(info.get_scheme_id());
+                        journal_block(info);
+                        ++adopted;
+                    }
+                    return true;
+                });
+        }
+        catch(iplock::ipset_error const & e)
+        {
+            SNAP_LOG_ERROR
+                << "could not list IP set \""
+                << name
+                << "\" to adopt its members: "
+                << e.what()
+                << SNAP_LOG_SEND;
+        }
+    }
+
+    return adopted;
+}
+
+
+/** \brief Save all the blocks in a new snapshot.
+ *
+ * This function saves the current state of the store in a snapshot
+ * and drops the journal records. It blocks until the snapshot is on
+ * disk.
+ */
+void block_store::save_snapshot()
+{
+    ban_journal::job_t job(start_compaction());
+    if(job)
+    {
+        job();
+    }
+}
+
+
+/** \brief Prepare a new snapshot of the blocks.
+ *
+ * The returned job saves the snapshot. It can run in another thread
+ * (see ban_journal::start_compaction()).
+ *
+ * \return The job to run or an empty job if there is nothing to do.
+ */
+ban_journal::job_t block_store::start_compaction()
+{
+    if(f_journal == nullptr)
+    {
+        return ban_journal::job_t();
+    }
+
+    std::vector<block_info const *> entries;
+    entries.reserve(f_blocks.size());
+    for(auto const & b : f_blocks)
+    {
+        entries.push_back(&b.second.f_info);
+    }
+    return f_journal->start_compaction(entries);
+}
+
+
+/** \brief Define an object used to gather statistics.
+ *
+ * The store reports the blocks which time out to \p s so the server
+ * can compute the unblock latency.
+ *
+ * \param[in] s  The statistics object or nullptr.
+ */
+void block_store::set_stats(stats * s)
+{
+    f_stats = s;
+}
+
+
+/** \brief Create the IP sets with packet and byte counters.
+ *
+ * When true, the IP sets get rebuilt with the counters extension on
+ * startup (see sync_sets()) so harvest_counters() can read the
+ * number of packets and bytes dropped for each blocked IP address.
+ *
+ * \param[in] counters  Whether the IP sets need counters.
+ */
+void block_store::set_counters(bool counters)
+{
+    f_counters = counters;
+}
+
+
+/** \brief Release the blocks of IP addresses which stopped sending packets.
+ *
+ * When an IP address does not send any packet for \p harvests harvests
+ * in a row, harvest_counters() unblocks it early. Use 0 to never
+ * release blocks early.
+ *
+ * \param[in] harvests  The number of harvests without packets.
+ */
+void block_store::set_idle_release(std::uint32_t harvests)
+{
+    f_idle_release = harvests;
+}
+
+
+/** \brief Extend the blocks of IP addresses still sending packets.
+ *
+ * When an IP address sends at least \p packets packets between two
+ * harvests, its block limit gets extended to now plus \p period (see
+ * block_info::extend_block_limit()). Use 0 packets to never extend
+ * the blocks.
+ *
+ * \param[in] period  The minimum period left on an active block.
+ * \param[in] packets  The number of packets between two harvests.
+ */
+void block_store::set_active_extension(std::string const & period, std::uint64_t packets)
+{
+    f_active_extension = period;
+    f_active_packets = packets;
+}
+
+
+/** \brief Check whether an IP address is currently blocked.
+ *
+ * The IP address is considered blocked if an entry exists with the
+ * same scheme as \p info or with the "all" scheme.
+ *
+ * \param[in] info  The block to search.
+ *
+ * \return true if the IP address is already blocked.
+ */
+bool block_store::is_blocked(block_info const & info) const
+{
+    block_info::address_t const & address(info.get_address());
+    return f_blocks.find(block_key{ address, info.get_scheme_id() }) != f_blocks.end()
+        || f_blocks.find(block_key{ address, g_scheme_all }) != f_blocks.end();
+}
+
+
+/** \brief Get the number of blocks per scheme and family.
+ *
+ * The key is the scheme identifier and whether the family is IPv4.
+ *
+ * \return The number of blocks per scheme and family.
+ */
+block_store::count_map_t const & block_store::get_counts() const
+{
+    return f_counts;
+}
+
+
+std::size_t block_store::size() const
+{
+    return f_blocks.size();
+}
+
+
+bool block_store::empty() const
+{
+    return f_blocks.empty();
+}
+
+
+/** \brief Add a block to the store.
+ *
+ * If the IP address is not yet blocked, then the function blocks it
+ * by adding it to its IP set and adds it to the store.
+ *
+ * If the IP address is already blocked with the same scheme or the
+ * "all" scheme, the existing entry is updated with keep_longest()
+ * instead. If the new block uses the "all" scheme, an existing block
+ * with another scheme gets upgraded to "all".
+ *
+ * \param[in] info  The block to add.
+ *
+ * \return true if the block is new, false if an existing block was updated.
+ */
+bool block_store::block(block_info & info)
+{
+    if(!info.is_valid())
+    {
+        return false;
+    }
+
+    block_info::address_t const & address(info.get_address());
+    block_info::scheme_id_t const scheme(info.get_scheme_id());
+
+    block_map_t::iterator it(find(address, g_scheme_all));
+    if(it == f_blocks.end()
+    && scheme == g_scheme_all)
+    {
+        for(auto const & s : f_schemes)
+        {
+            it = find(address, s);
+            if(it != f_blocks.end())
+            {
+                break;
+            }
+        }
+    }
+    if(it == f_blocks.end())
+    {
+        it = find(address, scheme);
+    }
+
+    if(it == f_blocks.end())
+    {
+        // this is a new block, add it to the store and the firewall
+        //
+        auto const r(f_blocks.emplace(block_key{ address, scheme }, entry_t{ info }));
+        index(r.first);
+        count(r.first, 1);
+        f_schemes.insert(scheme);
+        block_in_set(r.first->second.f_info);
+        journal_block(r.first->second.f_info);
+        return true;
+    }
+
+    // there is a matching old block, keep the new info in the old block
+    // but update as required
+    //
+    // (Note: the scheme may change to "all" inside keep_longest())
+    //
+    block_info previous(it->second.f_info);
+    it->second.f_info.keep_longest(info);
+    if(it->second.f_info.get_scheme_id() == it->first.f_scheme)
+    {
+        if(it->second.f_info.get_block_limit() != previous.get_block_limit())
+        {
+            // the block was extended, the kernel timeout has to be
+            // extended too
+            //
+            if(f_kernel_timeouts)
+            {
+                block_in_set(it->second.f_info);
+            }
+            index(it);
+            journal_block(it->second.f_info);
+        }
+        return false;
+    }
+
+    // the scheme changed so the key changed too, re-insert the entry
+    //
+    block_info const upgraded(it->second.f_info);
+    journal_unblock(it->first);
+    erase(it);
+
+    auto const r(f_blocks.emplace(block_key{ address, upgraded.get_scheme_id() }, entry_t{ upgraded }));
+    index(r.first);
+    count(r.first, 1);
+    f_schemes.insert(upgraded.get_scheme_id());
+    journal_block(r.first->second.f_info);
+
+    // if the new scheme uses a different set, for obvious security
+    // reasons, we first block in the new set and then unblock from the
+    // old set (unless another scheme still uses it)
+    //
+    if(upgraded.get_set_name() != previous.get_set_name())
+    {
+        block_in_set(upgraded);
+        unblock_from_set(previous);
+    }
+    else if(f_kernel_timeouts
+         && upgraded.get_block_limit() != previous.get_block_limit())
+    {
+        block_in_set(upgraded);
+    }
+
+    return false;
+}
+
+
+/** \brief Remove a block from the store.
+ *
+ * This function removes all the blocks matching \p info from the
+ * store and unblocks them from the firewall. An entry with the "all"
+ * scheme matches any scheme and an \p info with the "all" scheme
+ * matches all the entries of that IP address.
+ *
+ * Each entry gets unblocked using its own scheme, which may differ from
+ * the scheme found in \p info.
+ *
+ * If no entry matches, the IP address may still be blocked by a
+ * previous instance of ipwall, so \p info gets unblocked as is.
+ *
+ * \param[in] info  The block to remove.
+ *
+ * \return The number of entries removed from the store.
+ */
+std::size_t block_store::unblock(block_info & info)
+{
+    if(!info.is_valid())
+    {
+        return 0;
+    }
+
+    block_info::address_t const & address(info.get_address());
+    block_info::scheme_id_t const scheme(info.get_scheme_id());
+
+    std::size_t count(0);
+    auto remove = [this, &count](block_map_t::iterator it)
+    {
+        if(it != f_blocks.end())
+        {
+            block_info const removed(it->second.f_info);
+            journal_unblock(it->first);
+            erase(it);
+            unblock_from_set(removed);
+            ++count;
+        }
+    };
+
+    remove(find(address, g_scheme_all));
+    if(scheme == g_scheme_all)
+    {
+        for(auto const & s : f_schemes)
+        {
+            remove(find(address, s));
+        }
+    }
+    else
+    {
+        remove(find(address, scheme));
+    }
+
+    if(count == 0)
+    {
+        unblock_from_set(info);
+    }
+
+    return count;
+}
+
+
+/** \brief Unblock all the entries which timed out.
+ *
+ * This function moves the timing wheel to \p now, removes the entries
+ * which timed out from the store, and unblocks them from the firewall.
+ *
+ * The wheel only returns entries on the tick following their block
+ * limit so an IP address never gets unblocked early.
+ *
+ * \param[in] now  The current time.
+ *
+ * \return The number of entries that were unblocked.
+ */
+std::size_t block_store::expire(snapdev::timespec_ex const & now)
+{
+    timing_wheel::value_vector_t due;
+    f_wheel.advance(now, due);
+
+    std::size_t count(0);
+    for(auto const & key : due)
+    {
+        block_map_t::iterator it(f_blocks.find(*key));
+        if(it == f_blocks.end())
+        {
+            continue;
+        }
+
+        // the wheel already removed that entry
+        //
+        it->second.f_expiry = timing_wheel::handle_t();
+
+        if(f_stats != nullptr)
+        {
+            f_stats->expiry_due(it->second.f_info.get_block_limit());
+        }
+        block_info const expired(it->second.f_info);
+        erase(it);
+        unblock_from_set(expired);
+        ++count;
+    }
+
+    return count;
+}
+
+
+/** \brief Read the packet and byte counters from the kernel IP sets.
+ *
+ * This function lists each IP set created with the counters extension
+ * and saves the number of packets and bytes dropped for each blocked IP
+ * address in its block_info.
+ *
+ * The packet counts are then used to adjust the blocks:
+ *
+ * \li an IP address which did not send any packet for idle-release
+ * harvests in a row is unblocked early; it most certainly is not
+ * attacking us anymore and it only makes the set larger;
+ * \li an IP address which sent at least active-packets packets since
+ * the last harvest has its block extended by active-extension so it
+ * does not get unblocked while still attacking us.
+ *
+ * IP addresses which are not found in the IP sets (i.e. they are part
+ * of a network blocked as a whole) are left alone.
+ *
+ * The sets get listed through the lister (see set_lister()) so the
+ * counters may be harvested later. The blocks added or extended in the
+ * meantime are skipped. \p done is then called with the number of
+ * blocks which were released or extended.
+ *
+ * \param[in] done  The function called once the counters were harvested.
+ *
+ * \return false if the previous harvest is not yet done, in which case
+ * nothing happens.
+ */
+bool block_store::harvest_counters(done_callback_t done)
+{
+    if(f_harvesting)
+    {
+        return false;
+    }
+    f_harvesting = true;
+
+    std::uint32_t const serial(f_serial);
+    list(block_info::get_set_names(), false, [this, serial, done](kernel_listing::vector_t & listings)
+        {
+            f_harvesting = false;
+            std::size_t const changes(harvest_listings(listings, serial));
+            if(done)
+            {
+                done(changes);
+            }
+        });
+
+    return true;
+}
+
+
+std::size_t block_store::harvest_listings(kernel_listing::vector_t const & listings, std::uint32_t serial)
+{
+    std::vector<block_map_t::iterator> released;
+    std::size_t extended(0);
+    for(auto const & l : listings)
+    {
+        if(!l.f_error_message.empty())
+        {
+            SNAP_LOG_ERROR
+                << "could not list IP set \""
+                << l.f_set_name
+                << "\" to harvest its counters: "
+                << l.f_error_message
+                << SNAP_LOG_SEND;
+            continue;
+        }
+
+        // without counters, all the IP addresses look idle
+        //
+        if(!l.f_exists
+        || !l.f_header.f_with_counters)
+        {
+            continue;
+        }
+
+        for(auto const & element : l.f_elements)
+        {
+            for(auto const & s : f_schemes)
+            {
+                block_map_t::iterator it(find(element.f_address, s));
+                if(it == f_blocks.end()
+                || it->second.f_info.get_set_name() != l.f_set_name
+                || static_cast<std::int32_t>(it->second.f_serial - serial) > 0)
+                {
+                    continue;
+                }
+
+                // the counters restart at zero if the IP address
+                // was removed and added back
+                //
+                block_info & info(it->second.f_info);
+                std::uint64_t const previous(static_cast<std::uint64_t>(info.get_packet_count()));
+                std::uint64_t const packets(element.f_packets >= previous
+                            ? element.f_packets - previous
+                            : element.f_packets);
+                info.set_packet_count(static_cast<std::int64_t>(element.f_packets));
+                info.set_byte_count(static_cast<std::int64_t>(element.f_bytes));
+
+                if(packets == 0)
+                {
+                    if(it->second.f_idle_harvests < std::numeric_limits<std::uint16_t>::max())
+                    {
+                        ++it->second.f_idle_harvests;
+                    }
+                    if(f_idle_release != 0
+                    && it->second.f_idle_harvests >= f_idle_release)
+                    {
+                        released.push_back(it);
+                    }
+                    continue;
+                }
+
+                it->second.f_idle_harvests = 0;
+                if(f_active_packets != 0
+                && packets >= f_active_packets
+                && info.extend_block_limit(f_active_extension))
+                {
+                    if(f_kernel_timeouts)
+                    {
+                        block_in_set(info);
+                    }
+                    index(it);
+                    journal_block(info);
+                    ++extended;
+                }
+            }
+        }
+    }
+
+    // an address may be listed more than once
+    //
+    std::sort(
+          released.begin()
+        , released.end()
+        , [](block_map_t::iterator const & lhs, block_map_t::iterator const & rhs)
+        {
+            return std::less<block_key const *>()(&lhs->first, &rhs->first);
+        });
+    released.erase(std::unique(released.begin(), released.end()), released.end());
+
+    for(auto it : released)
+    {
+        block_info const idle(it->second.f_info);
+        journal_unblock(it->first);
+        erase(it);
+        unblock_from_set(idle);
+    }
+
+    if(f_stats != nullptr)
+    {
+        f_stats->counters_harvested(released.size(), extended);
+    }
+
+    if(!released.empty()
+    || extended > 0)
+    {
+        SNAP_LOG_INFO
+            << "harvested the IP set counters: "
+            << released.size()
+            << " idle IP addresses released and "
+            << extended
+            << " active IP addresses blocked longer."
+            << SNAP_LOG_SEND;
+    }
+
+    return released.size() + extended;
+}
+
+
+/** \brief Get the date when the next entries time out.
+ *
+ * The returned date is aligned on a tick of the timing wheel. It may
+ * also be the date when the wheel has to move entries between levels
+ * in which case no entries may time out at that date.
+ *
+ * \return The date of the next tick to process or zero if the store is
+ * empty.
+ */
+snapdev::timespec_ex block_store::next_expiry() const
+{
+    return f_wheel.next_tick();
+}
+
+
+/** \brief Reconcile the store with the kernel IP sets.
+ *
+ * When the kernel times out the IP addresses, the store does not get
+ * notified. This function removes the entries which the kernel already
+ * unblocked from the store. It also verifies that the other entries are
+ * still in the IP sets with the expected timeout. The entries which are
+ * missing or have a timeout too short (i.e. the block was extended and
+ * the update did not make it to the kernel) are added back.
+ *
+ * The sets get listed through the lister (see set_lister()) so the
+ * verification may happen later. The entries added or extended in the
+ * meantime are not verified since their operations may not yet have
+ * reached the kernel. \p done is then called with the number of entries
+ * which had to be fixed in the kernel.
+ *
+ * \param[in] now  The current time.
+ * \param[in] done  The function called once the sets were verified.
+ *
+ * \return false if the previous reconciliation is not yet done, in which
+ * case nothing happens.
+ */
+bool block_store::reconcile(snapdev::timespec_ex const & now, done_callback_t done)
+{
+    if(f_reconciling)
+    {
+        return false;
+    }
+
+    timing_wheel::value_vector_t due;
+    f_kernel_wheel.advance(now, due);
+    for(auto const & key : due)
+    {
+        block_map_t::iterator it(f_blocks.find(*key));
+        if(it != f_blocks.end())
+        {
+            it->second.f_expiry = timing_wheel::handle_t();
+            erase(it);
+        }
+    }
+
+    f_reconciling = true;
+    std::uint32_t const serial(f_serial);
+    list(block_info::get_set_names(), true, [this, serial, done](kernel_listing::vector_t & listings)
+        {
+            f_reconciling = false;
+            std::size_t const changes(reconcile_listings(listings, serial));
+            if(done)
+            {
+                done(changes);
+            }
+        });
+
+    return true;
+}
+
+
+std::size_t block_store::reconcile_listings(kernel_listing::vector_t const & listings, std::uint32_t serial)
+{
+    // the same address may be in the sets of several schemes
+    //
+    std::map<std::pair<std::string, block_info::address_t>, std::uint32_t> kernel;
+    for(auto const & l : listings)
+    {
+        if(!l.f_error_message.empty())
+        {
+            SNAP_LOG_ERROR
+                << "could not list IP set \""
+                << l.f_set_name
+                << "\" to reconcile it: "
+                << l.f_error_message
+                << SNAP_LOG_SEND;
+            return 0;
+        }
+        for(auto const & element : l.f_elements)
+        {
+            // when listed twice, keep the longest timeout (0 is forever)
+            //
+            auto const r(kernel.emplace(std::make_pair(l.f_set_name, element.f_address), element.f_timeout));
+            if(!r.second
+            && r.first->second != 0
+            && (element.f_timeout == 0 || element.f_timeout > r.first->second))
+            {
+                r.first->second = element.f_timeout;
+            }
+        }
+    }
+
+    std::size_t count(0);
+    for(auto & b : f_blocks)
+    {
+        // the serial number wraps around
+        //
+        if(static_cast<std::int32_t>(b.second.f_serial - serial) > 0)
+        {
+            continue;
+        }
+
+        // entries which ipwall times out itself were added without a
+        // timeout so we only check that they are still present
+        //
+        // several schemes may share the same set in which case the
+        // kernel has the longest timeout of all of them
+        //
+        auto const k(kernel.find(std::make_pair(b.second.f_info.get_set_name(), b.first.f_address)));
+        std::uint32_t timeout(0);
+        set_users(b.first.f_address, b.second.f_info.get_set_name(), timeout);
+        if(k == kernel.end()
+        || (timeout == 0
+                ? k->second != 0
+                : k->second + 1 < timeout))
+        {
+            b.second.f_info.iplock_block(*f_ipset, timeout);
+            ++count;
+        }
+    }
+
+    if(count > 0)
+    {
+        SNAP_LOG_WARNING
+            << count
+            << " blocked IP addresses had to be fixed in the kernel IP sets."
+            << SNAP_LOG_SEND;
+    }
+
+    return count;
+}
+
+
+/** \brief Define the function used to list the IP sets.
+ *
+ * By default, harvest_counters() and reconcile() list the IP sets
+ * through the ipset client which blocks until the kernel answered.
+ * The server replaces that with a lister which lists the sets from the
+ * kernel worker thread and calls the callback from the event loop once
+ * done.
+ *
+ * The lister receives true in its \p aggregated parameter when the
+ * members of the aggregated networks have to be included in the
+ * listings (reconcile()). The counters harvest does not want them since
+ * they would look idle. The default lister ignores that parameter and
+ * uses the ipset client given to the store as is.
+ *
+ * \param[in] lister  The function used to list the IP sets.
+ */
+void block_store::set_lister(lister_t lister)
+{
+    f_lister = lister;
+}
+
+
+void block_store::list(
+      std::vector<std::string> const & set_names
+    , bool aggregated
+    , listing_callback_t callback)
+{
+    if(f_lister)
+    {
+        f_lister(set_names, aggregated, callback);
+        return;
+    }
+
+    kernel_listing::vector_t listings(create_listings(set_names));
+    list_sets(*f_ipset, listings);
+    callback(listings);
+}
+
+
+bool block_store::rebuild_set(
+      std::string const & set_name
+    , iplock::ipset_operation::vector_t const & operations)
+{
+    std::string const tmp_name("ipwall_rebuild");
+
+    try
+    {
+        iplock::ipset_header h;
+        if(!f_ipset->header(set_name, h))
+        {
+            SNAP_LOG_ERROR
+                << "IP set \""
+                << set_name
+                << "\" does not exist; was ipload run?"
+                << SNAP_LOG_SEND;
+            return false;
+        }
+
+        iplock::ipset_options options;
+        options.f_type = h.f_type;
+        options.f_family = h.f_family;
+        options.f_with_timeout = h.f_with_timeout;
+        options.f_timeout = h.f_timeout;
+        options.f_with_counters = h.f_with_counters || f_counters;
+        options.f_hashsize = h.f_hashsize;
+        options.f_maxelem = std::max(
+                  h.f_maxelem
+                , static_cast<std::uint32_t>(operations.size()));
+
+        // a previous instance may have crashed while rebuilding
+        //
+        if(f_ipset->exists(tmp_name))
+        {
+            f_ipset->destroy(tmp_name);
+        }
+        f_ipset->create(tmp_name, options);
+
+        iplock::ipset_operation::vector_t tmp_operations(operations);
+        for(auto & op : tmp_operations)
+        {
+            op.f_set_name = tmp_name;
+        }
+        std::size_t const errors(f_ipset->apply(tmp_operations));
+        if(errors != 0)
+        {
+            SNAP_LOG_ERROR
+                << errors
+                << " addresses could not be added to \""
+                << set_name
+                << "\"."
+                << SNAP_LOG_SEND;
+        }
+
+        f_ipset->swap(set_name, tmp_name);
+        f_ipset->destroy(tmp_name);
+
+        SNAP_LOG_INFO
+            << "IP set \""
+            << set_name
+            << "\" rebuilt with "
+            << operations.size()
+            << " addresses."
+            << SNAP_LOG_SEND;
+    }
+    catch(iplock::ipset_error const & e)
+    {
+        SNAP_LOG_ERROR
+            << "could not rebuild IP set \""
+            << set_name
+            << "\": "
+            << e.what()
+            << SNAP_LOG_SEND;
+
+        try
+        {
+            if(f_ipset->exists(tmp_name))
+            {
+                f_ipset->destroy(tmp_name);
+            }
+        }
+        catch(iplock::ipset_error const &)
+        {
+        }
+        return false;
+    }
+
+    return true;
+}
+
+
+void block_store::journal_block(block_info const & info)
+{
+    if(f_journal != nullptr)
+    {
+        f_journal->record_block(info);
+    }
+}
+
+
+void block_store::journal_unblock(block_key const & key)
+{
+    if(f_journal != nullptr)
+    {
+        f_journal->record_unblock(key.f_address, block_info::get_scheme_name(key.f_scheme));
+    }
+}
+
+
+block_store::block_map_t::iterator block_store::find(
+      block_info::address_t const & address
+    , block_info::scheme_id_t scheme)
+{
+    return f_blocks.find(block_key{ address, scheme });
+}
+
+
+std::uint32_t block_store::kernel_timeout(block_info const & info) const
+{
+    if(!f_kernel_timeouts)
+    {
+        return 0;
+    }
+
+    return info.get_kernel_timeout(snapdev::timespec_ex::gettime());
+}
+
+
+/** \brief Count the entries of an IP address which use an IP set.
+ *
+ * By default, several schemes share the same IP set. The kernel only
+ * has one member for all of them so it has to use the longest timeout
+ * of all those entries. A timeout of 0 (ipwall removes the IP address
+ * itself) is the longest.
+ *
+ * \param[in] address  The IP address to search.
+ * \param[in] set_name  The name of the IP set.
+ * \param[out] timeout  The kernel timeout to use for that member.
+ *
+ * \return The number of entries of \p address using \p set_name.
+ */
+std::size_t block_store::set_users(
+      block_info::address_t const & address
+    , std::string const & set_name
+    , std::uint32_t & timeout) const
+{
+    std::size_t users(0);
+    bool permanent(false);
+    timeout = 0;
+    for(auto const & s : f_schemes)
+    {
+        auto const it(f_blocks.find(block_key{ address, s }));
+        if(it == f_blocks.end()
+        || it->second.f_info.get_set_name() != set_name)
+        {
+            continue;
+        }
+        ++users;
+        std::uint32_t const t(kernel_timeout(it->second.f_info));
+        if(t == 0)
+        {
+            permanent = true;
+        }
+        else
+        {
+            timeout = std::max(timeout, t);
+        }
+    }
+    if(permanent)
+    {
+        timeout = 0;
+    }
+
+    return users;
+}
+
+
+/** \brief Add the IP address of a block to its IP set.
+ *
+ * The IP address is added with the longest timeout of all the entries
+ * sharing the same IP set so a shorter block does not shorten the block
+ * of another scheme. The \p info entry must already be in the store.
+ *
+ * \param[in] info  The block to add to the firewall.
+ */
+void block_store::block_in_set(block_info const & info)
+{
+    std::uint32_t timeout(0);
+    set_users(info.get_address(), info.get_set_name(), timeout);
+    block_info(info).iplock_block(*f_ipset, timeout);
+}
+
+
+/** \brief Remove the IP address of a block from its IP set.
+ *
+ * The \p info entry must already be removed from the store. If another
+ * entry of the same IP address still uses that IP set, the member is
+ * kept and its timeout gets updated to the longest remaining timeout
+ * instead.
+ *
+ * \param[in] info  The block to remove from the firewall.
+ */
+void block_store::unblock_from_set(block_info const & info)
+{
+    std::uint32_t timeout(0);
+    if(set_users(info.get_address(), info.get_set_name(), timeout) == 0)
+    {
+        block_info(info).iplock_unblock(*f_ipset);
+    }
+    else if(f_kernel_timeouts)
+    {
+        block_info(info).iplock_block(*f_ipset, timeout);
+    }
+}
+
+
+void block_store::erase(block_map_t::iterator it)
+{
+    (it->second.f_kernel_expiry ? f_kernel_wheel : f_wheel).erase(it->second.f_expiry);
+    count(it, -1);
+    f_blocks.erase(it);
+}
+
+
+void block_store::count(block_map_t::iterator it, int delta)
+{
+    count_key_t const key(
+              it->first.f_scheme
+            , it->second.f_info.get_element().is_ipv4());
+    std::size_t & c(f_counts[key]);
+    c += delta;
+    if(c == 0)
+    {
+        f_counts.erase(key);
+    }
+}
+
+
+void block_store::index(block_map_t::iterator it)
+{
+    entry_t & entry(it->second);
+    (entry.f_kernel_expiry ? f_kernel_wheel : f_wheel).erase(entry.f_expiry);
+    entry.f_serial = ++f_serial;
+
+    // blocks which are too long for the kernel remain in our wheel
+    //
+    entry.f_kernel_expiry = kernel_timeout(entry.f_info) != 0;
+    entry.f_expiry = (entry.f_kernel_expiry ? f_kernel_wheel : f_wheel)
+                            .insert(&it->first, entry.f_info.get_block_limit());
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,162 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+
+// self
+//
+#include    "ban_journal.h"
+#include    "block_info.h"
+#include    "kernel_listing.h"
+#include    "timing_wheel.h"
+
+
+// C++
+//
+#include    <map>
+#include    <set>
+#include    <unordered_map>
+
+
+
+namespace ipwall
+{
+
+
+
+struct block_key
+{
+    bool                operator == (block_key const & rhs) const;
+
+    block_info::address_t
+                        f_address = block_info::address_t();
+    block_info::scheme_id_t
+                        f_scheme = block_info::SCHEME_HTTP;
+};
+
+
+struct block_key_hash
+{
+    std::size_t         operator () (block_key const & key) const;
+};
+
+
+class stats;
+
+
+class block_store
+{
+public:
+    typedef std::pair<block_info::scheme_id_t, bool>
+                                                    count_key_t;        // scheme, is IPv4
+    typedef std::map<count_key_t, std::size_t>      count_map_t;
+    typedef std::function<void(std::size_t changes)>
+                                                    done_callback_t;
+    typedef std::function<void(std::vector<std::string> const & set_names, bool aggregated, listing_callback_t callback)>
+                                                    lister_t;
+
+                        block_store(iplock::ipset::pointer_t s);
+
+    void                set_expiry_precision(snapdev::timespec_ex const & precision);
+    void                set_journal(ban_journal::pointer_t journal);
+    void                set_stats(stats * s);
+    void                set_counters(bool counters);
+    void                set_idle_release(std::uint32_t harvests);
+    void                set_active_extension(std::string const & period, std::uint64_t packets);
+    void                set_lister(lister_t lister);
+    bool                detect_kernel_timeouts();
+    bool                has_kernel_timeouts() const;
+    void                restore(block_info::block_info_vector_t const & blocks);
+    bool                sync_sets(block_info::block_info_vector_t const & expired = block_info::block_info_vector_t());
+    std::size_t         adopt_sets(snapdev::timespec_ex const & now);
+    bool                reconcile(snapdev::timespec_ex const & now, done_callback_t done);
+    void                save_snapshot();
+    ban_journal::job_t  start_compaction();
+
+    count_map_t const & get_counts() const;
+    std::size_t         size() const;
+    bool                empty() const;
+
+    bool                is_blocked(block_info const & info) const;
+    bool                block(block_info & info);
+    std::size_t         unblock(block_info & info);
+    std::size_t         expire(snapdev::timespec_ex const & now);
+    bool                harvest_counters(done_callback_t done);
+    snapdev::timespec_ex
+                        next_expiry() const;
+
+private:
+    struct entry_t
+    {
+        block_info                      f_info;
+        timing_wheel::handle_t          f_expiry = timing_wheel::handle_t();
+        std::uint32_t                   f_serial = 0;       // changes when the block limit changes
+        bool                            f_kernel_expiry = false;
+        std::uint16_t                   f_idle_harvests = 0;
+    };
+
+    typedef std::unordered_map<block_key, entry_t, block_key_hash>
+                                        block_map_t;
+
+    block_map_t::iterator
+                        find(block_info::address_t const & address, block_info::scheme_id_t scheme);
+    void                erase(block_map_t::iterator it);
+    void                count(block_map_t::iterator it, int delta);
+    void                list(std::vector<std::string> const & set_names, bool aggregated, listing_callback_t callback);
+    std::size_t         harvest_listings(kernel_listing::vector_t const & listings, std::uint32_t serial);
+    std::size_t         reconcile_listings(kernel_listing::vector_t const & listings, std::uint32_t serial);
+    bool                rebuild_set(
+                              std::string const & set_name
+                            , iplock::ipset_operation::vector_t const & operations);
+    void                journal_block(block_info const & info);
+    void                journal_unblock(block_key const & key);
+    std::uint32_t       kernel_timeout(block_info const & info) const;
+    std::size_t         set_users(
+                              block_info::address_t const & address
+                            , std::string const & set_name
+                            , std::uint32_t & timeout) const;
+    void                block_in_set(block_info const & info);
+    void                unblock_from_set(block_info const & info);
+    void                index(block_map_t::iterator it);
+
+    iplock::ipset::pointer_t
+                        f_ipset = iplock::ipset::pointer_t();
+    ban_journal::pointer_t
+                        f_journal = ban_journal::pointer_t();
+    block_map_t         f_blocks = block_map_t();
+    timing_wheel        f_wheel;
+    timing_wheel        f_kernel_wheel;
+    bool                f_kernel_timeouts = false;
+    bool                f_counters = false;
+    std::uint32_t       f_idle_release = 0;
+    std::string         f_active_extension = std::string();
+    std::uint64_t       f_active_packets = 0;
+    std::set<block_info::scheme_id_t>
+                        f_schemes = std::set<block_info::scheme_id_t>();
+    count_map_t         f_counts = count_map_t();
+    stats *             f_stats = nullptr;
+    lister_t            f_lister = lister_t();
+    std::uint32_t       f_serial = 0;
+    bool                f_harvesting = false;
+    bool                f_reconciling = false;
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,67 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "counters_timer.h"
+
+#include    "server.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \brief Initializes the timer with a pointer to the server.
+ *
+ * The timer ticks every \p interval microseconds. It is only created
+ * when the counters-interval option is not zero.
+ *
+ * \param[in] s  A pointer to the server object.
+ * \param[in] interval  The number of microseconds between two ticks.
+ */
+counters_timer::counters_timer(server * s, std::int64_t interval)
+    : timer(interval)
+    , f_server(s)
+{
+    set_name("counters_timer");
+}
+
+
+/** \brief Time to harvest the counters.
+ *
+ * This function asks the server to read the packet and byte counters
+ * of the blocked IP addresses from the kernel IP sets.
+ */
+void counters_timer::process_timeout()
+{
+    f_server->harvest_counters();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
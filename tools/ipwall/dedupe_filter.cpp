@@ -0,0 +1,369 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "dedupe_filter.h"
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief Maximum load of a table.
+ *
+ * A cuckoo filter with 4 slots per bucket works well up to about 95%
+ * full. The tables are sized so the requested capacity represents
+ * that load.
+ */
+constexpr double const          g_max_load = 0.95;
+
+
+/** \brief Mix the bits of a 64 bit value.
+ *
+ * This is the splitmix64 finalizer. It makes sure that all the bits
+ * of the result depend on all the bits of the input.
+ *
+ * \param[in] x  The value to mix.
+ *
+ * \return The mixed value.
+ */
+std::uint64_t mix(std::uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+std::uint16_t fingerprint(std::uint64_t h)
+{
+    // 0 represents an empty slot
+    //
+    std::uint16_t const f(static_cast<std::uint16_t>(h >> 48));
+    return f == 0 ? 1 : f;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class dedupe_filter
+ * \brief Filter of the blocks applied recently.
+ *
+ * The IPWALL_BLOCK messages are broadcast so when many computers detect
+ * the same offender, each ipwall receives the same block many times in
+ * a row. This filter remembers the (IP, scheme, limit) tuples which were
+ * applied recently so these duplicates can be dropped before they reach
+ * the block store, the journal, and the kernel.
+ *
+ * The filter is composed of two generations. The current generation
+ * receives the new tuples. Each time the window elapses, the previous
+ * generation gets cleared and becomes the current one. So a tuple is
+ * remembered for one to two windows.
+ *
+ * Each generation is a cuckoo filter with 16 bit fingerprints and 4 slots
+ * per bucket. It uses 2 bytes per entry, supports millions of entries,
+ * and has a false positive rate of about 0.01%. A false positive means a
+ * new block would be dropped. To make that case harmless, the limit is
+ * part of the tuple, rounded to the window, so a later block with a
+ * longer period is never considered a duplicate of an earlier block.
+ *
+ * A false negative is always possible (i.e. a fingerprint kicked out of
+ * a full table); it only means that a duplicate gets processed as usual.
+ */
+
+
+/** \brief Initialize the filter.
+ *
+ * \param[in] capacity  The number of tuples each generation can hold.
+ * \param[in] window  The amount of time a tuple is remembered. If less
+ * than one second, the filter is disabled.
+ */
+dedupe_filter::dedupe_filter(std::size_t capacity, snapdev::timespec_ex const & window)
+    : f_window(window.tv_sec)
+{
+    if(f_window <= 0)
+    {
+        f_window = 0;
+        return;
+    }
+
+    std::size_t const buckets(static_cast<std::size_t>(
+                static_cast<double>(capacity) / (SLOTS_PER_BUCKET * g_max_load)) + 1);
+    std::size_t size(1);
+    while(size < buckets)
+    {
+        size <<= 1;
+    }
+    f_mask = size - 1;
+    for(auto & t : f_generations)
+    {
+        t.f_buckets.resize(size);
+    }
+}
+
+
+bool dedupe_filter::is_enabled() const
+{
+    return f_window != 0;
+}
+
+
+/** \brief Get the number of tuples in the filter.
+ *
+ * \return The number of tuples in both generations.
+ */
+std::size_t dedupe_filter::size() const
+{
+    return f_generations[0].f_size + f_generations[1].f_size;
+}
+
+
+/** \brief Forget all the tuples.
+ *
+ * This function is called when the filter was idle for more than a
+ * window since all the tuples are stale by then.
+ */
+void dedupe_filter::clear()
+{
+    for(auto & t : f_generations)
+    {
+        std::fill(t.f_buckets.begin(), t.f_buckets.end(), bucket_t());
+        t.f_size = 0;
+    }
+}
+
+
+/** \brief Check whether a block was applied recently.
+ *
+ * \param[in] info  The block to check.
+ * \param[in] now  The current time.
+ *
+ * \return true if the block is a duplicate.
+ */
+bool dedupe_filter::contains(block_info const & info, snapdev::timespec_ex const & now)
+{
+    if(f_window == 0)
+    {
+        return false;
+    }
+
+    rotate(now);
+
+    std::uint64_t const h(hash(info));
+    return find(f_generations[0], h)
+        || find(f_generations[1], h);
+}
+
+
+/** \brief Remember a block which was just applied.
+ *
+ * If the current generation is full, the filter rotates early.
+ *
+ * \param[in] info  The block to remember.
+ * \param[in] now  The current time.
+ *
+ * \return false if the current generation was full.
+ */
+bool dedupe_filter::insert(block_info const & info, snapdev::timespec_ex const & now)
+{
+    if(f_window == 0)
+    {
+        return true;
+    }
+
+    rotate(now);
+
+    std::uint64_t const h(hash(info));
+    if(add(f_generations[f_current], h))
+    {
+        return true;
+    }
+
+    // the table is full, start a new generation early
+    //
+    f_next_rotation = now;
+    rotate(now);
+    add(f_generations[f_current], h);
+    return false;
+}
+
+
+std::uint64_t dedupe_filter::hash(block_info const & info) const
+{
+    // FNV-1a over the address, the scheme, and the limit in windows
+    //
+    std::uint64_t h(0xCBF29CE484222325ULL);
+    auto const add_byte([&h](std::uint8_t b)
+        {
+            h ^= b;
+            h *= 0x100000001B3ULL;
+        });
+    for(auto const b : info.get_address())
+    {
+        add_byte(b);
+    }
+    for(auto const c : info.get_scheme())
+    {
+        add_byte(static_cast<std::uint8_t>(c));
+    }
+    add_byte(0);
+    std::int64_t const limit(info.get_block_limit().tv_sec / f_window);
+    for(int shift(0); shift < 64; shift += 8)
+    {
+        add_byte(static_cast<std::uint8_t>(limit >> shift));
+    }
+    return mix(h);
+}
+
+
+std::size_t dedupe_filter::alternate(std::size_t index, std::uint16_t fingerprint) const
+{
+    return (index ^ mix(fingerprint)) & f_mask;
+}
+
+
+bool dedupe_filter::find(table_t const & t, std::uint64_t h) const
+{
+    std::uint16_t const f(fingerprint(h));
+    std::size_t const i1(h & f_mask);
+    std::size_t const i2(alternate(i1, f));
+    for(auto const slot : t.f_buckets[i1])
+    {
+        if(slot == f)
+        {
+            return true;
+        }
+    }
+    for(auto const slot : t.f_buckets[i2])
+    {
+        if(slot == f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** \brief Add a fingerprint to a table.
+ *
+ * If both buckets of the fingerprint are full, existing fingerprints
+ * get moved to their alternate bucket, up to MAX_KICKS times. If that
+ * fails, the last fingerprint kicked out is lost.
+ *
+ * \param[in] t  The table to update.
+ * \param[in] h  The hash of the tuple to add.
+ *
+ * \return false if the table is full.
+ */
+bool dedupe_filter::add(table_t & t, std::uint64_t h)
+{
+    if(find(t, h))
+    {
+        return true;
+    }
+
+    std::uint16_t f(fingerprint(h));
+    std::size_t index(h & f_mask);
+    for(int kick(0); kick <= MAX_KICKS; ++kick)
+    {
+        for(std::size_t const i : { index, alternate(index, f) })
+        {
+            for(auto & slot : t.f_buckets[i])
+            {
+                if(slot == 0)
+                {
+                    slot = f;
+                    ++t.f_size;
+                    return true;
+                }
+            }
+        }
+
+        // both buckets are full, kick a random fingerprint out
+        //
+        f_random = mix(f_random);
+        if((f_random & SLOTS_PER_BUCKET) != 0)
+        {
+            index = alternate(index, f);
+        }
+        std::swap(f, t.f_buckets[index][f_random % SLOTS_PER_BUCKET]);
+        index = alternate(index, f);
+    }
+
+    return false;
+}
+
+
+/** \brief Start a new generation if the window elapsed.
+ *
+ * \param[in] now  The current time.
+ */
+void dedupe_filter::rotate(snapdev::timespec_ex const & now)
+{
+    if(now < f_next_rotation)
+    {
+        return;
+    }
+
+    snapdev::timespec_ex const window(f_window, 0);
+    if(now >= f_next_rotation + window)
+    {
+        // idle for more than a window, everything is stale
+        //
+        clear();
+    }
+    else
+    {
+        f_current ^= 1;
+        table_t & t(f_generations[f_current]);
+        std::fill(t.f_buckets.begin(), t.f_buckets.end(), bucket_t());
+        t.f_size = 0;
+    }
+    f_next_rotation = now + window;
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,90 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "block_info.h"
+
+
+// snapdev
+//
+#include    <snapdev/timespec_ex.h>
+
+
+// C++
+//
+#include    <array>
+#include    <cstdint>
+#include    <memory>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+class dedupe_filter
+{
+public:
+    typedef std::shared_ptr<dedupe_filter>  pointer_t;
+
+                        dedupe_filter(std::size_t capacity, snapdev::timespec_ex const & window);
+
+    bool                is_enabled() const;
+    std::size_t         size() const;
+    void                clear();
+
+    bool                contains(block_info const & info, snapdev::timespec_ex const & now);
+    bool                insert(block_info const & info, snapdev::timespec_ex const & now);
+
+private:
+    static constexpr int const  SLOTS_PER_BUCKET = 4;
+    static constexpr int const  MAX_KICKS = 500;
+
+    typedef std::array<std::uint16_t, SLOTS_PER_BUCKET>
+                                        bucket_t;
+
+    struct table_t
+    {
+        std::vector<bucket_t>           f_buckets = std::vector<bucket_t>();
+        std::size_t                     f_size = 0;
+    };
+
+    std::uint64_t       hash(block_info const & info) const;
+    std::size_t         alternate(std::size_t index, std::uint16_t fingerprint) const;
+    bool                find(table_t const & t, std::uint64_t h) const;
+    bool                add(table_t & t, std::uint64_t h);
+    void                rotate(snapdev::timespec_ex const & now);
+
+    std::int64_t        f_window = 0;           // in seconds, 0 = disabled
+    std::size_t         f_mask = 0;
+    std::uint64_t       f_random = 0x9E3779B97F4A7C15ULL;
+    int                 f_current = 0;
+    snapdev::timespec_ex
+                        f_next_rotation = snapdev::timespec_ex();
+    std::array<table_t, 2>
+                        f_generations = {};
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,569 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "ingress_queue.h"
+
+#include    "stats.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \class ingress_queue
+ * \brief Queue the block and unblock requests before applying them.
+ *
+ * During an attack, the application servers may send tens of thousands
+ * of IPWALL_BLOCK messages per second. Applying each one as it arrives
+ * keeps the event loop busy and the other messages (IPWALL_GET_STATUS,
+ * STOP, etc.) wait behind them.
+ *
+ * Instead, the messenger saves the requests in this queue and the
+ * server applies them in slices (see the ingress-slice option). The
+ * control messages are never queued so they are handled between two
+ * slices.
+ *
+ * The requests are identified by their IP address and scheme so the
+ * same address written differently is recognized. When the same address
+ * and scheme get blocked again while the block is still in the queue,
+ * the two requests are merged and the longest period is kept. An unblock
+ * cancels the blocks of the same address and scheme still in the queue
+ * as well as the blocks with the "all" scheme. An unblock with the "all"
+ * scheme cancels all the blocks of that address.
+ *
+ * The unblock requests have priority over the block requests. However,
+ * when a block of the same address remains in the queue (i.e. one with
+ * another scheme), the unblock is queued after it so the two requests
+ * are applied in the order they were received.
+ *
+ * The queue is bounded. Once full, a new unblock request replaces the
+ * newest block request and a new block request is dropped. The merged
+ * and dropped requests are counted in the statistics. The requests with
+ * an invalid URI are reported and dropped immediately.
+ */
+
+
+
+std::size_t ingress_queue::key_hash::operator () (key_t const & key) const
+{
+    return address_hash()(key.first) ^ (key.second * 1099511628211ULL);
+}
+
+
+std::size_t ingress_queue::address_hash::operator () (block_info::address_t const & address) const
+{
+    return std::hash<std::string_view>()(std::string_view(
+                  reinterpret_cast<char const *>(address.data())
+                , address.size()));
+}
+
+
+
+/** \brief Initialize the queue.
+ *
+ * \param[in] capacity  The maximum number of requests in the queue.
+ */
+ingress_queue::ingress_queue(std::size_t capacity)
+    : f_capacity(std::max(capacity, static_cast<std::size_t>(1)))
+{
+}
+
+
+/** \brief Define the statistics object used to count dropped requests.
+ *
+ * \param[in] s  A pointer to the statistics object.
+ */
+void ingress_queue::set_stats(stats * s)
+{
+    f_stats = s;
+}
+
+
+/** \brief Define a function called when the load of the queue changes.
+ *
+ * The queue is considered overloaded once it is three quarters full.
+ * It remains overloaded until it goes down to one quarter. The
+ * callback is called each time the queue switches between these two
+ * states so the senders can be told to slow down.
+ *
+ * \param[in] callback  The function to call.
+ */
+void ingress_queue::set_load_callback(load_callback_t callback)
+{
+    f_load = callback;
+}
+
+
+/** \brief Add a block request to the queue.
+ *
+ * If a block of the same IP address and scheme is already in the queue,
+ * the two requests are merged: the longest period is kept and the reason
+ * is kept unless empty. The requests are not merged when an unblock of
+ * that IP address was queued in between.
+ *
+ * \param[in] request  The block request.
+ * \param[in] command  The name of the message which included the request.
+ *
+ * \return true if the request was queued or merged, false if it was
+ * dropped because it is invalid or the queue is full.
+ */
+bool ingress_queue::push_block(iplock::block_request const & request, char const * command)
+{
+    ingress_item item{ request, command };
+    if(!parse(item))
+    {
+        return false;
+    }
+
+    key_t const key(item.f_address, item.f_scheme);
+    auto it(f_pending_blocks.find(key));
+    if(it != f_pending_blocks.end())
+    {
+        auto const unblock(f_queued_unblocks.find(item.f_address));
+        if(unblock == f_queued_unblocks.end()
+        || unblock->second < it->second)
+        {
+            ingress_item & pending(f_blocks[it->second - f_first_block]);
+            if(block_info::get_period_duration(request.f_period)
+                    > block_info::get_period_duration(pending.f_request.f_period))
+            {
+                pending.f_request.f_period = request.f_period;
+            }
+            if(pending.f_request.f_reason.empty())
+            {
+                pending.f_request.f_reason = request.f_reason;
+            }
+            if(f_stats != nullptr)
+            {
+                f_stats->message_merged(command);
+            }
+            return true;
+        }
+    }
+
+    if(is_full())
+    {
+        if(f_stats != nullptr)
+        {
+            f_stats->message_dropped(command);
+        }
+        return false;
+    }
+
+    if(std::find(f_schemes.begin(), f_schemes.end(), item.f_scheme) == f_schemes.end())
+    {
+        f_schemes.push_back(item.f_scheme);
+    }
+    f_pending_blocks[key] = f_first_block + f_blocks.size();
+    ++f_address_blocks[item.f_address];
+    f_blocks.push_back(std::move(item));
+    update_load();
+
+    return true;
+}
+
+
+/** \brief Add an unblock request to the queue.
+ *
+ * The blocks of the same IP address still in the queue which this
+ * unblock would remove are cancelled (see block_store::unblock() for
+ * the scheme rules). If an unblock of the same IP address and scheme is
+ * already in the queue, the new request is merged with it.
+ *
+ * If another block of the same IP address remains in the queue, the
+ * unblock gets queued after it instead of going first.
+ *
+ * When the queue is full, the newest block request is dropped to make
+ * room for the unblock.
+ *
+ * \param[in] request  The unblock request; only its URI is used.
+ * \param[in] command  The name of the message which included the request.
+ *
+ * \return true if the request was queued or merged, false if it was
+ * dropped because it is invalid or the queue is full of unblock requests.
+ */
+bool ingress_queue::push_unblock(iplock::block_request const & request, char const * command)
+{
+    ingress_item item{ request, command, true };
+    if(!parse(item))
+    {
+        return false;
+    }
+
+    cancel_blocks(item.f_address, item.f_scheme);
+
+    bool const after_blocks(f_address_blocks.count(item.f_address) != 0);
+    key_t const key(item.f_address, item.f_scheme);
+    if(!after_blocks
+    && f_pending_unblocks.count(key) != 0)
+    {
+        if(f_stats != nullptr)
+        {
+            f_stats->message_merged(command);
+        }
+        update_load();
+        return true;
+    }
+
+    if(is_full()
+    && !drop_newest_block())
+    {
+        if(f_stats != nullptr)
+        {
+            f_stats->message_dropped(command);
+        }
+        return false;
+    }
+
+    if(after_blocks)
+    {
+        // keep the order with the blocks of the same address
+        //
+        f_queued_unblocks[item.f_address] = f_first_block + f_blocks.size();
+        f_blocks.push_back(std::move(item));
+    }
+    else
+    {
+        f_pending_unblocks.insert(key);
+        f_unblocks.push_back(std::move(item));
+    }
+    update_load();
+
+    return true;
+}
+
+
+/** \brief Retrieve the next request to apply.
+ *
+ * The unblock requests are returned first, then the block requests in
+ * the order they were received along with the unblock requests which
+ * had to remain behind one of them.
+ *
+ * \param[out] item  The request.
+ *
+ * \return true if a request was returned, false if the queue is empty.
+ */
+bool ingress_queue::pop(ingress_item & item)
+{
+    if(!f_unblocks.empty())
+    {
+        item = std::move(f_unblocks.front());
+        f_unblocks.pop_front();
+        f_pending_unblocks.erase(key_t(item.f_address, item.f_scheme));
+        update_load();
+        return true;
+    }
+
+    while(!f_blocks.empty())
+    {
+        bool const cancelled(f_blocks.front().f_cancelled);
+        if(cancelled)
+        {
+            --f_cancelled;
+        }
+        else
+        {
+            item = std::move(f_blocks.front());
+            forget(item, f_first_block);
+        }
+        f_blocks.pop_front();
+        ++f_first_block;
+
+        if(!cancelled)
+        {
+            update_load();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Check whether the queue is empty.
+ *
+ * \return true if no requests are waiting in the queue.
+ */
+bool ingress_queue::empty() const
+{
+    return size() == 0;
+}
+
+
+/** \brief Get the number of requests waiting in the queue.
+ *
+ * \return The number of block and unblock requests in the queue.
+ */
+std::size_t ingress_queue::size() const
+{
+    return f_unblocks.size() + f_blocks.size() - f_cancelled;
+}
+
+
+/** \brief Get the maximum number of requests in the queue.
+ *
+ * \return The capacity of the queue.
+ */
+std::size_t ingress_queue::get_capacity() const
+{
+    return f_capacity;
+}
+
+
+/** \brief Check whether the queue is overloaded.
+ *
+ * \return true if the queue went over three quarters of its capacity
+ * and did not yet go back down to one quarter.
+ */
+bool ingress_queue::is_overloaded() const
+{
+    return f_overloaded;
+}
+
+
+/** \brief Check whether the queue is full.
+ *
+ * The cancelled blocks remain in the queue until they reach its front
+ * and they still use memory so they count against the capacity. The
+ * ones found at the back are removed first.
+ *
+ * \return true if no more requests can be added.
+ */
+bool ingress_queue::is_full()
+{
+    while(!f_blocks.empty()
+       && f_blocks.back().f_cancelled)
+    {
+        f_blocks.pop_back();
+        --f_cancelled;
+    }
+
+    return f_unblocks.size() + f_blocks.size() >= f_capacity;
+}
+
+
+/** \brief Drop the newest block request.
+ *
+ * \return true if a block request was dropped, false if the newest
+ * request is an unblock request.
+ */
+bool ingress_queue::drop_newest_block()
+{
+    while(!f_blocks.empty())
+    {
+        ingress_item const & newest(f_blocks.back());
+        if(newest.f_unblock)
+        {
+            return false;
+        }
+        bool const cancelled(newest.f_cancelled);
+        if(cancelled)
+        {
+            --f_cancelled;
+        }
+        else
+        {
+            forget(newest, f_first_block + f_blocks.size() - 1);
+            if(f_stats != nullptr)
+            {
+                f_stats->message_dropped(newest.f_command);
+            }
+        }
+        f_blocks.pop_back();
+
+        if(!cancelled)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Parse the URI of a request.
+ *
+ * The IP address and scheme of the request are saved in \p item. They
+ * are used to recognize the requests of the same IP address.
+ *
+ * \param[in,out] item  The item to parse.
+ *
+ * \return true if the URI is valid.
+ */
+bool ingress_queue::parse(ingress_item & item)
+{
+    // message data could be tainted, we need to protect ourselves
+    // against unwanted exceptions
+    //
+    try
+    {
+        block_info const info(item.f_request.f_uri);
+        if(!info.is_valid())
+        {
+            return false;
+        }
+        item.f_address = info.get_address();
+        item.f_scheme = info.get_scheme_id();
+        return true;
+    }
+    catch(std::exception const & e)
+    {
+        SNAP_LOG_ERROR
+            << "an exception occurred while parsing the "
+            << item.f_command
+            << " request of \""
+            << item.f_request.f_uri
+            << "\": "
+            << e.what()
+            << SNAP_LOG_SEND;
+    }
+
+    return false;
+}
+
+
+/** \brief Cancel the blocks an unblock would remove.
+ *
+ * Like block_store::unblock(), the block with the "all" scheme is
+ * always cancelled and the "all" scheme cancels all the blocks of
+ * \p address.
+ *
+ * \param[in] address  The IP address being unblocked.
+ * \param[in] scheme  The scheme of the unblock.
+ */
+void ingress_queue::cancel_blocks(block_info::address_t const & address, block_info::scheme_id_t scheme)
+{
+    cancel_block(key_t(address, block_info::SCHEME_ALL));
+    if(scheme == block_info::SCHEME_ALL)
+    {
+        for(auto const s : f_schemes)
+        {
+            cancel_block(key_t(address, s));
+        }
+    }
+    else
+    {
+        cancel_block(key_t(address, scheme));
+    }
+}
+
+
+void ingress_queue::cancel_block(key_t const & key)
+{
+    auto it(f_pending_blocks.find(key));
+    if(it == f_pending_blocks.end())
+    {
+        return;
+    }
+
+    sequence_t const sequence(it->second);
+    ingress_item & pending(f_blocks[sequence - f_first_block]);
+    pending.f_cancelled = true;
+    ++f_cancelled;
+    if(f_stats != nullptr)
+    {
+        f_stats->message_merged(pending.f_command);
+    }
+    forget(pending, sequence);
+}
+
+
+/** \brief Forget about a request leaving the block queue.
+ *
+ * \param[in] item  The request which gets removed or cancelled.
+ * \param[in] sequence  The sequence number of \p item.
+ */
+void ingress_queue::forget(ingress_item const & item, sequence_t sequence)
+{
+    if(item.f_unblock)
+    {
+        auto const it(f_queued_unblocks.find(item.f_address));
+        if(it != f_queued_unblocks.end()
+        && it->second == sequence)
+        {
+            f_queued_unblocks.erase(it);
+        }
+        return;
+    }
+
+    // a newer block of the same key may be the one pending
+    //
+    auto const it(f_pending_blocks.find(key_t(item.f_address, item.f_scheme)));
+    if(it != f_pending_blocks.end()
+    && it->second == sequence)
+    {
+        f_pending_blocks.erase(it);
+    }
+
+    auto const count(f_address_blocks.find(item.f_address));
+    if(count != f_address_blocks.end()
+    && --count->second == 0)
+    {
+        f_address_blocks.erase(count);
+    }
+}
+
+
+/** \brief Check whether the queue switched between normal and overloaded.
+ */
+void ingress_queue::update_load()
+{
+    std::size_t const depth(size());
+    bool overloaded(f_overloaded);
+    if(depth >= f_capacity - f_capacity / 4)
+    {
+        overloaded = true;
+    }
+    else if(depth <= f_capacity / 4)
+    {
+        overloaded = false;
+    }
+
+    if(overloaded != f_overloaded)
+    {
+        f_overloaded = overloaded;
+        if(f_load != nullptr)
+        {
+            f_load(f_overloaded);
+        }
+    }
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
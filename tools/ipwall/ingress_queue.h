@@ -0,0 +1,131 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "block_info.h"
+
+
+// iplock
+//
+#include    <iplock/block_ip.h>
+
+
+// C++
+//
+#include    <deque>
+#include    <functional>
+#include    <memory>
+#include    <unordered_map>
+#include    <unordered_set>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+class stats;
+
+
+
+struct ingress_item
+{
+    iplock::block_request   f_request = iplock::block_request();
+    char const *            f_command = nullptr;
+    bool                    f_unblock = false;
+    bool                    f_cancelled = false;
+    block_info::address_t   f_address = block_info::address_t();
+    block_info::scheme_id_t f_scheme = block_info::SCHEME_HTTP;
+};
+
+
+class ingress_queue
+{
+public:
+    typedef std::shared_ptr<ingress_queue>  pointer_t;
+    typedef std::function<void(bool overloaded)>
+                                            load_callback_t;
+
+                        ingress_queue(std::size_t capacity);
+                        ingress_queue(ingress_queue const &) = delete;
+
+    ingress_queue &     operator = (ingress_queue const &) = delete;
+
+    void                set_stats(stats * s);
+    void                set_load_callback(load_callback_t callback);
+    bool                push_block(iplock::block_request const & request, char const * command);
+    bool                push_unblock(iplock::block_request const & request, char const * command);
+    bool                pop(ingress_item & item);
+    bool                empty() const;
+    std::size_t         size() const;
+    std::size_t         get_capacity() const;
+    bool                is_overloaded() const;
+
+private:
+    typedef std::uint64_t                   sequence_t;
+    typedef std::pair<block_info::address_t, block_info::scheme_id_t>
+                                            key_t;
+
+    struct key_hash
+    {
+        std::size_t         operator () (key_t const & key) const;
+    };
+
+    struct address_hash
+    {
+        std::size_t         operator () (block_info::address_t const & address) const;
+    };
+
+    static bool         parse(ingress_item & item);
+    void                cancel_blocks(block_info::address_t const & address, block_info::scheme_id_t scheme);
+    void                cancel_block(key_t const & key);
+    void                forget(ingress_item const & item, sequence_t sequence);
+    bool                is_full();
+    bool                drop_newest_block();
+    void                update_load();
+
+    std::size_t         f_capacity = 100'000;
+    std::deque<ingress_item>
+                        f_unblocks = std::deque<ingress_item>();
+    std::deque<ingress_item>
+                        f_blocks = std::deque<ingress_item>();
+    sequence_t          f_first_block = 0;      // sequence of f_blocks.front()
+    std::size_t         f_cancelled = 0;
+    std::unordered_map<key_t, sequence_t, key_hash>
+                        f_pending_blocks = std::unordered_map<key_t, sequence_t, key_hash>();
+    std::unordered_set<key_t, key_hash>
+                        f_pending_unblocks = std::unordered_set<key_t, key_hash>();
+    std::unordered_map<block_info::address_t, std::size_t, address_hash>
+                        f_address_blocks = std::unordered_map<block_info::address_t, std::size_t, address_hash>();     // blocks waiting per address
+    std::unordered_map<block_info::address_t, sequence_t, address_hash>
+                        f_queued_unblocks = std::unordered_map<block_info::address_t, sequence_t, address_hash>();    // last unblock queued with the blocks
+    std::vector<block_info::scheme_id_t>
+                        f_schemes = std::vector<block_info::scheme_id_t>();
+    stats *             f_stats = nullptr;
+    load_callback_t     f_load = load_callback_t();
+    bool                f_overloaded = false;
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,67 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "ingress_timer.h"
+
+#include    "server.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \brief Initializes the timer with a pointer to the server.
+ *
+ * The timer is "off" by default. It gets a timeout date each time a
+ * request is added to the ingress queue and after each slice of
+ * requests if more are waiting.
+ *
+ * \param[in] s  A pointer to the server object.
+ */
+ingress_timer::ingress_timer(server * s)
+    : timer(-1)
+    , f_server(s)
+{
+    set_name("ingress_timer");
+}
+
+
+/** \brief Time to apply the next slice of requests.
+ *
+ * This function asks the server to apply the next slice of requests
+ * found in the ingress queue.
+ */
+void ingress_timer::process_timeout()
+{
+    f_server->process_ingress();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
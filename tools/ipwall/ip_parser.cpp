@@ -0,0 +1,369 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "ip_parser.h"
+
+
+// C
+//
+#include    <string.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+/** \file
+ * \brief Parse IP addresses without allocating memory.
+ *
+ * The libaddr parser supports many formats (ports, masks, domain names,
+ * multiple addresses) and reports errors with exceptions. ipwall
+ * receives one IP address per block and many of them at once when
+ * under attack, so the common case is parsed here without any heap
+ * allocation and without exceptions. Anything else (i.e. an address
+ * with a port) falls back to libaddr.
+ */
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief Parse an IPv4 address in dotted decimal notation.
+ *
+ * Like inet_pton(), the four parts are required and leading zeroes
+ * are refused (they would be octal with inet_aton()).
+ *
+ * \param[in] s  The start of the address.
+ * \param[in] e  The end of the address.
+ * \param[out] out  The four bytes of the address.
+ *
+ * \return true if the whole string is a valid IPv4 address.
+ */
+bool parse_ipv4(char const * s, char const * e, std::uint8_t * out)
+{
+    int parts(0);
+    for(;;)
+    {
+        int value(0);
+        int digits(0);
+        while(s < e
+           && *s >= '0'
+           && *s <= '9')
+        {
+            if(digits > 0 && value == 0)
+            {
+                return false;
+            }
+            value = value * 10 + (*s - '0');
+            if(value > 255)
+            {
+                return false;
+            }
+            ++digits;
+            ++s;
+        }
+        if(digits == 0)
+        {
+            return false;
+        }
+        out[parts] = static_cast<std::uint8_t>(value);
+        ++parts;
+        if(s == e)
+        {
+            return parts == 4;
+        }
+        if(*s != '.'
+        || parts == 4)
+        {
+            return false;
+        }
+        ++s;
+    }
+}
+
+
+int hex_digit(char c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/** \brief Parse an IPv6 address.
+ *
+ * The address may use the "::" notation and end with an IPv4 address
+ * (i.e. "::ffff:192.168.1.1"). Zone identifiers are not supported.
+ *
+ * \param[in] s  The start of the address.
+ * \param[in] e  The end of the address.
+ * \param[out] out  The 16 bytes of the address.
+ *
+ * \return true if the whole string is a valid IPv6 address.
+ */
+bool parse_ipv6(char const * s, char const * e, std::uint8_t * out)
+{
+    std::uint8_t buf[16] = {};
+    int pos(0);
+    int gap(-1);
+
+    if(e - s >= 2
+    && s[0] == ':'
+    && s[1] == ':')
+    {
+        gap = 0;
+        s += 2;
+    }
+    else if(s < e
+         && *s == ':')
+    {
+        return false;
+    }
+
+    while(s < e)
+    {
+        if(pos >= 16)
+        {
+            return false;
+        }
+
+        char const * start(s);
+        int value(0);
+        int digits(0);
+        for(; s < e && digits <= 4; ++s, ++digits)
+        {
+            int const d(hex_digit(*s));
+            if(d < 0)
+            {
+                break;
+            }
+            value = value * 16 + d;
+        }
+        if(digits == 0)
+        {
+            return false;
+        }
+
+        if(s < e
+        && *s == '.')
+        {
+            // the last 32 bits are written as an IPv4 address
+            //
+            if(pos > 12
+            || !parse_ipv4(start, e, buf + pos))
+            {
+                return false;
+            }
+            pos += 4;
+            break;
+        }
+
+        if(digits > 4)
+        {
+            return false;
+        }
+        buf[pos] = static_cast<std::uint8_t>(value >> 8);
+        buf[pos + 1] = static_cast<std::uint8_t>(value);
+        pos += 2;
+
+        if(s == e)
+        {
+            break;
+        }
+        if(*s != ':')
+        {
+            return false;
+        }
+        ++s;
+        if(s == e)
+        {
+            // a single ':' at the end
+            //
+            return false;
+        }
+        if(*s == ':')
+        {
+            if(gap != -1)
+            {
+                return false;
+            }
+            gap = pos;
+            ++s;
+        }
+    }
+
+    if(gap == -1)
+    {
+        if(pos != 16)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if(pos == 16)
+        {
+            return false;
+        }
+        int const tail(pos - gap);
+        memmove(buf + 16 - tail, buf + gap, tail);
+        memset(buf + gap, 0, 16 - tail - gap);
+    }
+
+    memcpy(out, buf, sizeof(buf));
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Parse an IP address.
+ *
+ * The input is one IPv4 or IPv6 address without port and without mask.
+ * An IPv6 address may be written between square brackets. IPv4
+ * addresses are saved as IPv4 mapped IPv6 addresses (`::ffff:a.b.c.d`)
+ * like libaddr does.
+ *
+ * This function never allocates memory and never throws.
+ *
+ * \param[in] ip  The IP address to parse.
+ * \param[out] address  The binary address.
+ *
+ * \return true if \p ip was a valid IP address.
+ */
+bool parse_ip(std::string_view ip, std::array<std::uint8_t, 16> & address)
+{
+    if(ip.empty())
+    {
+        return false;
+    }
+
+    if(ip.front() == '[')
+    {
+        if(ip.length() < 2
+        || ip.back() != ']')
+        {
+            return false;
+        }
+        ip = ip.substr(1, ip.length() - 2);
+        return parse_ipv6(ip.data(), ip.data() + ip.length(), address.data());
+    }
+
+    if(ip.find(':') != std::string_view::npos)
+    {
+        return parse_ipv6(ip.data(), ip.data() + ip.length(), address.data());
+    }
+
+    std::uint8_t ipv4[4];
+    if(!parse_ipv4(ip.data(), ip.data() + ip.length(), ipv4))
+    {
+        return false;
+    }
+    memset(address.data(), 0, 10);
+    address[10] = 0xFF;
+    address[11] = 0xFF;
+    memcpy(address.data() + 12, ipv4, sizeof(ipv4));
+    return true;
+}
+
+
+/** \brief Check whether an IP address can be blocked.
+ *
+ * The unspecified, loopback, private, carrier, link local, and
+ * documentation addresses are never blocked: the default ipload rules
+ * already handle the local networks and blocking them could cut the
+ * computer from its own network. Public and multicast addresses can
+ * be blocked.
+ *
+ * This is the same test as the libaddr network type but without
+ * creating an addr object.
+ *
+ * \param[in] address  The binary address as returned by parse_ip().
+ *
+ * \return true if the address can be blocked.
+ */
+bool is_blockable_ip(std::array<std::uint8_t, 16> const & address)
+{
+    std::uint8_t const * a(address.data());
+
+    static std::uint8_t const mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+    if(memcmp(a, mapped, sizeof(mapped)) == 0)
+    {
+        std::uint8_t const * v4(a + 12);
+        if(v4[0] == 0                                           // 0.0.0.0/8 (any)
+        || v4[0] == 10                                          // 10.0.0.0/8
+        || v4[0] == 127                                         // 127.0.0.0/8
+        || (v4[0] == 172 && (v4[1] & 0xF0) == 16)               // 172.16.0.0/12
+        || (v4[0] == 192 && v4[1] == 168)                       // 192.168.0.0/16
+        || (v4[0] == 100 && (v4[1] & 0xC0) == 64)               // 100.64.0.0/10 (carrier)
+        || (v4[0] == 169 && v4[1] == 254)                       // 169.254.0.0/16 (link local)
+        || (v4[0] == 192 && v4[1] == 0 && v4[2] == 2)           // 192.0.2.0/24 (documentation)
+        || (v4[0] == 198 && v4[1] == 51 && v4[2] == 100)        // 198.51.100.0/24 (documentation)
+        || (v4[0] == 203 && v4[1] == 0 && v4[2] == 113))        // 203.0.113.0/24 (documentation)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    static std::uint8_t const zero[15] = {};
+    if(memcmp(a, zero, sizeof(zero)) == 0
+    && (a[15] == 0 || a[15] == 1))                              // :: (any) and ::1 (loopback)
+    {
+        return false;
+    }
+
+    if((a[0] & 0xFE) == 0xFC                                    // fc00::/7 (private)
+    || (a[0] == 0xFE && (a[1] & 0xC0) == 0x80)                  // fe80::/10 (link local)
+    || (a[0] == 0x20 && a[1] == 0x01 && a[2] == 0x0D && a[3] == 0xB8))  // 2001:db8::/32 (documentation)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,401 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "ipset_queue.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \class ipset_queue
+ * \brief Coalesce the add and del operations sent to the kernel.
+ *
+ * When many services report the same offenders at about the same time,
+ * ipwall receives many IPWALL_BLOCK and IPWALL_UNBLOCK messages in a
+ * very short amount of time. Instead of sending each operation to the
+ * kernel, the queue keeps them for a short period and then sends them
+ * all at once with iplock::ipset::apply().
+ *
+ * The queue keeps at most one operation per set and element. When a
+ * new operation is added for an element which already has a pending
+ * operation, the new operation replaces the old one, timeout included.
+ * So a block followed by an unblock of the same IP address generates
+ * one del and a block repeated by many services generates one add with
+ * the last timeout.
+ *
+ * The queue is committed when the batch timer times out or as soon as
+ * it reaches the maximum number of operations, whichever comes first.
+ * This keeps the queue bounded while the event loop continues to
+ * accept messages.
+ *
+ * All the other commands (create, list, test, etc.) first commit the
+ * pending operations and then get forwarded as is.
+ *
+ * When a kernel_worker is defined, the committed operations are sent
+ * to the kernel by the worker thread so the event loop does not wait
+ * on the kernel. In that case, the other commands also wait for the
+ * worker to be done with the operations it already received. The
+ * list_sets() and run() functions do not wait; their work gets done
+ * by the worker thread after the committed operations.
+ */
+
+
+/** \brief Initialize the queue.
+ *
+ * \param[in] s  The ipset client used to send the operations to the kernel.
+ */
+ipset_queue::ipset_queue(iplock::ipset::pointer_t s)
+    : f_ipset(s)
+{
+}
+
+
+ipset_queue::~ipset_queue()
+{
+}
+
+
+/** \brief Set the maximum number of pending operations.
+ *
+ * When the queue reaches this number of operations, it gets committed
+ * immediately.
+ *
+ * \param[in] max  The maximum number of operations, at least 1.
+ */
+void ipset_queue::set_max_operations(std::size_t max)
+{
+    f_max_operations = std::max(static_cast<std::size_t>(1), max);
+}
+
+
+/** \brief Set the function called when the queue needs a commit.
+ *
+ * The callback is called when the first operation gets added to an
+ * empty queue. It is expected to start a timer which calls commit()
+ * once the coalescing window is over.
+ *
+ * \param[in] callback  The function to call.
+ */
+void ipset_queue::set_schedule_callback(schedule_callback_t callback)
+{
+    f_schedule = callback;
+}
+
+
+/** \brief Set the function called each time operations reach the kernel.
+ *
+ * The callback receives the number of operations sent to the kernel
+ * and the number of those operations which failed. It is used to
+ * gather statistics.
+ *
+ * \param[in] callback  The function to call.
+ */
+void ipset_queue::set_commit_callback(commit_callback_t callback)
+{
+    f_committed = callback;
+}
+
+
+/** \brief Send the committed operations from a worker thread.
+ *
+ * Once a worker is defined, commit() submits the operations to that
+ * worker and returns immediately. The commit callback gets called
+ * once the worker applied them.
+ *
+ * \param[in] worker  The worker sending the operations to the kernel.
+ */
+void ipset_queue::set_worker(kernel_worker::pointer_t worker)
+{
+    f_worker = worker;
+    if(f_worker != nullptr)
+    {
+        f_worker->set_completion_callback([this](kernel_batch const & batch)
+            {
+                committed(batch.f_operations.size(), batch.f_errors);
+            });
+    }
+}
+
+
+std::size_t ipset_queue::pending() const
+{
+    return f_operations.size();
+}
+
+
+/** \brief Send the pending operations to the kernel.
+ *
+ * The add operations are sent first so an IP address moving from one
+ * set to another never gets unblocked in between.
+ *
+ * \return The number of operations sent to the kernel.
+ */
+std::size_t ipset_queue::commit()
+{
+    if(f_operations.empty())
+    {
+        return 0;
+    }
+
+    iplock::ipset_operation::vector_t operations;
+    operations.reserve(f_operations.size());
+    for(auto const & command : {
+                  iplock::ipset_command_t::IPSET_COMMAND_ADD
+                , iplock::ipset_command_t::IPSET_COMMAND_DEL })
+    {
+        for(auto const & op : f_operations)
+        {
+            if(op.second.f_command == command)
+            {
+                operations.push_back({ command, op.first.first, op.second.f_element });
+            }
+        }
+    }
+    f_operations.clear();
+
+    std::size_t const size(operations.size());
+    if(f_worker != nullptr)
+    {
+        f_worker->submit(std::move(operations));
+    }
+    else
+    {
+        committed(size, f_ipset->apply(operations));
+    }
+
+    return size;
+}
+
+
+/** \brief List IP sets without blocking the event loop.
+ *
+ * The pending operations are committed first. Then the sets get listed
+ * by the worker thread and \p callback gets called from the event loop
+ * with the result (see kernel_worker::list()).
+ *
+ * Without a worker, the sets are listed and \p callback is called
+ * immediately.
+ *
+ * \param[in] set_names  The names of the sets to list.
+ * \param[in] callback  The function called with the result.
+ */
+void ipset_queue::list_sets(std::vector<std::string> const & set_names, listing_callback_t callback)
+{
+    commit();
+    if(f_worker != nullptr)
+    {
+        f_worker->list(set_names, callback);
+        return;
+    }
+
+    kernel_listing::vector_t listings(create_listings(set_names));
+    ipwall::list_sets(*f_ipset, listings);
+    callback(listings);
+}
+
+
+/** \brief Run a job once the committed operations were applied.
+ *
+ * The pending operations are committed first. Then \p job gets run by
+ * the worker thread or, without a worker, immediately.
+ *
+ * \param[in] job  The function to run; nothing happens if empty.
+ */
+void ipset_queue::run(job_t job)
+{
+    if(!job)
+    {
+        return;
+    }
+
+    commit();
+    if(f_worker != nullptr)
+    {
+        f_worker->run(job);
+        return;
+    }
+
+    job();
+}
+
+
+/** \brief Commit and wait until the kernel is up to date.
+ *
+ * The commands which read from the kernel or change a set as a whole
+ * have to see all the operations which were queued before them.
+ */
+void ipset_queue::sync()
+{
+    commit();
+    if(f_worker != nullptr)
+    {
+        f_worker->wait();
+    }
+}
+
+
+void ipset_queue::committed(std::size_t operations, std::size_t errors)
+{
+    if(errors != 0)
+    {
+        SNAP_LOG_ERROR
+            << errors
+            << " out of "
+            << operations
+            << " ipset operations failed."
+            << SNAP_LOG_SEND;
+    }
+    if(f_committed)
+    {
+        f_committed(operations, errors);
+    }
+}
+
+
+void ipset_queue::create(std::string const & set_name, iplock::ipset_options const & options)
+{
+    sync();
+    f_ipset->create(set_name, options);
+}
+
+
+void ipset_queue::destroy(std::string const & set_name)
+{
+    sync();
+    f_ipset->destroy(set_name);
+}
+
+
+void ipset_queue::flush(std::string const & set_name)
+{
+    sync();
+    f_ipset->flush(set_name);
+}
+
+
+void ipset_queue::swap(std::string const & set_name1, std::string const & set_name2)
+{
+    sync();
+    f_ipset->swap(set_name1, set_name2);
+}
+
+
+bool ipset_queue::header(std::string const & set_name, iplock::ipset_header & h)
+{
+    sync();
+    return f_ipset->header(set_name, h);
+}
+
+
+void ipset_queue::add(std::string const & set_name, iplock::ipset_element const & element)
+{
+    enqueue(iplock::ipset_command_t::IPSET_COMMAND_ADD, set_name, element);
+}
+
+
+void ipset_queue::del(std::string const & set_name, iplock::ipset_element const & element)
+{
+    enqueue(iplock::ipset_command_t::IPSET_COMMAND_DEL, set_name, element);
+}
+
+
+bool ipset_queue::test(std::string const & set_name, iplock::ipset_element const & element)
+{
+    sync();
+    return f_ipset->test(set_name, element);
+}
+
+
+void ipset_queue::list(std::string const & set_name, element_callback_t callback)
+{
+    sync();
+    f_ipset->list(set_name, callback);
+}
+
+
+/** \brief Apply a list of operations immediately.
+ *
+ * The pending operations are committed first and then the \p operations
+ * are sent to the kernel as is, from the calling thread. This is used when a large number of
+ * operations is known at once, such as on startup.
+ *
+ * \param[in] operations  The operations to apply.
+ *
+ * \return The number of operations which failed.
+ */
+std::size_t ipset_queue::apply(iplock::ipset_operation::vector_t const & operations)
+{
+    sync();
+    std::size_t const errors(f_ipset->apply(operations));
+    if(f_committed)
+    {
+        f_committed(operations.size(), errors);
+    }
+    return errors;
+}
+
+
+void ipset_queue::enqueue(
+      iplock::ipset_command_t command
+    , std::string const & set_name
+    , iplock::ipset_element const & element)
+{
+    bool const first(f_operations.empty());
+
+    // the last operation wins, including its timeout
+    //
+    pending_t & pending(f_operations[key_t(set_name, element)]);
+    pending.f_command = command;
+    pending.f_element = element;
+
+    if(f_operations.size() >= f_max_operations)
+    {
+        commit();
+    }
+    else if(first
+         && f_schedule != nullptr)
+    {
+        f_schedule();
+    }
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "kernel_worker.h"
+
+
+// iplock
+//
+#include    <iplock/ipset.h>
+
+
+// C++
+//
+#include    <map>
+
+
+
+namespace ipwall
+{
+
+
+
+class ipset_queue
+    : public iplock::ipset
+{
+public:
+    typedef std::shared_ptr<ipset_queue>    pointer_t;
+    typedef std::function<void()>           schedule_callback_t;
+    typedef std::function<void(std::size_t operations, std::size_t errors)>
+                                            commit_callback_t;
+
+                        ipset_queue(iplock::ipset::pointer_t s);
+                        ipset_queue(ipset_queue const &) = delete;
+    virtual             ~ipset_queue() override;
+
+    ipset_queue &       operator = (ipset_queue const &) = delete;
+
+    void                set_max_operations(std::size_t max);
+    void                set_schedule_callback(schedule_callback_t callback);
+    void                set_commit_callback(commit_callback_t callback);
+    void                set_worker(kernel_worker::pointer_t worker);
+    std::size_t         pending() const;
+    std::size_t         commit();
+    void                list_sets(std::vector<std::string> const & set_names, listing_callback_t callback);
+    void                run(job_t job);
+
+    // iplock::ipset implementation
+    //
+    virtual void        create(std::string const & set_name, iplock::ipset_options const & options) override;
+    virtual void        destroy(std::string const & set_name) override;
+    virtual void        flush(std::string const & set_name) override;
+    virtual void        swap(std::string const & set_name1, std::string const & set_name2) override;
+    virtual bool        header(std::string const & set_name, iplock::ipset_header & h) override;
+    virtual void        add(std::string const & set_name, iplock::ipset_element const & element) override;
+    virtual void        del(std::string const & set_name, iplock::ipset_element const & element) override;
+    virtual bool        test(std::string const & set_name, iplock::ipset_element const & element) override;
+    virtual void        list(std::string const & set_name, element_callback_t callback) override;
+    virtual std::size_t apply(iplock::ipset_operation::vector_t const & operations) override;
+
+private:
+    typedef std::pair<std::string, iplock::ipset_element>
+                                            key_t;
+
+    // the key only compares the address and CIDR so the element with
+    // its timeout is saved along the command
+    //
+    struct pending_t
+    {
+        iplock::ipset_command_t             f_command = iplock::ipset_command_t::IPSET_COMMAND_ADD;
+        iplock::ipset_element               f_element = iplock::ipset_element();
+    };
+    typedef std::map<key_t, pending_t>      operation_map_t;
+
+    void                sync();
+    void                committed(std::size_t operations, std::size_t errors);
+    void                enqueue(
+                              iplock::ipset_command_t command
+                            , std::string const & set_name
+                            , iplock::ipset_element const & element);
+
+    iplock::ipset::pointer_t
+                        f_ipset = iplock::ipset::pointer_t();
+    std::size_t         f_max_operations = 1000;
+    schedule_callback_t f_schedule = schedule_callback_t();
+    commit_callback_t   f_committed = commit_callback_t();
+    kernel_worker::pointer_t
+                        f_worker = kernel_worker::pointer_t();
+    operation_map_t     f_operations = operation_map_t();
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,108 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "kernel_listing.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \struct kernel_listing
+ * \brief The header and members of an IP set.
+ *
+ * Listing large IP sets takes a while. The periodic listings (counters
+ * harvest, reconciliation) are done by the kernel worker thread which
+ * saves the result in these structures. The event loop then processes
+ * them once the completion eventfd gets signaled.
+ */
+
+
+/** \brief Create the listings of a set of IP sets.
+ *
+ * \param[in] set_names  The names of the sets to list.
+ *
+ * \return One empty listing per set.
+ */
+kernel_listing::vector_t create_listings(std::vector<std::string> const & set_names)
+{
+    kernel_listing::vector_t listings(set_names.size());
+    for(std::size_t idx(0); idx < set_names.size(); ++idx)
+    {
+        listings[idx].f_set_name = set_names[idx];
+    }
+    return listings;
+}
+
+
+/** \brief List IP sets with their header.
+ *
+ * This function reads the header and all the members of each set
+ * named in \p listings. The errors are saved in the listing instead
+ * of being thrown so the other sets still get listed.
+ *
+ * It is used by the kernel worker thread and, when there is no worker,
+ * directly by the event loop.
+ *
+ * \param[in] s  The ipset client to use.
+ * \param[in,out] listings  The sets to list; the results are saved in them.
+ */
+void list_sets(iplock::ipset & s, kernel_listing::vector_t & listings)
+{
+    for(auto & l : listings)
+    {
+        try
+        {
+            l.f_exists = s.header(l.f_set_name, l.f_header);
+            if(!l.f_exists)
+            {
+                continue;
+            }
+            l.f_elements.reserve(l.f_header.f_elements);
+            s.list(l.f_set_name, [&l](iplock::ipset_element const & element)
+                {
+                    l.f_elements.push_back(element);
+                    return true;
+                });
+        }
+        catch(iplock::ipset_error const & e)
+        {
+            l.f_elements.clear();
+            l.f_error_message = e.what();
+        }
+    }
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,64 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// iplock
+//
+#include    <iplock/ipset.h>
+
+
+// C++
+//
+#include    <functional>
+#include    <string>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+struct kernel_listing
+{
+    typedef std::vector<kernel_listing>     vector_t;
+
+    std::string         f_set_name = std::string();
+    bool                f_exists = false;
+    iplock::ipset_header
+                        f_header = iplock::ipset_header();
+    iplock::ipset_element::vector_t
+                        f_elements = iplock::ipset_element::vector_t();
+    std::string         f_error_message = std::string();
+};
+
+
+typedef std::function<void(kernel_listing::vector_t & listings)>
+                                            listing_callback_t;
+typedef std::function<void()>               job_t;
+
+
+void                    list_sets(iplock::ipset & s, kernel_listing::vector_t & listings);
+kernel_listing::vector_t
+                        create_listings(std::vector<std::string> const & set_names);
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,551 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "kernel_worker.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <memory>
+
+
+// C
+//
+#include    <poll.h>
+#include    <string.h>
+#include    <sys/eventfd.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+int create_eventfd(int flags)
+{
+    int const fd(eventfd(0, EFD_CLOEXEC | flags));
+    if(fd == -1)
+    {
+        int const e(errno);
+        throw iplock::ipset_error(
+                  std::string("could not create an eventfd for the kernel worker: ")
+                + strerror(e));
+    }
+    return fd;
+}
+
+
+void signal_eventfd(int fd)
+{
+    std::uint64_t const one(1);
+    while(write(fd, &one, sizeof(one)) == -1
+       && errno == EINTR);
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class kernel_runner
+ * \brief The thread sending the ipset operations to the kernel.
+ *
+ * The runner sleeps on an eventfd until the main thread submits a
+ * batch of operations. It then takes all the batches found in the
+ * request ring, merges them, and sends them to the kernel in a single
+ * call to iplock::ipset::apply(). So when the kernel is slow, the
+ * batches accumulate in the ring and the next transaction is larger.
+ *
+ * Once applied, the batch goes back to the main thread through the
+ * completion ring and the completion eventfd gets signaled.
+ *
+ * A batch may also ask for IP sets to be listed or for a job to be run
+ * (i.e. the synchronization of the ban journal). Such a batch is never
+ * merged: the batches received before it are applied first so the
+ * listings include their operations.
+ *
+ * A null batch asks the runner to exit.
+ */
+
+
+/** \brief Initialize the runner.
+ *
+ * The ipset client \p s is only used by this thread. It must not be
+ * shared with the main thread since the netlink socket is not thread
+ * safe.
+ *
+ * \param[in] s  The ipset client used to send the operations to the kernel.
+ * \param[in] requests  The ring of batches to apply.
+ * \param[in] completions  The ring of batches which were applied.
+ * \param[in] request_fd  The eventfd signaled when a batch is submitted.
+ * \param[in] done_fd  The eventfd to signal when a batch was applied.
+ */
+kernel_runner::kernel_runner(
+          iplock::ipset::pointer_t s
+        , kernel_ring_t & requests
+        , kernel_ring_t & completions
+        , int request_fd
+        , int done_fd)
+    : runner("kernel_runner")
+    , f_ipset(s)
+    , f_requests(requests)
+    , f_completions(completions)
+    , f_request_fd(request_fd)
+    , f_done_fd(done_fd)
+{
+}
+
+
+void kernel_runner::run()
+{
+    for(;;)
+    {
+        std::uint64_t value(0);
+        if(read(f_request_fd, &value, sizeof(value)) != sizeof(value))
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            int const e(errno);
+            SNAP_LOG_FATAL
+                << "the kernel worker could not read its eventfd: "
+                << strerror(e)
+                << SNAP_LOG_SEND;
+            return;
+        }
+
+        kernel_batch * merged(nullptr);
+        kernel_batch * batch(nullptr);
+        bool quit(false);
+        while(f_requests.pop(batch))
+        {
+            if(batch == nullptr)
+            {
+                quit = true;
+                break;
+            }
+            if(!batch->f_listings.empty()
+            || batch->f_job)
+            {
+                if(merged != nullptr)
+                {
+                    apply(merged);
+                    merged = nullptr;
+                }
+                apply(batch);
+            }
+            else if(merged == nullptr)
+            {
+                merged = batch;
+            }
+            else
+            {
+                merged->f_operations.insert(
+                          merged->f_operations.end()
+                        , batch->f_operations.begin()
+                        , batch->f_operations.end());
+                merged->f_batches += batch->f_batches;
+                delete batch;
+            }
+        }
+
+        if(merged != nullptr)
+        {
+            apply(merged);
+        }
+
+        if(quit)
+        {
+            return;
+        }
+    }
+}
+
+
+void kernel_runner::apply(kernel_batch * batch)
+{
+    if(!batch->f_operations.empty())
+    {
+        try
+        {
+            batch->f_errors = f_ipset->apply(batch->f_operations);
+        }
+        catch(iplock::ipset_error const & e)
+        {
+            batch->f_errors = batch->f_operations.size();
+            batch->f_error_message = e.what();
+        }
+    }
+
+    if(!batch->f_listings.empty())
+    {
+        list_sets(*f_ipset, batch->f_listings);
+    }
+
+    if(batch->f_job)
+    {
+        try
+        {
+            batch->f_job();
+        }
+        catch(std::exception const & e)
+        {
+            batch->f_error_message = e.what();
+        }
+    }
+
+    // the main thread never has more batches in flight than the ring
+    // can hold so this push cannot fail
+    //
+    f_completions.push(batch);
+    signal_eventfd(f_done_fd);
+}
+
+
+
+/** \class kernel_worker
+ * \brief Apply the ipset operations in a separate thread.
+ *
+ * Sending a large transaction to the kernel can take a while. If that
+ * was done in the event loop, ipwall would not handle any message
+ * during that time. Instead the ipset_queue submits its batches to
+ * this worker which sends them to the kernel from its own thread.
+ *
+ * The batches are passed through lock free single producer single
+ * consumer rings. The completions come back through an eventfd which
+ * this connection listens to so they get processed by the event loop
+ * like any other event.
+ *
+ * The commands which need an answer from the kernel (list, header,
+ * swap, etc.) first wait() for all the batches in flight so they see
+ * the operations which were submitted before them. The periodic
+ * listings (counters, reconciliation) use list() instead which does
+ * not block the event loop: the sets get listed by the worker thread
+ * and the result comes back through the completion eventfd. In the
+ * same way, run() executes a job, such as the synchronization of the
+ * ban journal, in the worker thread.
+ */
+
+
+/** \brief Initialize the worker and start its thread.
+ *
+ * \param[in] s  The ipset client used by the worker thread only.
+ */
+kernel_worker::kernel_worker(iplock::ipset::pointer_t s)
+    : fd_connection(create_eventfd(EFD_NONBLOCK), ed::fd_connection::mode_t::FD_MODE_READ)
+    , f_request_fd(create_eventfd(0))
+{
+    set_name("kernel_worker");
+
+    f_runner = std::make_shared<kernel_runner>(
+                  s
+                , f_requests
+                , f_completions
+                , f_request_fd
+                , get_socket());
+    f_thread = std::make_shared<cppthread::thread>("kernel_worker", f_runner);
+    if(!f_thread->start())
+    {
+        throw iplock::ipset_error("could not start the kernel worker thread.");
+    }
+}
+
+
+kernel_worker::~kernel_worker()
+{
+    // the owners of the callbacks may already be gone
+    //
+    f_completed = completion_callback_t();
+    f_callbacks = false;
+    stop();
+    close(f_request_fd);
+    close(get_socket());
+}
+
+
+/** \brief Set the function called once a batch was applied.
+ *
+ * The callback is called from the event loop (or wait()), never from
+ * the worker thread.
+ *
+ * \param[in] callback  The function to call.
+ */
+void kernel_worker::set_completion_callback(completion_callback_t callback)
+{
+    f_completed = callback;
+}
+
+
+/** \brief Submit a batch of operations to the worker thread.
+ *
+ * The function returns immediately unless the request ring is full,
+ * in which case it waits for the worker to apply at least one batch.
+ *
+ * \param[in] operations  The operations to send to the kernel.
+ */
+void kernel_worker::submit(iplock::ipset_operation::vector_t && operations)
+{
+    kernel_batch * batch(new kernel_batch);
+    batch->f_operations = std::move(operations);
+    push(batch);
+}
+
+
+/** \brief List IP sets from the worker thread.
+ *
+ * The sets get listed once the batches submitted so far were applied.
+ * The \p callback is then called from the event loop with the headers
+ * and members of the sets. A set which does not exist has its f_exists
+ * flag set to false and a set which could not be listed has an error
+ * message.
+ *
+ * \param[in] set_names  The names of the sets to list.
+ * \param[in] callback  The function called with the result.
+ */
+void kernel_worker::list(std::vector<std::string> const & set_names, listing_callback_t callback)
+{
+    kernel_batch * batch(new kernel_batch);
+    batch->f_listings = create_listings(set_names);
+    batch->f_listed = callback;
+    push(batch);
+}
+
+
+/** \brief Run a job in the worker thread.
+ *
+ * The job runs once the batches submitted so far were applied. It must
+ * not access anything the event loop may change in the meantime.
+ *
+ * \param[in] job  The function to run in the worker thread.
+ */
+void kernel_worker::run(job_t job)
+{
+    kernel_batch * batch(new kernel_batch);
+    batch->f_job = job;
+    push(batch);
+}
+
+
+/** \brief Get the number of batches not yet applied.
+ *
+ * \return The number of batches waiting for the kernel.
+ */
+std::size_t kernel_worker::in_flight() const
+{
+    return f_in_flight;
+}
+
+
+/** \brief Wait until all the batches submitted so far were applied.
+ *
+ * This function blocks the event loop. It is used before the commands
+ * which need the kernel to be up to date.
+ */
+void kernel_worker::wait()
+{
+    while(f_in_flight > 0)
+    {
+        wait_for_completion();
+    }
+    deliver_deferred();
+}
+
+
+/** \brief Apply the last batches and stop the worker thread.
+ */
+void kernel_worker::stop()
+{
+    if(f_thread == nullptr)
+    {
+        return;
+    }
+
+    wait();
+
+    f_requests.push(nullptr);
+    signal_worker();
+    f_thread->stop();
+    f_thread.reset();
+}
+
+
+/** \brief Process the batches which were applied.
+ *
+ * The completion eventfd was signaled. This function takes all the
+ * batches found in the completion ring, reports errors, and calls the
+ * completion callback.
+ */
+void kernel_worker::process_read()
+{
+    std::uint64_t value(0);
+    while(read(get_socket(), &value, sizeof(value)) == -1
+       && errno == EINTR);
+
+    if(!f_waiting
+    && f_callbacks
+    && !f_deferred.empty())
+    {
+        std::vector<std::unique_ptr<kernel_batch>> deferred;
+        deferred.swap(f_deferred);
+        for(auto & b : deferred)
+        {
+            b->f_listed(b->f_listings);
+        }
+    }
+
+    kernel_batch * batch(nullptr);
+    while(f_completions.pop(batch))
+    {
+        std::unique_ptr<kernel_batch> safe_batch(batch);
+        f_in_flight -= std::min(f_in_flight, batch->f_batches);
+
+        if(!batch->f_error_message.empty())
+        {
+            SNAP_LOG_ERROR
+                << (batch->f_job ? "kernel worker job failed: " : "ipset transaction failed: ")
+                << batch->f_error_message
+                << SNAP_LOG_SEND;
+        }
+        if(!f_callbacks)
+        {
+            continue;
+        }
+        if(f_completed
+        && !batch->f_operations.empty())
+        {
+            f_completed(*batch);
+        }
+        if(batch->f_listed)
+        {
+            if(f_waiting)
+            {
+                // the caller of wait() may be in the middle of changing
+                // the state the callback works on; deliver the listing
+                // from the event loop instead
+                //
+                f_deferred.push_back(std::move(safe_batch));
+                continue;
+            }
+            batch->f_listed(batch->f_listings);
+        }
+    }
+}
+
+
+void kernel_worker::push(kernel_batch * batch)
+{
+    std::unique_ptr<kernel_batch> safe_batch(batch);
+    if(f_thread == nullptr)
+    {
+        throw iplock::logic_error("kernel_worker request sent after stop().");
+    }
+
+    while(f_in_flight >= KERNEL_RING_SIZE - 1)
+    {
+        wait_for_completion();
+    }
+    deliver_deferred();
+
+    f_requests.push(safe_batch.release());
+    ++f_in_flight;
+    signal_worker();
+}
+
+
+void kernel_worker::wait_for_completion()
+{
+    pollfd fd = {};
+    fd.fd = get_socket();
+    fd.events = POLLIN;
+    if(poll(&fd, 1, -1) == -1
+    && errno != EINTR)
+    {
+        int const e(errno);
+        throw iplock::ipset_error(
+                  std::string("could not wait for the kernel worker: ")
+                + strerror(e));
+    }
+
+    bool const waiting(f_waiting);
+    f_waiting = true;
+    try
+    {
+        process_read();
+    }
+    catch(...)
+    {
+        f_waiting = waiting;
+        throw;
+    }
+    f_waiting = waiting;
+}
+
+
+/** \brief Make sure the deferred listings get delivered.
+ *
+ * The listings received while waiting are kept until the event loop
+ * calls process_read() again. This function signals the completion
+ * eventfd so it does.
+ */
+void kernel_worker::deliver_deferred()
+{
+    if(!f_waiting
+    && !f_deferred.empty())
+    {
+        signal_eventfd(get_socket());
+    }
+}
+
+
+void kernel_worker::signal_worker()
+{
+    signal_eventfd(f_request_fd);
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
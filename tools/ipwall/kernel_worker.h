@@ -0,0 +1,158 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "kernel_listing.h"
+#include    "spsc_ring.h"
+
+
+// iplock
+//
+#include    <iplock/ipset.h>
+
+
+// eventdispatcher
+//
+#include    <eventdispatcher/fd_connection.h>
+
+
+// cppthread
+//
+#include    <cppthread/runner.h>
+#include    <cppthread/thread.h>
+
+
+// C++
+//
+#include    <memory>
+
+
+
+namespace ipwall
+{
+
+
+
+struct kernel_batch
+{
+    iplock::ipset_operation::vector_t
+                        f_operations = iplock::ipset_operation::vector_t();
+    std::size_t         f_batches = 1;          // number of batches merged in this one
+    std::size_t         f_errors = 0;
+    std::string         f_error_message = std::string();
+
+    // a batch with listings or a job is never merged with other batches
+    //
+    kernel_listing::vector_t
+                        f_listings = kernel_listing::vector_t();
+    listing_callback_t  f_listed = listing_callback_t();
+    job_t               f_job = job_t();
+};
+
+
+constexpr std::size_t const     KERNEL_RING_SIZE = 256;
+
+typedef spsc_ring<kernel_batch *, KERNEL_RING_SIZE>     kernel_ring_t;
+
+
+class kernel_runner
+    : public cppthread::runner
+{
+public:
+    typedef std::shared_ptr<kernel_runner>  pointer_t;
+
+                        kernel_runner(
+                              iplock::ipset::pointer_t s
+                            , kernel_ring_t & requests
+                            , kernel_ring_t & completions
+                            , int request_fd
+                            , int done_fd);
+                        kernel_runner(kernel_runner const &) = delete;
+
+    kernel_runner &     operator = (kernel_runner const &) = delete;
+
+    // cppthread::runner implementation
+    //
+    virtual void        run() override;
+
+private:
+    void                apply(kernel_batch * batch);
+
+    iplock::ipset::pointer_t
+                        f_ipset = iplock::ipset::pointer_t();
+    kernel_ring_t &     f_requests;
+    kernel_ring_t &     f_completions;
+    int                 f_request_fd = -1;
+    int                 f_done_fd = -1;
+};
+
+
+class kernel_worker
+    : public ed::fd_connection
+{
+public:
+    typedef std::shared_ptr<kernel_worker>  pointer_t;
+    typedef std::function<void(kernel_batch const & batch)>
+                                            completion_callback_t;
+
+                        kernel_worker(iplock::ipset::pointer_t s);
+                        kernel_worker(kernel_worker const &) = delete;
+    virtual             ~kernel_worker() override;
+
+    kernel_worker &     operator = (kernel_worker const &) = delete;
+
+    void                set_completion_callback(completion_callback_t callback);
+    void                submit(iplock::ipset_operation::vector_t && operations);
+    void                list(std::vector<std::string> const & set_names, listing_callback_t callback);
+    void                run(job_t job);
+    std::size_t         in_flight() const;
+    void                wait();
+    void                stop();
+
+    // ed::fd_connection implementation
+    //
+    virtual void        process_read() override;
+
+private:
+    void                push(kernel_batch * batch);
+    void                wait_for_completion();
+    void                deliver_deferred();
+    void                signal_worker();
+
+    int                 f_request_fd = -1;
+    kernel_ring_t       f_requests = kernel_ring_t();
+    kernel_ring_t       f_completions = kernel_ring_t();
+    kernel_runner::pointer_t
+                        f_runner = kernel_runner::pointer_t();
+    cppthread::thread::pointer_t
+                        f_thread = cppthread::thread::pointer_t();
+    std::size_t         f_in_flight = 0;
+    completion_callback_t
+                        f_completed = completion_callback_t();
+    std::vector<std::unique_ptr<kernel_batch>>
+                        f_deferred = std::vector<std::unique_ptr<kernel_batch>>();
+    bool                f_waiting = false;
+    bool                f_callbacks = true;
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -64,8 +64,9 @@ namespace ipwall
  *
  * The messenger is a connection to the communicatord server.
  *
- * In most cases we receive IPWALL_BLOCK, STOP, and LOG_ROTATE messages
- * from it. We implement a few other messages too (HELP, READY...)
+ * In most cases we receive IPWALL_BLOCK, IPWALL_BLOCK_BATCH, STOP, and
+ * LOG_ROTATE messages from it. We implement a few other messages too
+ * (HELP, READY...)
  *
  * We use a permanent connection so if the communicatord restarts
  * for whatever reason, we reconnect automatically.
@@ -80,8 +81,10 @@ messenger::messenger(server * s, advgetopt::getopt & opts)
     set_name("messenger");
 
     get_dispatcher()->add_matches({
+        DISPATCHER_MATCH(iplock::g_name_iplock_cmd_ipwall_get_stats,  &messenger::msg_ipwall_get_stats),
         DISPATCHER_MATCH(iplock::g_name_iplock_cmd_ipwall_get_status, &messenger::msg_ipwall_get_status),
         DISPATCHER_MATCH(iplock::g_name_iplock_cmd_ipwall_block,      &messenger::msg_ipwall_block_ip),
+        DISPATCHER_MATCH(iplock::g_name_iplock_cmd_ipwall_block_batch, &messenger::msg_ipwall_block_ips),
         DISPATCHER_MATCH(iplock::g_name_iplock_cmd_ipwall_unblock,    &messenger::msg_ipwall_unblock_ip),
     });
 }
@@ -100,6 +103,12 @@ void messenger::msg_ipwall_block_ip(ed::message & msg)
 }
 
 
+void messenger::msg_ipwall_block_ips(ed::message & msg)
+{
+    f_server->block_ips(msg);
+}
+
+
 void messenger::msg_ipwall_unblock_ip(ed::message & msg)
 {
     f_server->unblock_ip(msg);
@@ -125,6 +134,38 @@ void messenger::msg_ipwall_unblock_ip(ed::message & msg)
 //}
 
 
+/** \brief Broadcast the current status of the firewall.
+ *
+ * The server calls this function once the firewall is setup so
+ * services waiting on the firewall know that they can proceed.
+ *
+ * It is also called each time the ingress queue becomes overloaded
+ * and once it is back to normal. The message includes the depth of
+ * the queue so the senders can slow down.
+ *
+ * The message is cached until we are connected to the communicator
+ * daemon.
+ */
+void messenger::send_firewall_status()
+{
+    ed::message status;
+    status.set_command(iplock::g_name_iplock_cmd_ipwall_current_status);
+    status.set_service(".");
+    status.add_parameter(
+              ::communicator::g_name_communicator_param_status
+            , f_server->is_firewall_up()
+                    ? ::communicator::g_name_communicator_value_up
+                    : ::communicator::g_name_communicator_value_down);
+    status.add_parameter(
+              iplock::g_name_iplock_param_queue_depth
+            , f_server->get_ingress_depth());
+    status.add_parameter(
+              iplock::g_name_iplock_param_queue_capacity
+            , f_server->get_ingress_capacity());
+    send_message(status, true);
+}
+
+
 void messenger::msg_ipwall_get_status(ed::message & msg)
 {
     // someone is asking us whether we are ready, reply with
@@ -143,6 +184,30 @@ void messenger::msg_ipwall_get_status(ed::message & msg)
             , f_server->is_firewall_up()
                     ? ::communicator::g_name_communicator_value_up
                     : ::communicator::g_name_communicator_value_down);
+    reply.add_parameter(
+              iplock::g_name_iplock_param_queue_depth
+            , f_server->get_ingress_depth());
+    reply.add_parameter(
+              iplock::g_name_iplock_param_queue_capacity
+            , f_server->get_ingress_capacity());
+    send_message(reply);
+}
+
+
+void messenger::msg_ipwall_get_stats(ed::message & msg)
+{
+    // the statistics change all the time, make sure the reply does
+    // not get cached
+    //
+    ed::message reply;
+    reply.reply_to(msg);
+    reply.set_command(iplock::g_name_iplock_cmd_ipwall_stats);
+    reply.add_parameter(
+              ::communicator::g_name_communicator_param_cache
+            , ::communicator::g_name_communicator_value_no);
+    reply.add_parameter(
+              iplock::g_name_iplock_param_stats
+            , f_server->get_stats());
     send_message(reply);
 }
 
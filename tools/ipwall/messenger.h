@@ -45,9 +45,12 @@ public:
     messenger &         operator = (messenger const & rhs) = delete;
 
     void                finish_initialization();
+    void                send_firewall_status();
 
 private:
     void                msg_ipwall_block_ip(ed::message & msg);
+    void                msg_ipwall_block_ips(ed::message & msg);
+    void                msg_ipwall_get_stats(ed::message & msg);
     void                msg_ipwall_get_status(ed::message & msg);
     void                msg_ipwall_unblock_ip(ed::message & msg);
 
@@ -0,0 +1,914 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "net_aggregator.h"
+
+#include    "stats.h"
+
+
+// iplock
+//
+#include    <iplock/exception.h>
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The maximum length of an IP set name.
+ *
+ * The kernel limits the names to 32 characters including the
+ * terminating null.
+ */
+constexpr std::string::size_type const  g_max_set_name_length = 31;
+
+
+
+} // no name namespace
+
+
+
+/** \class net_aggregator
+ * \brief Replace many blocks of the same network with one net block.
+ *
+ * Scanners often rotate through all the addresses of a small network.
+ * Each address becomes its own entry in the "unwanted" sets which grow
+ * and keep being rehashed by the kernel.
+ *
+ * This decorator sits between the block store and the ipset queue. It
+ * keeps track of the addresses added to each network (a /24 for IPv4
+ * and a /64 for IPv6 by default). Once a network reaches the threshold
+ * number of blocks within the window, the individual entries get
+ * replaced by one entry in the `hash:net` companion set (i.e.
+ * `unwanted_net_ipv4` for `unwanted_ipv4`). Further blocks in that
+ * network do not reach the kernel.
+ *
+ * The net entry remains until all of its members were removed, so it
+ * expires once all of its members would have expired. When the kernel
+ * times out the blocks, the net entry gets the longest timeout of its
+ * members.
+ *
+ * A network which includes an allowed IP address (see allowlist) is
+ * never aggregated. An explicit unblock of a member (see release())
+ * re-adds the other members individually and prevents the aggregation
+ * of that network for one window.
+ *
+ * From the point of view of the block store, the sets still include
+ * all the members: list() and test() report the aggregated members.
+ *
+ * Sets without a companion set are forwarded as is.
+ */
+
+
+/** \brief Initialize the aggregator.
+ *
+ * \param[in] s  The ipset client used to send the operations to the kernel.
+ * \param[in] allowed  The addresses which must never be blocked.
+ */
+net_aggregator::net_aggregator(iplock::ipset::pointer_t s, iplock::allowlist::pointer_t allowed)
+    : f_ipset(s)
+    , f_allowlist(allowed)
+{
+}
+
+
+net_aggregator::~net_aggregator()
+{
+}
+
+
+/** \brief Set the number of blocks which triggers an aggregation.
+ *
+ * \param[in] threshold  The number of blocks within the window; 0
+ * disables the aggregation.
+ */
+void net_aggregator::set_threshold(std::size_t threshold)
+{
+    f_threshold = threshold;
+}
+
+
+void net_aggregator::set_window(snapdev::timespec_ex const & window)
+{
+    f_window = static_cast<std::uint32_t>(std::max(static_cast<time_t>(1), window.tv_sec));
+}
+
+
+/** \brief Set the size of the aggregated networks.
+ *
+ * \param[in] ipv4  The number of bits of the IPv4 networks (8 to 31).
+ * \param[in] ipv6  The number of bits of the IPv6 networks (16 to 127).
+ */
+void net_aggregator::set_prefixes(int ipv4, int ipv6)
+{
+    f_ipv4_prefix = std::clamp(ipv4, 8, 31);
+    f_ipv6_prefix = std::clamp(ipv6, 16, 127);
+}
+
+
+void net_aggregator::set_stats(stats * s)
+{
+    f_stats = s;
+}
+
+
+/** \brief Find the companion sets.
+ *
+ * For each set name ending with "_ipv4" or "_ipv6", the companion set
+ * uses the same name with "_net" inserted before the suffix. Only the
+ * sets with an existing companion are aggregated.
+ *
+ * Since the aggregator starts without any state, the net entries found
+ * in the companion sets are only remembered here. They stay in the
+ * kernel until the blocks were restored in the main sets (see
+ * block_store::sync_sets()) and then drop_stale() removes them. This
+ * way the aggregated addresses are never unblocked while ipwall starts.
+ *
+ * \param[in] set_names  The names of the sets used by ipwall.
+ */
+void net_aggregator::setup(std::vector<std::string> const & set_names)
+{
+    f_companions.clear();
+    f_networks.clear();
+    f_stale.clear();
+    f_aggregate_count = 0;
+
+    if(f_threshold == 0)
+    {
+        return;
+    }
+
+    for(auto const & name : set_names)
+    {
+        if(name.length() <= 5)
+        {
+            continue;
+        }
+        std::string const suffix(name.substr(name.length() - 5));
+        if(suffix != "_ipv4"
+        && suffix != "_ipv6")
+        {
+            continue;
+        }
+        std::string const companion(name.substr(0, name.length() - 5) + "_net" + suffix);
+        if(companion.length() > g_max_set_name_length)
+        {
+            continue;
+        }
+
+        try
+        {
+            iplock::ipset_header h;
+            if(!f_ipset->header(companion, h))
+            {
+                SNAP_LOG_INFO
+                    << "IP set \""
+                    << companion
+                    << "\" does not exist; blocks in \""
+                    << name
+                    << "\" will not be aggregated."
+                    << SNAP_LOG_SEND;
+                continue;
+            }
+            iplock::ipset_element::vector_t & stale(f_stale[companion]);
+            stale.reserve(h.f_elements);
+            f_ipset->list(companion, [&stale](iplock::ipset_element const & element)
+                {
+                    stale.push_back(element);
+                    return true;
+                });
+        }
+        catch(iplock::ipset_error const & e)
+        {
+            SNAP_LOG_ERROR
+                << "could not setup IP set \""
+                << companion
+                << "\": "
+                << e.what()
+                << SNAP_LOG_SEND;
+            continue;
+        }
+        f_companions[name] = companion;
+    }
+}
+
+
+/** \brief Remove the net entries left by a previous instance.
+ *
+ * This function is called once the blocks were restored in the main
+ * sets. The members of the networks found in the companion sets by
+ * setup() are then blocked again, either individually or by a new
+ * aggregate, so the old net entries can be removed:
+ *
+ * \li a net entry which was aggregated again is kept as is;
+ * \li a net entry with members blocked individually gets deleted;
+ * \li a net entry without any known member (i.e. the journal was lost)
+ * is left to the kernel if it has a timeout and deleted otherwise since
+ * nothing else would ever remove it.
+ */
+void net_aggregator::drop_stale()
+{
+    std::size_t dropped(0);
+    for(auto const & c : f_companions)
+    {
+        auto const stale(f_stale.find(c.second));
+        if(stale == f_stale.end())
+        {
+            continue;
+        }
+        for(auto const & element : stale->second)
+        {
+            key_t const key(get_key(c.first, iplock::ipset_element(element.f_address)));
+            auto const it(f_networks.find(key));
+            bool const same_network(it != f_networks.end()
+                        && key.second == element.f_address
+                        && element.f_cidr == (element.is_ipv4() ? f_ipv4_prefix : f_ipv6_prefix));
+            if(same_network
+            && it->second.f_aggregated)
+            {
+                continue;
+            }
+            if(!same_network
+            && element.f_timeout != 0)
+            {
+                continue;
+            }
+            f_ipset->del(c.second, element);
+            ++dropped;
+        }
+    }
+    f_stale.clear();
+
+    if(dropped > 0)
+    {
+        SNAP_LOG_INFO
+            << "removed "
+            << dropped
+            << " net entries left by a previous instance."
+            << SNAP_LOG_SEND;
+    }
+}
+
+
+/** \brief Break the aggregates which include an address.
+ *
+ * This function is called before an address gets unblocked explicitly.
+ * The other members of its network get added back individually and the
+ * net entry gets removed so the address is really unblocked. That
+ * network cannot be aggregated again for one window.
+ *
+ * \param[in] address  The address about to be unblocked.
+ */
+void net_aggregator::release(block_info::address_t const & address)
+{
+    std::uint32_t const now(static_cast<std::uint32_t>(snapdev::timespec_ex::gettime().tv_sec));
+    iplock::ipset_element const element(address);
+    for(auto const & c : f_companions)
+    {
+        if(!is_managed(c.first, element))
+        {
+            continue;
+        }
+        key_t const key(get_key(c.first, element));
+        auto it(f_networks.find(key));
+        if(it == f_networks.end())
+        {
+            continue;
+        }
+        if(it->second.f_aggregated)
+        {
+            prune(it->second, now);
+            disaggregate(key, it->second, now);
+        }
+        it->second.f_no_aggregate_until = now + f_window;
+    }
+}
+
+
+/** \brief Break the aggregates which include an allowed address.
+ *
+ * The aggregation checks the allowlist only when a network gets
+ * aggregated. This function is called after the allowlist changed so
+ * the networks which were aggregated before one of their addresses got
+ * allowed are broken. The members get added back individually and that
+ * network cannot be aggregated again for one window.
+ */
+void net_aggregator::check_allowlist()
+{
+    if(f_allowlist == nullptr)
+    {
+        return;
+    }
+
+    std::uint32_t const now(static_cast<std::uint32_t>(snapdev::timespec_ex::gettime().tv_sec));
+    for(auto & n : f_networks)
+    {
+        if(!n.second.f_aggregated
+        || !f_allowlist->overlaps(n.first.second, get_prefix(iplock::ipset_element(n.first.second))))
+        {
+            continue;
+        }
+
+        SNAP_LOG_INFO
+            << "network "
+            << get_network_element(n.first, 0, 0).to_string()
+            << " of \""
+            << n.first.first
+            << "\" includes an allowed address; adding its "
+            << n.second.f_members.size()
+            << " blocks back individually."
+            << SNAP_LOG_SEND;
+
+        prune(n.second, now);
+        disaggregate(n.first, n.second, now);
+        n.second.f_no_aggregate_until = now + f_window;
+    }
+}
+
+
+/** \brief Forget about the members which timed out.
+ *
+ * When the kernel times out the blocks, the aggregator does not get
+ * told about the members which timed out. This function removes them
+ * and the networks without members.
+ *
+ * \param[in] now  The current time.
+ */
+void net_aggregator::cleanup(snapdev::timespec_ex const & now)
+{
+    std::uint32_t const seconds(static_cast<std::uint32_t>(now.tv_sec));
+    for(auto it(f_networks.begin()); it != f_networks.end(); )
+    {
+        prune(it->second, seconds);
+        if(it->second.f_members.empty()
+        && it->second.f_no_aggregate_until <= seconds)
+        {
+            if(it->second.f_aggregated)
+            {
+                f_ipset->del(f_companions[it->first.first], get_network_element(it->first, 0, seconds));
+                --f_aggregate_count;
+            }
+            it = f_networks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+
+std::size_t net_aggregator::get_aggregate_count() const
+{
+    return f_aggregate_count;
+}
+
+
+void net_aggregator::create(std::string const & set_name, iplock::ipset_options const & options)
+{
+    f_ipset->create(set_name, options);
+}
+
+
+void net_aggregator::destroy(std::string const & set_name)
+{
+    f_ipset->destroy(set_name);
+}
+
+
+void net_aggregator::flush(std::string const & set_name)
+{
+    f_ipset->flush(set_name);
+}
+
+
+void net_aggregator::swap(std::string const & set_name1, std::string const & set_name2)
+{
+    f_ipset->swap(set_name1, set_name2);
+}
+
+
+bool net_aggregator::header(std::string const & set_name, iplock::ipset_header & h)
+{
+    return f_ipset->header(set_name, h);
+}
+
+
+void net_aggregator::add(std::string const & set_name, iplock::ipset_element const & element)
+{
+    if(!is_managed(set_name, element))
+    {
+        f_ipset->add(set_name, element);
+        return;
+    }
+
+    std::uint32_t const now(static_cast<std::uint32_t>(snapdev::timespec_ex::gettime().tv_sec));
+    std::uint32_t const start(now > f_window ? now - f_window : 0);
+    key_t const key(get_key(set_name, element));
+    network_t & n(f_networks[key]);
+
+    // a member already counted within the window is not counted again
+    //
+    std::uint32_t const expiry(element.f_timeout == 0 ? 0 : now + element.f_timeout);
+    auto const m(n.f_members.find(element.f_address));
+    bool const counted(m != n.f_members.end() && m->second.f_added >= start);
+    set_member(n, element.f_address, member_t{ now, expiry });
+
+    if(n.f_aggregated)
+    {
+        // the net entry already blocks this address, make sure it
+        // lasts long enough
+        //
+        std::uint32_t const net_expiry(get_expiry(n));
+        if(net_expiry != n.f_expiry)
+        {
+            n.f_expiry = net_expiry;
+            f_ipset->add(f_companions[set_name], get_network_element(key, net_expiry, now));
+        }
+        return;
+    }
+
+    f_ipset->add(set_name, element);
+
+    // only the last threshold additions matter
+    //
+    if(!counted)
+    {
+        n.f_recent.push_back(now);
+    }
+    while(!n.f_recent.empty()
+       && (n.f_recent.front() < start
+            || n.f_recent.size() > f_threshold))
+    {
+        n.f_recent.pop_front();
+    }
+
+    if(n.f_no_aggregate_until > now)
+    {
+        return;
+    }
+    if(n.f_recent.size() >= f_threshold)
+    {
+        aggregate(key, n, now);
+    }
+}
+
+
+void net_aggregator::del(std::string const & set_name, iplock::ipset_element const & element)
+{
+    if(!is_managed(set_name, element))
+    {
+        f_ipset->del(set_name, element);
+        return;
+    }
+
+    key_t const key(get_key(set_name, element));
+    auto it(f_networks.find(key));
+    if(it == f_networks.end())
+    {
+        f_ipset->del(set_name, element);
+        return;
+    }
+
+    network_t & n(it->second);
+    auto const m(n.f_members.find(element.f_address));
+    if(m != n.f_members.end())
+    {
+        erase_member(n, m);
+    }
+
+    if(!n.f_aggregated)
+    {
+        f_ipset->del(set_name, element);
+    }
+
+    if(n.f_members.empty())
+    {
+        if(n.f_aggregated)
+        {
+            f_ipset->del(f_companions[set_name], get_network_element(key, 0, 0));
+            --f_aggregate_count;
+        }
+        f_networks.erase(it);
+    }
+}
+
+
+bool net_aggregator::test(std::string const & set_name, iplock::ipset_element const & element)
+{
+    if(is_managed(set_name, element))
+    {
+        auto it(f_networks.find(get_key(set_name, element)));
+        if(it != f_networks.end()
+        && it->second.f_aggregated
+        && it->second.f_members.find(element.f_address) != it->second.f_members.end())
+        {
+            return true;
+        }
+    }
+
+    return f_ipset->test(set_name, element);
+}
+
+
+/** \brief List the elements of a set.
+ *
+ * The members of the aggregated networks of that set are listed too,
+ * with their own remaining timeout, as if they were still in the set.
+ *
+ * \param[in] set_name  The name of the set to list.
+ * \param[in] callback  The function called with each element.
+ */
+void net_aggregator::list(std::string const & set_name, element_callback_t callback)
+{
+    bool more(true);
+    f_ipset->list(set_name, [&more, &callback](iplock::ipset_element const & element)
+        {
+            more = callback(element);
+            return more;
+        });
+
+    if(more)
+    {
+        list_aggregated(set_name, callback);
+    }
+}
+
+
+/** \brief Add the members of the aggregated networks to listings.
+ *
+ * The kernel worker lists the sets directly with its own ipset client
+ * so the listings do not include the addresses blocked by a net entry.
+ * This function adds those members to the listings as list() would.
+ *
+ * \param[in,out] listings  The listings to complete.
+ */
+void net_aggregator::add_aggregated(kernel_listing::vector_t & listings) const
+{
+    for(auto & l : listings)
+    {
+        if(!l.f_exists
+        || !l.f_error_message.empty())
+        {
+            continue;
+        }
+        list_aggregated(l.f_set_name, [&l](iplock::ipset_element const & element)
+            {
+                l.f_elements.push_back(element);
+                return true;
+            });
+    }
+}
+
+
+bool net_aggregator::list_aggregated(std::string const & set_name, element_callback_t callback) const
+{
+    if(f_companions.find(set_name) == f_companions.end())
+    {
+        return true;
+    }
+
+    std::uint32_t const now(static_cast<std::uint32_t>(snapdev::timespec_ex::gettime().tv_sec));
+    for(auto const & n : f_networks)
+    {
+        if(n.first.first != set_name
+        || !n.second.f_aggregated)
+        {
+            continue;
+        }
+        for(auto const & m : n.second.f_members)
+        {
+            // a member which timed out is not blocked anymore
+            //
+            if(m.second.f_expiry != 0
+            && m.second.f_expiry <= now)
+            {
+                continue;
+            }
+            iplock::ipset_element element(m.first);
+            element.f_timeout = m.second.f_expiry == 0 ? 0 : m.second.f_expiry - now;
+            if(!callback(element))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/** \brief Apply a list of operations.
+ *
+ * The operations on sets with a companion go through add() and del().
+ * The others are forwarded at once.
+ *
+ * \param[in] operations  The operations to apply.
+ *
+ * \return The number of operations which failed.
+ */
+std::size_t net_aggregator::apply(iplock::ipset_operation::vector_t const & operations)
+{
+    iplock::ipset_operation::vector_t forward;
+    forward.reserve(operations.size());
+    std::size_t errors(0);
+    for(auto const & op : operations)
+    {
+        if(!is_managed(op.f_set_name, op.f_element))
+        {
+            forward.push_back(op);
+            continue;
+        }
+        try
+        {
+            switch(op.f_command)
+            {
+            case iplock::ipset_command_t::IPSET_COMMAND_ADD:
+                add(op.f_set_name, op.f_element);
+                break;
+
+            case iplock::ipset_command_t::IPSET_COMMAND_DEL:
+                del(op.f_set_name, op.f_element);
+                break;
+
+            }
+        }
+        catch(iplock::ipset_error const &)
+        {
+            ++errors;
+        }
+    }
+
+    if(!forward.empty())
+    {
+        errors += f_ipset->apply(forward);
+    }
+
+    return errors;
+}
+
+
+bool net_aggregator::is_managed(std::string const & set_name, iplock::ipset_element const & element) const
+{
+    return f_threshold != 0
+        && (element.f_cidr == 0 || element.f_cidr == element.get_host_cidr())
+        && f_companions.find(set_name) != f_companions.end();
+}
+
+
+/** \brief Get the size of the network of an element.
+ *
+ * \param[in] element  The element to check.
+ *
+ * \return The number of bits of the network in IPv6 bits.
+ */
+int net_aggregator::get_prefix(iplock::ipset_element const & element) const
+{
+    return element.is_ipv4()
+            ? 96 + f_ipv4_prefix
+            : f_ipv6_prefix;
+}
+
+
+net_aggregator::key_t net_aggregator::get_key(
+      std::string const & set_name
+    , iplock::ipset_element const & element) const
+{
+    int const prefix(get_prefix(element));
+    block_info::address_t network(element.f_address);
+    int const bytes(prefix / 8);
+    int const bits(prefix % 8);
+    if(bits != 0)
+    {
+        network[bytes] &= static_cast<std::uint8_t>(0xFF << (8 - bits));
+    }
+    std::fill(network.begin() + bytes + (bits != 0 ? 1 : 0), network.end(), 0);
+    return key_t(set_name, network);
+}
+
+
+iplock::ipset_element net_aggregator::get_network_element(
+      key_t const & key
+    , std::uint32_t expiry
+    , std::uint32_t now) const
+{
+    iplock::ipset_element element(key.second);
+    element.f_cidr = static_cast<std::uint8_t>(element.is_ipv4() ? f_ipv4_prefix : f_ipv6_prefix);
+    element.f_timeout = expiry > now ? expiry - now : 0;
+    return element;
+}
+
+
+std::size_t net_aggregator::address_hash::operator () (block_info::address_t const & address) const
+{
+    // FNV-1a
+    //
+    std::size_t h(14695981039346656037ULL);
+    for(auto const b : address)
+    {
+        h ^= b;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+/** \brief Get the expiry of the net entry of a network.
+ *
+ * The latest expiry is maintained as the members get added. Removing
+ * a member does not lower it until the next prune() so the net entry
+ * may last a little longer than its members, never shorter.
+ *
+ * \param[in] n  The network.
+ *
+ * \return The latest expiry of the members or 0 if one of the members
+ * does not expire on its own.
+ */
+std::uint32_t net_aggregator::get_expiry(network_t const & n)
+{
+    return n.f_permanent > 0 ? 0 : n.f_max_expiry;
+}
+
+
+void net_aggregator::set_member(network_t & n, block_info::address_t const & address, member_t const & member)
+{
+    auto const r(n.f_members.insert({ address, member }));
+    if(!r.second)
+    {
+        if(r.first->second.f_expiry == 0)
+        {
+            --n.f_permanent;
+        }
+        r.first->second = member;
+    }
+    if(member.f_expiry == 0)
+    {
+        ++n.f_permanent;
+    }
+    else
+    {
+        n.f_max_expiry = std::max(n.f_max_expiry, member.f_expiry);
+    }
+}
+
+
+void net_aggregator::erase_member(network_t & n, member_map_t::iterator it)
+{
+    if(it->second.f_expiry == 0)
+    {
+        --n.f_permanent;
+    }
+    n.f_members.erase(it);
+}
+
+
+/** \brief Remove the members which timed out.
+ *
+ * This function goes through all the members of the network so it is
+ * only called by cleanup() and before a network gets disaggregated. It
+ * also recomputes the latest expiry.
+ *
+ * \param[in] n  The network to prune.
+ * \param[in] now  The current time.
+ */
+void net_aggregator::prune(network_t & n, std::uint32_t now)
+{
+    n.f_max_expiry = 0;
+    for(auto it(n.f_members.begin()); it != n.f_members.end(); )
+    {
+        if(it->second.f_expiry != 0
+        && it->second.f_expiry <= now)
+        {
+            it = n.f_members.erase(it);
+        }
+        else
+        {
+            n.f_max_expiry = std::max(n.f_max_expiry, it->second.f_expiry);
+            ++it;
+        }
+    }
+}
+
+
+/** \brief Replace the members of a network with one net entry.
+ *
+ * The net entry gets added first so the addresses are never unblocked
+ * in between.
+ *
+ * \param[in] key  The set and network.
+ * \param[in] n  The network to aggregate.
+ * \param[in] now  The current time.
+ */
+void net_aggregator::aggregate(key_t const & key, network_t & n, std::uint32_t now)
+{
+    if(f_allowlist != nullptr
+    && f_allowlist->overlaps(key.second, get_prefix(iplock::ipset_element(key.second))))
+    {
+        // never block an allowed address; check again after one window
+        //
+        n.f_no_aggregate_until = now + f_window;
+        return;
+    }
+
+    std::string const & companion(f_companions[key.first]);
+    n.f_expiry = get_expiry(n);
+    f_ipset->add(companion, get_network_element(key, n.f_expiry, now));
+    for(auto const & m : n.f_members)
+    {
+        f_ipset->del(key.first, iplock::ipset_element(m.first));
+    }
+    n.f_aggregated = true;
+    ++f_aggregate_count;
+
+    if(f_stats != nullptr)
+    {
+        f_stats->network_aggregated();
+    }
+
+    SNAP_LOG_INFO
+        << "replaced "
+        << n.f_members.size()
+        << " blocks of \""
+        << key.first
+        << "\" with network "
+        << get_network_element(key, 0, 0).to_string()
+        << " in \""
+        << companion
+        << "\"."
+        << SNAP_LOG_SEND;
+}
+
+
+/** \brief Add the members of a network back individually.
+ *
+ * The members get added first and then the net entry gets removed so
+ * the addresses are never unblocked in between.
+ *
+ * \param[in] key  The set and network.
+ * \param[in] n  The network to break.
+ * \param[in] now  The current time.
+ */
+void net_aggregator::disaggregate(key_t const & key, network_t & n, std::uint32_t now)
+{
+    for(auto const & m : n.f_members)
+    {
+        // a timeout of 0 would make a member which timed out permanent
+        //
+        if(m.second.f_expiry != 0
+        && m.second.f_expiry <= now)
+        {
+            continue;
+        }
+        iplock::ipset_element element(m.first);
+        element.f_timeout = m.second.f_expiry == 0 ? 0 : m.second.f_expiry - now;
+        f_ipset->add(key.first, element);
+    }
+    f_ipset->del(f_companions[key.first], get_network_element(key, 0, 0));
+    n.f_aggregated = false;
+    --f_aggregate_count;
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,156 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "block_info.h"
+#include    "kernel_listing.h"
+
+
+// iplock
+//
+#include    <iplock/allowlist.h>
+#include    <iplock/ipset.h>
+
+
+// snapdev
+//
+#include    <snapdev/timespec_ex.h>
+
+
+// C++
+//
+#include    <deque>
+#include    <map>
+#include    <unordered_map>
+
+
+
+namespace ipwall
+{
+
+
+
+class stats;
+
+
+
+class net_aggregator
+    : public iplock::ipset
+{
+public:
+    typedef std::shared_ptr<net_aggregator> pointer_t;
+
+                        net_aggregator(iplock::ipset::pointer_t s, iplock::allowlist::pointer_t allowed);
+                        net_aggregator(net_aggregator const &) = delete;
+    virtual             ~net_aggregator() override;
+
+    net_aggregator &    operator = (net_aggregator const &) = delete;
+
+    void                set_threshold(std::size_t threshold);
+    void                set_window(snapdev::timespec_ex const & window);
+    void                set_prefixes(int ipv4, int ipv6);
+    void                set_stats(stats * s);
+    void                setup(std::vector<std::string> const & set_names);
+    void                drop_stale();
+    void                release(block_info::address_t const & address);
+    void                check_allowlist();
+    void                add_aggregated(kernel_listing::vector_t & listings) const;
+    void                cleanup(snapdev::timespec_ex const & now);
+    std::size_t         get_aggregate_count() const;
+
+    // iplock::ipset implementation
+    //
+    virtual void        create(std::string const & set_name, iplock::ipset_options const & options) override;
+    virtual void        destroy(std::string const & set_name) override;
+    virtual void        flush(std::string const & set_name) override;
+    virtual void        swap(std::string const & set_name1, std::string const & set_name2) override;
+    virtual bool        header(std::string const & set_name, iplock::ipset_header & h) override;
+    virtual void        add(std::string const & set_name, iplock::ipset_element const & element) override;
+    virtual void        del(std::string const & set_name, iplock::ipset_element const & element) override;
+    virtual bool        test(std::string const & set_name, iplock::ipset_element const & element) override;
+    virtual void        list(std::string const & set_name, element_callback_t callback) override;
+    virtual std::size_t apply(iplock::ipset_operation::vector_t const & operations) override;
+
+private:
+    struct member_t
+    {
+        std::uint32_t                   f_added = 0;        // in seconds
+        std::uint32_t                   f_expiry = 0;       // in seconds, 0 = until deleted
+    };
+
+    struct address_hash
+    {
+        std::size_t                     operator () (block_info::address_t const & address) const;
+    };
+
+    typedef std::unordered_map<block_info::address_t, member_t, address_hash>
+                                        member_map_t;
+
+    struct network_t
+    {
+        member_map_t                    f_members = member_map_t();
+        std::deque<std::uint32_t>       f_recent = std::deque<std::uint32_t>();     // dates of the last additions
+        std::size_t                     f_permanent = 0;    // members without expiry
+        std::uint32_t                   f_max_expiry = 0;   // latest member expiry
+        std::uint32_t                   f_no_aggregate_until = 0;
+        std::uint32_t                   f_expiry = 0;       // of the net entry, 0 = until deleted
+        bool                            f_aggregated = false;
+    };
+
+    typedef std::pair<std::string, block_info::address_t>
+                                        key_t;
+    typedef std::map<key_t, network_t>  network_map_t;
+    typedef std::map<std::string, iplock::ipset_element::vector_t>
+                                        stale_map_t;
+
+    bool                is_managed(std::string const & set_name, iplock::ipset_element const & element) const;
+    int                 get_prefix(iplock::ipset_element const & element) const;
+    key_t               get_key(std::string const & set_name, iplock::ipset_element const & element) const;
+    iplock::ipset_element
+                        get_network_element(key_t const & key, std::uint32_t expiry, std::uint32_t now) const;
+    static std::uint32_t
+                        get_expiry(network_t const & n);
+    static void         set_member(network_t & n, block_info::address_t const & address, member_t const & member);
+    static void         erase_member(network_t & n, member_map_t::iterator it);
+    static void         prune(network_t & n, std::uint32_t now);
+    void                aggregate(key_t const & key, network_t & n, std::uint32_t now);
+    void                disaggregate(key_t const & key, network_t & n, std::uint32_t now);
+    bool                list_aggregated(std::string const & set_name, element_callback_t callback) const;
+
+    iplock::ipset::pointer_t
+                        f_ipset = iplock::ipset::pointer_t();
+    iplock::allowlist::pointer_t
+                        f_allowlist = iplock::allowlist::pointer_t();
+    stats *             f_stats = nullptr;
+    std::size_t         f_threshold = 16;
+    std::uint32_t       f_window = 24 * 60 * 60;    // in seconds
+    int                 f_ipv4_prefix = 24;
+    int                 f_ipv6_prefix = 64;
+    std::map<std::string, std::string>
+                        f_companions = std::map<std::string, std::string>();
+    network_map_t       f_networks = network_map_t();
+    stale_map_t         f_stale = stale_map_t();
+    std::size_t         f_aggregate_count = 0;
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,246 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "offender_history.h"
+
+
+// C++
+//
+#include    <algorithm>
+#include    <limits>
+#include    <string_view>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \class offender_history
+ * \brief Number of times each IP address was blocked.
+ *
+ * Most of the blocks are for a few persistent scanners which come back
+ * as soon as they get unblocked. This table remembers how many times
+ * each IP address was blocked so the block period can be escalated
+ * (i.e. one hour, then one day, then one week, etc.) which means fewer
+ * unblock/block cycles in the kernel.
+ *
+ * The table uses open addressing with linear probing. Each entry uses
+ * 24 bytes: the binary address, the number of offenses, and the time of
+ * the last offense. The number of offenses decays: it gets divided by
+ * two each time the half-life elapses since the last offense.
+ *
+ * When the table is full, the entries with the fewest offenses get
+ * removed first.
+ */
+
+
+/** \brief Initialize the table.
+ *
+ * \param[in] capacity  The maximum number of IP addresses to remember.
+ * \param[in] half_life  The amount of time after which the number of
+ * offenses of an IP address gets divided by two.
+ */
+offender_history::offender_history(std::size_t capacity, snapdev::timespec_ex const & half_life)
+    : f_capacity(std::max(static_cast<std::size_t>(1), capacity))
+    , f_half_life(static_cast<std::uint32_t>(std::max(static_cast<time_t>(1), half_life.tv_sec)))
+{
+    // keep the load under 75% so the probe sequences remain short
+    //
+    std::size_t size(1);
+    while(size * 3 < f_capacity * 4)
+    {
+        size <<= 1;
+    }
+    f_table.resize(size);
+    f_mask = size - 1;
+}
+
+
+std::size_t offender_history::size() const
+{
+    return f_size;
+}
+
+
+/** \brief Get the current number of offenses of an IP address.
+ *
+ * \param[in] address  The IP address to search.
+ * \param[in] now  The current time.
+ *
+ * \return The number of offenses after decay, 0 if unknown.
+ */
+std::uint32_t offender_history::get_offenses(
+      block_info::address_t const & address
+    , snapdev::timespec_ex const & now) const
+{
+    for(std::size_t idx(slot(address));; idx = (idx + 1) & f_mask)
+    {
+        entry_t const & e(f_table[idx]);
+        if(e.f_offenses == 0)
+        {
+            return 0;
+        }
+        if(e.f_address == address)
+        {
+            return decay(e, static_cast<std::uint32_t>(now.tv_sec));
+        }
+    }
+}
+
+
+/** \brief Record one more offense of an IP address.
+ *
+ * \param[in] address  The IP address which just got blocked.
+ * \param[in] now  The current time.
+ *
+ * \return The number of offenses after decay, including this one.
+ */
+std::uint32_t offender_history::offend(
+      block_info::address_t const & address
+    , snapdev::timespec_ex const & now)
+{
+    std::uint32_t const seconds(static_cast<std::uint32_t>(now.tv_sec));
+    std::size_t idx(slot(address));
+    for(;; idx = (idx + 1) & f_mask)
+    {
+        entry_t & e(f_table[idx]);
+        if(e.f_offenses == 0)
+        {
+            break;
+        }
+        if(e.f_address == address)
+        {
+            e.f_offenses = std::min(
+                      decay(e, seconds) + 1
+                    , std::numeric_limits<std::uint32_t>::max() >> 1);
+            e.f_last = seconds;
+            return e.f_offenses;
+        }
+    }
+
+    if(f_size >= f_capacity)
+    {
+        purge(seconds);
+
+        // the purge moved entries around
+        //
+        idx = slot(address);
+        while(f_table[idx].f_offenses != 0)
+        {
+            idx = (idx + 1) & f_mask;
+        }
+    }
+
+    entry_t & e(f_table[idx]);
+    e.f_address = address;
+    e.f_offenses = 1;
+    e.f_last = seconds;
+    ++f_size;
+
+    return 1;
+}
+
+
+std::size_t offender_history::slot(block_info::address_t const & address) const
+{
+    return std::hash<std::string_view>()(std::string_view(
+                  reinterpret_cast<char const *>(address.data())
+                , address.size())) & f_mask;
+}
+
+
+std::uint32_t offender_history::decay(entry_t const & e, std::uint32_t now) const
+{
+    std::uint32_t const half_lives(now > e.f_last ? (now - e.f_last) / f_half_life : 0);
+    if(half_lives >= 32)
+    {
+        return 0;
+    }
+    return e.f_offenses >> half_lives;
+}
+
+
+/** \brief Make room in the table.
+ *
+ * The entries which decayed to zero are removed. If that is not enough
+ * to free 25% of the capacity, the entries with the fewest offenses are
+ * removed as well, the oldest first.
+ *
+ * \param[in] now  The current time in seconds.
+ */
+void offender_history::purge(std::uint32_t now)
+{
+    std::vector<entry_t> entries;
+    entries.reserve(f_size);
+    for(auto & e : f_table)
+    {
+        if(e.f_offenses != 0
+        && decay(e, now) != 0)
+        {
+            entries.push_back(e);
+        }
+    }
+
+    std::size_t const keep(f_capacity - f_capacity / 4);
+    if(entries.size() > keep)
+    {
+        std::nth_element(
+                  entries.begin()
+                , entries.begin() + (entries.size() - keep)
+                , entries.end()
+                , [this, now](entry_t const & lhs, entry_t const & rhs)
+                {
+                    std::uint32_t const l(decay(lhs, now));
+                    std::uint32_t const r(decay(rhs, now));
+                    if(l != r)
+                    {
+                        return l < r;
+                    }
+                    return lhs.f_last < rhs.f_last;
+                });
+        entries.erase(entries.begin(), entries.begin() + (entries.size() - keep));
+    }
+
+    std::fill(f_table.begin(), f_table.end(), entry_t());
+    f_size = 0;
+    for(auto const & e : entries)
+    {
+        std::size_t idx(slot(e.f_address));
+        while(f_table[idx].f_offenses != 0)
+        {
+            idx = (idx + 1) & f_mask;
+        }
+        f_table[idx] = e;
+        ++f_size;
+    }
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// self
+//
+#include    "block_info.h"
+
+
+// snapdev
+//
+#include    <snapdev/timespec_ex.h>
+
+
+// C++
+//
+#include    <cstdint>
+#include    <memory>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+class offender_history
+{
+public:
+    typedef std::shared_ptr<offender_history>   pointer_t;
+
+                        offender_history(std::size_t capacity, snapdev::timespec_ex const & half_life);
+
+    std::size_t         size() const;
+    std::uint32_t       get_offenses(block_info::address_t const & address, snapdev::timespec_ex const & now) const;
+    std::uint32_t       offend(block_info::address_t const & address, snapdev::timespec_ex const & now);
+
+private:
+    struct entry_t
+    {
+        block_info::address_t           f_address = block_info::address_t();
+        std::uint32_t                   f_offenses = 0;     // 0 means the slot is empty
+        std::uint32_t                   f_last = 0;         // in seconds
+    };
+
+    std::size_t         slot(block_info::address_t const & address) const;
+    std::uint32_t       decay(entry_t const & e, std::uint32_t now) const;
+    void                purge(std::uint32_t now);
+
+    std::vector<entry_t>
+                        f_table = std::vector<entry_t>();
+    std::size_t         f_mask = 0;
+    std::size_t         f_capacity = 0;
+    std::size_t         f_size = 0;
+    std::uint32_t       f_half_life = 0;        // in seconds
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
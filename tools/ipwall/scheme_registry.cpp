@@ -0,0 +1,485 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "scheme_registry.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// advgetopt
+//
+#include    <advgetopt/conf_file.h>
+#include    <advgetopt/utils.h>
+
+
+// snapdev
+//
+#include    <snapdev/glob_to_list.h>
+#include    <snapdev/pathinfo.h>
+
+
+// C++
+//
+#include    <set>
+
+
+// C
+//
+#include    <stdlib.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The base name of the IP sets used by default.
+ *
+ * The iplock tool blocks IP addresses in the "unwanted" sets. Schemes
+ * which do not specify a set use the same sets.
+ */
+constexpr char const *      g_default_set = "unwanted";
+
+
+/** \brief Maximum number of unknown schemes we remember.
+ *
+ * We warn only once about each unknown scheme. To avoid growing that
+ * list forever, we stop remembering and reporting new names after this
+ * many.
+ */
+constexpr std::size_t const g_max_warned = 100;
+
+
+/** \brief Check the name of a set.
+ *
+ * The kernel limits the name of a set to 31 characters. We append
+ * "_ipv4" or "_ipv6" to the base name so it has to be at most 26
+ * characters. We also limit the characters to letters, digits,
+ * underscores, and dashes.
+ *
+ * \param[in] name  The base name of the set to check.
+ *
+ * \return true if the name can be used.
+ */
+bool valid_set_name(std::string const & name)
+{
+    if(name.empty()
+    || name.length() > 26)
+    {
+        return false;
+    }
+    for(auto const c : name)
+    {
+        if((c < 'a' || c > 'z')
+        && (c < 'A' || c > 'Z')
+        && (c < '0' || c > '9')
+        && c != '_'
+        && c != '-')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class scheme_registry
+ * \brief Cache of the schemes supported by ipwall.
+ *
+ * The schemes are defined in configuration files found under
+ * /etc/iplock/schemes and /etc/iplock/schemes/schemes.d. The files
+ * in the schemes.d sub-directory can be prefixed with a number and
+ * a dash (i.e. "50-smtp.conf") and override the system files.
+ *
+ * Each scheme can define the following parameters:
+ *
+ * \li set -- the base name of the IP sets used to block IP addresses
+ * with that scheme; "_ipv4" and "_ipv6" get appended; the default is
+ * "unwanted"
+ * \li ports -- the list of ports that the scheme represents
+ *
+ * The directories are read once and the results are kept in memory so
+ * checking a scheme is a simple hash lookup. The scheme_watcher calls
+ * invalidate() whenever a file changes in these directories and the
+ * files get reloaded on the next lookup.
+ */
+
+
+/** \brief Initialize the registry.
+ *
+ * \param[in] path  The directory with the scheme configuration files.
+ */
+scheme_registry::scheme_registry(std::string const & path)
+    : f_path(path)
+{
+    f_default.f_set_ipv4 = std::string(g_default_set) + "_ipv4";
+    f_default.f_set_ipv6 = std::string(g_default_set) + "_ipv6";
+}
+
+
+/** \brief Get the registry used by ipwall.
+ *
+ * \return The registry of the schemes found under /etc/iplock/schemes.
+ */
+scheme_registry::pointer_t scheme_registry::instance()
+{
+    static pointer_t g_instance(std::make_shared<scheme_registry>("/etc/iplock/schemes"));
+    return g_instance;
+}
+
+
+std::string const & scheme_registry::get_path() const
+{
+    return f_path;
+}
+
+
+/** \brief Mark the registry as out of date.
+ *
+ * The configuration files get reloaded on the next call to find() or
+ * get_set_names(). We also forget about the unknown schemes we already
+ * warned about since they may now be defined.
+ */
+void scheme_registry::invalidate()
+{
+    f_loaded = false;
+    f_warned.clear();
+    f_too_many_warned = false;
+}
+
+
+/** \brief Search for a scheme.
+ *
+ * \param[in] scheme  The name of the scheme to search.
+ *
+ * \return A pointer to the scheme information or nullptr if the scheme
+ * is not defined.
+ */
+scheme_info const * scheme_registry::find(std::string const & scheme)
+{
+    load();
+
+    auto const it(f_schemes.find(scheme));
+    if(it == f_schemes.end())
+    {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+
+/** \brief Get the information used with undefined schemes.
+ *
+ * \return The information using the "unwanted" sets.
+ */
+scheme_info const & scheme_registry::get_default_info() const
+{
+    return f_default;
+}
+
+
+/** \brief Get the names of all the IP sets used by the schemes.
+ *
+ * \return The sorted list of IP set names, including the default sets.
+ */
+std::vector<std::string> scheme_registry::get_set_names()
+{
+    load();
+
+    std::set<std::string> names{ f_default.f_set_ipv4, f_default.f_set_ipv6 };
+    for(auto const & s : f_schemes)
+    {
+        names.insert(s.second.f_set_ipv4);
+        names.insert(s.second.f_set_ipv6);
+    }
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
+
+/** \brief Search for a scheme blocking IP addresses in a given set.
+ *
+ * This is used to guess the scheme of the IP addresses found in an IP
+ * set when ipwall has no other information about them. The default
+ * sets are used by the "all" scheme unless it is defined with other
+ * sets.
+ *
+ * \param[in] set_name  The name of the IP set.
+ *
+ * \return The name of a scheme using that set or an empty string.
+ */
+std::string scheme_registry::find_scheme_by_set(std::string const & set_name)
+{
+    load();
+
+    auto const all(f_schemes.find("all"));
+    scheme_info const & all_info(all == f_schemes.end() ? f_default : all->second);
+    if(all_info.f_set_ipv4 == set_name
+    || all_info.f_set_ipv6 == set_name)
+    {
+        return "all";
+    }
+
+    std::string result;
+    for(auto const & s : f_schemes)
+    {
+        if((s.second.f_set_ipv4 == set_name
+         || s.second.f_set_ipv6 == set_name)
+        && (result.empty() || s.first < result))
+        {
+            result = s.first;
+        }
+    }
+    return result;
+}
+
+
+/** \brief Check whether we already warned about an unknown scheme.
+ *
+ * Once too many unknown schemes were remembered, this function logs
+ * one last warning and then always returns false until the registry
+ * gets reloaded.
+ *
+ * \param[in] scheme  The unknown scheme.
+ *
+ * \return true the first time this function is called with \p scheme.
+ */
+bool scheme_registry::warn_once(std::string const & scheme)
+{
+    if(f_warned.find(scheme) != f_warned.end())
+    {
+        return false;
+    }
+    if(f_warned.size() >= g_max_warned)
+    {
+        if(!f_too_many_warned)
+        {
+            f_too_many_warned = true;
+            SNAP_LOG_WARNING
+                << "too many unknown schemes; further unknown schemes are not reported."
+                << SNAP_LOG_SEND;
+        }
+        return false;
+    }
+    f_warned.insert(scheme);
+    return true;
+}
+
+
+void scheme_registry::load()
+{
+    if(f_loaded)
+    {
+        return;
+    }
+    f_loaded = true;
+    f_schemes.clear();
+
+    // the files may have changed since the last time we read them
+    //
+    advgetopt::conf_file::reset_conf_files();
+
+    load_directory(f_path + "/");
+    load_directory(f_path + "/schemes.d/");
+
+    SNAP_LOG_INFO
+        << "loaded "
+        << f_schemes.size()
+        << " schemes from \""
+        << f_path
+        << "\"."
+        << SNAP_LOG_SEND;
+}
+
+
+void scheme_registry::load_directory(std::string const & path)
+{
+    snapdev::glob_to_list<std::set<std::string>> glob;
+    if(!glob.read_path<
+             snapdev::glob_to_list_flag_t::GLOB_FLAG_IGNORE_ERRORS>(path + "*.conf"))
+    {
+        return;
+    }
+
+    for(auto const & filename : glob)
+    {
+        std::string scheme(snapdev::pathinfo::basename(filename, ".conf"));
+
+        // remove the "<number>-" introducer if present
+        //
+        std::string::size_type const dash(scheme.find('-'));
+        if(dash != std::string::npos
+        && dash > 0
+        && scheme.find_first_not_of("0123456789") == dash)
+        {
+            scheme = scheme.substr(dash + 1);
+        }
+
+        load_scheme(scheme, filename);
+    }
+}
+
+
+void scheme_registry::load_scheme(std::string const & scheme, std::string const & filename)
+{
+    advgetopt::conf_file_setup conf_setup(
+              filename
+            , advgetopt::line_continuation_t::line_continuation_unix
+            , advgetopt::ASSIGNMENT_OPERATOR_EQUAL);
+    if(!conf_setup.is_valid())
+    {
+        return;
+    }
+    advgetopt::conf_file::pointer_t conf(advgetopt::conf_file::get_conf_file(conf_setup));
+
+    scheme_info info;
+    info.f_name = scheme;
+
+    std::string set(g_default_set);
+    if(conf->has_parameter("set"))
+    {
+        set = conf->get_parameter("set");
+        if(!valid_set_name(set))
+        {
+            SNAP_LOG_ERROR
+                << "invalid set name \""
+                << set
+                << "\" in \""
+                << filename
+                << "\"; using \""
+                << g_default_set
+                << "\" instead."
+                << SNAP_LOG_SEND;
+            set = g_default_set;
+        }
+    }
+    info.f_set_ipv4 = set + "_ipv4";
+    info.f_set_ipv6 = set + "_ipv6";
+
+    if(conf->has_parameter("ports"))
+    {
+        advgetopt::string_list_t ports;
+        advgetopt::split_string(conf->get_parameter("ports"), ports, {","});
+        for(auto const & p : ports)
+        {
+            char * end(nullptr);
+            long const port(strtol(p.c_str(), &end, 10));
+            if(end == p.c_str()
+            || *end != '\0'
+            || port < 1
+            || port > 65535)
+            {
+                SNAP_LOG_ERROR
+                    << "invalid port \""
+                    << p
+                    << "\" in \""
+                    << filename
+                    << "\"."
+                    << SNAP_LOG_SEND;
+                continue;
+            }
+            info.f_ports.push_back(static_cast<int>(port));
+        }
+    }
+
+    // files found in schemes.d are loaded last and override the others
+    //
+    f_schemes[scheme] = info;
+}
+
+
+
+/** \class scheme_watcher
+ * \brief Watch the scheme directories for changes.
+ *
+ * This connection uses inotify to get notified whenever a file changes
+ * in the scheme directories. When that happens, the registry gets
+ * invalidated so the files are reloaded on the next lookup.
+ */
+
+
+/** \brief Start watching the directories of \p registry.
+ *
+ * \param[in] registry  The registry to invalidate on changes.
+ */
+scheme_watcher::scheme_watcher(scheme_registry::pointer_t registry)
+    : f_registry(registry)
+{
+    set_name("scheme_watcher");
+
+    ed::file_event_mask_t const events(
+              ed::SNAP_FILE_CHANGED_EVENT_WRITE
+            | ed::SNAP_FILE_CHANGED_EVENT_CREATED
+            | ed::SNAP_FILE_CHANGED_EVENT_DELETED);
+    for(auto const & path : { f_registry->get_path(), f_registry->get_path() + "/schemes.d" })
+    {
+        try
+        {
+            watch_directory(path, events);
+        }
+        catch(std::exception const & e)
+        {
+            // the directory may not exist
+            //
+            SNAP_LOG_WARNING
+                << "could not watch \""
+                << path
+                << "\" for changes: "
+                << e.what()
+                << SNAP_LOG_SEND;
+        }
+    }
+}
+
+
+void scheme_watcher::process_event(ed::file_event const & watch_event)
+{
+    SNAP_LOG_INFO
+        << "scheme file \""
+        << watch_event.get_filename()
+        << "\" changed; reloading the schemes."
+        << SNAP_LOG_SEND;
+
+    f_registry->invalidate();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
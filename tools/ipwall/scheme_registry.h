@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// eventdispatcher
+//
+#include    <eventdispatcher/file_changed.h>
+
+
+// C++
+//
+#include    <memory>
+#include    <string>
+#include    <unordered_map>
+#include    <unordered_set>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+struct scheme_info
+{
+    std::string         f_name = std::string();
+    std::string         f_set_ipv4 = std::string();
+    std::string         f_set_ipv6 = std::string();
+    std::vector<int>    f_ports = std::vector<int>();
+};
+
+
+class scheme_registry
+{
+public:
+    typedef std::shared_ptr<scheme_registry>    pointer_t;
+
+                        scheme_registry(std::string const & path);
+                        scheme_registry(scheme_registry const &) = delete;
+
+    scheme_registry &   operator = (scheme_registry const &) = delete;
+
+    static pointer_t    instance();
+
+    std::string const & get_path() const;
+    void                invalidate();
+    scheme_info const * find(std::string const & scheme);
+    scheme_info const & get_default_info() const;
+    std::vector<std::string>
+                        get_set_names();
+    std::string         find_scheme_by_set(std::string const & set_name);
+    bool                warn_once(std::string const & scheme);
+
+private:
+    typedef std::unordered_map<std::string, scheme_info>
+                                        scheme_map_t;
+
+    void                load();
+    void                load_directory(std::string const & path);
+    void                load_scheme(std::string const & scheme, std::string const & filename);
+
+    std::string         f_path = std::string();
+    bool                f_loaded = false;
+    scheme_info         f_default = scheme_info();
+    scheme_map_t        f_schemes = scheme_map_t();
+    std::unordered_set<std::string>
+                        f_warned = std::unordered_set<std::string>();
+    bool                f_too_many_warned = false;
+};
+
+
+class scheme_watcher
+    : public ed::file_changed
+{
+public:
+    typedef std::shared_ptr<scheme_watcher>     pointer_t;
+
+                        scheme_watcher(scheme_registry::pointer_t registry);
+                        scheme_watcher(scheme_watcher const &) = delete;
+
+    scheme_watcher &    operator = (scheme_watcher const &) = delete;
+
+    // ed::file_changed implementation
+    //
+    virtual void        process_event(ed::file_event const & watch_event) override;
+
+private:
+    scheme_registry::pointer_t
+                        f_registry = scheme_registry::pointer_t();
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
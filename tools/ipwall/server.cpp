@@ -24,6 +24,9 @@
 
 // iplock
 //
+#include    <iplock/block_ip.h>
+#include    <iplock/ipset_netlink.h>
+#include    <iplock/names.h>
 #include    <iplock/version.h>
 
 
@@ -42,6 +45,20 @@
 // advgetopt
 //
 #include    <advgetopt/exception.h>
+#include    <advgetopt/utils.h>
+#include    <advgetopt/validator_duration.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+// C
+//
+#include    <stdio.h>
+#include    <string.h>
+#include    <unistd.h>
 
 
 // last include
@@ -133,6 +150,199 @@ namespace ipwall
  */
 advgetopt::option const g_options[] =
 {
+    advgetopt::define_option(
+          advgetopt::Name("batch-size")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1000")
+        , advgetopt::Validator("integer(1...1000000)")
+        , advgetopt::Help("Maximum number of ipset operations sent to the kernel in one batch.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("batch-window")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("0.02s")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Amount of time to wait for more ipset operations before sending a batch to the kernel.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("ingress-capacity")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("100000")
+        , advgetopt::Validator("integer(100...10000000)")
+        , advgetopt::Help("Maximum number of block and unblock requests waiting to be applied; further blocks get dropped.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("ingress-slice")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1000")
+        , advgetopt::Validator("integer(1...1000000)")
+        , advgetopt::Help("Number of block and unblock requests applied before handling the other messages again.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("expiry-precision")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1s")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Precision of the block timeouts; blocks timing out within the same period are removed together.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("reconcile-interval")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1h")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Interval between reconciliations of the blocks with the kernel IP sets when these time out the blocks.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("counters-interval")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("300s")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Interval between two reads of the packet counters of the blocked IP addresses; use 0 to disable the counters.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("idle-release")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("12")
+        , advgetopt::Validator("integer(0...65535)")
+        , advgetopt::Help("Number of reads of the packet counters without any new packet after which an IP address gets unblocked early; use 0 to disable.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("active-extension")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("day")
+        , advgetopt::Help("Minimum block period left on an IP address which keeps sending packets.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("active-packets")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1000")
+        , advgetopt::Validator("integer(0...1000000000)")
+        , advgetopt::Help("Number of packets between two reads of the counters from which the block of an IP address gets extended; use 0 to disable.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("dedupe-capacity")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1000000")
+        , advgetopt::Validator("integer(1000...100000000)")
+        , advgetopt::Help("Number of recent blocks the dedupe filter remembers per window.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("dedupe-window")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("60s")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Amount of time a block is remembered to drop the same block received from other computers; use 0 to disable.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("escalation")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("hour,day,week,year")
+        , advgetopt::Help("Comma separated list of the minimum block periods of the first, second, third, etc. offense of an IP address.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("offender-capacity")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("250000")
+        , advgetopt::Validator("integer(1000...100000000)")
+        , advgetopt::Help("Number of IP addresses for which ipwall remembers the number of offenses.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("offender-half-life")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("30d")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Amount of time after which the number of offenses of an IP address gets divided by two.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("aggregate-threshold")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("16")
+        , advgetopt::Validator("integer(0...65536)")
+        , advgetopt::Help("Number of IP addresses of the same network blocked within the aggregate-window which get replaced by a block of the whole network; use 0 to disable.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("aggregate-window")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("1d")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Amount of time during which the blocks of a network are counted to decide whether to block the whole network.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("aggregate-ipv4-prefix")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("24")
+        , advgetopt::Validator("integer(8...31)")
+        , advgetopt::Help("Size of the IPv4 networks blocked as a whole.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("aggregate-ipv6-prefix")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("64")
+        , advgetopt::Validator("integer(16...127)")
+        , advgetopt::Help("Size of the IPv6 networks blocked as a whole.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("stats-file")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::Help("Path to a file where ipwall saves its statistics in the Prometheus text format.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("stats-interval")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("15s")
+        , advgetopt::Validator("duration")
+        , advgetopt::Help("Interval between two saves of the statistics file.")
+    ),
+    advgetopt::define_option(
+          advgetopt::Name("journal-path")
+        , advgetopt::Flags(advgetopt::all_flags<
+                      advgetopt::GETOPT_FLAG_GROUP_OPTIONS
+                    , advgetopt::GETOPT_FLAG_REQUIRED>())
+        , advgetopt::DefaultValue("/var/lib/iplock/ipwall")
+        , advgetopt::Help("Directory where ipwall saves its journal of blocks so they survive a restart.")
+    ),
     advgetopt::end_options()
 };
 
@@ -197,11 +407,20 @@ advgetopt::options_environment const g_options_environment =
  * As we are at it, we also load the configuration file and
  * setup the logger.
  *
+ * The constructor also opens the netlink socket used to add and remove
+ * IP addresses to and from the kernel IP sets. This requires the
+ * CAP_NET_ADMIN capability.
+ *
  * \param[in] argc  The command line argc parameter.
  * \param[in] argv  The command line argv parameter.
  */
 server::server(int argc, char * argv[])
     : f_opts(g_options_environment)
+    , f_ipset(std::make_shared<iplock::ipset_netlink>())
+    , f_ipset_queue(std::make_shared<ipset_queue>(f_ipset))
+    , f_allowlist(std::make_shared<iplock::allowlist>())
+    , f_aggregator(std::make_shared<net_aggregator>(f_ipset_queue, f_allowlist))
+    , f_blocks(f_aggregator)
 {
     snaplogger::add_logger_options(f_opts);
     f_opts.finish_parsing(argc, argv);
@@ -211,6 +430,125 @@ server::server(int argc, char * argv[])
         //
         throw advgetopt::getopt_exit("logger options generated an error.", 0);
     }
+
+    f_ipset_queue->set_max_operations(f_opts.get_long("batch-size"));
+    double window(0.02);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("batch-window")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , window);
+    f_batch_window = snapdev::timespec_ex(window);
+
+    f_ingress = std::make_shared<ingress_queue>(f_opts.get_long("ingress-capacity"));
+    f_ingress->set_stats(&f_stats);
+    f_ingress->set_load_callback(std::bind(
+              &server::ingress_load_changed
+            , this
+            , std::placeholders::_1));
+    f_ingress_slice = f_opts.get_long("ingress-slice");
+
+    double precision(1.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("expiry-precision")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , precision);
+    f_blocks.set_expiry_precision(snapdev::timespec_ex(precision));
+
+    double reconcile(3600.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("reconcile-interval")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , reconcile);
+    f_reconcile_interval = snapdev::timespec_ex(reconcile);
+
+    if(f_opts.is_defined("stats-file"))
+    {
+        f_stats_file = f_opts.get_string("stats-file");
+    }
+    double interval(15.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("stats-interval")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , interval);
+    f_stats_interval = snapdev::timespec_ex(interval);
+    f_blocks.set_stats(&f_stats);
+
+    double counters(300.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("counters-interval")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , counters);
+    f_counters_interval = snapdev::timespec_ex(counters);
+    f_blocks.set_counters(f_counters_interval != snapdev::timespec_ex());
+    f_blocks.set_idle_release(f_opts.get_long("idle-release"));
+
+    // logs an error if the period is not valid
+    //
+    block_info::get_period_duration(f_opts.get_string("active-extension"));
+    f_blocks.set_active_extension(
+              f_opts.get_string("active-extension")
+            , f_opts.get_long("active-packets"));
+
+    // the window cannot be longer than the shortest block (5min) so
+    // a new block of an IP which timed out is never considered a
+    // duplicate (its limit lands in a different window)
+    //
+    double dedupe_window(60.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("dedupe-window")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , dedupe_window);
+    if(dedupe_window > 5.0 * 60.0)
+    {
+        SNAP_LOG_WARNING
+            << "the dedupe-window ("
+            << dedupe_window
+            << "s) is too large, using 5min instead."
+            << SNAP_LOG_SEND;
+        dedupe_window = 5.0 * 60.0;
+    }
+    f_dedupe = std::make_shared<dedupe_filter>(
+                  f_opts.get_long("dedupe-capacity")
+                , snapdev::timespec_ex(dedupe_window));
+
+    advgetopt::split_string(f_opts.get_string("escalation"), f_escalation, {","});
+    for(auto const & period : f_escalation)
+    {
+        // logs an error if the period is not valid
+        //
+        block_info::get_period_duration(period);
+    }
+    double half_life(30.0 * 24.0 * 60.0 * 60.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("offender-half-life")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , half_life);
+    f_history = std::make_shared<offender_history>(
+                  f_opts.get_long("offender-capacity")
+                , snapdev::timespec_ex(half_life));
+
+    // the allowed IP addresses, and the networks which include them,
+    // never get blocked
+    //
+    f_allowlist->load({
+              "/etc/iplock/iplock.conf"
+            , "/etc/iplock/iplock.d/50-iplock.conf"
+        });
+
+    double aggregate_window(24.0 * 60.0 * 60.0);
+    advgetopt::validator_duration::convert_string(
+                  f_opts.get_string("aggregate-window")
+                , advgetopt::validator_duration::VALIDATOR_DURATION_DEFAULT_FLAGS
+                , aggregate_window);
+    f_aggregator->set_threshold(f_opts.get_long("aggregate-threshold"));
+    f_aggregator->set_window(snapdev::timespec_ex(aggregate_window));
+    f_aggregator->set_prefixes(
+                  f_opts.get_long("aggregate-ipv4-prefix")
+                , f_opts.get_long("aggregate-ipv6-prefix"));
+    f_aggregator->set_stats(&f_stats);
+
+    f_journal = std::make_shared<ban_journal>(f_opts.get_string("journal-path"));
+    f_blocks.set_journal(f_journal);
 }
 
 
@@ -255,10 +593,82 @@ void server::run()
     f_wakeup_timer = std::make_shared<wakeup_timer>(this);
     f_communicator->add_connection(f_wakeup_timer);
 
+    f_batch_timer = std::make_shared<batch_timer>(this);
+    f_communicator->add_connection(f_batch_timer);
+
+    f_ingress_timer = std::make_shared<ingress_timer>(this);
+    f_communicator->add_connection(f_ingress_timer);
+    f_ipset_queue->set_schedule_callback(std::bind(&server::schedule_batch, this));
+    f_ipset_queue->set_commit_callback(std::bind(
+              &server::kernel_applied
+            , this
+            , std::placeholders::_1
+            , std::placeholders::_2));
+
+    // the kernel worker uses its own netlink socket since the socket
+    // of f_ipset is used by the event loop thread
+    //
+    f_kernel_worker = std::make_shared<kernel_worker>(std::make_shared<iplock::ipset_netlink>());
+    f_communicator->add_connection(f_kernel_worker);
+    f_ipset_queue->set_worker(f_kernel_worker);
+
+    // the periodic listings of the IP sets are done by the kernel worker
+    // too; the worker lists the sets directly so the aggregated members
+    // are added when requested
+    //
+    f_blocks.set_lister([this](
+              std::vector<std::string> const & set_names
+            , bool aggregated
+            , listing_callback_t callback)
+        {
+            f_ipset_queue->list_sets(set_names, [this, aggregated, callback](kernel_listing::vector_t & listings)
+                {
+                    if(aggregated)
+                    {
+                        f_aggregator->add_aggregated(listings);
+                    }
+                    callback(listings);
+                });
+        });
+
+    if(!f_stats_file.empty())
+    {
+        f_stats_timer = std::make_shared<stats_timer>(this, f_stats_interval.to_usec());
+        f_communicator->add_connection(f_stats_timer);
+    }
+
+    if(f_counters_interval != snapdev::timespec_ex())
+    {
+        f_counters_timer = std::make_shared<counters_timer>(this, f_counters_interval.to_usec());
+        f_communicator->add_connection(f_counters_timer);
+    }
+
+    f_scheme_watcher = std::make_shared<scheme_watcher>(scheme_registry::instance());
+    f_communicator->add_connection(f_scheme_watcher);
+
+    f_allowlist_watcher = std::make_shared<allowlist_watcher>(f_allowlist, f_aggregator);
+    f_communicator->add_connection(f_allowlist_watcher);
+
+    // restore the blocks which did not yet time out before the last
+    // restart
+    //
+    setup_firewall();
+
     f_messenger = std::make_shared<messenger>(this, f_opts);
     f_messenger->finish_initialization();
     f_communicator->add_connection(f_messenger);
 
+    // let others know that the firewall is up
+    //
+    // TODO
+    // some daemons, like snapserver does, should wait on that
+    // signal before starting... (but ipwall is optional,
+    // so be careful on how you handle that one! in snapserver
+    // we first check whether ipwall is active on the
+    // computer and if so request the message.)
+    //
+    f_messenger->send_firewall_status();
+
     f_communicator->run();
 }
 
@@ -266,252 +676,135 @@ void server::run()
 /** \brief Setup the firewall on startup.
  *
  * On startup we have to assume that the firewall is not yet properly setup
- * so we run the follow process once.
+ * so we run the following process once.
  *
- * The process gets all the IPs defined in the database and:
+ * The process loads all the blocks saved in the journal which did not
+ * yet time out. Then it lists the live members of each IP set and
+ * applies only the differences: the addresses which ipwall blocked and
+ * which timed out while it was not running get removed and the missing
+ * addresses get added (see block_store::sync_sets()). The addresses
+ * blocked by other tools are left alone. The live sets are never empty
+ * or partially filled and the restart only costs as many kernel
+ * operations as there are differences.
  *
- * \li unblock the addresses which timed out
- * \li unblock and (re-)block addresses that are not out of date
+ * When no journal exists at all, the members of the IP sets are
+ * adopted instead so a lost journal does not unblock everyone.
  *
- * The unblock and re-block process is necessary in case you are restarting
- * the process. The problem is that the IP address may already be in your
- * firewall. If that's the case, just blocking would duplicate it, which
- * would slow down the firewall for nothing and also would not properly
- * unblock the IP when we receive the timeout because that process would
- * only unblock one instance.
+ * If the IP sets were created with timeout support, the blocks are
+ * added with their remaining duration and the kernel unblocks them.
+ * In that case, ipwall only reconciles its store with the kernel once
+ * in a while (see the reconcile-interval option).
+ *
+ * Once done, the firewall is considered up.
  */
 void server::setup_firewall()
 {
-#if 0
-    // make sure we are also connected with the Cassandra database
-    //
-    if(!f_firewall_table)
+    if(f_blocks.detect_kernel_timeouts())
     {
-        return;
+        SNAP_LOG_INFO
+            << "the IP sets support timeouts; the kernel will unblock the IP addresses."
+            << SNAP_LOG_SEND;
+        f_next_reconcile = snapdev::timespec_ex::gettime() + f_reconcile_interval;
     }
-
-    int64_t const now(snap::snap_communicator::get_current_date());
-    int64_t const limit(now + 60LL * 1000000LL); // "lose" 1 min. precision
-
-    libdbproxy::row::pointer_t row(f_firewall_table->getRow(f_server_name));
-    row->clearCache();
-
-    // the first row we keep has a date we use to know when to wake up
-    // next and drop that IP from our firewall
-    //
-    bool first(true);
-
-    block_info_t::block_info_vector_t to_block_list;
-
-    // run through the entire table
-    //
-    auto column_predicate(std::make_shared<libdbproxy::cell_range_predicate>());
-    column_predicate->setCount(100);
-    column_predicate->setIndex(); // behave like an index
-    for(;;)
+    f_aggregator->setup(block_info::get_set_names());
+    snapdev::timespec_ex const now(snapdev::timespec_ex::gettime());
+    block_info::block_info_vector_t expired;
+    block_info::block_info_vector_t const blocks(f_journal->load(now, &expired));
+    if(blocks.empty()
+    && !f_journal->has_state())
     {
-        row->readCells(column_predicate);
-        libdbproxy::cells const cells(row->getCells());
-        if(cells.isEmpty())
-        {
-            // it looks like we are done
-            break;
-        }
-
-        for(libdbproxy::cells::const_iterator it(cells.begin());
-                                                         it != cells.end();
-                                                         ++it)
-        {
-            libdbproxy::cell::pointer_t cell(*it);
-
-            // first we want to unblock that IP address
-            //
-            QString const uri(cell->getValue().stringValue());
-
-            try
-            {
-                // this one should always work since we saved it in the
-                // database, only between versions the format could change
-                //
-                block_info_t info(uri);
-
-                QByteArray const key(it.key());
-                int64_t const drop_date(libdbproxy::safeInt64Value(key, 0, -1));
-                if(drop_date < limit)
-                {
-                    // unblock the IP, just in case
-                    //
-                    //info.iplock_unblock();
-                    SNAP_LOG_TRACE( "No longer blocking ip address '")(info.get_ip())("'");
-
-                    // save with the new status of UNBANNED
-                    //
-                    info.save(f_firewall_table, f_server_name);
-
-                    // now drop that row
-                    //
-                    // Note: the save() does that for new keys, old keys may
-                    //       not get deleted properly so I kept this code
-                    //       for now... generally speaking, it is safer
-                    //       to have it here anyway
-                    //
-                    row->dropCell(key);
-                }
-                else
-                {
-                    // this IP is still expected to be blocked, so
-                    // re-block it
-                    //
-                    if(first)
-                    {
-                        // on the first one, we want to mark that as the
-                        // time when the block has to be dropped
-                        //
-                        // Note: only the first one is necessary since these
-                        //       are sorted by date in the database
-                        //
-                        first = false;
-                        f_wakeup_timer->set_timeout_date(drop_date);
-                    }
-
-                    // block the IP
-                    //
-                    //info.iplock_block();
-                    to_block_list.push_back( info );
-
-                    // show all the IPs (not useful at all time to reprint
-                    // all the IPs, it should go a lot faster by not doing
-                    // so.)
-                    //
-                    //SNAP_LOG_TRACE( "Add to block list address='")(info.get_ip())("', scheme='")(info.get_scheme())("'.");
-
-                    // no save necessary, it is already as it needs to be
-                }
-            }
-            catch(std::exception const & e)
-            {
-                SNAP_LOG_ERROR("an exception occurred while initializing the firewall: ")(e.what());
-            }
-        }
+        SNAP_LOG_INFO
+            << "no ipwall journal found; adopted "
+            << f_blocks.adopt_sets(now)
+            << " IP addresses found in the IP sets."
+            << SNAP_LOG_SEND;
+    }
+    else
+    {
+        f_blocks.restore(blocks);
+    }
+    if(!f_blocks.sync_sets(expired))
+    {
+        SNAP_LOG_WARNING
+            << "the IP sets could not all be synchronized with the saved blocks."
+            << SNAP_LOG_SEND;
     }
 
-    std::for_each(
-              f_blocks.begin()
-            , f_blocks.end()
-            , [&, limit](block_info_t & info)
-            {
-                if(limit >= info.get_block_limit())
-                {
-                    // passed the limit already so we can unblock now
-                    //
-                    //info.iplock_unblock();
-                }
-                else
-                {
-                    to_block_list.push_back( info );
+    // the aggregated addresses are blocked again, the net entries of the
+    // previous instance can go
+    //
+    f_aggregator->drop_stale();
 
-                    // show all the pending IPs
-                    //
-                    //SNAP_LOG_TRACE( "Add pending IP address to block list: '")(info.get_ip())("'");
-                }
+    SNAP_LOG_INFO
+        << "firewall setup with "
+        << f_blocks.size()
+        << " blocked IP addresses."
+        << SNAP_LOG_SEND;
 
-                // always save the IP so we know that such and such was
-                // banned before (i.e. recidivists can be counted now)
-                //
-                info.save(f_firewall_table, f_server_name);
-            }
-        );
+    f_firewall_up = true;
 
-    SNAP_LOG_INFO("Block ")(to_block_list.size())(" IPs (including ")(f_blocks.size())(" from the pending IP address list).");
+    next_wakeup();
+}
 
-    f_blocks.clear();
 
-    std::string const private_folder("/var/cache/snapwebsites/private");
-    QDir pf( private_folder.c_str() );
-    if( !pf.exists() )
-    {
-        pf.mkdir( private_folder.c_str() );
-        if( ::chmod( private_folder.c_str(), 0700 ) != 0 )
-        {
-            // this should not happen, but at least let admins know
-            //
-            int const e(errno);
-            SNAP_LOG_WARNING("chmod(\"")(private_folder)(", 0700\") failed. (errno: ")(e)(", ")(strerror(e));
-        }
-    }
+/** \brief Send the pending ipset operations to the kernel.
+ *
+ * The IPWALL_BLOCK and IPWALL_UNBLOCK messages do not update the kernel
+ * immediately. Instead the operations are queued for a short period
+ * (see the batch-window option) and then sent to the kernel at once.
+ * This function is called by the batch timer once that period is over.
+ *
+ * The operations are applied by the kernel worker thread so this
+ * function does not wait for the kernel (see kernel_applied()).
+ *
+ * The ban journal is synchronized to disk at the same time and, if it
+ * grew too large, compacted in a new snapshot. The disk writes are also
+ * done by the kernel worker thread, after the operations were applied.
+ */
+void server::process_batch()
+{
+    f_ipset_queue->commit();
 
-    std::stringstream ss;
-    ss << private_folder << "/iplock." << getpid();
-    std::string const outfile(ss.str());
+    // the journal is synchronized at the same time so the firewall and
+    // the journal remain in sync; the fdatasync() and the snapshot are
+    // written by the kernel worker
+    //
+    f_ipset_queue->run(f_journal->start_sync());
+    if(f_journal->needs_compaction(f_blocks.size()))
     {
-        std::ofstream ip_list( outfile );
-
-        for( auto const & info : to_block_list )
-        {
-            ip_list << info.get_ip().toUtf8().data()
-                    << " "
-                    << info.get_scheme().toUtf8().data()
-                    << std::endl;
-        }
+        f_ipset_queue->run(f_blocks.start_compaction());
     }
+}
 
-    // Run the iplock process, but in batch mode.
-    //
-    {
-        snap::process iplock_process("block bulk IP address");
-        iplock_process.set_command("iplock");
 
-        // whether we block or unblock the specified IP address
-        iplock_process.add_argument("--batch");
-        iplock_process.add_argument(outfile.c_str());
+/** \brief A batch of operations reached the kernel.
+ *
+ * This function is called once the kernel worker applied a batch of
+ * operations. It computes the latencies of the messages and expiries
+ * which were waiting for that batch.
+ *
+ * \param[in] operations  The number of operations in the batch.
+ * \param[in] errors  The number of operations which failed.
+ */
+void server::kernel_applied(std::size_t operations, std::size_t errors)
+{
+    f_stats.batch_applied(operations, errors);
+    f_stats.applied(snapdev::timespec_ex::gettime());
+}
 
-        // keep the stderr output
-        iplock_process.add_argument("2>&1");
 
-        int const r(iplock_process.run());
-        if(r != 0)
-        {
-            // Note: if the IP was not already defined, this command
-            //       generates an error
-            //
-            int const e(errno);
-            QString const output(iplock_process.get_output(true));
-            SNAP_LOG_ERROR("an error occurred (")
-                    (r)
-                    (") trying to run \"")
-                    (iplock_process.get_name())
-                    ("\", errno: ")
-                    (e)
-                    (" -- ")
-                    (strerror(e))
-                    ("\nConsole output:\n")
-                    (output);
-        }
+/** \brief Make sure the batch timer is running.
+ *
+ * This function starts the batch timer unless it is already running.
+ * It is called whenever an ipset operation gets queued or a change
+ * gets recorded in the journal.
+ */
+void server::schedule_batch()
+{
+    if(f_batch_timer->get_timeout_date() == -1)
+    {
+        f_batch_timer->set_timeout_date(snapdev::timespec_ex::gettime() + f_batch_window);
     }
-
-    f_firewall_up = true;
-
-#ifndef _DEBUG
-    // Only remove if we are not in debug mode
-    //
-    unlink( outfile.c_str() );
-#endif
-
-    // send a "FIREWALLUP" message to let others know that the firewall
-    // is up
-    //
-    // TODO
-    // some daemons, like snapserver does, should wait on that
-    // signal before starting... (but ipwall is optional,
-    // so be careful on how you handle that one! in snapserver
-    // we first check whether ipwall is active on the
-    // computer and if so request the message.)
-    //
-    snap::snap_communicator_message firewall_up_message;
-    firewall_up_message.set_command("FIREWALL_UP");
-    firewall_up_message.set_service(".");
-    f_messenger->send_message(firewall_up_message);
-#endif
 }
 
 
@@ -538,33 +831,39 @@ void server::process_timeout()
         return;
     }
 
+    // remove the entries which timed out from the firewall and the
+    // f_blocks store (so in effect we "lose" that IP information but we
+    // do not want to use too much RAM either; in a properly setup system
+    // it should be really rare)
+    //
+    // all the entries which timed out on this tick get sent to the
+    // kernel in one batch
+    //
     snapdev::timespec_ex const now(snapdev::timespec_ex::gettime());
+    std::size_t changes(f_blocks.expire(now));
 
-    f_blocks.erase(
-            std::remove_if(
-                  f_blocks.begin()
-                , f_blocks.end()
-                , [&, now](block_info & info)
+    // the kernel does not tell us about the blocks it times out so once
+    // in a while we check the IP sets
+    //
+    if(f_blocks.has_kernel_timeouts()
+    && now >= f_next_reconcile)
+    {
+        f_blocks.reconcile(now, [this](std::size_t fixed)
+            {
+                if(fixed > 0
+                && !f_stop_received)
                 {
-                    if(now > info.get_block_limit())
-                    {
-                        // this one timed out, remove from the
-                        // firewall and the f_blocks vector
-                        // (so in effect we "lose" that IP information
-                        // but we do not want to use too much RAM either;
-                        // in a properly setup system it should be really
-                        // rare)
-                        //
-                        info.iplock_unblock();
-
-                        return true;
-                    }
-
-                    return false;
+                    process_batch();
                 }
-            )
-            , f_blocks.end()
-        );
+            });
+        f_aggregator->cleanup(now);
+        f_next_reconcile = now + f_reconcile_interval;
+    }
+
+    if(changes > 0)
+    {
+        process_batch();
+    }
 
 #if 0
     // make sure we are connected to cassandra
@@ -722,15 +1021,20 @@ void server::next_wakeup()
     }
     else
 #endif
-         if(!f_blocks.empty())
     {
-        // each time we add an entry to f_blocks, we re-sort the vector
-        // so the first entry is always the smallest
+        // the store keeps its entries in a timing wheel which gives
+        // us the next tick to process
         //
-        limit = f_blocks.front().get_block_limit();
+        limit = f_blocks.next_expiry();
     }
 
     snapdev::timespec_ex zero(0, 0);
+    if(f_blocks.has_kernel_timeouts()
+    && (limit == zero || f_next_reconcile < limit))
+    {
+        limit = f_next_reconcile;
+    }
+
     if(limit > zero)
     {
         // we have a valid date to wait on,
@@ -742,6 +1046,101 @@ void server::next_wakeup()
 }
 
 
+/** \brief Get the current statistics.
+ *
+ * This function generates the statistics in the Prometheus text format.
+ * It is used to reply to the IPWALL_GET_STATS message and to save the
+ * stats-file.
+ *
+ * \return The statistics as a string.
+ */
+std::string server::get_stats() const
+{
+    return f_stats.to_prometheus(f_blocks, snapdev::timespec_ex::gettime())
+         + "# HELP ipwall_aggregated_networks Number of networks currently blocked as a whole.\n"
+           "# TYPE ipwall_aggregated_networks gauge\n"
+           "ipwall_aggregated_networks " + std::to_string(f_aggregator->get_aggregate_count()) + "\n"
+           "# HELP ipwall_ingress_queue_depth Number of block and unblock requests waiting to be applied.\n"
+           "# TYPE ipwall_ingress_queue_depth gauge\n"
+           "ipwall_ingress_queue_depth " + std::to_string(f_ingress->size()) + "\n"
+           "# HELP ipwall_ingress_queue_capacity Maximum number of block and unblock requests waiting to be applied.\n"
+           "# TYPE ipwall_ingress_queue_capacity gauge\n"
+           "ipwall_ingress_queue_capacity " + std::to_string(f_ingress->get_capacity()) + '\n';
+}
+
+
+/** \brief Save the statistics in the stats-file.
+ *
+ * The statistics are first written in a temporary file which then
+ * gets renamed so a scraper never reads a partial file.
+ */
+void server::save_stats()
+{
+    if(f_stop_received
+    || f_stats_file.empty())
+    {
+        return;
+    }
+
+    std::string const tmp(f_stats_file + ".tmp");
+    {
+        std::ofstream out(tmp);
+        out << get_stats();
+        if(!out)
+        {
+            SNAP_LOG_ERROR
+                << "could not save statistics \""
+                << tmp
+                << "\"."
+                << SNAP_LOG_SEND;
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+    if(rename(tmp.c_str(), f_stats_file.c_str()) != 0)
+    {
+        int const e(errno);
+        SNAP_LOG_ERROR
+            << "could not rename \""
+            << tmp
+            << "\": "
+            << strerror(e)
+            << SNAP_LOG_SEND;
+        unlink(tmp.c_str());
+    }
+}
+
+
+/** \brief Read the packet counters of the blocked IP addresses.
+ *
+ * This function is called by the counters timer. The store reads the
+ * counters from the kernel IP sets, releases the blocks of the IP
+ * addresses which stopped sending packets, and extends the blocks of
+ * the IP addresses still sending packets (see
+ * block_store::harvest_counters()).
+ *
+ * The IP sets are listed by the kernel worker thread so the changes
+ * are applied later, once the listings come back.
+ */
+void server::harvest_counters()
+{
+    if(f_stop_received)
+    {
+        return;
+    }
+
+    f_blocks.harvest_counters([this](std::size_t changes)
+        {
+            if(changes > 0
+            && !f_stop_received)
+            {
+                next_wakeup();
+                process_batch();
+            }
+        });
+}
+
+
 bool server::is_firewall_up() const
 {
     return f_firewall_up;
@@ -834,6 +1233,37 @@ void server::stop(bool quitting)
         f_wakeup_timer->set_enable(false);
         f_wakeup_timer->set_timeout_date(-1);
     }
+    if(f_batch_timer != nullptr)
+    {
+        f_batch_timer->set_enable(false);
+        f_batch_timer->set_timeout_date(-1);
+    }
+    if(f_ingress_timer != nullptr)
+    {
+        f_ingress_timer->set_enable(false);
+        f_ingress_timer->set_timeout_date(-1);
+    }
+    if(f_stats_timer != nullptr)
+    {
+        f_stats_timer->set_enable(false);
+    }
+    if(f_counters_timer != nullptr)
+    {
+        f_counters_timer->set_enable(false);
+    }
+
+    // do not lose the requests and operations received before the STOP
+    // and save a snapshot so the next start does not have to replay the
+    // journal
+    //
+    apply_ingress(f_ingress->size());
+    f_ipset_queue->commit();
+    if(f_kernel_worker != nullptr)
+    {
+        f_kernel_worker->stop();
+    }
+    f_blocks.save_snapshot();
+    f_journal->sync();
 
     if(f_messenger != nullptr)
     {
@@ -852,186 +1282,366 @@ void server::stop(bool quitting)
     {
         f_communicator->remove_connection(f_database_timer);
         f_communicator->remove_connection(f_wakeup_timer);
+        f_communicator->remove_connection(f_batch_timer);
+        f_communicator->remove_connection(f_ingress_timer);
+        f_communicator->remove_connection(f_kernel_worker);
+        f_communicator->remove_connection(f_scheme_watcher);
+        f_communicator->remove_connection(f_allowlist_watcher);
+        if(f_stats_timer != nullptr)
+        {
+            f_communicator->remove_connection(f_stats_timer);
+        }
+        if(f_counters_timer != nullptr)
+        {
+            f_communicator->remove_connection(f_counters_timer);
+        }
         f_communicator->remove_connection(f_interrupt);
     }
 }
 
 
 
+/** \brief Queue the block of one IP address.
+ *
+ * This function handles the IPWALL_BLOCK message. The block is not
+ * applied immediately. Instead it gets added to the ingress queue and
+ * is applied on the next slice (see process_ingress()).
+ *
+ * \param[in] msg  The IPWALL_BLOCK message.
+ */
 void server::block_ip(ed::message const & msg)
 {
-    // message data could be tainted, we need to protect ourselves against
-    // unwanted exceptions
+    f_stats.message_received(msg.get_command(), snapdev::timespec_ex::gettime());
+
+    // the URI may include a protocol and an IP separated by "://"
+    // if no "://" appears, then only an IP is expected; it gets
+    // verified once the request is applied
     //
-    try
+    if(!msg.has_parameter(iplock::g_name_iplock_param_uri))
     {
-        // check the "uri" and "period" parameters
-        //
-        // the URI may include a protocol and an IP separated by "://"
-        // if no "://" appears, then only an IP is expected
-        //
-        block_info info(msg, status_t::BLOCK_INFO_BANNED);
-        info.set_ban_count(1); // newly created ban count is always 0, so just set to 1
+        SNAP_LOG_ERROR
+            << "the IPWALL_BLOCK message \""
+            << iplock::g_name_iplock_param_uri
+            << "\" parameter is mandatory."
+            << SNAP_LOG_SEND;
+        return;
+    }
 
-#if 0
-        // save in our list of blocked IP addresses
-        //
-        if(f_firewall_table != nullptr)
-        {
-            // actually add to the firewall
-            //
-            info.iplock_block();
+    iplock::block_request request;
+    request.f_uri = msg.get_parameter(iplock::g_name_iplock_param_uri);
+    if(msg.has_parameter(iplock::g_name_iplock_param_period))
+    {
+        request.f_period = msg.get_parameter(iplock::g_name_iplock_param_period);
+    }
+    if(msg.has_parameter(iplock::g_name_iplock_param_reason))
+    {
+        request.f_reason = msg.get_parameter(iplock::g_name_iplock_param_reason);
+    }
 
-            info.save(f_firewall_table, f_server_name);
-        }
-        else
-#endif
-        {
-            // cache in memory for later, once we connect to our database,
-            // we will save those there
-            //
-            // TODO: I do not, right now, think that we could have such an
-            //       attack that memory would be a problem because some of
-            //       the largest DDoS only make use of 10 to 20,000 IPs
-            //       Even a 50,000 IPs attack is just not quite likely
-            //       before you connect to the database unless somehow
-            //       ipwall never gets a connection...
-            //
-            auto const & it(std::find(
-                      f_blocks.begin()
-                    , f_blocks.end()
-                    , info));
-            if(it == f_blocks.end())
-            {
-                // block the IP now
-                //
-                info.iplock_block();
+    if(f_ingress->push_block(request, iplock::g_name_iplock_cmd_ipwall_block))
+    {
+        schedule_ingress();
+    }
+}
 
-                // this is a new block, keep it as is
-                //
-                f_blocks.push_back(info);
-            }
-            else
-            {
-                // there is a matching old block, keep the new info in
-                // the old block but update as required
-                //
-                it->keep_longest(info);
 
-                // no need to block the IP, it already is
-                //
-                // (Note: it may have changed from some scheme to "all"
-                //        inside the keep_longest() function...)
-            }
+/** \brief Block one IP address unless it was blocked recently.
+ *
+ * The IPWALL_BLOCK messages are broadcast so all the computers of a
+ * cluster which detect the same offender send us the same block. The
+ * dedupe filter remembers the blocks applied recently and this function
+ * drops the duplicates before they reach the store.
+ *
+ * The filter is only trusted while the IP address is still blocked. So
+ * an IP address which gets unblocked can be blocked again right away
+ * without having to forget the other tuples of the filter.
+ *
+ * \param[in] info  The block to apply.
+ * \param[in] command  The name of the message, used for statistics.
+ *
+ * \return true if the block was applied, false if it was a duplicate or
+ * the IP address is allowed.
+ */
+bool server::block(block_info & info, std::string const & command)
+{
+    // never block an allowed IP address
+    //
+    if(f_allowlist->is_allowed(info.get_address()))
+    {
+        f_stats.message_allowlisted(command);
+        return false;
+    }
 
-            // keep them sorted, as in the database
-            //
-            // even if we do not push a new entry, the keep_longest()
-            // may end up changing the order of the existing items...
-            //
-            std::sort(f_blocks.begin(), f_blocks.end());
+    snapdev::timespec_ex const now(snapdev::timespec_ex::gettime());
+    if(f_dedupe->contains(info, now)
+    && f_blocks.is_blocked(info))
+    {
+        f_stats.message_deduplicated(command);
+        return false;
+    }
+    if(!f_dedupe->insert(info, now))
+    {
+        f_stats.dedupe_filter_full();
+    }
+
+    // a repeat offender gets blocked for longer each time; reports of
+    // an IP address which is still blocked are not new offenses
+    //
+    if(!f_blocks.is_blocked(info))
+    {
+        std::uint32_t const offenses(f_history->offend(info.get_address(), now));
+        info.set_ban_count(offenses);
+        if(!f_escalation.empty()
+        && info.extend_block_limit(f_escalation[std::min(
+                      static_cast<std::size_t>(offenses)
+                    , f_escalation.size()) - 1]))
+        {
+            f_stats.block_escalated();
         }
+    }
 
-        next_wakeup();
+    f_blocks.block(info);
+
+    return true;
+}
+
+
+/** \brief Queue the blocks of many IP addresses at once.
+ *
+ * This function handles the IPWALL_BLOCK_BATCH message. The message
+ * includes many blocks encoded with iplock::encode_block_batch(). Each
+ * block is queued like an IPWALL_BLOCK message.
+ *
+ * \param[in] msg  The IPWALL_BLOCK_BATCH message.
+ */
+void server::block_ips(ed::message const & msg)
+{
+    f_stats.message_received(msg.get_command(), snapdev::timespec_ex::gettime());
+
+    if(!msg.has_parameter(iplock::g_name_iplock_param_blocks))
+    {
+        SNAP_LOG_ERROR
+            << "the IPWALL_BLOCK_BATCH message \""
+            << iplock::g_name_iplock_param_blocks
+            << "\" parameter is mandatory."
+            << SNAP_LOG_SEND;
+        return;
     }
-    catch(std::exception const & e)
+
+    iplock::block_request::vector_t const blocks(iplock::decode_block_batch(
+                msg.get_parameter(iplock::g_name_iplock_param_blocks)));
+    for(auto const & b : blocks)
+    {
+        f_ingress->push_block(b, iplock::g_name_iplock_cmd_ipwall_block_batch);
+    }
+
+    schedule_ingress();
+}
+
+
+/** \brief Queue the unblock of one IP address.
+ *
+ * This function handles the IPWALL_UNBLOCK message. The unblock requests
+ * are applied before the block requests found in the ingress queue,
+ * except when a block of the same address is still waiting in that
+ * queue, in which case the unblock is applied after that block.
+ *
+ * \param[in] msg  The IPWALL_UNBLOCK message.
+ */
+void server::unblock_ip(ed::message const & msg)
+{
+    f_stats.message_received(msg.get_command(), snapdev::timespec_ex::gettime());
+
+    if(!msg.has_parameter(iplock::g_name_iplock_param_uri))
     {
         SNAP_LOG_ERROR
-            << "an exception occurred while checking the IPWALL_BLOCK message in the block_ip() function: "
-            << e.what()
+            << "the IPWALL_UNBLOCK message \""
+            << iplock::g_name_iplock_param_uri
+            << "\" parameter is mandatory."
             << SNAP_LOG_SEND;
+        return;
+    }
 
-        // we probably should not catch all exceptions here (i.e. on a
-        // bad_alloc, we probably want to quit...)
-        //
-        // in any event, this probably means we just lost our connections
-        // and need to try to reconnect
-        //
-#if 0
-        f_cassandra.disconnect();
-        f_firewall_table.reset();
-#endif
+    iplock::block_request request;
+    request.f_uri = msg.get_parameter(iplock::g_name_iplock_param_uri);
+    if(f_ingress->push_unblock(request, iplock::g_name_iplock_cmd_ipwall_unblock))
+    {
+        schedule_ingress();
+    }
+}
 
-        // check with snapdbproxy whether it is still connected or not
-        //
-        is_db_ready();
+
+/** \brief Get the number of requests waiting in the ingress queue.
+ *
+ * \return The depth of the ingress queue.
+ */
+std::size_t server::get_ingress_depth() const
+{
+    return f_ingress->size();
+}
+
+
+/** \brief Get the maximum number of requests in the ingress queue.
+ *
+ * \return The capacity of the ingress queue.
+ */
+std::size_t server::get_ingress_capacity() const
+{
+    return f_ingress->get_capacity();
+}
+
+
+/** \brief Make sure the ingress timer is running.
+ *
+ * The timer times out immediately so the requests get applied on the
+ * next iteration of the event loop, once the other connections had a
+ * chance to process their messages.
+ */
+void server::schedule_ingress()
+{
+    if(f_ingress_timer != nullptr
+    && !f_ingress->empty()
+    && f_ingress_timer->get_timeout_date() == -1)
+    {
+        f_ingress_timer->set_timeout_date(snapdev::timespec_ex::gettime());
     }
 }
 
 
-void server::unblock_ip(ed::message const & msg)
+/** \brief Apply the next slice of requests found in the ingress queue.
+ *
+ * This function applies up to ingress-slice requests. If more requests
+ * are waiting, the ingress timer is restarted so the other messages,
+ * such as STOP and IPWALL_GET_STATUS, get handled in between.
+ */
+void server::process_ingress()
 {
-    // message data could be tainted, we need to protect ourselves against
-    // unwanted exceptions
-    //
-    try
+    f_ingress_timer->set_timeout_date(-1);
+    if(f_stop_received)
     {
-        // check the "uri" and "period" parameters
-        //
-        // the URI may include a protocol and an IP separated by "://"
-        // if no "://" appears, then only an IP is expected
-        //
-        block_info info(msg, status_t::BLOCK_INFO_UNBANNED);
+        return;
+    }
 
-        // remove from the firewall
-        //
-        info.iplock_unblock();
+    if(apply_ingress(f_ingress_slice) > 0)
+    {
+        next_wakeup();
+        schedule_batch();
+    }
 
-#if 0
-        // save in our list of blocked IP addresses
+    schedule_ingress();
+}
+
+
+/** \brief Let the senders know when the ingress queue gets overloaded.
+ *
+ * The IPWALL_CURRENT_STATUS message includes the depth of the ingress
+ * queue. It gets broadcast each time the queue becomes overloaded and
+ * once it is back to normal so the senders can slow down.
+ *
+ * \param[in] overloaded  Whether the queue is now overloaded.
+ */
+void server::ingress_load_changed(bool overloaded)
+{
+    if(overloaded)
+    {
+        SNAP_LOG_WARNING
+            << "the ingress queue is overloaded with "
+            << f_ingress->size()
+            << " requests waiting to be applied."
+            << SNAP_LOG_SEND;
+    }
+    else
+    {
+        SNAP_LOG_INFO
+            << "the ingress queue is back to normal."
+            << SNAP_LOG_SEND;
+    }
+
+    if(f_messenger != nullptr)
+    {
+        f_messenger->send_firewall_status();
+    }
+}
+
+
+/** \brief Apply requests found in the ingress queue.
+ *
+ * The block and unblock requests are verified here. An invalid request
+ * is reported and skipped; it does not prevent the other requests from
+ * being applied.
+ *
+ * \param[in] max  The maximum number of requests to apply.
+ *
+ * \return The number of requests taken out of the queue.
+ */
+std::size_t server::apply_ingress(std::size_t max)
+{
+    std::size_t count(0);
+    std::size_t errors(0);
+    ingress_item item;
+    for(; count < max && f_ingress->pop(item); ++count)
+    {
+        // message data could be tainted, we need to protect ourselves
+        // against unwanted exceptions
         //
-        if(f_firewall_table != nullptr)
+        try
         {
-            info.save(f_firewall_table, f_server_name);
+            block_info info(item.f_request.f_uri);
+            if(item.f_unblock)
+            {
+                // remove from the firewall and our store
+                //
+                // if the IP is part of a blocked network, the other IPs
+                // of that network get blocked individually again first
+                //
+                f_aggregator->release(info.get_address());
+                f_blocks.unblock(info);
+            }
+            else
+            {
+                // if the IP is not yet blocked, the store blocks it now;
+                // otherwise the existing block is updated with the longest
+                // limit (and its scheme may change to "all" in the process)
+                //
+                info.set_block_limit(item.f_request.f_period);
+                info.set_reason(item.f_request.f_reason);
+                info.set_ban_count(1);
+                block(info, item.f_command);
+            }
         }
-        else
+        catch(std::exception const & e)
         {
-            // find the block in the cache, it should be there unless we
-            // lost the connection with the database
-            //
-            auto const & it(std::find(
-                      f_blocks.begin()
-                    , f_blocks.end()
-                    , info));
-            if(it != f_blocks.end())
+            if(errors == 0)
             {
-                // by erasing the info we lose that data, but that only
-                // happens when we are not connected to the database;
-                // the connection to the database should happen very
-                // quickly so most blocks will not be removed before
-                // they get saved
-                //
-                f_blocks.erase(it);
+                SNAP_LOG_ERROR
+                    << "an exception occurred while applying the "
+                    << item.f_command
+                    << " request of \""
+                    << item.f_request.f_uri
+                    << "\": "
+                    << e.what()
+                    << SNAP_LOG_SEND;
             }
+            ++errors;
         }
-#endif
-
-        next_wakeup();
     }
-    catch(std::exception const & e)
+
+    if(errors > 1)
     {
         SNAP_LOG_ERROR
-            << "an exception occurred while checking the IPWALL_UNBLOCK message in the unblock_ip() function: "
-            << e.what()
+            << errors
+            << " block or unblock requests were invalid."
             << SNAP_LOG_SEND;
-
-        // we probably should not catch all exceptions here (i.e. on a
-        // bad_alloc, we probably want to quit...)
-        //
-        // in any event, this probably means we just lost our connections
-        // and need to try to reconnect
-        //
-#if 0
-        f_database.disconnect();
-        f_firewall_table.reset();
-#endif
-
+    }
+    if(errors > 0)
+    {
         // check with snapdbproxy whether it is still connected or not
         //
         is_db_ready();
     }
-}
 
+    return count;
+}
 
 
 } // namespace ipwall
@@ -20,10 +20,24 @@
 
 // self
 //
-#include    "block_info.h"
+#include    "allowlist_watcher.h"
+#include    "ban_journal.h"
+#include    "batch_timer.h"
+#include    "block_store.h"
+#include    "counters_timer.h"
 #include    "database_timer.h"
+#include    "dedupe_filter.h"
+#include    "ingress_queue.h"
+#include    "ingress_timer.h"
 #include    "interrupt.h"
+#include    "ipset_queue.h"
+#include    "kernel_worker.h"
 #include    "messenger.h"
+#include    "net_aggregator.h"
+#include    "offender_history.h"
+#include    "scheme_registry.h"
+#include    "stats.h"
+#include    "stats_timer.h"
 #include    "wakeup_timer.h"
 
 
@@ -49,19 +63,33 @@ public:
     void                        run();
 
     void                        process_timeout();
+    void                        process_batch();
+    void                        schedule_batch();
+    void                        process_ingress();
     void                        process_reconnect();
     void                        process_database_ready();
     void                        process_no_database();
     void                        stop(bool quitting);
     void                        next_wakeup();
     void                        block_ip(ed::message const & message);
+    void                        block_ips(ed::message const & message);
     void                        unblock_ip(ed::message const & message);
+    std::size_t                 get_ingress_depth() const;
+    std::size_t                 get_ingress_capacity() const;
     void                        is_db_ready();
+    std::string                 get_stats() const;
+    void                        save_stats();
+    void                        harvest_counters();
 
     bool                        is_firewall_up() const;
 
 private:
     void                        setup_firewall();
+    void                        schedule_ingress();
+    void                        kernel_applied(std::size_t operations, std::size_t errors);
+    void                        ingress_load_changed(bool overloaded);
+    std::size_t                 apply_ingress(std::size_t max);
+    bool                        block(block_info & info, std::string const & command);
 
     advgetopt::getopt                   f_opts;
     ed::communicator::pointer_t         f_communicator = ed::communicator::pointer_t();
@@ -70,11 +98,35 @@ private:
     messenger::pointer_t                f_messenger = messenger::pointer_t();
     database_timer::pointer_t           f_database_timer = database_timer::pointer_t();
     wakeup_timer::pointer_t             f_wakeup_timer = wakeup_timer::pointer_t();
+    batch_timer::pointer_t              f_batch_timer = batch_timer::pointer_t();
+    ingress_timer::pointer_t            f_ingress_timer = ingress_timer::pointer_t();
+    scheme_watcher::pointer_t           f_scheme_watcher = scheme_watcher::pointer_t();
+    stats_timer::pointer_t              f_stats_timer = stats_timer::pointer_t();
+    std::string                         f_stats_file = std::string();
+    snapdev::timespec_ex                f_stats_interval = snapdev::timespec_ex(15, 0);
+    counters_timer::pointer_t           f_counters_timer = counters_timer::pointer_t();
+    snapdev::timespec_ex                f_counters_interval = snapdev::timespec_ex(300, 0);
+    snapdev::timespec_ex                f_batch_window = snapdev::timespec_ex(0, 20'000'000);
+    snapdev::timespec_ex                f_reconcile_interval = snapdev::timespec_ex(3600, 0);
+    snapdev::timespec_ex                f_next_reconcile = snapdev::timespec_ex();
     //snap::database                      f_database = snap::database();
     //libdbproxy::table::pointer_t        f_firewall_table = libdbproxy::table::pointer_t();
     bool                                f_stop_received = false;
     bool                                f_firewall_up = false;
-    block_info::block_info_vector_t     f_blocks = block_info::block_info_vector_t();       // save here until connected to Cassandra
+    iplock::ipset::pointer_t            f_ipset = iplock::ipset::pointer_t();
+    ipset_queue::pointer_t              f_ipset_queue = ipset_queue::pointer_t();
+    kernel_worker::pointer_t            f_kernel_worker = kernel_worker::pointer_t();
+    iplock::allowlist::pointer_t        f_allowlist = iplock::allowlist::pointer_t();
+    allowlist_watcher::pointer_t        f_allowlist_watcher = allowlist_watcher::pointer_t();
+    net_aggregator::pointer_t           f_aggregator = net_aggregator::pointer_t();
+    ban_journal::pointer_t              f_journal = ban_journal::pointer_t();
+    ingress_queue::pointer_t            f_ingress = ingress_queue::pointer_t();
+    std::size_t                         f_ingress_slice = 1000;
+    block_store                         f_blocks;       // save here until connected to Cassandra
+    dedupe_filter::pointer_t            f_dedupe = dedupe_filter::pointer_t();
+    offender_history::pointer_t         f_history = offender_history::pointer_t();
+    advgetopt::string_list_t            f_escalation = advgetopt::string_list_t();
+    stats                               f_stats = stats();
 };
 
 
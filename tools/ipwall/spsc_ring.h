@@ -0,0 +1,102 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// C++
+//
+#include    <array>
+#include    <atomic>
+#include    <cstddef>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \brief A bounded single producer single consumer ring.
+ *
+ * One thread pushes items and another thread pops them. Neither side
+ * ever takes a lock. The head is only written by the consumer and the
+ * tail only by the producer; each side reads the other index with
+ * acquire semantic so the item it sees is complete.
+ *
+ * The \p SIZE must be a power of two. The ring holds up to SIZE - 1
+ * items.
+ */
+template<typename T, std::size_t SIZE>
+class spsc_ring
+{
+public:
+    static_assert((SIZE & (SIZE - 1)) == 0, "the spsc_ring SIZE must be a power of two");
+
+    /** \brief Add an item at the end of the ring.
+     *
+     * Only the producer thread can call this function.
+     *
+     * \param[in] item  The item to add.
+     *
+     * \return false if the ring is full.
+     */
+    bool push(T const & item)
+    {
+        std::size_t const tail(f_tail.load(std::memory_order_relaxed));
+        std::size_t const next((tail + 1) & (SIZE - 1));
+        if(next == f_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        f_items[tail] = item;
+        f_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /** \brief Remove the item at the front of the ring.
+     *
+     * Only the consumer thread can call this function.
+     *
+     * \param[out] item  The item removed from the ring.
+     *
+     * \return false if the ring is empty.
+     */
+    bool pop(T & item)
+    {
+        std::size_t const head(f_head.load(std::memory_order_relaxed));
+        if(head == f_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = f_items[head];
+        f_head.store((head + 1) & (SIZE - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    // keep the indexes on separate cache lines so the two threads do
+    // not invalidate each other's cache on each push and pop
+    //
+    alignas(64) std::atomic<std::size_t>    f_head = 0;
+    alignas(64) std::atomic<std::size_t>    f_tail = 0;
+    alignas(64) std::array<T, SIZE>         f_items = {};
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
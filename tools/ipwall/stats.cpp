@@ -0,0 +1,534 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "stats.h"
+
+#include    "block_store.h"
+
+
+// C++
+//
+#include    <algorithm>
+#include    <iomanip>
+#include    <iterator>
+#include    <sstream>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The upper bounds of the batch size buckets.
+ *
+ * The last bucket is used for anything larger.
+ */
+constexpr std::uint64_t const   g_batch_buckets[] = { 1, 10, 100, 1'000, 10'000 };
+
+
+/** \brief The upper bounds of the latency buckets in seconds.
+ *
+ * These are the buckets exported to Prometheus. Internally, the
+ * histogram has many more buckets. The 0.1 second bucket represents
+ * our SLO for blocks.
+ */
+constexpr double const          g_latency_buckets[] = {
+        0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+    };
+
+
+void output_histogram(
+      std::ostream & out
+    , std::string const & name
+    , std::string const & help
+    , latency_histogram const & h)
+{
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << " histogram\n";
+    for(auto const le : g_latency_buckets)
+    {
+        out << name << "_bucket{le=\"" << le << "\"} " << h.get_count_up_to(le) << '\n';
+    }
+    out << name << "_bucket{le=\"+Inf\"} " << h.get_count() << '\n'
+        << name << "_sum " << h.get_sum() << '\n'
+        << name << "_count " << h.get_count() << '\n';
+
+    out << "# HELP " << name << "_p99 The 99th percentile of the " << name << " histogram.\n"
+        << "# TYPE " << name << "_p99 gauge\n"
+        << name << "_p99 " << h.get_percentile(99.0) << '\n'
+        << "# HELP " << name << "_max The largest value of the " << name << " histogram.\n"
+        << "# TYPE " << name << "_max gauge\n"
+        << name << "_max " << h.get_max() << '\n';
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class latency_histogram
+ * \brief Histogram of latencies with a bounded relative error.
+ *
+ * The histogram works like an HDR histogram: each power of two is
+ * split in 16 sub-buckets so the relative error is at most about 6%
+ * whatever the magnitude of the latency. The latencies are recorded
+ * in microseconds, from 1 microsecond to about 19 hours.
+ *
+ * Recording a latency is O(1) and the memory used is fixed.
+ */
+
+
+/** \brief Record one latency.
+ *
+ * \param[in] latency  The latency to record. Negative values are
+ * recorded as zero.
+ */
+void latency_histogram::record(snapdev::timespec_ex const & latency)
+{
+    std::int64_t const us(
+              static_cast<std::int64_t>(latency.tv_sec) * 1'000'000
+            + latency.tv_nsec / 1'000);
+    std::uint64_t const value(us < 0 ? 0 : static_cast<std::uint64_t>(us));
+
+    ++f_buckets[get_index(value)];
+    ++f_count;
+    f_sum += value;
+    f_max = std::max(f_max, value);
+}
+
+
+std::uint64_t latency_histogram::get_count() const
+{
+    return f_count;
+}
+
+
+/** \brief Get the sum of all the latencies.
+ *
+ * \return The sum in seconds.
+ */
+double latency_histogram::get_sum() const
+{
+    return static_cast<double>(f_sum) / 1'000'000.0;
+}
+
+
+/** \brief Get the largest latency recorded.
+ *
+ * \return The largest latency in seconds.
+ */
+double latency_histogram::get_max() const
+{
+    return static_cast<double>(f_max) / 1'000'000.0;
+}
+
+
+/** \brief Get a percentile.
+ *
+ * The result is the upper bound of the bucket in which the percentile
+ * lands so it is never smaller than the real value.
+ *
+ * \param[in] p  The percentile, between 0.0 and 100.0.
+ *
+ * \return The latency in seconds.
+ */
+double latency_histogram::get_percentile(double p) const
+{
+    if(f_count == 0)
+    {
+        return 0.0;
+    }
+
+    std::uint64_t const target(std::max(
+              static_cast<std::uint64_t>(1)
+            , static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(f_count) + 0.5)));
+    std::uint64_t total(0);
+    for(int idx(0); idx < BUCKET_COUNT; ++idx)
+    {
+        total += f_buckets[idx];
+        if(total >= target)
+        {
+            return static_cast<double>(std::min(get_upper_bound(idx), f_max)) / 1'000'000.0;
+        }
+    }
+
+    return get_max();
+}
+
+
+/** \brief Count the latencies up to the specified number of seconds.
+ *
+ * The count includes all the buckets which upper bound is at most
+ * \p seconds so it has the same precision as the histogram.
+ *
+ * \param[in] seconds  The maximum latency.
+ *
+ * \return The number of latencies up to \p seconds.
+ */
+std::uint64_t latency_histogram::get_count_up_to(double seconds) const
+{
+    std::uint64_t const us(static_cast<std::uint64_t>(seconds * 1'000'000.0));
+    std::uint64_t total(0);
+    for(int idx(0); idx < BUCKET_COUNT; ++idx)
+    {
+        if(get_upper_bound(idx) > us)
+        {
+            break;
+        }
+        total += f_buckets[idx];
+    }
+    return total;
+}
+
+
+int latency_histogram::get_index(std::uint64_t us)
+{
+    if(us < SUB_BUCKET_COUNT)
+    {
+        return static_cast<int>(us);
+    }
+
+    int const exponent(63 - __builtin_clzll(us));
+    int const sub(static_cast<int>(us >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKET_COUNT);
+    int const index(SUB_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT + sub);
+    return std::min(index, BUCKET_COUNT - 1);
+}
+
+
+/** \brief Get the largest value which lands in a bucket.
+ *
+ * \param[in] index  The index of the bucket.
+ *
+ * \return The largest value in microseconds.
+ */
+std::uint64_t latency_histogram::get_upper_bound(int index)
+{
+    if(index < SUB_BUCKET_COUNT)
+    {
+        return index;
+    }
+
+    int const exponent((index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT + SUB_BUCKET_BITS);
+    std::uint64_t const sub((index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT);
+    return ((SUB_BUCKET_COUNT + sub + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+
+
+/** \class stats
+ * \brief Statistics about the ipwall performance.
+ *
+ * The server updates these statistics as it receives messages and
+ * applies the resulting operations to the kernel. They can be retrieved
+ * with the IPWALL_GET_STATS message or saved in a file in the Prometheus
+ * text format (see the stats-file option).
+ *
+ * The latencies measure:
+ *
+ * \li from the time a message is received to the time the corresponding
+ * operation was sent to the kernel (ban latency);
+ * \li from the time a block is due to the time it was removed from the
+ * kernel (unblock latency).
+ */
+
+
+/** \brief Count a message and remember when it was received.
+ *
+ * The time is used to compute the ban latency once the next batch gets
+ * applied.
+ *
+ * \param[in] command  The name of the message.
+ * \param[in] now  The time when the message was received.
+ */
+void stats::message_received(std::string const & command, snapdev::timespec_ex const & now)
+{
+    ++f_messages[command];
+    f_pending_messages.push_back(now);
+}
+
+
+/** \brief Count a block dropped by the dedupe filter.
+ *
+ * \param[in] command  The name of the message which included the block.
+ */
+void stats::message_deduplicated(std::string const & command)
+{
+    ++f_deduplicated[command];
+}
+
+
+/** \brief Count a block dropped because the IP address is allowed.
+ *
+ * \param[in] command  The name of the message which included the block.
+ */
+void stats::message_allowlisted(std::string const & command)
+{
+    ++f_allowlisted[command];
+}
+
+
+/** \brief Count a request merged with another one in the ingress queue.
+ *
+ * \param[in] command  The name of the message which included the request.
+ */
+void stats::message_merged(std::string const & command)
+{
+    ++f_merged[command];
+}
+
+
+/** \brief Count a request dropped because the ingress queue was full.
+ *
+ * \param[in] command  The name of the message which included the request.
+ */
+void stats::message_dropped(std::string const & command)
+{
+    ++f_dropped[command];
+}
+
+
+/** \brief Count the number of times the dedupe filter was full.
+ *
+ * When this happens, the filter rotates early so duplicates may get
+ * through. If this counter increases, the dedupe-capacity option
+ * should be increased.
+ */
+void stats::dedupe_filter_full()
+{
+    ++f_dedupe_full;
+}
+
+
+/** \brief Count a block which was extended because of past offenses.
+ */
+void stats::block_escalated()
+{
+    ++f_escalated;
+}
+
+
+/** \brief Count a network which replaced its individual blocks.
+ */
+void stats::network_aggregated()
+{
+    ++f_aggregated;
+}
+
+
+/** \brief Count the blocks adjusted after reading the IP set counters.
+ *
+ * \param[in] released  The number of idle IP addresses unblocked early.
+ * \param[in] extended  The number of active IP addresses blocked longer.
+ */
+void stats::counters_harvested(std::size_t released, std::size_t extended)
+{
+    ++f_harvests;
+    f_idle_released += released;
+    f_active_extended += extended;
+}
+
+
+/** \brief Remember when a block was due.
+ *
+ * \param[in] limit  The block limit of an entry being unblocked.
+ */
+void stats::expiry_due(snapdev::timespec_ex const & limit)
+{
+    f_pending_expiries.push_back(limit);
+}
+
+
+/** \brief Count a batch of operations sent to the kernel.
+ *
+ * \param[in] operations  The number of operations in the batch.
+ * \param[in] errors  The number of operations which failed.
+ */
+void stats::batch_applied(std::size_t operations, std::size_t errors)
+{
+    std::size_t idx(0);
+    while(idx < std::size(g_batch_buckets)
+       && operations > g_batch_buckets[idx])
+    {
+        ++idx;
+    }
+    ++f_batch_sizes[idx];
+    ++f_batches;
+    f_operations += operations;
+    f_failures += errors;
+}
+
+
+/** \brief The pending operations were sent to the kernel.
+ *
+ * This function computes the latencies of the messages and expiries
+ * which were waiting for the pending operations to be applied.
+ *
+ * \param[in] now  The time when the operations were applied.
+ */
+void stats::applied(snapdev::timespec_ex const & now)
+{
+    for(auto const & t : f_pending_messages)
+    {
+        f_ban_latency.record(now - t);
+    }
+    f_pending_messages.clear();
+
+    for(auto const & t : f_pending_expiries)
+    {
+        f_unblock_latency.record(now - t);
+    }
+    f_pending_expiries.clear();
+}
+
+
+/** \brief Generate the statistics in the Prometheus text format.
+ *
+ * \param[in] blocks  The store, used to count the active bans.
+ * \param[in] now  The current time.
+ *
+ * \return The statistics as a string.
+ */
+std::string stats::to_prometheus(block_store const & blocks, snapdev::timespec_ex const & now) const
+{
+    std::stringstream out;
+    out << std::setprecision(9);
+
+    out << "# HELP ipwall_bans_active Number of IP addresses currently blocked.\n"
+        << "# TYPE ipwall_bans_active gauge\n";
+    for(auto const & c : blocks.get_counts())
+    {
+        out << "ipwall_bans_active{scheme=\"" << block_info::get_scheme_name(c.first.first)
+            << "\",family=\"" << (c.first.second ? "ipv4" : "ipv6")
+            << "\"} " << c.second << '\n';
+    }
+
+    out << "# HELP ipwall_messages_received_total Number of messages received.\n"
+        << "# TYPE ipwall_messages_received_total counter\n";
+    for(auto const & m : f_messages)
+    {
+        out << "ipwall_messages_received_total{message=\"" << m.first << "\"} " << m.second << '\n';
+    }
+
+    out << "# HELP ipwall_blocks_deduplicated_total Number of blocks dropped because they were applied recently.\n"
+        << "# TYPE ipwall_blocks_deduplicated_total counter\n";
+    for(auto const & d : f_deduplicated)
+    {
+        out << "ipwall_blocks_deduplicated_total{message=\"" << d.first << "\"} " << d.second << '\n';
+    }
+    out << "# HELP ipwall_blocks_allowlisted_total Number of blocks dropped because the IP address is in the allowlist.\n"
+        << "# TYPE ipwall_blocks_allowlisted_total counter\n";
+    for(auto const & a : f_allowlisted)
+    {
+        out << "ipwall_blocks_allowlisted_total{message=\"" << a.first << "\"} " << a.second << '\n';
+    }
+    out << "# HELP ipwall_requests_merged_total Number of requests merged with a request of the same IP address waiting in the ingress queue.\n"
+        << "# TYPE ipwall_requests_merged_total counter\n";
+    for(auto const & m : f_merged)
+    {
+        out << "ipwall_requests_merged_total{message=\"" << m.first << "\"} " << m.second << '\n';
+    }
+    out << "# HELP ipwall_requests_dropped_total Number of requests dropped because the ingress queue was full.\n"
+        << "# TYPE ipwall_requests_dropped_total counter\n";
+    for(auto const & d : f_dropped)
+    {
+        out << "ipwall_requests_dropped_total{message=\"" << d.first << "\"} " << d.second << '\n';
+    }
+    out << "# HELP ipwall_dedupe_filter_full_total Number of times the dedupe filter was full and rotated early.\n"
+        << "# TYPE ipwall_dedupe_filter_full_total counter\n"
+        << "ipwall_dedupe_filter_full_total " << f_dedupe_full << '\n';
+
+    out << "# HELP ipwall_blocks_escalated_total Number of blocks extended because the IP address offended before.\n"
+        << "# TYPE ipwall_blocks_escalated_total counter\n"
+        << "ipwall_blocks_escalated_total " << f_escalated << '\n';
+
+    out << "# HELP ipwall_networks_aggregated_total Number of networks blocked as a whole instead of each IP address.\n"
+        << "# TYPE ipwall_networks_aggregated_total counter\n"
+        << "ipwall_networks_aggregated_total " << f_aggregated << '\n';
+
+    out << "# HELP ipwall_counters_harvests_total Number of times the packet counters were read from the IP sets.\n"
+        << "# TYPE ipwall_counters_harvests_total counter\n"
+        << "ipwall_counters_harvests_total " << f_harvests << '\n';
+
+    out << "# HELP ipwall_blocks_idle_released_total Number of blocks released early because the IP address stopped sending packets.\n"
+        << "# TYPE ipwall_blocks_idle_released_total counter\n"
+        << "ipwall_blocks_idle_released_total " << f_idle_released << '\n';
+
+    out << "# HELP ipwall_blocks_active_extended_total Number of blocks extended because the IP address kept sending packets.\n"
+        << "# TYPE ipwall_blocks_active_extended_total counter\n"
+        << "ipwall_blocks_active_extended_total " << f_active_extended << '\n';
+
+    out << "# HELP ipwall_batch_size Number of operations sent to the kernel per batch.\n"
+        << "# TYPE ipwall_batch_size histogram\n";
+    std::uint64_t total(0);
+    for(std::size_t idx(0); idx < std::size(g_batch_buckets); ++idx)
+    {
+        total += f_batch_sizes[idx];
+        out << "ipwall_batch_size_bucket{le=\"" << g_batch_buckets[idx] << "\"} " << total << '\n';
+    }
+    out << "ipwall_batch_size_bucket{le=\"+Inf\"} " << f_batches << '\n'
+        << "ipwall_batch_size_sum " << f_operations << '\n'
+        << "ipwall_batch_size_count " << f_batches << '\n';
+
+    out << "# HELP ipwall_kernel_failures_total Number of operations the kernel refused.\n"
+        << "# TYPE ipwall_kernel_failures_total counter\n"
+        << "ipwall_kernel_failures_total " << f_failures << '\n';
+
+    double backlog(0.0);
+    snapdev::timespec_ex const next(blocks.next_expiry());
+    if(next != snapdev::timespec_ex()
+    && next < now)
+    {
+        backlog = (now - next).to_sec();
+    }
+    out << "# HELP ipwall_expiry_backlog_seconds How late ipwall is at unblocking expired blocks.\n"
+        << "# TYPE ipwall_expiry_backlog_seconds gauge\n"
+        << "ipwall_expiry_backlog_seconds " << backlog << '\n';
+
+    output_histogram(
+              out
+            , "ipwall_ban_latency_seconds"
+            , "Time from receiving a message to applying it to the kernel."
+            , f_ban_latency);
+    output_histogram(
+              out
+            , "ipwall_unblock_latency_seconds"
+            , "Time from a block timing out to removing it from the kernel."
+            , f_unblock_latency);
+
+    return out.str();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,125 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+// snapdev
+//
+#include    <snapdev/timespec_ex.h>
+
+
+// C++
+//
+#include    <array>
+#include    <cstdint>
+#include    <map>
+#include    <string>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+class block_store;
+
+
+
+class latency_histogram
+{
+public:
+    void                record(snapdev::timespec_ex const & latency);
+    std::uint64_t       get_count() const;
+    double              get_sum() const;
+    double              get_max() const;
+    double              get_percentile(double p) const;
+    std::uint64_t       get_count_up_to(double seconds) const;
+
+private:
+    // 16 sub-buckets per power of two gives a precision of about 6%;
+    // the last bucket is used for anything over about 19 hours
+    //
+    static constexpr int const  SUB_BUCKET_BITS = 4;
+    static constexpr int const  SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr int const  BUCKET_COUNT = SUB_BUCKET_COUNT * (36 - SUB_BUCKET_BITS + 1);
+
+    static int          get_index(std::uint64_t us);
+    static std::uint64_t
+                        get_upper_bound(int index);
+
+    std::array<std::uint64_t, BUCKET_COUNT>
+                        f_buckets = {};
+    std::uint64_t       f_count = 0;
+    std::uint64_t       f_sum = 0;      // in microseconds
+    std::uint64_t       f_max = 0;      // in microseconds
+};
+
+
+class stats
+{
+public:
+    void                message_received(std::string const & command, snapdev::timespec_ex const & now);
+    void                message_deduplicated(std::string const & command);
+    void                message_allowlisted(std::string const & command);
+    void                message_merged(std::string const & command);
+    void                message_dropped(std::string const & command);
+    void                dedupe_filter_full();
+    void                block_escalated();
+    void                network_aggregated();
+    void                counters_harvested(std::size_t released, std::size_t extended);
+    void                expiry_due(snapdev::timespec_ex const & limit);
+    void                batch_applied(std::size_t operations, std::size_t errors);
+    void                applied(snapdev::timespec_ex const & now);
+
+    std::string         to_prometheus(block_store const & blocks, snapdev::timespec_ex const & now) const;
+
+private:
+    std::map<std::string, std::uint64_t>
+                        f_messages = std::map<std::string, std::uint64_t>();
+    std::map<std::string, std::uint64_t>
+                        f_deduplicated = std::map<std::string, std::uint64_t>();
+    std::map<std::string, std::uint64_t>
+                        f_allowlisted = std::map<std::string, std::uint64_t>();
+    std::map<std::string, std::uint64_t>
+                        f_merged = std::map<std::string, std::uint64_t>();
+    std::map<std::string, std::uint64_t>
+                        f_dropped = std::map<std::string, std::uint64_t>();
+    std::uint64_t       f_dedupe_full = 0;
+    std::uint64_t       f_escalated = 0;
+    std::uint64_t       f_aggregated = 0;
+    std::uint64_t       f_harvests = 0;
+    std::uint64_t       f_idle_released = 0;
+    std::uint64_t       f_active_extended = 0;
+    std::vector<snapdev::timespec_ex>
+                        f_pending_messages = std::vector<snapdev::timespec_ex>();
+    std::vector<snapdev::timespec_ex>
+                        f_pending_expiries = std::vector<snapdev::timespec_ex>();
+    std::array<std::uint64_t, 6>
+                        f_batch_sizes = {};
+    std::uint64_t       f_batches = 0;
+    std::uint64_t       f_operations = 0;
+    std::uint64_t       f_failures = 0;
+    latency_histogram   f_ban_latency = latency_histogram();
+    latency_histogram   f_unblock_latency = latency_histogram();
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
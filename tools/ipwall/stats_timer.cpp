@@ -0,0 +1,67 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "stats_timer.h"
+
+#include    "server.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \brief Initializes the timer with a pointer to the server.
+ *
+ * The timer ticks every \p interval microseconds. It is only created
+ * when the stats-file option is defined.
+ *
+ * \param[in] s  A pointer to the server object.
+ * \param[in] interval  The number of microseconds between two ticks.
+ */
+stats_timer::stats_timer(server * s, std::int64_t interval)
+    : timer(interval)
+    , f_server(s)
+{
+    set_name("stats_timer");
+}
+
+
+/** \brief Time to save the statistics.
+ *
+ * This function asks the server to save its statistics in the
+ * Prometheus text file.
+ */
+void stats_timer::process_timeout()
+{
+    f_server->save_stats();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
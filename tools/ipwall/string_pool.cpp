@@ -0,0 +1,229 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// self
+//
+#include    "string_pool.h"
+
+
+// snaplogger
+//
+#include    <snaplogger/message.h>
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+/** \class string_pool
+ * \brief Intern strings which repeat in many blocks.
+ *
+ * Each block has a scheme and a reason. There are only a few different
+ * schemes and the reasons are generally generated by a few services so
+ * the same strings repeat in millions of blocks. Instead of a copy of
+ * each string, the blocks keep a 16 bit identifier in this pool.
+ *
+ * Looking up an existing string does not allocate memory.
+ *
+ * Identifier 0 (NO_STRING) is always the empty string. By default, the
+ * strings are never removed, the references returned by get() remain
+ * valid for the lifetime of the pool, and once the pool is full,
+ * intern() returns NO_STRING for any new string.
+ *
+ * A pool created with \em recycle set to true is used for strings which
+ * come from the network, such as the reasons. Once full, the least
+ * recently used string gets replaced by the new string and the
+ * generation of its identifier is incremented. Users of such a pool save
+ * the generation along the identifier and use get(id, generation) which
+ * returns an empty string once the identifier was recycled.
+ */
+
+
+/** \brief Initialize the pool with a set of predefined strings.
+ *
+ * The predefined strings get the identifiers 1, 2, 3, etc. in order.
+ * They are never recycled.
+ *
+ * \param[in] strings  The strings to intern first.
+ * \param[in] max_strings  The maximum number of strings in the pool, at
+ * most MAX_STRINGS.
+ * \param[in] recycle  Whether the least recently used strings get
+ * replaced once the pool is full.
+ */
+string_pool::string_pool(
+          std::initializer_list<std::string_view> strings
+        , std::size_t max_strings
+        , bool recycle)
+    : f_max_strings(std::clamp(max_strings, strings.size() + 1, MAX_STRINGS))
+{
+    f_strings.emplace_back();
+    f_generations.push_back(0);
+    f_lru_positions.push_back(f_lru.end());
+    for(auto const & s : strings)
+    {
+        intern(s);
+    }
+    f_recycle = recycle;
+}
+
+
+/** \brief Get the identifier of a string.
+ *
+ * If the string is not yet in the pool, it gets added.
+ *
+ * \param[in] s  The string to intern.
+ *
+ * \return The identifier of the string or NO_STRING if \p s is empty or
+ * the pool is full.
+ */
+string_pool::id_t string_pool::intern(std::string_view s)
+{
+    if(s.empty())
+    {
+        return NO_STRING;
+    }
+
+    auto const it(f_ids.find(s));
+    if(it != f_ids.end())
+    {
+        if(f_recycle
+        && f_lru_positions[it->second] != f_lru.end())
+        {
+            f_lru.splice(f_lru.begin(), f_lru, f_lru_positions[it->second]);
+        }
+        return it->second;
+    }
+
+    if(f_strings.size() > f_max_strings)
+    {
+        if(f_recycle
+        && !f_lru.empty())
+        {
+            // replace the least recently used string
+            //
+            id_t const id(f_lru.back());
+            f_ids.erase(f_strings[id]);
+            f_strings[id] = s;
+            ++f_generations[id];
+            f_ids.emplace(f_strings[id], id);
+            f_lru.splice(f_lru.begin(), f_lru, f_lru_positions[id]);
+            return id;
+        }
+
+        if(!f_full)
+        {
+            f_full = true;
+            SNAP_LOG_WARNING
+                << "the string pool is full; new strings are ignored."
+                << SNAP_LOG_SEND;
+        }
+        return NO_STRING;
+    }
+
+    id_t const id(static_cast<id_t>(f_strings.size()));
+    f_strings.emplace_back(s);
+    f_generations.push_back(0);
+    f_ids.emplace(f_strings.back(), id);
+    if(f_recycle)
+    {
+        f_lru.push_front(id);
+        f_lru_positions.push_back(f_lru.begin());
+    }
+    else
+    {
+        f_lru_positions.push_back(f_lru.end());
+    }
+    return id;
+}
+
+
+/** \brief Get the generation of an identifier.
+ *
+ * The generation changes each time a recycling pool reuses the
+ * identifier for another string.
+ *
+ * \param[in] id  The identifier returned by intern().
+ *
+ * \return The current generation of \p id.
+ */
+string_pool::generation_t string_pool::get_generation(id_t id) const
+{
+    if(id >= f_generations.size())
+    {
+        return 0;
+    }
+    return f_generations[id];
+}
+
+
+/** \brief Get a string from its identifier.
+ *
+ * \param[in] id  The identifier returned by intern().
+ *
+ * \return The string or an empty string if \p id is not valid.
+ */
+std::string const & string_pool::get(id_t id) const
+{
+    if(id >= f_strings.size())
+    {
+        return f_strings.front();
+    }
+    return f_strings[id];
+}
+
+
+/** \brief Get a string from a recycling pool.
+ *
+ * \param[in] id  The identifier returned by intern().
+ * \param[in] generation  The generation of \p id when it was interned.
+ *
+ * \return The string or an empty string if \p id is not valid or was
+ * recycled since.
+ */
+std::string const & string_pool::get(id_t id, generation_t generation) const
+{
+    if(id >= f_strings.size()
+    || f_generations[id] != generation)
+    {
+        return f_strings.front();
+    }
+    return f_strings[id];
+}
+
+
+std::size_t string_pool::size() const
+{
+    return f_ids.size();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,81 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+
+// C++
+//
+#include    <cstdint>
+#include    <deque>
+#include    <initializer_list>
+#include    <limits>
+#include    <list>
+#include    <map>
+#include    <string>
+#include    <string_view>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+class string_pool
+{
+public:
+    typedef std::uint16_t               id_t;
+    typedef std::uint16_t               generation_t;
+
+    static constexpr id_t const         NO_STRING = 0;
+    static constexpr std::size_t const  MAX_STRINGS = std::numeric_limits<id_t>::max();
+
+                        string_pool(
+                              std::initializer_list<std::string_view> strings
+                            , std::size_t max_strings = MAX_STRINGS
+                            , bool recycle = false);
+                        string_pool(string_pool const &) = delete;
+
+    string_pool &       operator = (string_pool const &) = delete;
+
+    id_t                intern(std::string_view s);
+    generation_t        get_generation(id_t id) const;
+    std::string const & get(id_t id) const;
+    std::string const & get(id_t id, generation_t generation) const;
+    std::size_t         size() const;
+
+private:
+    typedef std::map<std::string, id_t, std::less<>>
+                                        id_map_t;
+    typedef std::list<id_t>             lru_t;
+
+    std::deque<std::string>             f_strings = std::deque<std::string>();
+    std::vector<generation_t>           f_generations = std::vector<generation_t>();
+    id_map_t                            f_ids = id_map_t();
+    lru_t                               f_lru = lru_t();        // most recently used first
+    std::vector<lru_t::iterator>        f_lru_positions = std::vector<lru_t::iterator>();
+    std::size_t                         f_max_strings = MAX_STRINGS;
+    bool                                f_recycle = false;
+    bool                                f_full = false;
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,383 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// self
+//
+#include    "timing_wheel.h"
+
+
+// C++
+//
+#include    <algorithm>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace ipwall
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief The number of ticks covered by one slot of each level.
+ *
+ * With a precision of one second, the levels represent seconds,
+ * minutes, hours, and days.
+ */
+constexpr std::int64_t const    g_width[] = { 1, 60, 60 * 60, 24 * 60 * 60 };
+
+
+/** \brief The number of slots in each level.
+ *
+ * The last level covers a little over 5 years, which is the longest
+ * block ipwall supports ("forever"). Anything further goes in an
+ * overflow list which is checked once per day.
+ */
+constexpr std::int64_t const    g_slots[] = { 60, 60, 24, 2048 };
+
+
+/** \brief Maximum number of ticks processed one by one.
+ *
+ * If the wheel is late by more than this number of ticks (i.e. the
+ * computer was suspended), all the entries get re-placed at once
+ * instead of processing each tick.
+ */
+constexpr std::int64_t const    g_max_catch_up = 24 * 60 * 60;
+
+
+constexpr std::int64_t span(int level)
+{
+    return g_width[level] * g_slots[level];
+}
+
+
+
+} // no name namespace
+
+
+
+/** \class timing_wheel
+ * \brief Hierarchical timing wheel used to time out the blocks.
+ *
+ * The wheel has four levels of slots. The first level has one slot per
+ * tick for the next 60 ticks, the second one slot per 60 ticks for the
+ * next hour, the third one slot per hour for the next day, and the
+ * last one slot per day. With the default precision of one second,
+ * the levels represent seconds, minutes, hours, and days.
+ *
+ * Inserting and removing an entry is O(1). When the wheel moves to the
+ * next tick, the entries of the current first level slot are due. Once
+ * in a while, the entries of a higher level slot get moved (cascaded)
+ * to the lower levels.
+ *
+ * An entry is due on the first tick after its limit, so entries are
+ * never timed out early, and all the entries due within the same tick
+ * are returned together.
+ */
+
+
+/** \brief Initialize the wheel.
+ *
+ * \param[in] precision  The duration of one tick.
+ * \param[in] now  The current time.
+ */
+timing_wheel::timing_wheel(snapdev::timespec_ex const & precision, snapdev::timespec_ex const & now)
+    : f_precision(std::max(
+                  static_cast<std::int64_t>(1'000'000)
+                , static_cast<std::int64_t>(precision.tv_sec) * 1'000'000'000 + precision.tv_nsec))
+{
+    for(int level(0); level < LEVEL_COUNT; ++level)
+    {
+        f_levels[level].resize(g_slots[level]);
+    }
+    f_current = to_tick(now);
+}
+
+
+std::size_t timing_wheel::size() const
+{
+    return f_size;
+}
+
+
+bool timing_wheel::empty() const
+{
+    return f_size == 0;
+}
+
+
+/** \brief Add an entry to the wheel.
+ *
+ * \param[in] value  The value to return once the entry is due.
+ * \param[in] limit  The time after which the entry is due.
+ *
+ * \return A handle used to remove the entry from the wheel.
+ */
+timing_wheel::handle_t timing_wheel::insert(value_t value, snapdev::timespec_ex const & limit)
+{
+    std::int64_t const t(to_tick(limit) + 1);
+    int level(0);
+    slot_t & slot(find_slot(t, level));
+    slot.push_back(node_t{ value, t, level, &slot });
+    if(level != LEVEL_EXPIRED)
+    {
+        ++f_counts[level];
+    }
+    ++f_size;
+
+    handle_t result;
+    result.f_node = std::prev(slot.end());
+    result.f_valid = true;
+    return result;
+}
+
+
+/** \brief Remove an entry from the wheel.
+ *
+ * The handle becomes invalid. Calling this function with an invalid
+ * handle does nothing.
+ *
+ * \param[in,out] handle  The handle returned by insert().
+ */
+void timing_wheel::erase(handle_t & handle)
+{
+    if(!handle.f_valid)
+    {
+        return;
+    }
+
+    if(handle.f_node->f_level != LEVEL_EXPIRED)
+    {
+        --f_counts[handle.f_node->f_level];
+    }
+    handle.f_node->f_slot->erase(handle.f_node);
+    --f_size;
+    handle.f_valid = false;
+}
+
+
+/** \brief Move the wheel to \p now.
+ *
+ * This function processes all the ticks up to \p now and saves the
+ * values of the entries which are due in \p due. These entries are
+ * removed from the wheel so their handles become invalid.
+ *
+ * \param[in] now  The current time.
+ * \param[out] due  The values of the entries which are due.
+ */
+void timing_wheel::advance(snapdev::timespec_ex const & now, value_vector_t & due)
+{
+    collect(f_expired, due);
+
+    std::int64_t const target(to_tick(now));
+    if(target - f_current > g_max_catch_up)
+    {
+        // we are very late, re-place all the entries at once
+        //
+        slot_t all;
+        for(auto & level : f_levels)
+        {
+            for(auto & slot : level)
+            {
+                all.splice(all.end(), slot);
+            }
+        }
+        all.splice(all.end(), f_overflow);
+
+        f_current = target;
+        cascade(all);
+        collect(f_expired, due);
+        return;
+    }
+
+    while(f_current < target)
+    {
+        tick(due);
+    }
+}
+
+
+/** \brief Get the time of the next tick which needs processing.
+ *
+ * This is the time of the next tick with due entries or the next tick
+ * when a higher level slot with entries gets cascaded. If the wheel is
+ * empty, the function returns zero.
+ *
+ * \return The time when advance() should be called next.
+ */
+snapdev::timespec_ex timing_wheel::next_tick() const
+{
+    if(!f_expired.empty())
+    {
+        return to_time(f_current);
+    }
+
+    std::int64_t result(-1);
+    for(int level(0); level < LEVEL_COUNT; ++level)
+    {
+        if(f_counts[level] == 0)
+        {
+            continue;
+        }
+        std::int64_t const first(f_current / g_width[level] + 1);
+        for(std::int64_t idx(0); idx < g_slots[level]; ++idx)
+        {
+            std::int64_t const t((first + idx) * g_width[level]);
+            if(result != -1 && t >= result)
+            {
+                break;
+            }
+            if(!f_levels[level][(first + idx) % g_slots[level]].empty())
+            {
+                result = t;
+                break;
+            }
+        }
+    }
+    if(f_counts[LEVEL_OVERFLOW] != 0)
+    {
+        std::int64_t const t((f_current / g_width[LEVEL_COUNT - 1] + 1) * g_width[LEVEL_COUNT - 1]);
+        if(result == -1 || t < result)
+        {
+            result = t;
+        }
+    }
+
+    if(result == -1)
+    {
+        return snapdev::timespec_ex();
+    }
+    return to_time(result);
+}
+
+
+std::int64_t timing_wheel::to_tick(snapdev::timespec_ex const & t) const
+{
+    return (static_cast<std::int64_t>(t.tv_sec) * 1'000'000'000 + t.tv_nsec) / f_precision;
+}
+
+
+snapdev::timespec_ex timing_wheel::to_time(std::int64_t tick) const
+{
+    std::int64_t const ns(tick * f_precision);
+    return snapdev::timespec_ex(ns / 1'000'000'000, ns % 1'000'000'000);
+}
+
+
+timing_wheel::slot_t & timing_wheel::find_slot(std::int64_t tick, int & level)
+{
+    std::int64_t const delta(tick - f_current);
+    if(delta <= 0)
+    {
+        level = LEVEL_EXPIRED;
+        return f_expired;
+    }
+    for(level = 0; level < LEVEL_COUNT; ++level)
+    {
+        if(delta < span(level))
+        {
+            return f_levels[level][(tick / g_width[level]) % g_slots[level]];
+        }
+    }
+    level = LEVEL_OVERFLOW;
+    return f_overflow;
+}
+
+
+void timing_wheel::place(slot_t & from, slot_t::iterator node)
+{
+    int level(0);
+    slot_t & to(find_slot(node->f_tick, level));
+    node->f_level = level;
+    node->f_slot = &to;
+    if(level != LEVEL_EXPIRED)
+    {
+        ++f_counts[level];
+    }
+    to.splice(to.end(), from, node);
+}
+
+
+void timing_wheel::cascade(slot_t & slot)
+{
+    // the iterators remain valid when moved to another list
+    //
+    slot_t moving;
+    moving.splice(moving.end(), slot);
+    while(!moving.empty())
+    {
+        if(moving.front().f_level != LEVEL_EXPIRED)
+        {
+            --f_counts[moving.front().f_level];
+        }
+        place(moving, moving.begin());
+    }
+}
+
+
+void timing_wheel::tick(value_vector_t & due)
+{
+    ++f_current;
+
+    // cascade the higher levels first since they may move entries to
+    // the lower level slots which get cascaded on the same tick
+    //
+    if(f_current % g_width[LEVEL_COUNT - 1] == 0)
+    {
+        cascade(f_overflow);
+    }
+    for(int level(LEVEL_COUNT - 1); level > 0; --level)
+    {
+        if(f_current % g_width[level] == 0)
+        {
+            cascade(f_levels[level][(f_current / g_width[level]) % g_slots[level]]);
+        }
+    }
+
+    collect(f_levels[0][f_current % g_slots[0]], due);
+    collect(f_expired, due);
+}
+
+
+void timing_wheel::collect(slot_t & slot, value_vector_t & due)
+{
+    for(auto const & node : slot)
+    {
+        due.push_back(node.f_value);
+        if(node.f_level != LEVEL_EXPIRED)
+        {
+            --f_counts[node.f_level];
+        }
+    }
+    f_size -= slot.size();
+    slot.clear();
+}
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et
@@ -0,0 +1,113 @@
+// Copyright (c) 2014-2025  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/iplock
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+
+// snapdev
+//
+#include    <snapdev/timespec_ex.h>
+
+
+// C++
+//
+#include    <array>
+#include    <list>
+#include    <vector>
+
+
+
+namespace ipwall
+{
+
+
+
+struct block_key;
+
+
+
+class timing_wheel
+{
+public:
+    typedef block_key const *           value_t;
+    typedef std::vector<value_t>        value_vector_t;
+
+private:
+    struct node_t;
+    typedef std::list<node_t>           slot_t;
+
+    struct node_t
+    {
+        value_t                         f_value = nullptr;
+        std::int64_t                    f_tick = 0;
+        int                             f_level = 0;
+        slot_t *                        f_slot = nullptr;
+    };
+
+public:
+    class handle_t
+    {
+    public:
+        bool                            is_valid() const { return f_valid; }
+
+    private:
+        friend class timing_wheel;
+
+        slot_t::iterator                f_node = slot_t::iterator();
+        bool                            f_valid = false;
+    };
+
+                        timing_wheel(snapdev::timespec_ex const & precision, snapdev::timespec_ex const & now);
+
+    std::size_t         size() const;
+    bool                empty() const;
+
+    handle_t            insert(value_t value, snapdev::timespec_ex const & limit);
+    void                erase(handle_t & handle);
+    void                advance(snapdev::timespec_ex const & now, value_vector_t & due);
+    snapdev::timespec_ex
+                        next_tick() const;
+
+private:
+    static constexpr int const  LEVEL_COUNT = 4;
+    static constexpr int const  LEVEL_EXPIRED = -1;
+    static constexpr int const  LEVEL_OVERFLOW = LEVEL_COUNT;
+
+    std::int64_t        to_tick(snapdev::timespec_ex const & t) const;
+    snapdev::timespec_ex
+                        to_time(std::int64_t tick) const;
+    slot_t &            find_slot(std::int64_t tick, int & level);
+    void                place(slot_t & from, slot_t::iterator node);
+    void                cascade(slot_t & slot);
+    void                tick(value_vector_t & due);
+    void                collect(slot_t & slot, value_vector_t & due);
+
+    std::int64_t        f_precision = 1'000'000'000;    // in nanoseconds
+    std::int64_t        f_current = 0;                  // last processed tick
+    std::size_t         f_size = 0;
+    std::array<std::size_t, LEVEL_COUNT + 1>
+                        f_counts = {};
+    std::array<std::vector<slot_t>, LEVEL_COUNT>
+                        f_levels = {};
+    slot_t              f_expired = slot_t();
+    slot_t              f_overflow = slot_t();
+};
+
+
+
+} // namespace ipwall
+// vim: ts=4 sw=4 et